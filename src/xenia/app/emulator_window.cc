@@ -120,16 +120,21 @@ bool EmulatorWindow::Initialize() {
         GpuClearCaches();
       } break;
       case 0x76: {  // VK_F7
-        // Save to file
+        // Save to file, with shift only the changes since the full save
         // TODO: Choose path based on user input, or from options
-        // TODO: Spawn a new thread to do this.
-        emulator()->SaveToFile("test.sav");
+        if (e->is_shift_pressed()) {
+          emulator()->SaveToFile("test_incremental.sav", true);
+        } else {
+          emulator()->SaveToFile("test.sav");
+        }
       } break;
       case 0x77: {  // VK_F8
         // Restore from file
         // TODO: Choose path from user
         // TODO: Spawn a new thread to do this.
-        emulator()->RestoreFromFile("test.sav");
+        emulator()->RestoreFromFile(e->is_shift_pressed()
+                                        ? "test_incremental.sav"
+                                        : "test.sav");
       } break;
       case 0x7A: {  // VK_F11
         ToggleFullscreen();
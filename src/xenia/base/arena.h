@@ -31,6 +31,9 @@ class Arena {
   }
   void Rewind(size_t size);
 
+  // Total size of the allocations since the last reset.
+  size_t CalculateSize();
+
   void* CloneContents();
   template <typename T>
   void CloneContents(std::vector<T>* buffer) {
@@ -51,7 +54,6 @@ class Arena {
     size_t offset;
   };
 
-  size_t CalculateSize();
   void CloneContents(void* buffer, size_t buffer_length);
 
   size_t chunk_size_;
@@ -9,8 +9,10 @@
 
 #include "xenia/base/mapped_memory.h"
 
+#include <fcntl.h>
 #include <sys/mman.h>
-#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <memory>
 
 #include "xenia/base/string.h"
@@ -20,32 +22,46 @@ namespace xe {
 class PosixMappedMemory : public MappedMemory {
  public:
   PosixMappedMemory(const std::filesystem::path& path, Mode mode)
-      : MappedMemory(path, mode), file_handle(nullptr) {}
+      : MappedMemory(path, mode), file_descriptor(-1) {}
 
-  ~PosixMappedMemory() override {
+  ~PosixMappedMemory() override { Close(0); }
+
+  // Only uses system calls, so this can be done in a forked process.
+  void Close(uint64_t truncate_size) override {
     if (data_) {
       munmap(data_, size_);
+      data_ = nullptr;
+    }
+    if (file_descriptor >= 0) {
+      if (truncate_size) {
+        ftruncate(file_descriptor, off_t(truncate_size));
+      }
+      close(file_descriptor);
+      file_descriptor = -1;
     }
-    if (file_handle) {
-      fclose(file_handle);
+  }
+
+  void Flush() override {
+    if (data_) {
+      msync(data_, size_, MS_SYNC);
     }
   }
 
-  FILE* file_handle;
+  int file_descriptor;
 };
 
 std::unique_ptr<MappedMemory> MappedMemory::Open(
     const std::filesystem::path& path, Mode mode, size_t offset,
     size_t length) {
-  const char* mode_str;
+  int open_flags;
   int prot;
   switch (mode) {
     case Mode::kRead:
-      mode_str = "rb";
+      open_flags = O_RDONLY;
       prot = PROT_READ;
       break;
     case Mode::kReadWrite:
-      mode_str = "r+b";
+      open_flags = O_RDWR;
       prot = PROT_READ | PROT_WRITE;
       break;
   }
@@ -53,25 +69,38 @@ std::unique_ptr<MappedMemory> MappedMemory::Open(
   auto mm =
       std::unique_ptr<PosixMappedMemory>(new PosixMappedMemory(path, mode));
 
-  mm->file_handle = fopen(path.c_str(), mode_str);
-  if (!mm->file_handle) {
+  mm->file_descriptor = open(path.c_str(), open_flags);
+  if (mm->file_descriptor < 0) {
     return nullptr;
   }
 
-  size_t map_length;
-  map_length = length;
+  struct stat file_stat;
+  if (fstat(mm->file_descriptor, &file_stat)) {
+    return nullptr;
+  }
+  size_t file_length = size_t(file_stat.st_size);
+  size_t map_length = length;
   if (!length) {
-    fseeko(mm->file_handle, 0, SEEK_END);
-    map_length = ftello(mm->file_handle);
-    fseeko(mm->file_handle, 0, SEEK_SET);
+    if (file_length <= offset) {
+      return nullptr;
+    }
+    map_length = file_length - offset;
+  } else if (file_length < offset + map_length) {
+    // Pages past the end of the file can't be accessed (SIGBUS), so extend it
+    // to cover the whole view like CreateFileMapping does on Windows.
+    if (mode != Mode::kReadWrite ||
+        ftruncate(mm->file_descriptor, off_t(offset + map_length))) {
+      return nullptr;
+    }
   }
-  mm->size_ = map_length;
 
-  mm->data_ =
-      mmap(0, map_length, prot, MAP_SHARED, fileno(mm->file_handle), offset);
-  if (!mm->data_) {
+  void* data = mmap(nullptr, map_length, prot, MAP_SHARED, mm->file_descriptor,
+                    off_t(offset));
+  if (data == MAP_FAILED) {
     return nullptr;
   }
+  mm->data_ = data;
+  mm->size_ = map_length;
 
   return std::move(mm);
 }
@@ -147,10 +147,17 @@ void CloseFileMappingHandle(FileMappingHandle handle,
 #endif
 }
 
+// The guest memory is saved from a forked process (Memory::SaveRaw), which
+// only gets a consistent snapshot of it if the views are copied on fork rather
+// than shared with the emulator process.
+constexpr int kFileViewMapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+static_assert(!(kFileViewMapFlags & MAP_SHARED),
+              "Forked state saving requires private guest memory views");
+
 void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
                   PageAccess access, size_t file_offset) {
   uint32_t prot = ToPosixProtectFlags(access);
-  return mmap64(base_address, length, prot, MAP_PRIVATE | MAP_ANONYMOUS, handle,
+  return mmap64(base_address, length, prot, kFileViewMapFlags, handle,
                 file_offset);
 }
 
@@ -10,8 +10,12 @@
 #ifndef XENIA_BASE_MUTEX_H_
 #define XENIA_BASE_MUTEX_H_
 
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 
+#include "xenia/base/clock.h"
+
 namespace xe {
 
 // The global critical region mutex singleton.
@@ -81,6 +85,68 @@ class global_critical_region {
   }
 };
 
+// A lock for data split out of the global critical region into independently
+// locked shards, counting the acquisitions that had to wait for another thread
+// and the time it's held, for displaying in the profiler. Mutex may be
+// std::mutex or std::recursive_mutex - for the latter, only the outermost
+// acquisition is counted.
+//
+// Where the global critical region is needed too, it must be acquired first.
+template <typename Mutex>
+class profiled_mutex {
+ public:
+  void lock() {
+    if (!mutex_.try_lock()) {
+      contended_count_.fetch_add(1, std::memory_order_relaxed);
+      mutex_.lock();
+    }
+    OnAcquired();
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    OnAcquired();
+    return true;
+  }
+
+  void unlock() {
+    if (!--lock_depth_) {
+      hold_ticks_.fetch_add(Clock::QueryHostTickCount() - lock_tick_,
+                            std::memory_order_relaxed);
+    }
+    mutex_.unlock();
+  }
+
+  uint64_t acquired_count() const {
+    return acquired_count_.load(std::memory_order_relaxed);
+  }
+  uint64_t contended_count() const {
+    return contended_count_.load(std::memory_order_relaxed);
+  }
+  // Total time the lock has been held, in host ticks.
+  uint64_t hold_ticks() const {
+    return hold_ticks_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void OnAcquired() {
+    if (!lock_depth_++) {
+      acquired_count_.fetch_add(1, std::memory_order_relaxed);
+      lock_tick_ = Clock::QueryHostTickCount();
+    }
+  }
+
+  Mutex mutex_;
+  // Only accessed by the owner.
+  uint32_t lock_depth_ = 0;
+  uint64_t lock_tick_ = 0;
+  std::atomic<uint64_t> acquired_count_{0};
+  std::atomic<uint64_t> contended_count_{0};
+  std::atomic<uint64_t> hold_ticks_{0};
+};
+
 }  // namespace xe
 
 #endif  // XENIA_BASE_MUTEX_H_
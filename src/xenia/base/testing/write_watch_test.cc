@@ -0,0 +1,238 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/write_watch.h"
+
+#include <atomic>
+#include <chrono>
+
+#include "third_party/catch/include/catch.hpp"
+#include "third_party/fmt/include/fmt/format.h"
+
+#include "xenia/base/clock.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+
+#if XE_PLATFORM_LINUX
+#include <signal.h>
+#include <sys/mman.h>
+#endif  // XE_PLATFORM_LINUX
+
+namespace xe {
+namespace base {
+namespace test {
+
+#if XE_PLATFORM_LINUX
+
+struct WriteWatchTestContext {
+  std::atomic<uint32_t> write_count{0};
+  std::atomic<uint32_t> flush_count{0};
+};
+
+static void WriteWatchTestWriteCallback(void* context, void* host_address) {
+  ++static_cast<WriteWatchTestContext*>(context)->write_count;
+}
+
+static bool WriteWatchTestFlushCallback(void* context) {
+  ++static_cast<WriteWatchTestContext*>(context)->flush_count;
+  return true;
+}
+
+static uint8_t* AllocTestPages(size_t page_count) {
+  void* pages =
+      mmap(nullptr, page_count * xe::memory::page_size(),
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  REQUIRE(pages != MAP_FAILED);
+  return static_cast<uint8_t*>(pages);
+}
+
+TEST_CASE("write_watch_first_write", "Write Watch") {
+  WriteWatchTestContext context;
+  auto write_watch = xe::memory::WriteWatch::Create(
+      WriteWatchTestWriteCallback, WriteWatchTestFlushCallback, &context);
+  if (!write_watch) {
+    WARN("Write watch not supported by the host");
+    return;
+  }
+  const size_t page_size = xe::memory::page_size();
+  const size_t page_count = 16;
+  uint8_t* pages = AllocTestPages(page_count);
+  // Populate some of the pages before protecting.
+  pages[0] = 1;
+  pages[5 * page_size] = 1;
+
+  REQUIRE(write_watch->Protect(pages, page_count * page_size));
+  // Reads are not caught.
+  REQUIRE(pages[0] == 1);
+  REQUIRE(context.write_count == 0);
+  // The callback is invoked before the writer is resumed.
+  pages[0] = 2;
+  REQUIRE(context.write_count == 1);
+  // Only for the first write.
+  pages[1] = 2;
+  pages[5 * page_size] = 2;
+  pages[5 * page_size + 1] = 2;
+  // Including pages not populated yet.
+  pages[15 * page_size] = 2;
+  REQUIRE(context.write_count == 3);
+  REQUIRE(pages[5 * page_size] == 2);
+
+  // Unprotected pages are not caught.
+  REQUIRE(write_watch->Unprotect(pages, page_count * page_size));
+  pages[7 * page_size] = 2;
+  REQUIRE(context.write_count == 3);
+
+  // Can be protected again.
+  REQUIRE(write_watch->Protect(pages, page_count * page_size));
+  pages[0] = 3;
+  REQUIRE(context.write_count == 4);
+
+  write_watch.reset();
+  munmap(pages, page_count * page_size);
+}
+
+// Guest memory is mapped with MapFileView, test the same kind of views rather
+// than assuming how they're mapped.
+static uint8_t* MapTestView(xe::memory::FileMappingHandle mapping,
+                            size_t length) {
+  void* view = xe::memory::MapFileView(
+      mapping, nullptr, length, xe::memory::PageAccess::kReadWrite, 0);
+  REQUIRE(view != nullptr);
+  REQUIRE(view != MAP_FAILED);
+  return static_cast<uint8_t*>(view);
+}
+
+TEST_CASE("write_watch_file_view", "Write Watch") {
+  WriteWatchTestContext context;
+  auto write_watch = xe::memory::WriteWatch::Create(
+      WriteWatchTestWriteCallback, WriteWatchTestFlushCallback, &context);
+  if (!write_watch) {
+    WARN("Write watch not supported by the host");
+    return;
+  }
+  const size_t page_size = xe::memory::page_size();
+  const size_t length = 16 * page_size;
+  auto path = fmt::format("xenia_test_{}", Clock::QueryHostTickCount());
+  auto mapping = xe::memory::CreateFileMappingHandle(
+      path, length, xe::memory::PageAccess::kReadWrite, true);
+  REQUIRE(mapping != xe::memory::kFileMappingHandleInvalid);
+  uint8_t* view = MapTestView(mapping, length);
+  uint8_t* other_view = MapTestView(mapping, length);
+  view[0] = 1;
+
+  REQUIRE(write_watch->Protect(view, length));
+  REQUIRE(view[0] == 1);
+  REQUIRE(context.write_count == 0);
+  view[0] = 2;
+  REQUIRE(context.write_count == 1);
+  view[1] = 2;
+  // Including pages of the view not populated yet.
+  view[9 * page_size] = 2;
+  REQUIRE(context.write_count == 2);
+  // The protection is per view, like with page protection.
+  other_view[3 * page_size] = 3;
+  REQUIRE(context.write_count == 2);
+  view[3 * page_size] = 4;
+  REQUIRE(context.write_count == 3);
+  REQUIRE(view[3 * page_size] == 4);
+
+  REQUIRE(write_watch->Unprotect(view, length));
+  view[5 * page_size] = 5;
+  REQUIRE(context.write_count == 3);
+
+  write_watch.reset();
+  xe::memory::UnmapFileView(mapping, other_view, length);
+  xe::memory::UnmapFileView(mapping, view, length);
+  xe::memory::CloseFileMappingHandle(mapping, path);
+}
+
+static uint8_t* signal_test_pages_;
+static size_t signal_test_length_;
+
+static void WriteWatchTestSignalHandler(int signal, siginfo_t* info,
+                                        void* context) {
+  auto address = static_cast<uint8_t*>(info->si_addr);
+  size_t page_size = xe::memory::page_size();
+  if (address < signal_test_pages_ ||
+      address >= signal_test_pages_ + signal_test_length_) {
+    abort();
+  }
+  mprotect(reinterpret_cast<void*>(size_t(address) & ~(page_size - 1)),
+           page_size, PROT_READ | PROT_WRITE);
+}
+
+// Compares the cost of catching the first write to each page with page
+// protection and access violations and with the write watch. Run explicitly
+// with the [benchmark] tag.
+TEST_CASE("write_watch_benchmark", "[.][benchmark]") {
+  const size_t page_size = xe::memory::page_size();
+  const size_t page_count = 1000;
+  const uint32_t iteration_count = 32;
+  uint8_t* pages = AllocTestPages(page_count);
+  for (size_t i = 0; i < page_count; ++i) {
+    pages[i * page_size] = 0;
+  }
+
+  // Access violations.
+  signal_test_pages_ = pages;
+  signal_test_length_ = page_count * page_size;
+  struct sigaction signal_action = {}, old_signal_action;
+  signal_action.sa_sigaction = WriteWatchTestSignalHandler;
+  signal_action.sa_flags = SA_SIGINFO;
+  sigemptyset(&signal_action.sa_mask);
+  REQUIRE(sigaction(SIGSEGV, &signal_action, &old_signal_action) == 0);
+  std::chrono::nanoseconds protect_time(0);
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    mprotect(pages, page_count * page_size, PROT_READ);
+    for (size_t j = 0; j < page_count; ++j) {
+      pages[j * page_size] = uint8_t(i);
+    }
+    protect_time += std::chrono::steady_clock::now() - start;
+  }
+  sigaction(SIGSEGV, &old_signal_action, nullptr);
+  fmt::print("Access violations: {} us per 1000 pages\n",
+             std::chrono::duration_cast<std::chrono::microseconds>(
+                 protect_time / iteration_count)
+                     .count() *
+                 1000 / page_count);
+
+  // Write watch.
+  WriteWatchTestContext context;
+  auto write_watch = xe::memory::WriteWatch::Create(
+      WriteWatchTestWriteCallback, WriteWatchTestFlushCallback, &context);
+  if (write_watch) {
+    std::chrono::nanoseconds write_watch_time(0);
+    for (uint32_t i = 0; i < iteration_count; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      write_watch->Protect(pages, page_count * page_size);
+      for (size_t j = 0; j < page_count; ++j) {
+        pages[j * page_size] = uint8_t(i);
+      }
+      write_watch_time += std::chrono::steady_clock::now() - start;
+    }
+    REQUIRE(context.write_count == page_count * iteration_count);
+    fmt::print("Write watch: {} us per 1000 pages\n",
+               std::chrono::duration_cast<std::chrono::microseconds>(
+                   write_watch_time / iteration_count)
+                       .count() *
+                   1000 / page_count);
+    write_watch.reset();
+  } else {
+    WARN("Write watch not supported by the host");
+  }
+
+  munmap(pages, page_count * page_size);
+}
+
+#endif  // XE_PLATFORM_LINUX
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_WRITE_WATCH_H_
+#define XENIA_BASE_WRITE_WATCH_H_
+
+#include <cstddef>
+#include <memory>
+
+namespace xe {
+namespace memory {
+
+// Write protection handled without raising signals in the writing thread -
+// the kernel suspends the thread and reports the write to a dedicated watch
+// thread, which invokes the callbacks and makes the page writable again.
+// This is separate from the page protection set with Protect.
+//
+// Currently implemented with userfaultfd write protection on Linux.
+class WriteWatch {
+ public:
+  // Called on the watch thread for the first write to a protected page, before
+  // the writing thread is resumed, so must not wait for anything the writer may
+  // be holding (such as the global critical region).
+  typedef void (*WriteCallback)(void* context, void* host_address);
+  // Called on the watch thread after resuming the writing threads. Returns
+  // false if it needs to be called again later, for instance, if a lock it
+  // needs couldn't be acquired.
+  typedef bool (*FlushCallback)(void* context);
+
+  // Returns nullptr if not supported by the host.
+  static std::unique_ptr<WriteWatch> Create(WriteCallback write_callback,
+                                            FlushCallback flush_callback,
+                                            void* callback_context);
+
+  virtual ~WriteWatch() = default;
+
+  // Protects the pages from writing until written to or unprotected. The range
+  // must be page-aligned and mapped.
+  virtual bool Protect(void* base_address, size_t length) = 0;
+  virtual bool Unprotect(void* base_address, size_t length) = 0;
+};
+
+}  // namespace memory
+}  // namespace xe
+
+#endif  // XENIA_BASE_WRITE_WATCH_H_
@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/write_watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <thread>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+
+// Newer than the headers commonly available.
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_HUGETLBFS_SHMEM
+#define UFFD_FEATURE_WP_HUGETLBFS_SHMEM (1 << 12)
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+
+namespace xe {
+namespace memory {
+
+#if defined(UFFDIO_WRITEPROTECT) && defined(__NR_userfaultfd)
+
+class UserfaultfdWriteWatch : public WriteWatch {
+ public:
+  UserfaultfdWriteWatch(int uffd, int shutdown_fd,
+                        WriteCallback write_callback,
+                        FlushCallback flush_callback, void* callback_context)
+      : uffd_(uffd),
+        shutdown_fd_(shutdown_fd),
+        page_size_(xe::memory::page_size()),
+        write_callback_(write_callback),
+        flush_callback_(flush_callback),
+        callback_context_(callback_context) {
+    thread_ = std::thread(&UserfaultfdWriteWatch::ThreadMain, this);
+  }
+
+  ~UserfaultfdWriteWatch() override {
+    uint64_t value = 1;
+    write(shutdown_fd_, &value, sizeof(value));
+    thread_.join();
+    // Closing the userfaultfd removes the write protection and wakes any
+    // waiting threads.
+    close(uffd_);
+    close(shutdown_fd_);
+  }
+
+  bool Protect(void* base_address, size_t length) override {
+    // Registration is lost when the pages are remapped (such as when they're
+    // committed), so always register. Registering again is cheap.
+    uffdio_register register_args = {};
+    register_args.range.start = uint64_t(base_address);
+    register_args.range.len = length;
+    register_args.mode = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl(uffd_, UFFDIO_REGISTER, &register_args) < 0) {
+      XELOGE("Failed to register {} bytes at {} for write watching: {}",
+             length, base_address, errno);
+      return false;
+    }
+    return WriteProtect(uint64_t(base_address), length, true);
+  }
+
+  bool Unprotect(void* base_address, size_t length) override {
+    return WriteProtect(uint64_t(base_address), length, false);
+  }
+
+ private:
+  bool WriteProtect(uint64_t base_address, uint64_t length, bool protect) {
+    uffdio_writeprotect writeprotect_args = {};
+    writeprotect_args.range.start = base_address;
+    writeprotect_args.range.len = length;
+    // Removing the protection also wakes the threads waiting for the pages.
+    writeprotect_args.mode = protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+    return ioctl(uffd_, UFFDIO_WRITEPROTECT, &writeprotect_args) == 0;
+  }
+
+  void ThreadMain() {
+    uffd_msg messages[16];
+    int timeout = -1;
+    while (true) {
+      pollfd poll_fds[2] = {{uffd_, POLLIN, 0}, {shutdown_fd_, POLLIN, 0}};
+      int poll_result = poll(poll_fds, 2, timeout);
+      if (poll_result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        assert_always();
+        break;
+      }
+      if (poll_fds[1].revents) {
+        break;
+      }
+      if (poll_fds[0].revents & POLLIN) {
+        ssize_t read_size = read(uffd_, messages, sizeof(messages));
+        for (ssize_t i = 0; i < read_size / ssize_t(sizeof(uffd_msg)); ++i) {
+          const uffd_msg& message = messages[i];
+          if (message.event != UFFD_EVENT_PAGEFAULT ||
+              !(message.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP)) {
+            continue;
+          }
+          uint64_t page_address =
+              message.arg.pagefault.address & ~uint64_t(page_size_ - 1);
+          write_callback_(callback_context_,
+                          reinterpret_cast<void*>(page_address));
+          WriteProtect(page_address, page_size_, false);
+        }
+      }
+      // Retry soon if the writes couldn't be processed yet.
+      timeout = flush_callback_(callback_context_) ? -1 : 1;
+    }
+  }
+
+  int uffd_;
+  int shutdown_fd_;
+  size_t page_size_;
+  WriteCallback write_callback_;
+  FlushCallback flush_callback_;
+  void* callback_context_;
+  std::thread thread_;
+};
+
+std::unique_ptr<WriteWatch> WriteWatch::Create(WriteCallback write_callback,
+                                               FlushCallback flush_callback,
+                                               void* callback_context) {
+  // Faults in the kernel (like in read into a watched buffer) are handled too
+  // if allowed, otherwise such syscalls fail, like with page protection.
+  int uffd = int(syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+  if (uffd < 0 && errno == EPERM) {
+    uffd = int(syscall(__NR_userfaultfd,
+                       O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+  }
+  if (uffd < 0) {
+    XELOGI("userfaultfd is not available: {}", errno);
+    return nullptr;
+  }
+  // Pages not populated yet must be protected too, so the first write to them
+  // is caught (Linux 6.4).
+  uffdio_api api_args = {};
+  api_args.api = UFFD_API;
+  api_args.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP |
+                      UFFD_FEATURE_WP_HUGETLBFS_SHMEM |
+                      UFFD_FEATURE_WP_UNPOPULATED;
+  if (ioctl(uffd, UFFDIO_API, &api_args) < 0) {
+    XELOGI("userfaultfd write protection is not supported: {}", errno);
+    close(uffd);
+    return nullptr;
+  }
+  int shutdown_fd = eventfd(0, EFD_CLOEXEC);
+  if (shutdown_fd < 0) {
+    close(uffd);
+    return nullptr;
+  }
+  return std::make_unique<UserfaultfdWriteWatch>(
+      uffd, shutdown_fd, write_callback, flush_callback, callback_context);
+}
+
+#else
+
+std::unique_ptr<WriteWatch> WriteWatch::Create(WriteCallback write_callback,
+                                               FlushCallback flush_callback,
+                                               void* callback_context) {
+  return nullptr;
+}
+
+#endif  // UFFDIO_WRITEPROTECT && __NR_userfaultfd
+
+}  // namespace memory
+}  // namespace xe
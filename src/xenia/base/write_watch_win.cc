@@ -0,0 +1,23 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/write_watch.h"
+
+namespace xe {
+namespace memory {
+
+// Windows only provides GetWriteWatch, which needs polling.
+std::unique_ptr<WriteWatch> WriteWatch::Create(WriteCallback write_callback,
+                                               FlushCallback flush_callback,
+                                               void* callback_context) {
+  return nullptr;
+}
+
+}  // namespace memory
+}  // namespace xe
@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <filesystem>
 #include <memory>
 
 #include "xenia/cpu/backend/machine_info.h"
@@ -54,6 +55,18 @@ class Backend {
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
       Module* module, uint32_t address) = 0;
 
+  // Sets up persistent storage of generated code under the cache root, if
+  // supported and enabled.
+  virtual void InitializeCodeStorage(const std::filesystem::path& cache_root) {}
+  // Called once the code of a guest module is in memory (imports resolved),
+  // before any of it is executed. The hash identifies the module code.
+  virtual void OnModuleLoaded(Module* module, uint64_t module_hash) {}
+  virtual void OnModuleUnloaded(Module* module) {}
+
+  // Makes the calls to the guest function stop going directly to its current
+  // code, so they reach the code placed for it next or resolve it again.
+  virtual void InvalidateGuestCode(uint32_t guest_address) {}
+
   // Calculates the next host instruction based on the current thread state and
   // current PC. This will look for branches and other control flow
   // instructions.
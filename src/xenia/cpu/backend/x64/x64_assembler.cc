@@ -77,22 +77,27 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   // Lower HIR -> x64.
   void* machine_code = nullptr;
   size_t code_size = 0;
+  auto code = std::make_unique<GuestFunction::Code>();
   if (!emitter_->Emit(function, builder, debug_info_flags, debug_info.get(),
-                      &machine_code, &code_size, &function->source_map())) {
+                      &machine_code, &code_size, &code->source_map)) {
     return false;
   }
+  code->machine_code = reinterpret_cast<uint8_t*>(machine_code);
+  code->machine_code_length = code_size;
 
   // Stash generated machine code.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmMachineCode) {
-    DumpMachineCode(machine_code, code_size, function->source_map(),
-                    &string_buffer_);
+    DumpMachineCode(machine_code, code_size, code->source_map, &string_buffer_);
     debug_info->set_machine_code_disasm(strdup(string_buffer_.buffer()));
     string_buffer_.Reset();
   }
 
-  function->set_debug_info(std::move(debug_info));
-  static_cast<X64Function*>(function)->Setup(
-      reinterpret_cast<uint8_t*>(machine_code), code_size);
+  if (debug_info) {
+    function->set_debug_info(std::move(debug_info));
+  }
+  // The function may be running or looked up on other threads if it's being
+  // translated again.
+  function->PublishCode(std::move(code));
 
   // Install into indirection table.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
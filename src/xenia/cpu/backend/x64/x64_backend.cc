@@ -10,6 +10,7 @@
 #include "xenia/cpu/backend/x64/x64_backend.h"
 
 #include <stddef.h>
+#include <algorithm>
 
 #include "third_party/capstone/include/capstone/capstone.h"
 #include "third_party/capstone/include/capstone/x86.h"
@@ -18,11 +19,13 @@
 #include "xenia/base/logging.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_code_storage.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/breakpoint.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/stack_walker.h"
 
@@ -30,6 +33,17 @@ DEFINE_bool(
     use_haswell_instructions, true,
     "Uses the AVX2/FMA/etc instructions on Haswell processors when available.",
     "CPU");
+DEFINE_bool(use_avx512_instructions, true,
+            "Uses the AVX-512 instructions when available. Only takes effect "
+            "with use_haswell_instructions.",
+            "CPU");
+DEFINE_bool(store_jit_code, false,
+            "Store the generated code of guest modules in the cache directory "
+            "and reuse it the next time the same modules are loaded, instead "
+            "of translating the functions again.",
+            "CPU");
+DECLARE_bool(count_unlinked_calls);
+DECLARE_bool(indirect_call_cache_stats);
 
 namespace xe {
 namespace cpu {
@@ -64,6 +78,40 @@ X64Backend::X64Backend() : Backend(), code_cache_(nullptr) {
 }
 
 X64Backend::~X64Backend() {
+  code_storages_.clear();
+
+  if (code_cache_ && cvars::count_unlinked_calls) {
+    auto stats = code_cache_->QueryCallSiteStats();
+    XELOGI(
+        "Guest call sites: {} linked, {} unlinked, {} calls made through the "
+        "indirection table",
+        stats.linked_count, stats.unlinked_count, stats.unlinked_call_count);
+  }
+
+  if (code_cache_ && cvars::indirect_call_cache_stats) {
+    auto site_stats = code_cache_->QueryIndirectCallSiteStats();
+    uint64_t call_count = 0, miss_count = 0;
+    for (const auto& site : site_stats) {
+      call_count += site.call_count;
+      miss_count += site.miss_count;
+    }
+    XELOGI("Indirect guest calls: {} sites, {} calls, {} inline cache misses",
+           site_stats.size(), call_count, miss_count);
+    std::sort(site_stats.begin(), site_stats.end(),
+              [](const X64CodeCache::IndirectCallSiteStats& a,
+                 const X64CodeCache::IndirectCallSiteStats& b) {
+                return a.miss_count > b.miss_count;
+              });
+    for (size_t i = 0; i < std::min(site_stats.size(), size_t(16)); ++i) {
+      const auto& site = site_stats[i];
+      if (!site.miss_count) {
+        break;
+      }
+      XELOGI("  {:08X}: {} calls, {} misses", site.guest_address,
+             site.call_count, site.miss_count);
+    }
+  }
+
   if (capstone_handle_) {
     cs_close(&capstone_handle_);
   }
@@ -149,6 +197,68 @@ std::unique_ptr<GuestFunction> X64Backend::CreateGuestFunction(
   return std::make_unique<X64Function>(module, address);
 }
 
+void X64Backend::InitializeCodeStorage(
+    const std::filesystem::path& cache_root) {
+  if (!cvars::store_jit_code || cache_root.empty()) {
+    return;
+  }
+  code_storage_root_ = cache_root / "jit";
+}
+
+void X64Backend::OnModuleLoaded(Module* module, uint64_t module_hash) {
+  if (!is_code_storage_enabled()) {
+    return;
+  }
+  // Restored functions come without debug info, don't mix them.
+  if (cvars::disassemble_functions || cvars::trace_functions) {
+    return;
+  }
+  auto code_storage = std::make_unique<X64CodeStorage>(this, module);
+  if (!code_storage->Initialize(code_storage_root_, module_hash)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(code_storages_mutex_);
+  code_storages_[module] = std::move(code_storage);
+}
+
+void X64Backend::OnModuleUnloaded(Module* module) {
+  // Nothing may jump straight into the code of the module anymore, the calls
+  // linked to it from other modules are restored to their stubs.
+  module->ForEachFunction([this](Function* function) {
+    if (function->is_guest() &&
+        static_cast<GuestFunction*>(function)->machine_code()) {
+      code_cache_->InvalidateGuestCode(function->address());
+    }
+  });
+  std::lock_guard<std::mutex> lock(code_storages_mutex_);
+  code_storages_.erase(module);
+}
+
+void X64Backend::InvalidateGuestCode(uint32_t guest_address) {
+  code_cache_->InvalidateGuestCode(guest_address);
+}
+
+void X64Backend::StoreFunction(GuestFunction* function,
+                               const EmitFunctionInfo& func_info,
+                               const void* machine_code,
+                               const std::vector<SourceMapEntry>& source_map,
+                               const std::vector<X64Relocation>& relocations) {
+  if (!is_code_storage_enabled()) {
+    return;
+  }
+  X64CodeStorage* code_storage;
+  {
+    std::lock_guard<std::mutex> lock(code_storages_mutex_);
+    auto it = code_storages_.find(function->module());
+    if (it == code_storages_.end()) {
+      return;
+    }
+    code_storage = it->second.get();
+  }
+  code_storage->StoreFunction(function, func_info, machine_code, source_map,
+                              relocations);
+}
+
 uint64_t ReadCapstoneReg(X64Context* context, x86_reg reg) {
   switch (reg) {
     case X86_REG_RAX:
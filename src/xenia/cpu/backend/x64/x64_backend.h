@@ -10,12 +10,18 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 #define XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 
+#include <filesystem>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "xenia/base/cvar.h"
 #include "xenia/cpu/backend/backend.h"
+#include "xenia/cpu/function.h"
 
 DECLARE_bool(use_haswell_instructions);
+DECLARE_bool(use_avx512_instructions);
 
 namespace xe {
 class Exception;
@@ -26,6 +32,9 @@ namespace backend {
 namespace x64 {
 
 class X64CodeCache;
+class X64CodeStorage;
+struct EmitFunctionInfo;
+struct X64Relocation;
 
 #define XENIA_HAS_X64_BACKEND 1
 
@@ -61,6 +70,21 @@ class X64Backend : public Backend {
   std::unique_ptr<GuestFunction> CreateGuestFunction(Module* module,
                                                      uint32_t address) override;
 
+  void InitializeCodeStorage(const std::filesystem::path& cache_root) override;
+  void OnModuleLoaded(Module* module, uint64_t module_hash) override;
+  void OnModuleUnloaded(Module* module) override;
+
+  void InvalidateGuestCode(uint32_t guest_address) override;
+
+  // Whether generated code is written to the persistent code storage. Must not
+  // change once any code has been generated.
+  bool is_code_storage_enabled() const { return !code_storage_root_.empty(); }
+  // Writes the function to the code storage of its module, if there's one.
+  void StoreFunction(GuestFunction* function, const EmitFunctionInfo& func_info,
+                     const void* machine_code,
+                     const std::vector<SourceMapEntry>& source_map,
+                     const std::vector<X64Relocation>& relocations);
+
   uint64_t CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
                                         uint64_t current_pc) override;
 
@@ -77,6 +101,11 @@ class X64Backend : public Backend {
   std::unique_ptr<X64CodeCache> code_cache_;
   uintptr_t emitter_data_ = 0;
 
+  std::filesystem::path code_storage_root_;
+  std::mutex code_storages_mutex_;
+  std::unordered_map<const Module*, std::unique_ptr<X64CodeStorage>>
+      code_storages_;
+
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
@@ -174,9 +174,14 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
                                   void*& code_write_address_out) {
   // Hold a lock while we bump the pointers up. This is important as the
   // unwind table requires entries AND code to be sorted in order.
+  // Only the reservation and the small unwind data are handled under the
+  // lock - the code itself is copied afterwards, so functions compiled on
+  // multiple threads are placed in parallel. Nothing can call the code before
+  // the indirection table entry is written at the end.
   size_t low_mark;
   size_t high_mark;
   uint8_t* code_execute_address;
+  uint8_t* code_write_address;
   UnwindReservation unwind_reservation;
   {
     auto global_lock = global_critical_region_.Acquire();
@@ -188,8 +193,7 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
     code_execute_address =
         generated_code_execute_base_ + generated_code_offset_;
     code_execute_address_out = code_execute_address;
-    uint8_t* code_write_address =
-        generated_code_write_base_ + generated_code_offset_;
+    code_write_address = generated_code_write_base_ + generated_code_offset_;
     code_write_address_out = code_write_address;
     generated_code_offset_ += xe::round_up(func_info.code_size.total, 16);
 
@@ -215,10 +219,6 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
             generated_code_offset_,
         function_info);
 
-    // TODO(DrChat): The following code doesn't really need to be under the
-    // global lock except for PlaceCode (but it depends on the previous code
-    // already being ran)
-
     // If we are going above the high water mark of committed memory, commit
     // some more. It's ok if multiple threads do this, as redundant commits
     // aren't harmful.
@@ -243,9 +243,6 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
     } while (generated_code_commit_mark_.compare_exchange_weak(
         old_commit_mark, new_commit_mark));
 
-    // Copy code.
-    std::memcpy(code_write_address, machine_code, func_info.code_size.total);
-
     // Fill unused slots with 0xCC
     std::memset(tail_write_address, 0xCC,
                 static_cast<size_t>(end_write_address - tail_write_address));
@@ -255,6 +252,10 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
               unwind_reservation);
   }
 
+  // Copy code.
+  std::memcpy(code_write_address, machine_code, func_info.code_size.total);
+  FlushCode(code_execute_address, func_info.code_size.total);
+
 #if ENABLE_VTUNE
   if (iJIT_IsProfilingActive() == iJIT_SAMPLING_ON) {
     std::string method_name;
@@ -280,11 +281,171 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   // Note that we do support code that doesn't have an indirection fixup, so
   // ignore those when we see them.
   if (guest_address && indirection_table_base_) {
+    if (GetPlacedCode(guest_address)) {
+      // Replacing the code of a recompiled function - unlink the calls to the
+      // old code first, so until they're relinked below, they go through the
+      // resolve thunk, which returns the already published new code.
+      InvalidateGuestCode(guest_address);
+    }
+    // Other threads may jump through the slot as soon as it's written.
+    std::atomic_thread_fence(std::memory_order_release);
     uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
         indirection_table_base_ + (guest_address - kIndirectionTableBase));
-    *indirection_slot =
+    uint32_t host_address =
         uint32_t(reinterpret_cast<uint64_t>(code_execute_address));
+    *indirection_slot = host_address;
+
+    // Link the calls to the function, or relink them to the new code.
+    std::lock_guard<std::mutex> lock(call_sites_mutex_);
+    auto it = call_sites_.find(guest_address);
+    if (it != call_sites_.end()) {
+      for (const CallSite& call_site : it->second) {
+        PatchCallSite(call_site, host_address);
+      }
+    }
+  }
+}
+
+uint32_t X64CodeCache::GetPlacedCode(uint32_t guest_address) const {
+  uint32_t host_address = *reinterpret_cast<const uint32_t*>(
+      indirection_table_base_ + (guest_address - kIndirectionTableBase));
+  return host_address != indirection_default_value_ ? host_address : 0;
+}
+
+void X64CodeCache::PatchCallSite(const CallSite& call_site,
+                                 uint32_t target_address) {
+  assert_zero(call_site.rel32_address & 3);
+  int32_t rel32 = int32_t(target_address - (call_site.rel32_address + 4));
+  auto rel32_write_address = reinterpret_cast<volatile int32_t*>(
+      generated_code_write_base_ +
+      (call_site.rel32_address -
+       uint32_t(reinterpret_cast<uint64_t>(generated_code_execute_base_))));
+  // A single aligned store, the call is either to the old or the new target.
+  *rel32_write_address = rel32;
+  FlushCode(reinterpret_cast<void*>(uint64_t(call_site.rel32_address)),
+            sizeof(rel32));
+}
+
+void X64CodeCache::AddCallSite(uint32_t target_guest_address,
+                               uint8_t* rel32_address, uint8_t* stub_address) {
+  if (!indirection_table_base_) {
+    return;
+  }
+  CallSite call_site;
+  call_site.rel32_address = uint32_t(reinterpret_cast<uint64_t>(rel32_address));
+  call_site.stub_address = uint32_t(reinterpret_cast<uint64_t>(stub_address));
+  std::lock_guard<std::mutex> lock(call_sites_mutex_);
+  call_sites_[target_guest_address].push_back(call_site);
+  // The callee may have been placed while the caller was being compiled.
+  uint32_t target_code = GetPlacedCode(target_guest_address);
+  if (target_code) {
+    PatchCallSite(call_site, target_code);
+  }
+}
+
+void X64CodeCache::InvalidateGuestCode(uint32_t guest_address) {
+  if (!indirection_table_base_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(call_sites_mutex_);
+  AddIndirection(guest_address, indirection_default_value_);
+  auto it = call_sites_.find(guest_address);
+  if (it != call_sites_.end()) {
+    for (const CallSite& call_site : it->second) {
+      PatchCallSite(call_site, call_site.stub_address);
+    }
+  }
+}
+
+void X64CodeCache::AddIndirectCallTarget(const uint8_t* cache_header,
+                                         uint32_t target_guest_address) {
+  auto header =
+      reinterpret_cast<const IndirectCallCacheHeader*>(cache_header);
+  auto slots = reinterpret_cast<const IndirectCallCacheSlot*>(header + 1);
+  auto code_address = [cache_header](int32_t offset) {
+    return uint32_t(reinterpret_cast<uint64_t>(cache_header + offset));
+  };
+  auto write_address = [this](uint32_t execute_address) {
+    return generated_code_write_base_ +
+           (execute_address -
+            uint32_t(reinterpret_cast<uint64_t>(generated_code_execute_base_)));
+  };
+  std::lock_guard<std::mutex> lock(call_sites_mutex_);
+  uint32_t slot_index = 0;
+  for (; slot_index < header->slot_count; ++slot_index) {
+    uint32_t slot_guest_address = *reinterpret_cast<const volatile uint32_t*>(
+        cache_header + slots[slot_index].guest_address_offset);
+    if (!slot_guest_address) {
+      break;
+    }
+    if (slot_guest_address == target_guest_address) {
+      // Added by another thread.
+      return;
+    }
+  }
+  // Only addresses in the indirection table can be linked. Others would come
+  // here on every call, so they disable the cache like when it's full.
+  if (!target_guest_address || target_guest_address < kIndirectionTableBase ||
+      target_guest_address - kIndirectionTableBase >= kIndirectionTableSize) {
+    slot_index = header->slot_count;
+  } else if (slot_index < header->slot_count) {
+    const IndirectCallCacheSlot& slot = slots[slot_index];
+    // Link the rel32 first, the slot can't be hit until the address is set.
+    CallSite call_site;
+    call_site.rel32_address = code_address(slot.rel32_offset);
+    call_site.stub_address = code_address(header->stub_offset);
+    call_sites_[target_guest_address].push_back(call_site);
+    uint32_t target_code = GetPlacedCode(target_guest_address);
+    if (target_code) {
+      PatchCallSite(call_site, target_code);
+    }
+    uint32_t guest_address_address = code_address(slot.guest_address_offset);
+    assert_zero(guest_address_address & 3);
+    *reinterpret_cast<volatile uint32_t*>(
+        write_address(guest_address_address)) = target_guest_address;
+    FlushCode(reinterpret_cast<void*>(uint64_t(guest_address_address)),
+              sizeof(uint32_t));
+    ++slot_index;
+  }
+  if (slot_index >= header->slot_count) {
+    // Full or unusable, go straight to the indirection table on misses from
+    // now on.
+    CallSite miss_jump;
+    miss_jump.rel32_address = code_address(header->miss_jump_rel32_offset);
+    PatchCallSite(miss_jump, code_address(header->table_lookup_offset));
+  }
+}
+
+X64CodeCache::IndirectCallSiteStats* X64CodeCache::AddIndirectCallSiteStats(
+    uint32_t guest_address) {
+  std::lock_guard<std::mutex> lock(call_sites_mutex_);
+  indirect_call_site_stats_.emplace_back();
+  IndirectCallSiteStats& stats = indirect_call_site_stats_.back();
+  stats.guest_address = guest_address;
+  stats.call_count = 0;
+  stats.miss_count = 0;
+  return &stats;
+}
+
+std::vector<X64CodeCache::IndirectCallSiteStats>
+X64CodeCache::QueryIndirectCallSiteStats() {
+  std::lock_guard<std::mutex> lock(call_sites_mutex_);
+  return std::vector<IndirectCallSiteStats>(indirect_call_site_stats_.begin(),
+                                            indirect_call_site_stats_.end());
+}
+
+X64CodeCache::CallSiteStats X64CodeCache::QueryCallSiteStats() {
+  CallSiteStats stats = {};
+  std::lock_guard<std::mutex> lock(call_sites_mutex_);
+  for (const auto& it : call_sites_) {
+    if (GetPlacedCode(it.first)) {
+      stats.linked_count += it.second.size();
+    } else {
+      stats.unlinked_count += it.second.size();
+    }
   }
+  stats.unlinked_call_count = unlinked_call_count_;
+  return stats;
 }
 
 uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
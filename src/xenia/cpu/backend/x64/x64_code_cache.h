@@ -13,8 +13,11 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -74,6 +77,60 @@ class X64CodeCache : public CodeCache {
                       void*& code_write_address_out);
   uint32_t PlaceData(const void* data, size_t length);
 
+  // Registers a placed guest-to-guest call site - a call or jmp rel32 that
+  // initially targets a stub in the caller going through the indirection
+  // table. The rel32 is patched to point directly to the code of the callee
+  // as soon as it's placed (or right away if it already is), and repatched if
+  // the callee is recompiled. The rel32 must be 4-byte aligned so it can be
+  // rewritten while other threads may be executing it.
+  void AddCallSite(uint32_t target_guest_address, uint8_t* rel32_address,
+                   uint8_t* stub_address);
+  // Points the calls to the function back to their stubs and resets its
+  // indirection table entry, so the next call resolves the function again.
+  void InvalidateGuestCode(uint32_t guest_address);
+
+  struct CallSiteStats {
+    uint64_t linked_count;
+    uint64_t unlinked_count;
+    // Calls made through the stubs, counted only by the code emitted with
+    // count_unlinked_calls.
+    uint64_t unlinked_call_count;
+  };
+  CallSiteStats QueryCallSiteStats();
+  uint64_t* unlinked_call_counter() { return &unlinked_call_count_; }
+
+  // Data emitted after an inline indirect call target cache, describing where
+  // its slots are, as offsets relative to the header. Each slot is a cmp with
+  // the guest address (0 while unused) followed by a call or jmp rel32 that is
+  // linked like the direct calls.
+  struct IndirectCallCacheHeader {
+    // The jmp rel32 taken on misses, either to the code adding the target to
+    // the cache, or to the indirection table lookup once all slots are used.
+    int32_t miss_jump_rel32_offset;
+    int32_t stub_offset;
+    int32_t table_lookup_offset;
+    uint32_t slot_count;
+  };
+  struct IndirectCallCacheSlot {
+    // imm32 of the cmp.
+    int32_t guest_address_offset;
+    int32_t rel32_offset;
+  };
+  // Puts the guest address into a free slot of the cache, or makes the cache
+  // stop calling this if there are none left or the address can't be linked.
+  void AddIndirectCallTarget(const uint8_t* cache_header,
+                             uint32_t target_guest_address);
+
+  struct IndirectCallSiteStats {
+    uint32_t guest_address;
+    uint64_t call_count;
+    uint64_t miss_count;
+  };
+  // Allocates counters updated by the code of an indirect call site, with
+  // indirect_call_cache_stats.
+  IndirectCallSiteStats* AddIndirectCallSiteStats(uint32_t guest_address);
+  std::vector<IndirectCallSiteStats> QueryIndirectCallSiteStats();
+
   GuestFunction* LookupFunction(uint64_t host_pc) override;
 
  protected:
@@ -110,6 +167,9 @@ class X64CodeCache : public CodeCache {
                          const EmitFunctionInfo& func_info,
                          void* code_execute_address,
                          UnwindReservation unwind_reservation) {}
+  // Called after the machine code has been copied to its place, outside the
+  // global lock.
+  virtual void FlushCode(void* code_execute_address, size_t code_size) {}
 
   std::filesystem::path file_name_;
   xe::memory::FileMappingHandle mapping_ =
@@ -141,6 +201,23 @@ class X64CodeCache : public CodeCache {
   // This can be used to bsearch on host PC to find the guest function.
   // The key is [start address | end address].
   std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+
+  struct CallSite {
+    // Execute addresses, the generated code is in the low 4 GB.
+    uint32_t rel32_address;
+    uint32_t stub_address;
+  };
+  void PatchCallSite(const CallSite& call_site, uint32_t target_address);
+  // Host address currently in the indirection table entry of a function, or 0
+  // if it's not placed.
+  uint32_t GetPlacedCode(uint32_t guest_address) const;
+
+  std::mutex call_sites_mutex_;
+  // Keyed by the guest address of the callee.
+  std::unordered_map<uint32_t, std::vector<CallSite>> call_sites_;
+  uint64_t unlinked_call_count_ = 0;
+  // Not moved so the code can reference the counters.
+  std::deque<IndirectCallSiteStats> indirect_call_site_stats_;
 };
 
 }  // namespace x64
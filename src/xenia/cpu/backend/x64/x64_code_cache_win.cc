@@ -109,6 +109,7 @@ class Win32X64CodeCache : public X64CodeCache {
   void PlaceCode(uint32_t guest_address, void* machine_code,
                  const EmitFunctionInfo& func_info, void* code_execute_address,
                  UnwindReservation unwind_reservation) override;
+  void FlushCode(void* code_execute_address, size_t code_size) override;
 
   void InitializeUnwindEntry(uint8_t* unwind_entry_address,
                              size_t unwind_table_slot,
@@ -228,15 +229,18 @@ void Win32X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
 
   if (supports_growable_table_) {
     // Notify that the unwind table has grown.
-    // We do this outside of the lock, but with the latest total count.
+    // This is done under the lock, with all the entries up to the latest total
+    // count initialized.
     grow_table_(unwind_table_handle_, unwind_table_count_);
   }
+}
 
+void Win32X64CodeCache::FlushCode(void* code_execute_address,
+                                  size_t code_size) {
   // This isn't needed on x64 (probably), but is convention.
   // On UWP, FlushInstructionCache available starting from 10.0.16299.0.
   // https://docs.microsoft.com/en-us/uwp/win32-and-com/win32-apis
-  FlushInstructionCache(GetCurrentProcess(), code_execute_address,
-                        func_info.code_size.total);
+  FlushInstructionCache(GetCurrentProcess(), code_execute_address, code_size);
 }
 
 void Win32X64CodeCache::InitializeUnwindEntry(
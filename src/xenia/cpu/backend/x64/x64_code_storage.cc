@@ -0,0 +1,453 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_code_storage.h"
+
+#include <cstring>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "build/version.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/utf8.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/processor.h"
+
+DECLARE_bool(emit_source_annotations);
+DECLARE_bool(link_guest_calls);
+DECLARE_int32(inline_max_guest_instructions);
+DECLARE_int32(inline_budget_instructions);
+DECLARE_bool(global_register_allocation);
+DECLARE_bool(loop_invariant_code_motion);
+DECLARE_bool(fold_read_only_loads);
+DECLARE_int32(indirect_call_cache_size);
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// 'XEJC'.
+static const uint32_t kStorageMagic = 0x434A4558;
+
+// Puts the indirect call cache back into the state it was emitted in, with all
+// slots unused, returns false if it doesn't fit in the code.
+static bool ResetIndirectCallCache(uint8_t* code, size_t code_size,
+                                   const X64Relocation& relocation) {
+  using IndirectCallCacheHeader = X64CodeCache::IndirectCallCacheHeader;
+  using IndirectCallCacheSlot = X64CodeCache::IndirectCallCacheSlot;
+  auto store_rel32 = [code](int64_t rel32_offset, int64_t target_offset) {
+    int32_t rel32 =
+        int32_t(target_offset - (rel32_offset + int64_t(sizeof(int32_t))));
+    std::memcpy(code + rel32_offset, &rel32, sizeof(rel32));
+  };
+  auto in_code = [code_size](int64_t offset, size_t size) {
+    return offset >= 0 && uint64_t(offset) + size <= code_size;
+  };
+  int64_t header_offset = relocation.code_offset;
+  if (!in_code(header_offset, sizeof(IndirectCallCacheHeader)) ||
+      relocation.value >= code_size) {
+    return false;
+  }
+  IndirectCallCacheHeader header;
+  std::memcpy(&header, code + header_offset, sizeof(header));
+  int64_t miss_jump_rel32_offset =
+      header_offset + header.miss_jump_rel32_offset;
+  int64_t stub_offset = header_offset + header.stub_offset;
+  if (!in_code(miss_jump_rel32_offset, sizeof(int32_t)) ||
+      !in_code(stub_offset, 1) ||
+      header.slot_count > (code_size - header_offset - sizeof(header)) /
+                              sizeof(IndirectCallCacheSlot)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header.slot_count; ++i) {
+    IndirectCallCacheSlot slot;
+    std::memcpy(&slot,
+                code + header_offset + sizeof(header) + i * sizeof(slot),
+                sizeof(slot));
+    int64_t guest_address_offset = header_offset + slot.guest_address_offset;
+    int64_t rel32_offset = header_offset + slot.rel32_offset;
+    if (!in_code(guest_address_offset, sizeof(uint32_t)) ||
+        !in_code(rel32_offset, sizeof(int32_t))) {
+      return false;
+    }
+    std::memset(code + guest_address_offset, 0, sizeof(uint32_t));
+    store_rel32(rel32_offset, stub_offset);
+  }
+  store_rel32(miss_jump_rel32_offset, int64_t(relocation.value));
+  return true;
+}
+
+X64CodeStorage::X64CodeStorage(X64Backend* backend, Module* module)
+    : backend_(backend), module_(module) {}
+
+X64CodeStorage::~X64CodeStorage() { Shutdown(); }
+
+uint64_t X64CodeStorage::CalculateConfigHash() const {
+  struct {
+    char build_commit[40];
+    uint32_t feature_flags;
+    uint32_t supports_extended_load_store;
+    uint32_t disable_global_lock;
+    uint32_t emit_source_annotations;
+    // Hot functions get more passes.
+    uint32_t tiered_compilation;
+    uint32_t link_guest_calls;
+    int32_t inline_max_guest_instructions;
+    int32_t inline_budget_instructions;
+    uint32_t global_register_allocation;
+    uint32_t loop_invariant_code_motion;
+    uint32_t fold_read_only_loads;
+    int32_t indirect_call_cache_size;
+    uint64_t emitter_data;
+    uint64_t host_to_guest_thunk;
+    uint64_t guest_to_host_thunk;
+    uint64_t resolve_function_thunk;
+  } config;
+  std::memset(&config, 0, sizeof(config));
+  // Any commit may change the layout of the guest context or the sequences.
+  std::strncpy(config.build_commit, XE_BUILD_COMMIT,
+               sizeof(config.build_commit));
+  config.feature_flags = X64Emitter::QueryFeatureFlags();
+  config.supports_extended_load_store =
+      backend_->machine_info()->supports_extended_load_store;
+  config.disable_global_lock = cvars::disable_global_lock;
+  config.emit_source_annotations = cvars::emit_source_annotations;
+  config.tiered_compilation = cvars::tiered_compilation;
+  config.link_guest_calls = cvars::link_guest_calls;
+  config.inline_max_guest_instructions = cvars::inline_max_guest_instructions;
+  config.inline_budget_instructions = cvars::inline_budget_instructions;
+  config.global_register_allocation = cvars::global_register_allocation;
+  config.loop_invariant_code_motion = cvars::loop_invariant_code_motion;
+  config.fold_read_only_loads = cvars::fold_read_only_loads;
+  config.indirect_call_cache_size = cvars::indirect_call_cache_size;
+  // Embedded directly in the code, these are at fixed addresses normally.
+  config.emitter_data = backend_->emitter_data();
+  config.host_to_guest_thunk =
+      reinterpret_cast<uint64_t>(backend_->host_to_guest_thunk());
+  config.guest_to_host_thunk =
+      reinterpret_cast<uint64_t>(backend_->guest_to_host_thunk());
+  config.resolve_function_thunk =
+      reinterpret_cast<uint64_t>(backend_->resolve_function_thunk());
+  return XXH3_64bits(&config, sizeof(config));
+}
+
+uint64_t X64CodeStorage::HashGuestCode(uint32_t address,
+                                       uint32_t end_address) const {
+  // The end address is inclusive (points to the last instruction).
+  return XXH3_64bits(module_->memory()->TranslateVirtual(address),
+                     end_address + 4 - address);
+}
+
+bool X64CodeStorage::Initialize(const std::filesystem::path& storage_root,
+                                uint64_t module_hash) {
+  Shutdown();
+
+  if (!std::filesystem::exists(storage_root)) {
+    if (!std::filesystem::create_directories(storage_root)) {
+      XELOGE(
+          "Failed to create the code storage directory, persistent code "
+          "storage will be disabled: {}",
+          xe::path_to_utf8(storage_root));
+      return false;
+    }
+  }
+
+  auto file_path =
+      storage_root / fmt::format("{}.{:016X}.x64.xjit",
+                                 xe::utf8::find_base_name_from_guest_path(
+                                     module_->name()),
+                                 module_hash);
+  file_ = xe::filesystem::OpenFile(file_path, "a+b");
+  if (!file_) {
+    XELOGE(
+        "Failed to open the code storage file for writing, persistent code "
+        "storage will be disabled: {}",
+        xe::path_to_utf8(file_path));
+    return false;
+  }
+
+  FileHeader expected_header;
+  expected_header.magic = kStorageMagic;
+  expected_header.version = kVersion;
+  expected_header.module_hash = module_hash;
+  expected_header.config_hash = CalculateConfigHash();
+
+  // The reading position of an append stream is implementation-defined, and
+  // the size bounds the records read from a corrupted file.
+  xe::filesystem::Seek(file_, 0, SEEK_END);
+  int64_t file_size = xe::filesystem::Tell(file_);
+  xe::filesystem::Seek(file_, 0, SEEK_SET);
+
+  FileHeader header;
+  if (file_size >= int64_t(sizeof(header)) &&
+      fread(&header, sizeof(header), 1, file_) &&
+      !std::memcmp(&header, &expected_header, sizeof(header))) {
+    uint64_t restore_start = xe::Clock::QueryHostTickCount();
+    uint64_t restored_count = 0;
+    uint64_t valid_bytes =
+        RestoreFunctions(uint64_t(file_size), &restored_count);
+    XELOGI("Restored {} functions of {} from the code storage in {} ms",
+           restored_count, module_->name(),
+           (xe::Clock::QueryHostTickCount() - restore_start) * 1000 /
+               xe::Clock::QueryHostTickFrequency());
+    // Drop the corrupted tail, if any, so new records are appended after the
+    // valid ones. Switching from reading to writing requires a seek.
+    xe::filesystem::Seek(file_, 0, SEEK_END);
+    xe::filesystem::TruncateStdioFile(file_, valid_bytes);
+  } else {
+    // Different module, build or configuration - start over.
+    xe::filesystem::Seek(file_, 0, SEEK_END);
+    xe::filesystem::TruncateStdioFile(file_, 0);
+    fwrite(&expected_header, sizeof(expected_header), 1, file_);
+  }
+  return true;
+}
+
+void X64CodeStorage::Shutdown() {
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+uint64_t X64CodeStorage::RestoreFunctions(uint64_t file_size,
+                                          uint64_t* restored_count_out) {
+  uint64_t valid_bytes = sizeof(FileHeader);
+  uint64_t restored_count = 0;
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> machine_code;
+  StoredFunctionHeader header;
+  while (fread(&header, sizeof(header), 1, file_)) {
+    // Check the sizes against what's left in the file before allocating, so a
+    // corrupted record can't request gigabytes.
+    uint64_t remaining_bytes = file_size - (valid_bytes + sizeof(header));
+    if (valid_bytes + sizeof(header) > file_size ||
+        header.machine_code_length > remaining_bytes ||
+        header.source_map_count > remaining_bytes / sizeof(SourceMapEntry) ||
+        header.relocation_count > remaining_bytes / sizeof(X64Relocation)) {
+      break;
+    }
+    uint64_t source_map_size =
+        uint64_t(header.source_map_count) * sizeof(SourceMapEntry);
+    uint64_t relocations_size =
+        uint64_t(header.relocation_count) * sizeof(X64Relocation);
+    uint64_t data_size =
+        header.machine_code_length + source_map_size + relocations_size;
+    if (data_size > remaining_bytes) {
+      break;
+    }
+    data.resize(size_t(data_size));
+    if (data_size && !fread(data.data(), size_t(data_size), 1, file_)) {
+      break;
+    }
+    if (XXH3_64bits(data.data(), size_t(data_size)) != header.data_hash) {
+      break;
+    }
+    valid_bytes += sizeof(header) + data_size;
+
+    // Skip functions whose guest code has been changed since (patches,
+    // different imports).
+    if (!module_->ContainsAddress(header.guest_address) ||
+        !module_->ContainsAddress(header.guest_end_address) ||
+        header.guest_end_address < header.guest_address ||
+        HashGuestCode(header.guest_address, header.guest_end_address) !=
+        header.guest_code_hash) {
+      continue;
+    }
+
+    machine_code.assign(data.data(), data.data() + header.machine_code_length);
+    auto source_map = reinterpret_cast<const SourceMapEntry*>(
+        data.data() + header.machine_code_length);
+    auto relocations = reinterpret_cast<const X64Relocation*>(
+        data.data() + header.machine_code_length + source_map_size);
+    if (RestoreFunction(header, machine_code, source_map, relocations)) {
+      ++restored_count;
+    }
+  }
+  *restored_count_out = restored_count;
+  return valid_bytes;
+}
+
+bool X64CodeStorage::RestoreFunction(const StoredFunctionHeader& header,
+                                     std::vector<uint8_t>& machine_code,
+                                     const SourceMapEntry* source_map,
+                                     const X64Relocation* relocations) {
+  // Apply the relocations before placing the code, so it's never visible
+  // through the indirection table with stale pointers.
+  for (uint32_t i = 0; i < header.relocation_count; ++i) {
+    const X64Relocation& relocation = relocations[i];
+    if (relocation.type == X64Relocation::Type::kCallSite) {
+      // Stored pointing to the stub, linked once the code is placed.
+      if (relocation.code_offset + sizeof(int32_t) > machine_code.size() ||
+          (relocation.value >> 32) >= machine_code.size()) {
+        return false;
+      }
+      continue;
+    }
+    if (relocation.type == X64Relocation::Type::kIndirectCallCache) {
+      // Stored with no targets, filled again as the calls are made.
+      if (!ResetIndirectCallCache(machine_code.data(), machine_code.size(),
+                                  relocation)) {
+        return false;
+      }
+      continue;
+    }
+    if (relocation.code_offset + sizeof(uint64_t) > machine_code.size()) {
+      return false;
+    }
+    uint64_t value;
+    switch (relocation.type) {
+      case X64Relocation::Type::kHostImage:
+        value = X64Emitter::host_image_anchor() + relocation.value;
+        break;
+      case X64Relocation::Type::kBuiltinArg0:
+      case X64Relocation::Type::kBuiltinArg1: {
+        auto symbol = backend_->processor()->builtin_module()->LookupSymbol(
+            uint32_t(relocation.value));
+        if (!symbol || symbol->type() != Symbol::Type::kFunction ||
+            static_cast<Function*>(symbol)->behavior() !=
+                Function::Behavior::kBuiltin) {
+          return false;
+        }
+        auto builtin_function = static_cast<BuiltinFunction*>(symbol);
+        value = reinterpret_cast<uint64_t>(
+            relocation.type == X64Relocation::Type::kBuiltinArg0
+                ? builtin_function->arg0()
+                : builtin_function->arg1());
+      } break;
+      default:
+        return false;
+    }
+    std::memcpy(machine_code.data() + relocation.code_offset, &value,
+                sizeof(value));
+  }
+
+  Function* function;
+  auto status = module_->DeclareFunction(header.guest_address, &function);
+  if (status == Symbol::Status::kNew) {
+    function->set_end_address(header.guest_end_address);
+    function->set_status(Symbol::Status::kDeclared);
+  } else if (status != Symbol::Status::kDeclared) {
+    return false;
+  }
+  if (!function->is_guest() ||
+      module_->DefineFunction(function) != Symbol::Status::kNew) {
+    return false;
+  }
+  auto guest_function = static_cast<X64Function*>(function);
+
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.prolog = header.code_size_prolog;
+  func_info.code_size.body = header.code_size_body;
+  func_info.code_size.epilog = header.code_size_epilog;
+  func_info.code_size.tail = header.code_size_tail;
+  func_info.code_size.total = header.machine_code_length;
+  func_info.prolog_stack_alloc_offset = header.prolog_stack_alloc_offset;
+  func_info.stack_size = header.stack_size;
+
+  guest_function->set_end_address(header.guest_end_address);
+  auto code = std::make_unique<GuestFunction::Code>();
+  code->source_map.assign(source_map, source_map + header.source_map_count);
+  void* code_execute_address;
+  void* code_write_address;
+  backend_->code_cache()->PlaceGuestCode(
+      header.guest_address, machine_code.data(), func_info, guest_function,
+      code_execute_address, code_write_address);
+  code->machine_code = reinterpret_cast<uint8_t*>(code_execute_address);
+  code->machine_code_length = header.machine_code_length;
+  guest_function->PublishCode(std::move(code));
+  guest_function->set_status(Symbol::Status::kDefined);
+
+  // Link the calls like X64Emitter does for new code.
+  auto code_address = reinterpret_cast<uint8_t*>(code_execute_address);
+  for (uint32_t i = 0; i < header.relocation_count; ++i) {
+    const X64Relocation& relocation = relocations[i];
+    if (relocation.type == X64Relocation::Type::kCallSite) {
+      backend_->code_cache()->AddCallSite(
+          uint32_t(relocation.value), code_address + relocation.code_offset,
+          code_address + (relocation.value >> 32));
+    }
+  }
+  return true;
+}
+
+void X64CodeStorage::StoreFunction(
+    GuestFunction* function, const EmitFunctionInfo& func_info,
+    const void* machine_code, const std::vector<SourceMapEntry>& source_map,
+    const std::vector<X64Relocation>& relocations) {
+  StoredFunctionHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  header.guest_code_hash =
+      HashGuestCode(function->address(), function->end_address());
+  header.machine_code_length = uint32_t(func_info.code_size.total);
+  header.source_map_count = uint32_t(source_map.size());
+  header.relocation_count = uint32_t(relocations.size());
+  header.stack_size = uint32_t(func_info.stack_size);
+  header.code_size_prolog = uint32_t(func_info.code_size.prolog);
+  header.code_size_body = uint32_t(func_info.code_size.body);
+  header.code_size_epilog = uint32_t(func_info.code_size.epilog);
+  header.code_size_tail = uint32_t(func_info.code_size.tail);
+  header.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+
+  // Store the machine code with the relocated values zeroed so the records
+  // don't depend on where the host executable was loaded.
+  std::vector<uint8_t> data;
+  size_t source_map_size = source_map.size() * sizeof(SourceMapEntry);
+  size_t relocations_size = relocations.size() * sizeof(X64Relocation);
+  data.resize(header.machine_code_length + source_map_size + relocations_size);
+  std::memcpy(data.data(), machine_code, header.machine_code_length);
+  for (const X64Relocation& relocation : relocations) {
+    if (relocation.type == X64Relocation::Type::kCallSite) {
+      // May be linked to the callee already - store it calling the stub.
+      int32_t rel32 = int32_t(uint32_t(relocation.value >> 32) -
+                              (relocation.code_offset + sizeof(int32_t)));
+      std::memcpy(data.data() + relocation.code_offset, &rel32, sizeof(rel32));
+      continue;
+    }
+    if (relocation.type == X64Relocation::Type::kIndirectCallCache) {
+      // Other threads may have added targets since the code was placed.
+      ResetIndirectCallCache(data.data(), header.machine_code_length,
+                             relocation);
+      continue;
+    }
+    std::memset(data.data() + relocation.code_offset, 0, sizeof(uint64_t));
+  }
+  if (source_map_size) {
+    std::memcpy(data.data() + header.machine_code_length, source_map.data(),
+                source_map_size);
+  }
+  if (relocations_size) {
+    std::memcpy(data.data() + header.machine_code_length + source_map_size,
+                relocations.data(), relocations_size);
+  }
+  header.data_hash = XXH3_64bits(data.data(), data.size());
+
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  if (!file_) {
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, file_);
+  fwrite(data.data(), data.size(), 1, file_);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_X64_X64_CODE_STORAGE_H_
+#define XENIA_CPU_BACKEND_X64_X64_CODE_STORAGE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/module.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+class X64Backend;
+struct EmitFunctionInfo;
+
+// Persistent storage of the machine code generated for the functions of a
+// single guest module, so later runs can skip scanning, translating and
+// assembling them.
+//
+// The file is keyed on the hash of the module code, the storage format version
+// and everything that affects the generated code (host CPU features, cvars and
+// the host addresses of the thunks and constants shared by all functions).
+// Records are appended as functions are compiled and validated individually
+// on load - the stream is truncated at the first corrupted record.
+class X64CodeStorage {
+ public:
+  // Bump when anything in the translator or the emitter changes the generated
+  // code or the stored data layout.
+  static constexpr uint32_t kVersion = 3;
+
+  X64CodeStorage(X64Backend* backend, Module* module);
+  ~X64CodeStorage();
+
+  Module* module() const { return module_; }
+
+  // Opens (or creates) the storage file for the module and restores all still
+  // valid functions from it into the code cache.
+  bool Initialize(const std::filesystem::path& storage_root,
+                  uint64_t module_hash);
+  void Shutdown();
+
+  // Appends a freshly generated function to the storage.
+  void StoreFunction(GuestFunction* function, const EmitFunctionInfo& func_info,
+                     const void* machine_code,
+                     const std::vector<SourceMapEntry>& source_map,
+                     const std::vector<X64Relocation>& relocations);
+
+ private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t module_hash;
+    uint64_t config_hash;
+  };
+
+  struct StoredFunctionHeader {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    // Hash of the guest instructions, to skip functions modified at runtime.
+    uint64_t guest_code_hash;
+    uint32_t machine_code_length;
+    uint32_t source_map_count;
+    uint32_t relocation_count;
+    uint32_t stack_size;
+    uint32_t code_size_prolog;
+    uint32_t code_size_body;
+    uint32_t code_size_epilog;
+    uint32_t code_size_tail;
+    uint32_t prolog_stack_alloc_offset;
+    uint32_t padding;
+    // Hash of everything following the header in the record.
+    uint64_t data_hash;
+  };
+
+  uint64_t CalculateConfigHash() const;
+  uint64_t HashGuestCode(uint32_t address, uint32_t end_address) const;
+  // Returns the number of bytes of valid records read.
+  uint64_t RestoreFunctions(uint64_t file_size, uint64_t* restored_count_out);
+  bool RestoreFunction(const StoredFunctionHeader& header,
+                       std::vector<uint8_t>& machine_code,
+                       const SourceMapEntry* source_map,
+                       const X64Relocation* relocations);
+
+  X64Backend* backend_;
+  Module* module_;
+
+  std::mutex file_mutex_;
+  FILE* file_ = nullptr;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_CODE_STORAGE_H_
@@ -42,6 +42,26 @@ DEFINE_bool(ignore_undefined_externs, true,
 DEFINE_bool(emit_source_annotations, false,
             "Add extra movs and nops to make disassembly easier to read.",
             "CPU");
+DEFINE_bool(link_guest_calls, true,
+            "Patch calls between guest functions to go directly to the code of "
+            "the callee once it's compiled, instead of loading it from the "
+            "indirection table on every call.",
+            "CPU");
+DEFINE_int32(indirect_call_cache_size, 2,
+             "Number of targets of each indirect guest call or jump to compare "
+             "against inline and call directly, instead of loading them from "
+             "the indirection table, or 0 to disable. Requires "
+             "link_guest_calls.",
+             "CPU");
+DEFINE_bool(indirect_call_cache_stats, false,
+            "Count the calls and the inline cache misses of every indirect "
+            "guest call site, and log the sites missing the most on shutdown.",
+            "CPU");
+DEFINE_bool(count_unlinked_calls, false,
+            "Count the calls between guest functions that went through the "
+            "indirection table because the callee wasn't compiled yet, and "
+            "log them with the number of linked call sites on shutdown.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -72,14 +92,7 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
       backend_(backend),
       code_cache_(backend->code_cache()),
       allocator_(allocator) {
-  if (cvars::use_haswell_instructions) {
-    feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tAVX2) ? kX64EmitAVX2 : 0;
-    feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tFMA) ? kX64EmitFMA : 0;
-    feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tLZCNT) ? kX64EmitLZCNT : 0;
-    feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tBMI2) ? kX64EmitBMI2 : 0;
-    feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tF16C) ? kX64EmitF16C : 0;
-    feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tMOVBE) ? kX64EmitMovbe : 0;
-  }
+  feature_flags_ = QueryFeatureFlags();
 
   if (!cpu_.has(Xbyak::util::Cpu::tAVX)) {
     xe::FatalError(
@@ -91,6 +104,34 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
 
 X64Emitter::~X64Emitter() = default;
 
+uint32_t X64Emitter::QueryFeatureFlags() {
+  uint32_t feature_flags = 0;
+  if (cvars::use_haswell_instructions) {
+    Xbyak::util::Cpu cpu;
+    feature_flags |= cpu.has(Xbyak::util::Cpu::tAVX2) ? kX64EmitAVX2 : 0;
+    feature_flags |= cpu.has(Xbyak::util::Cpu::tFMA) ? kX64EmitFMA : 0;
+    feature_flags |= cpu.has(Xbyak::util::Cpu::tLZCNT) ? kX64EmitLZCNT : 0;
+    feature_flags |= cpu.has(Xbyak::util::Cpu::tBMI2) ? kX64EmitBMI2 : 0;
+    feature_flags |= cpu.has(Xbyak::util::Cpu::tF16C) ? kX64EmitF16C : 0;
+    feature_flags |= cpu.has(Xbyak::util::Cpu::tMOVBE) ? kX64EmitMovbe : 0;
+    if (cvars::use_avx512_instructions) {
+      feature_flags |= (cpu.has(Xbyak::util::Cpu::tAVX512F) &&
+                        cpu.has(Xbyak::util::Cpu::tAVX512VL))
+                           ? kX64EmitAVX512Ortho
+                           : 0;
+      feature_flags |=
+          cpu.has(Xbyak::util::Cpu::tAVX512BW) ? kX64EmitAVX512BW : 0;
+      feature_flags |=
+          cpu.has(Xbyak::util::Cpu::tAVX512_VBMI) ? kX64EmitAVX512VBMI : 0;
+    }
+  }
+  return feature_flags;
+}
+
+uintptr_t X64Emitter::host_image_anchor() {
+  return reinterpret_cast<uintptr_t>(&X64Emitter::PlaceConstData);
+}
+
 bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
                       uint32_t debug_info_flags, FunctionDebugInfo* debug_info,
                       void** out_code_address, size_t* out_code_size,
@@ -101,11 +142,18 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_ = debug_info;
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
+  tier_up_function_ = function->is_baseline_tier() ? function : nullptr;
   source_map_arena_.Reset();
+  relocations_.clear();
+  persistable_ = true;
+  call_sites_.clear();
+  indirect_call_caches_.clear();
 
   // Fill the generator with code.
   EmitFunctionInfo func_info = {};
   if (!Emit(builder, func_info)) {
+    call_sites_.clear();
+    indirect_call_caches_.clear();
     return false;
   }
 
@@ -113,9 +161,40 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   *out_code_size = getSize();
   *out_code_address = Emplace(func_info, function);
 
+  // Link the calls now that their addresses are known.
+  auto code_address = reinterpret_cast<uint8_t*>(*out_code_address);
+  for (const CallSite& call_site : call_sites_) {
+    code_cache_->AddCallSite(call_site.target_address,
+                             code_address + call_site.rel32_offset,
+                             code_address + call_site.stub_offset);
+    // Restored code is linked again wherever it's placed.
+    X64Relocation relocation;
+    relocation.code_offset = uint32_t(call_site.rel32_offset);
+    relocation.type = X64Relocation::Type::kCallSite;
+    relocation.value =
+        (uint64_t(call_site.stub_offset) << 32) | call_site.target_address;
+    relocations_.push_back(relocation);
+  }
+  call_sites_.clear();
+  for (const IndirectCallCache& cache : indirect_call_caches_) {
+    X64Relocation relocation;
+    relocation.code_offset = uint32_t(cache.header_offset);
+    relocation.type = X64Relocation::Type::kIndirectCallCache;
+    relocation.value = cache.add_target_offset;
+    relocations_.push_back(relocation);
+  }
+  indirect_call_caches_.clear();
+
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
+  // Debug info and tracing reference per-process allocations, so only plain
+  // functions can be reused by later runs.
+  if (persistable_ && !debug_info_flags_) {
+    backend_->StoreFunction(function, func_info, *out_code_address,
+                            *out_source_map, relocations_);
+  }
+
   return true;
 }
 
@@ -147,6 +226,14 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   return new_execute_address;
 }
 
+// Called by the baseline tier code of a function when it becomes hot.
+uint64_t TierUpFunction(void* raw_context, uint64_t function_ptr) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  thread_state->processor()->RequestFunctionTierUp(
+      reinterpret_cast<GuestFunction*>(function_ptr));
+  return 0;
+}
+
 bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   Xbyak::Label epilog_label;
   epilog_label_ = &epilog_label;
@@ -228,6 +315,19 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     bts(qword[low_address(&trace_header->function_thread_use)], rax);
   }
 
+  // Baseline tier - request the recompilation once the function is hot.
+  if (tier_up_function_) {
+    // The code refers to the function object, which is different every run.
+    MarkNotPersistable();
+    Xbyak::Label tier_up_done;
+    mov(rax, reinterpret_cast<uint64_t>(tier_up_function_->tier_up_counter()));
+    lock();
+    dec(dword[rax]);
+    jnz(tier_up_done, CodeGenerator::T_NEAR);
+    CallNative(TierUpFunction, reinterpret_cast<uint64_t>(tier_up_function_));
+    L(tier_up_done);
+  }
+
   // Load membase.
   mov(GetMembaseReg(),
       qword[GetContextReg() + offsetof(ppc::PPCContext, virtual_membase)]);
@@ -273,6 +373,9 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 
   code_offsets.tail = getSize();
 
+  EmitCallSiteStubs();
+  EmitIndirectCallCacheStubs();
+
   if (cvars::emit_source_annotations) {
     nop();
     nop();
@@ -296,6 +399,7 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 void X64Emitter::MarkSourceOffset(const Instr* i) {
   auto entry = source_map_arena_.Alloc<SourceMapEntry>();
   entry->guest_address = static_cast<uint32_t>(i->src1.offset);
+  source_guest_address_ = entry->guest_address;
   entry->hir_offset = uint32_t(i->block->ordinal << 16) | i->ordinal;
   entry->code_offset = static_cast<uint32_t>(getSize());
 
@@ -398,11 +502,65 @@ extern "C" uint64_t ResolveFunction(void* raw_context,
   return addr;
 }
 
+void X64Emitter::EmitLinkableCall(GuestFunction* function, bool tail) {
+  // Align the rel32 so it can be patched with a single store.
+  while ((getSize() + 1) & 3) {
+    nop();
+  }
+  call_sites_.emplace_back();
+  CallSite& call_site = call_sites_.back();
+  call_site.target_address = function->address();
+  if (tail) {
+    jmp(call_site.stub_label, CodeGenerator::T_NEAR);
+  } else {
+    call(call_site.stub_label);
+  }
+  call_site.rel32_offset = getSize() - 4;
+}
+
+void X64Emitter::EmitCallSiteStubs() {
+  // Used until the callee is compiled - the indirection table contains either
+  // its code or the resolve thunk, which expects the guest address in ebx.
+  for (CallSite& call_site : call_sites_) {
+    L(call_site.stub_label);
+    call_site.stub_offset = getSize();
+    if (cvars::count_unlinked_calls) {
+      MarkNotPersistable();
+      mov(rax,
+          reinterpret_cast<uint64_t>(code_cache_->unlinked_call_counter()));
+      lock();
+      inc(qword[rax]);
+    }
+    mov(ebx, call_site.target_address);
+    mov(eax, dword[ebx]);
+    jmp(rax);
+  }
+}
+
 void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   assert_not_null(function);
   auto fn = static_cast<X64Function*>(function);
+  if (cvars::link_guest_calls && code_cache_->has_indirection_table()) {
+    // Whether the callee is compiled or not, the call is patched to go to its
+    // latest code by X64CodeCache, and the code is independent of placement.
+    if (instr->flags & hir::CALL_TAIL) {
+      EmitTraceUserCallReturn();
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+      add(rsp, static_cast<uint32_t>(stack_size()));
+      EmitLinkableCall(function, true);
+    } else {
+      mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+      EmitLinkableCall(function, false);
+    }
+    return;
+  }
+
   // Resolve address to the function to call and store in rax.
-  if (fn->machine_code()) {
+  // Placement of stored code differs between runs, so don't embed host
+  // addresses of other functions when the code may be persisted. With tiered
+  // compilation, the code of the callee may be replaced later.
+  if (fn->machine_code() && !backend_->is_code_storage_enabled() &&
+      !cvars::tiered_compilation) {
     // TODO(benvanik): is it worth it to do this? It removes the need for
     // a ResolveFunction call, but makes the table less useful.
     assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
@@ -438,6 +596,133 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   }
 }
 
+// Called by the code of an indirect call site on a miss while its inline
+// target cache has free slots.
+static uint64_t AddIndirectCallTarget(void* raw_context, uint64_t cache_header,
+                                      uint64_t target_address) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto backend =
+      static_cast<X64Backend*>(thread_state->processor()->backend());
+  backend->code_cache()->AddIndirectCallTarget(
+      reinterpret_cast<const uint8_t*>(cache_header),
+      uint32_t(target_address));
+  return 0;
+}
+
+void X64Emitter::EmitCachedIndirectCall(const hir::Instr* instr) {
+  bool tail = (instr->flags & hir::CALL_TAIL) != 0;
+  indirect_call_caches_.emplace_back();
+  IndirectCallCache& cache = indirect_call_caches_.back();
+
+  X64CodeCache::IndirectCallSiteStats* stats = nullptr;
+  if (cvars::indirect_call_cache_stats) {
+    MarkNotPersistable();
+    stats = code_cache_->AddIndirectCallSiteStats(source_guest_address_);
+    mov(rax, reinterpret_cast<uint64_t>(&stats->call_count));
+    lock();
+    inc(qword[rax]);
+  }
+
+  Xbyak::Label done_label;
+  if (!tail) {
+    // Return address is from the previous SET_RETURN_ADDRESS.
+    mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+  }
+  for (int32_t n = 0; n < cvars::indirect_call_cache_size; ++n) {
+    Xbyak::Label next_slot_label;
+    // cmp ebx, imm32, with the imm32 aligned so it can be set with a single
+    // store (xbyak would pick the imm8 form for the initial 0).
+    while ((getSize() + 2) & 3) {
+      nop();
+    }
+    db(0x81);
+    db(0xFB);
+    size_t guest_address_offset = getSize();
+    dd(0);
+    jne(next_slot_label, CodeGenerator::T_NEAR);
+    if (tail) {
+      EmitTraceUserCallReturn();
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+      add(rsp, static_cast<uint32_t>(stack_size()));
+    }
+    // Linked like the direct calls once a target is set.
+    while ((getSize() + 1) & 3) {
+      nop();
+    }
+    if (tail) {
+      jmp(cache.stub_label, CodeGenerator::T_NEAR);
+    } else {
+      call(cache.stub_label);
+    }
+    cache.slots.emplace_back(guest_address_offset, getSize() - 4);
+    if (!tail) {
+      jmp(done_label, CodeGenerator::T_NEAR);
+    }
+    L(next_slot_label);
+  }
+
+  // Misses add the target to the cache until it's full.
+  while ((getSize() + 1) & 3) {
+    nop();
+  }
+  jmp(cache.add_target_label, CodeGenerator::T_NEAR);
+  cache.miss_jump_rel32_offset = getSize() - 4;
+
+  L(cache.table_lookup_label);
+  cache.table_lookup_offset = getSize();
+  if (stats) {
+    mov(rax, reinterpret_cast<uint64_t>(&stats->miss_count));
+    lock();
+    inc(qword[rax]);
+  }
+  mov(eax, dword[ebx]);
+  if (tail) {
+    EmitTraceUserCallReturn();
+    mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+    add(rsp, static_cast<uint32_t>(stack_size()));
+    jmp(rax);
+  } else {
+    mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    call(rax);
+  }
+  L(done_label);
+}
+
+void X64Emitter::EmitIndirectCallCacheStubs() {
+  for (IndirectCallCache& cache : indirect_call_caches_) {
+    // The target of the slots until they're linked, ebx is the guest address.
+    L(cache.stub_label);
+    cache.stub_offset = getSize();
+    mov(eax, dword[ebx]);
+    jmp(rax);
+
+    L(cache.add_target_label);
+    cache.add_target_offset = getSize();
+    lea(GetNativeParam(0), ptr[rip + cache.header_label]);
+    mov(GetNativeParam(1).cvt32(), ebx);
+    CallNativeSafe(reinterpret_cast<void*>(AddIndirectCallTarget));
+    jmp(cache.table_lookup_label, CodeGenerator::T_NEAR);
+  }
+  if (indirect_call_caches_.empty()) {
+    return;
+  }
+  // X64CodeCache::IndirectCallCacheHeader and the slots.
+  align(4);
+  for (IndirectCallCache& cache : indirect_call_caches_) {
+    L(cache.header_label);
+    cache.header_offset = getSize();
+    int32_t header_offset = int32_t(cache.header_offset);
+    dd(uint32_t(int32_t(cache.miss_jump_rel32_offset) - header_offset));
+    dd(uint32_t(int32_t(cache.stub_offset) - header_offset));
+    dd(uint32_t(int32_t(cache.table_lookup_offset) - header_offset));
+    dd(uint32_t(cache.slots.size()));
+    for (const auto& slot : cache.slots) {
+      dd(uint32_t(int32_t(slot.first) - header_offset));
+      dd(uint32_t(int32_t(slot.second) - header_offset));
+    }
+  }
+}
+
 void X64Emitter::CallIndirect(const hir::Instr* instr,
                               const Xbyak::Reg64& reg) {
   // Check if return.
@@ -446,6 +731,15 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     je(epilog_label(), CodeGenerator::T_NEAR);
   }
 
+  if (cvars::link_guest_calls && cvars::indirect_call_cache_size > 0 &&
+      code_cache_->has_indirection_table()) {
+    if (reg.cvt32() != ebx) {
+      mov(ebx, reg.cvt32());
+    }
+    EmitCachedIndirectCall(instr);
+    return;
+  }
+
   // Load the pointer to the indirection table maintained in X64CodeCache.
   // The target dword will either contain the address of the generated code
   // or a thunk to ResolveAddress.
@@ -504,9 +798,12 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // r9  = arg2
       auto thunk = backend()->guest_to_host_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
-      mov(rcx, reinterpret_cast<uint64_t>(builtin_function->handler()));
-      mov(rdx, reinterpret_cast<uint64_t>(builtin_function->arg0()));
-      mov(r8, reinterpret_cast<uint64_t>(builtin_function->arg1()));
+      MovHostImageAddress(
+          rcx, reinterpret_cast<const void*>(builtin_function->handler()));
+      MovRelocatable(rdx, reinterpret_cast<uint64_t>(builtin_function->arg0()),
+                     X64Relocation::Type::kBuiltinArg0, function->address());
+      MovRelocatable(r8, reinterpret_cast<uint64_t>(builtin_function->arg1()),
+                     X64Relocation::Type::kBuiltinArg1, function->address());
       call(rax);
       // rax = host return
     }
@@ -520,7 +817,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // r9  = arg2
       auto thunk = backend()->guest_to_host_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovHostImageAddress(rcx, reinterpret_cast<const void*>(
+                                   extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(rax);
@@ -528,6 +826,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     }
   }
   if (undefined) {
+    MarkNotPersistable();
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
   }
 }
@@ -555,7 +854,7 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // r9  = arg2
   auto thunk = backend()->guest_to_host_thunk();
   mov(rax, reinterpret_cast<uint64_t>(thunk));
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
+  MovHostImageAddress(rcx, fn);
   call(rax);
   // rax = host return
 }
@@ -607,6 +906,28 @@ void X64Emitter::nop(size_t length) {
   }
 }
 
+void X64Emitter::MovHostImageAddress(const Xbyak::Reg64& r,
+                                     const void* address) {
+  MovRelocatable(r, reinterpret_cast<uint64_t>(address),
+                 X64Relocation::Type::kHostImage,
+                 reinterpret_cast<uint64_t>(address) - host_image_anchor());
+}
+
+void X64Emitter::MovRelocatable(const Xbyak::Reg64& r, uint64_t v,
+                                X64Relocation::Type type,
+                                uint64_t relocation_value) {
+  // Always use the 10 byte mov r64, imm64 form (xbyak picks shorter encodings
+  // based on the value) so the immediate can be patched with any value.
+  db(0x48 | (r.getIdx() >= 8 ? 0x01 : 0x00));
+  db(0xB8 | (r.getIdx() & 7));
+  X64Relocation relocation;
+  relocation.code_offset = static_cast<uint32_t>(getSize());
+  relocation.type = type;
+  relocation.value = relocation_value;
+  relocations_.push_back(relocation);
+  dq(v);
+}
+
 bool X64Emitter::ConstantFitsIn32Reg(uint64_t v) {
   if ((v & ~0x7FFFFFFF) == 0) {
     // Fits under 31 bits, so just load using normal mov.
@@ -748,6 +1069,8 @@ static const vec128_t xmm_consts[] = {
     /* XMMQNaN                */ vec128i(0x7FC00000u),
     /* XMMInt127              */ vec128i(0x7Fu),
     /* XMM2To32               */ vec128f(0x1.0p32f),
+    /* XMMShiftMaskPI16       */ vec128s(0xF),
+    /* XMMShiftMaskPI8        */ vec128b(0x7),
 };
 
 // First location to try and place constants.
@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 #define XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 
+#include <deque>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/arena.h"
@@ -116,6 +118,8 @@ enum XmmConst {
   XMMQNaN,
   XMMInt127,
   XMM2To32,
+  XMMShiftMaskPI16,
+  XMMShiftMaskPI8,
 };
 
 // Unfortunately due to the design of xbyak we have to pass this to the ctor.
@@ -124,6 +128,34 @@ class XbyakAllocator : public Xbyak::Allocator {
   virtual bool useProtect() const { return false; }
 };
 
+// A host value embedded in emitted code that is only valid within the current
+// process and must be fixed up when the code is reloaded from the persistent
+// code storage (see X64CodeStorage).
+struct X64Relocation {
+  enum class Type : uint32_t {
+    // Pointer into the host executable image, stored relative to
+    // X64Emitter::host_image_anchor().
+    kHostImage,
+    // arg0/arg1 of the builtin function at the guest address in value.
+    kBuiltinArg0,
+    kBuiltinArg1,
+    // rel32 of a guest call linked by X64CodeCache::AddCallSite, with the guest
+    // address of the callee in the low 32 bits of the value and the offset of
+    // the stub in the high 32 bits.
+    kCallSite,
+    // X64CodeCache::IndirectCallCacheHeader at code_offset, with the offset of
+    // the code adding the targets (the initial miss jump target) in the value.
+    // The slots may be filled by other threads at any time, so they're reset
+    // to unused when storing.
+    kIndirectCallCache,
+  };
+  // Offset of the 64-bit immediate (or of the rel32 for kCallSite, or of the
+  // header for kIndirectCallCache) from the start of the function.
+  uint32_t code_offset;
+  Type type;
+  uint64_t value;
+};
+
 enum X64EmitterFeatureFlags {
   kX64EmitAVX2 = 1 << 1,
   kX64EmitFMA = 1 << 2,
@@ -131,6 +163,11 @@ enum X64EmitterFeatureFlags {
   kX64EmitBMI2 = 1 << 4,
   kX64EmitF16C = 1 << 5,
   kX64EmitMovbe = 1 << 6,
+  // AVX-512 Foundation with the Vector Length extensions, needed for any
+  // EVEX-encoded instruction on xmm and ymm registers.
+  kX64EmitAVX512Ortho = 1 << 7,
+  kX64EmitAVX512BW = 1 << 8,
+  kX64EmitAVX512VBMI = 1 << 9,
 };
 
 class X64Emitter : public Xbyak::CodeGenerator {
@@ -144,6 +181,14 @@ class X64Emitter : public Xbyak::CodeGenerator {
   static uintptr_t PlaceConstData();
   static void FreeConstData(uintptr_t data);
 
+  // Queries the X64EmitterFeatureFlags usable on the host.
+  static uint32_t QueryFeatureFlags();
+
+  // Address within the host executable that image-relative relocations are
+  // stored against. All of the emulator is linked into a single image, so the
+  // distance to any other function or static table is constant for a build.
+  static uintptr_t host_image_anchor();
+
   bool Emit(GuestFunction* function, hir::HIRBuilder* builder,
             uint32_t debug_info_flags, FunctionDebugInfo* debug_info,
             void** out_code_address, size_t* out_code_size,
@@ -207,6 +252,16 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   void nop(size_t length = 1);
 
+  // Loads a pointer to a host function or static table into the register
+  // using a fixed-size encoding and records a relocation for it.
+  void MovHostImageAddress(const Xbyak::Reg64& r, const void* address);
+  // Loads a 64-bit value that must be fixed up on reload into the register.
+  void MovRelocatable(const Xbyak::Reg64& r, uint64_t v,
+                      X64Relocation::Type type, uint64_t relocation_value);
+  // Marks the function being emitted as referencing host state that can't be
+  // relocated (heap pointers), so it's never written to the code storage.
+  void MarkNotPersistable() { persistable_ = false; }
+
   // Moves a 64bit immediate into memory.
   bool ConstantFitsIn32Reg(uint64_t v);
   void MovMem64(const Xbyak::RegExp& addr, uint64_t v);
@@ -220,8 +275,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Address StashConstantXmm(int index, double v);
   Xbyak::Address StashConstantXmm(int index, const vec128_t& v);
 
-  bool IsFeatureEnabled(uint32_t feature_flag) const {
-    return (feature_flags_ & feature_flag) != 0;
+  // Whether all of the features in the mask are enabled.
+  bool IsFeatureEnabled(uint32_t feature_flags) const {
+    return (feature_flags_ & feature_flags) == feature_flags;
   }
 
   FunctionDebugInfo* debug_info() const { return debug_info_; }
@@ -234,6 +290,15 @@ class X64Emitter : public Xbyak::CodeGenerator {
   bool Emit(hir::HIRBuilder* builder, EmitFunctionInfo& func_info);
   void EmitGetCurrentThreadId();
   void EmitTraceUserCallReturn();
+  // Emits a call or a tail jump to a guest function that X64CodeCache can
+  // patch to go directly to the callee.
+  void EmitLinkableCall(GuestFunction* function, bool tail);
+  void EmitCallSiteStubs();
+  // Emits an indirect call or tail jump to the guest address in ebx comparing
+  // it with the last few targets first, which are called directly (see the
+  // indirect_call_cache_size cvar).
+  void EmitCachedIndirectCall(const hir::Instr* instr);
+  void EmitIndirectCallCacheStubs();
 
  protected:
   Processor* processor_ = nullptr;
@@ -250,8 +315,44 @@ class X64Emitter : public Xbyak::CodeGenerator {
   FunctionDebugInfo* debug_info_ = nullptr;
   uint32_t debug_info_flags_ = 0;
   FunctionTraceData* trace_data_ = nullptr;
+  // Set when emitting the baseline tier of a function, to count its calls.
+  GuestFunction* tier_up_function_ = nullptr;
   Arena source_map_arena_;
 
+  // Relocations of the function being emitted, and whether it only references
+  // host state that can be described by them.
+  std::vector<X64Relocation> relocations_;
+  bool persistable_ = true;
+
+  struct CallSite {
+    uint32_t target_address;
+    // Offset of the rel32 of the call or jmp.
+    size_t rel32_offset;
+    size_t stub_offset;
+    Xbyak::Label stub_label;
+  };
+  // Labels must not move, so not a vector.
+  std::deque<CallSite> call_sites_;
+
+  // Offsets of the parts of an inline indirect call target cache, described
+  // to X64CodeCache by an X64CodeCache::IndirectCallCacheHeader.
+  struct IndirectCallCache {
+    // Offsets of the imm32 of the cmp and of the rel32 of each slot.
+    std::vector<std::pair<size_t, size_t>> slots;
+    size_t miss_jump_rel32_offset;
+    size_t stub_offset;
+    size_t table_lookup_offset;
+    size_t add_target_offset;
+    size_t header_offset;
+    Xbyak::Label stub_label;
+    Xbyak::Label add_target_label;
+    Xbyak::Label table_lookup_label;
+    Xbyak::Label header_label;
+  };
+  std::deque<IndirectCallCache> indirect_call_caches_;
+  // Guest address of the last source offset, for the indirect call stats.
+  uint32_t source_guest_address_ = 0;
+
   size_t stack_size_ = 0;
 
   static const uint32_t gpr_reg_map_[GPR_COUNT];
@@ -23,17 +23,8 @@ class X64Function : public GuestFunction {
   X64Function(Module* module, uint32_t address);
   ~X64Function() override;
 
-  uint8_t* machine_code() const override { return machine_code_; }
-  size_t machine_code_length() const override { return machine_code_length_; }
-
-  void Setup(uint8_t* machine_code, size_t machine_code_length);
-
  protected:
   bool CallImpl(ThreadState* thread_state, uint32_t return_address) override;
-
- private:
-  uint8_t* machine_code_ = nullptr;
-  size_t machine_code_length_ = 0;
 };
 
 }  // namespace x64
@@ -11,10 +11,14 @@
 
 #include <algorithm>
 #include <cstring>
+#include <vector>
 
 #include "xenia/base/memory.h"
 #include "xenia/cpu/backend/x64/x64_op.h"
 #include "xenia/cpu/backend/x64/x64_tracers.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/reservation_table.h"
 
 namespace xe {
 namespace cpu {
@@ -103,6 +107,98 @@ RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
   }
 }
 
+// Loads and stores that have accessed MMIO via an access violation before are
+// retranslated with LOAD_STORE_MMIO_CHECK, and call the MMIO handlers directly
+// if the address is in an MMIO range. Places the guest address in the second
+// native parameter and jumps to mmio_labels[n] for the nth range. Returns false
+// if the access doesn't need the check.
+template <typename T>
+bool EmitMMIOCheck(X64Emitter& e, const Instr* instr, const T& guest,
+                   int32_t offset, std::vector<Xbyak::Label>& mmio_labels) {
+  if (!(instr->flags & LoadStoreFlags::LOAD_STORE_MMIO_CHECK) ||
+      guest.is_constant) {
+    // Constant MMIO addresses are already converted to LOAD/STORE_MMIO.
+    return false;
+  }
+  MMIOHandler* mmio_handler = MMIOHandler::global_handler();
+  if (!mmio_handler || mmio_handler->mapped_ranges().empty()) {
+    return false;
+  }
+  const std::vector<MMIORange>& ranges = mmio_handler->mapped_ranges();
+  e.MarkNotPersistable();
+  auto address = e.GetNativeParam(1).cvt32();
+  e.mov(address, guest.reg().cvt32());
+  if (offset) {
+    e.add(address, offset);
+  }
+  mmio_labels.resize(ranges.size());
+  for (size_t n = 0; n < ranges.size(); ++n) {
+    e.mov(e.eax, address);
+    e.and_(e.eax, ranges[n].mask);
+    e.cmp(e.eax, ranges[n].address);
+    e.je(mmio_labels[n], X64Emitter::T_NEAR);
+  }
+  return true;
+}
+
+static void EmitMMIOCheckedAccessCount(X64Emitter& e) {
+  e.mov(e.rax, reinterpret_cast<uint64_t>(
+                   MMIOHandler::global_handler()->checked_access_counter()));
+  e.lock();
+  e.inc(e.qword[e.rax]);
+}
+
+// Emits the MMIO paths of a checked load after the regular one.
+static void EmitMMIOCheckedLoad(X64Emitter& e, const Instr* instr,
+                                std::vector<Xbyak::Label>& mmio_labels,
+                                const Xbyak::Reg32& dest) {
+  const std::vector<MMIORange>& ranges =
+      MMIOHandler::global_handler()->mapped_ranges();
+  Xbyak::Label done;
+  for (size_t n = 0; n < ranges.size(); ++n) {
+    e.jmp(done, X64Emitter::T_NEAR);
+    e.L(mmio_labels[n]);
+    EmitMMIOCheckedAccessCount(e);
+    e.mov(e.GetNativeParam(0), uint64_t(ranges[n].callback_context));
+    e.CallNativeSafe(reinterpret_cast<void*>(ranges[n].read));
+    if (!(instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP)) {
+      // Same as the raw big-endian load from memory.
+      e.bswap(e.eax);
+    }
+    e.mov(dest, e.eax);
+  }
+  e.L(done);
+}
+
+// Emits the MMIO paths of a checked store after the regular one.
+template <typename T>
+void EmitMMIOCheckedStore(X64Emitter& e, const Instr* instr,
+                          std::vector<Xbyak::Label>& mmio_labels,
+                          const T& value) {
+  const std::vector<MMIORange>& ranges =
+      MMIOHandler::global_handler()->mapped_ranges();
+  bool byte_swap = (instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0;
+  Xbyak::Label done;
+  for (size_t n = 0; n < ranges.size(); ++n) {
+    e.jmp(done, X64Emitter::T_NEAR);
+    e.L(mmio_labels[n]);
+    EmitMMIOCheckedAccessCount(e);
+    e.mov(e.GetNativeParam(0), uint64_t(ranges[n].callback_context));
+    auto write_value = e.GetNativeParam(2).cvt32();
+    if (value.is_constant) {
+      uint32_t constant = uint32_t(value.constant());
+      e.mov(write_value, byte_swap ? constant : xe::byte_swap(constant));
+    } else {
+      e.mov(write_value, value);
+      if (!byte_swap) {
+        e.bswap(write_value);
+      }
+    }
+    e.CallNativeSafe(reinterpret_cast<void*>(ranges[n].write));
+  }
+  e.L(done);
+}
+
 // ============================================================================
 // OPCODE_ATOMIC_EXCHANGE
 // ============================================================================
@@ -213,6 +309,130 @@ struct ATOMIC_COMPARE_EXCHANGE_I64
 EMITTER_OPCODE_TABLE(OPCODE_ATOMIC_COMPARE_EXCHANGE,
                      ATOMIC_COMPARE_EXCHANGE_I32, ATOMIC_COMPARE_EXCHANGE_I64);
 
+// ============================================================================
+// OPCODE_RESERVED_LOAD
+// ============================================================================
+// See ReservationTable for how the reservation works.
+// Puts the guest address in ecx and the line in the PPCContext::reserved_line
+// form in edx.
+template <typename T>
+void EmitReservedLine(X64Emitter& e, const T& guest) {
+  if (guest.is_constant) {
+    e.mov(e.ecx, static_cast<uint32_t>(guest.constant()));
+  } else {
+    e.mov(e.ecx, guest.reg().cvt32());
+  }
+  e.mov(e.edx, e.ecx);
+  e.shr(e.edx, ReservationTable::kLineSizeLog2);
+  e.or_(e.edx, ReservationTable::kReservedLineValid);
+}
+// Replaces the line in edx with the address of its reservation table entry.
+static void EmitReservationEntryAddress(X64Emitter& e) {
+  e.and_(e.edx, ReservationTable::kEntryCount - 1);
+  e.shl(e.edx, ReservationTable::kEntrySizeLog2);
+  e.add(e.rdx, e.qword[e.GetContextReg() +
+                       offsetof(ppc::PPCContext, reservation_table)]);
+}
+template <typename SEQ, typename REG, typename ARGS>
+void EmitReservedLoadXX(X64Emitter& e, const ARGS& i) {
+  EmitReservedLine(e, i.src1);
+  e.mov(e.dword[e.GetContextReg() + offsetof(ppc::PPCContext, reserved_line)],
+        e.edx);
+  EmitReservationEntryAddress(e);
+  e.mov(e.eax, e.dword[e.rdx]);
+  e.mov(
+      e.dword[e.GetContextReg() + offsetof(ppc::PPCContext, reserved_version)],
+      e.eax);
+  // Loads are not reordered with older loads, so the value is at least as new
+  // as the version.
+  auto addr = ComputeMemoryAddress(e, i.src1);
+  e.mov(i.dest, e.ptr[addr]);
+  e.mov(e.ptr[e.GetContextReg() + offsetof(ppc::PPCContext, reserved_val)],
+        i.dest);
+}
+struct RESERVED_LOAD_I32
+    : Sequence<RESERVED_LOAD_I32, I<OPCODE_RESERVED_LOAD, I32Op, I64Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitReservedLoadXX<RESERVED_LOAD_I32, Reg32>(e, i);
+  }
+};
+struct RESERVED_LOAD_I64
+    : Sequence<RESERVED_LOAD_I64, I<OPCODE_RESERVED_LOAD, I64Op, I64Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitReservedLoadXX<RESERVED_LOAD_I64, Reg64>(e, i);
+  }
+};
+EMITTER_OPCODE_TABLE(OPCODE_RESERVED_LOAD, RESERVED_LOAD_I32,
+                     RESERVED_LOAD_I64);
+
+// ============================================================================
+// OPCODE_RESERVED_STORE
+// ============================================================================
+template <typename SEQ, typename REG, typename ARGS>
+void EmitReservedStoreXX(X64Emitter& e, const ARGS& i) {
+  Xbyak::Label failed, done;
+  EmitReservedLine(e, i.src1);
+  // The reservation is lost whether the store succeeds or not.
+  e.mov(e.eax,
+        e.dword[e.GetContextReg() + offsetof(ppc::PPCContext, reserved_line)]);
+  e.mov(e.dword[e.GetContextReg() + offsetof(ppc::PPCContext, reserved_line)],
+        0);
+  e.cmp(e.eax, e.edx);
+  e.jne(failed, X64Emitter::T_NEAR);
+  // Claim the line, failing if another conditional store has done it since the
+  // reserved load.
+  EmitReservationEntryAddress(e);
+  e.mov(e.eax, e.dword[e.GetContextReg() +
+                       offsetof(ppc::PPCContext, reserved_version)]);
+  e.lea(e.r8d, e.ptr[e.rax + 1]);
+  e.lock();
+  e.cmpxchg(e.dword[e.rdx], e.r8d);
+  e.jne(failed, X64Emitter::T_NEAR);
+  // Store unless the value has been changed by any store since the reserved
+  // load.
+  REG expected(e.rax.getIdx());
+  REG value(e.r8.getIdx());
+  e.mov(expected,
+        e.ptr[e.GetContextReg() + offsetof(ppc::PPCContext, reserved_val)]);
+  if (i.src2.is_constant) {
+    e.mov(value, i.src2.constant());
+  } else {
+    e.mov(value, i.src2);
+  }
+  if (xe::memory::allocation_granularity() > 0x1000) {
+    // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
+    // it via memory mapping.
+    e.cmp(e.ecx, 0xE0000000);
+    e.setae(e.dl);
+    e.movzx(e.edx, e.dl);
+    e.shl(e.edx, 12);
+    e.add(e.ecx, e.edx);
+  }
+  e.lock();
+  e.cmpxchg(e.ptr[e.GetMembaseReg() + e.rcx], value);
+  e.sete(i.dest);
+  e.jmp(done, X64Emitter::T_NEAR);
+  e.L(failed);
+  e.xor_(i.dest, i.dest);
+  e.L(done);
+}
+struct RESERVED_STORE_I32
+    : Sequence<RESERVED_STORE_I32,
+               I<OPCODE_RESERVED_STORE, I8Op, I64Op, I32Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitReservedStoreXX<RESERVED_STORE_I32, Reg32>(e, i);
+  }
+};
+struct RESERVED_STORE_I64
+    : Sequence<RESERVED_STORE_I64,
+               I<OPCODE_RESERVED_STORE, I8Op, I64Op, I64Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitReservedStoreXX<RESERVED_STORE_I64, Reg64>(e, i);
+  }
+};
+EMITTER_OPCODE_TABLE(OPCODE_RESERVED_STORE, RESERVED_STORE_I32,
+                     RESERVED_STORE_I64);
+
 // ============================================================================
 // OPCODE_LOAD_LOCAL
 // ============================================================================
@@ -556,6 +776,7 @@ struct LOAD_MMIO_I32
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
@@ -581,6 +802,7 @@ struct STORE_MMIO_I32
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), write_address);
     if (i.src3.is_constant) {
@@ -634,6 +856,9 @@ struct LOAD_OFFSET_I16
 struct LOAD_OFFSET_I32
     : Sequence<LOAD_OFFSET_I32, I<OPCODE_LOAD_OFFSET, I32Op, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    std::vector<Xbyak::Label> mmio_labels;
+    bool mmio_check = EmitMMIOCheck(e, i.instr, i.src1,
+                                    int32_t(i.src2.constant()), mmio_labels);
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
@@ -645,6 +870,9 @@ struct LOAD_OFFSET_I32
     } else {
       e.mov(i.dest, e.dword[addr]);
     }
+    if (mmio_check) {
+      EmitMMIOCheckedLoad(e, i.instr, mmio_labels, i.dest);
+    }
   }
 };
 
@@ -709,6 +937,9 @@ struct STORE_OFFSET_I32
     : Sequence<STORE_OFFSET_I32,
                I<OPCODE_STORE_OFFSET, VoidOp, I64Op, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    std::vector<Xbyak::Label> mmio_labels;
+    bool mmio_check = EmitMMIOCheck(e, i.instr, i.src1,
+                                    int32_t(i.src2.constant()), mmio_labels);
     auto addr = ComputeMemoryAddressOffset(e, i.src1, i.src2);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src3.is_constant);
@@ -724,6 +955,9 @@ struct STORE_OFFSET_I32
         e.mov(e.dword[addr], i.src3);
       }
     }
+    if (mmio_check) {
+      EmitMMIOCheckedStore(e, i.instr, mmio_labels, i.src3);
+    }
   }
 };
 
@@ -787,6 +1021,8 @@ struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
 };
 struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    std::vector<Xbyak::Label> mmio_labels;
+    bool mmio_check = EmitMMIOCheck(e, i.instr, i.src1, 0, mmio_labels);
     auto addr = ComputeMemoryAddress(e, i.src1);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
@@ -798,6 +1034,9 @@ struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
     } else {
       e.mov(i.dest, e.dword[addr]);
     }
+    if (mmio_check) {
+      EmitMMIOCheckedLoad(e, i.instr, mmio_labels, i.dest);
+    }
     if (IsTracingData()) {
       e.mov(e.GetNativeParam(1).cvt32(), i.dest);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -919,6 +1158,8 @@ struct STORE_I16 : Sequence<STORE_I16, I<OPCODE_STORE, VoidOp, I64Op, I16Op>> {
 };
 struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    std::vector<Xbyak::Label> mmio_labels;
+    bool mmio_check = EmitMMIOCheck(e, i.instr, i.src1, 0, mmio_labels);
     auto addr = ComputeMemoryAddress(e, i.src1);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
@@ -934,6 +1175,9 @@ struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
         e.mov(e.dword[addr], i.src2);
       }
     }
+    if (mmio_check) {
+      EmitMMIOCheckedStore(e, i.instr, mmio_labels, i.src2);
+    }
     if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(1).cvt32(), e.dword[addr]);
@@ -154,14 +154,14 @@ struct LOAD_VECTOR_SHL_I8
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsl_table));
-      e.mov(e.rax, (uintptr_t)&lvsl_table[sh]);
+      e.MovHostImageAddress(e.rax, &lvsl_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and_(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsl_table);
+      e.MovHostImageAddress(e.rax, lvsl_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
     }
   }
@@ -195,14 +195,14 @@ struct LOAD_VECTOR_SHR_I8
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsr_table));
-      e.mov(e.rax, (uintptr_t)&lvsr_table[sh]);
+      e.MovHostImageAddress(e.rax, &lvsr_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and_(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsr_table);
+      e.MovHostImageAddress(e.rax, lvsr_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
     }
   }
@@ -689,6 +689,99 @@ struct VECTOR_SUB
 };
 EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SUB, VECTOR_SUB);
 
+// ============================================================================
+// AVX-512 variable shifts
+// ============================================================================
+// AVX-512BW has per-element shifts of words, bytes are shifted as words after
+// widening them. Wider values are only kept in ymm16 and up, which can't dirty
+// the upper halves of ymm0-15, so no vzeroupper is needed afterwards.
+enum class VectorShiftOp {
+  kLeft,
+  kRightLogical,
+  kRightArithmetic,
+};
+
+static bool IsAVX512VectorShiftEnabled(X64Emitter& e) {
+  return e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW);
+}
+
+// Loads src2 with the counts masked to the element width into xmm0.
+template <typename ARGS>
+static void EmitMaskedShiftCounts(X64Emitter& e, const ARGS& i,
+                                  TypeName type) {
+  if (i.src2.is_constant) {
+    vec128_t masked = i.src2.constant();
+    if (type == INT8_TYPE) {
+      for (size_t n = 0; n < 16; ++n) {
+        masked.u8[n] &= 0x7;
+      }
+    } else {
+      for (size_t n = 0; n < 8; ++n) {
+        masked.u16[n] &= 0xF;
+      }
+    }
+    e.LoadConstantXmm(e.xmm0, masked);
+  } else {
+    e.vpand(e.xmm0, i.src2,
+            e.GetXmmConstPtr(type == INT8_TYPE ? XMMShiftMaskPI8
+                                               : XMMShiftMaskPI16));
+  }
+}
+
+template <typename ARGS>
+static Xmm GetShiftSource(X64Emitter& e, const ARGS& i) {
+  if (i.src1.is_constant) {
+    e.LoadConstantXmm(e.xmm1, i.src1.constant());
+    return e.xmm1;
+  }
+  return i.src1;
+}
+
+template <typename ARGS>
+static void EmitAVX512VectorShiftInt16(X64Emitter& e, const ARGS& i,
+                                       VectorShiftOp op) {
+  Xmm src1 = GetShiftSource(e, i);
+  EmitMaskedShiftCounts(e, i, INT16_TYPE);
+  switch (op) {
+    case VectorShiftOp::kLeft:
+      e.vpsllvw(i.dest, src1, e.xmm0);
+      break;
+    case VectorShiftOp::kRightLogical:
+      e.vpsrlvw(i.dest, src1, e.xmm0);
+      break;
+    case VectorShiftOp::kRightArithmetic:
+      e.vpsravw(i.dest, src1, e.xmm0);
+      break;
+  }
+}
+
+template <typename ARGS>
+static void EmitAVX512VectorShiftInt8(X64Emitter& e, const ARGS& i,
+                                      VectorShiftOp op) {
+  Xmm src1 = GetShiftSource(e, i);
+  EmitMaskedShiftCounts(e, i, INT8_TYPE);
+  e.vpmovzxbw(e.ymm17, e.xmm0);
+  // Sign-extend for arithmetic shifts, the low byte of each word is the result
+  // either way.
+  if (op == VectorShiftOp::kRightArithmetic) {
+    e.vpmovsxbw(e.ymm16, src1);
+  } else {
+    e.vpmovzxbw(e.ymm16, src1);
+  }
+  switch (op) {
+    case VectorShiftOp::kLeft:
+      e.vpsllvw(e.ymm16, e.ymm16, e.ymm17);
+      break;
+    case VectorShiftOp::kRightLogical:
+      e.vpsrlvw(e.ymm16, e.ymm16, e.ymm17);
+      break;
+    case VectorShiftOp::kRightArithmetic:
+      e.vpsravw(e.ymm16, e.ymm16, e.ymm17);
+      break;
+  }
+  e.vpmovwb(i.dest, e.ymm16);
+}
+
 // ============================================================================
 // OPCODE_VECTOR_SHL
 // ============================================================================
@@ -729,6 +822,10 @@ struct VECTOR_SHL_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
+    if (IsAVX512VectorShiftEnabled(e)) {
+      EmitAVX512VectorShiftInt8(e, i, VectorShiftOp::kLeft);
+      return;
+    }
     // TODO(benvanik): native version (with shift magic).
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
@@ -765,6 +862,11 @@ struct VECTOR_SHL_V128
       }
     }
 
+    if (IsAVX512VectorShiftEnabled(e)) {
+      EmitAVX512VectorShiftInt16(e, i, VectorShiftOp::kLeft);
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -918,6 +1020,10 @@ struct VECTOR_SHR_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
+    if (IsAVX512VectorShiftEnabled(e)) {
+      EmitAVX512VectorShiftInt8(e, i, VectorShiftOp::kRightLogical);
+      return;
+    }
     // TODO(benvanik): native version (with shift magic).
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
@@ -946,6 +1052,11 @@ struct VECTOR_SHR_V128
       }
     }
 
+    if (IsAVX512VectorShiftEnabled(e)) {
+      EmitAVX512VectorShiftInt16(e, i, VectorShiftOp::kRightLogical);
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1082,6 +1193,10 @@ struct VECTOR_SHA_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
+    if (IsAVX512VectorShiftEnabled(e)) {
+      EmitAVX512VectorShiftInt8(e, i, VectorShiftOp::kRightArithmetic);
+      return;
+    }
     // TODO(benvanik): native version (with shift magic).
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
@@ -1110,6 +1225,11 @@ struct VECTOR_SHA_V128
       }
     }
 
+    if (IsAVX512VectorShiftEnabled(e)) {
+      EmitAVX512VectorShiftInt16(e, i, VectorShiftOp::kRightArithmetic);
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1228,11 +1348,57 @@ static __m128i EmulateVectorRotateLeft(void*, __m128i src1, __m128i src2) {
   return _mm_load_si128(reinterpret_cast<__m128i*>(value));
 }
 
-// TODO(benvanik): AVX512 has a native variable rotate (rolv).
 struct VECTOR_ROTATE_LEFT_V128
     : Sequence<VECTOR_ROTATE_LEFT_V128,
                I<OPCODE_VECTOR_ROTATE_LEFT, V128Op, V128Op, V128Op>> {
+  static void EmitAVX512Int8(X64Emitter& e, const EmitArgType& i) {
+    Xmm src1 = GetShiftSource(e, i);
+    EmitMaskedShiftCounts(e, i, INT8_TYPE);
+    e.vpmovzxbw(e.ymm17, e.xmm0);
+    e.vpmovzxbw(e.ymm16, src1);
+    e.vpsllvw(e.ymm16, e.ymm16, e.ymm17);
+    // Bring the bits shifted out of the low byte back into it.
+    e.vpsrlw(e.ymm17, e.ymm16, 8);
+    e.vpord(e.ymm16, e.ymm16, e.ymm17);
+    e.vpmovwb(i.dest, e.ymm16);
+  }
+
+  static void EmitAVX512Int16(X64Emitter& e, const EmitArgType& i) {
+    Xmm src1 = GetShiftSource(e, i);
+    EmitMaskedShiftCounts(e, i, INT16_TYPE);
+    e.vpsllvw(e.xmm2, src1, e.xmm0);
+    // x >> (16 - n) as (x >> 1) >> (15 - n), which is also correct for n = 0.
+    e.vpxor(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMShiftMaskPI16));
+    e.vpsrlw(i.dest, src1, 1);
+    e.vpsrlvw(i.dest, i.dest, e.xmm0);
+    e.vpor(i.dest, i.dest, e.xmm2);
+  }
+
+  static void EmitAVX512Int32(X64Emitter& e, const EmitArgType& i) {
+    Xmm src1 = GetShiftSource(e, i);
+    // vprolvd uses the counts modulo 32 by itself.
+    if (i.src2.is_constant) {
+      e.LoadConstantXmm(e.xmm0, i.src2.constant());
+      e.vprolvd(i.dest, src1, e.xmm0);
+    } else {
+      e.vprolvd(i.dest, src1, i.src2);
+    }
+  }
+
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (IsAVX512VectorShiftEnabled(e)) {
+      switch (i.instr->flags) {
+        case INT8_TYPE:
+          EmitAVX512Int8(e, i);
+          return;
+        case INT16_TYPE:
+          EmitAVX512Int16(e, i);
+          return;
+        case INT32_TYPE:
+          EmitAVX512Int32(e, i);
+          return;
+      }
+    }
     switch (i.instr->flags) {
       case INT8_TYPE:
         // TODO(benvanik): native version (with shift magic).
@@ -1498,7 +1664,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostImageAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -1688,6 +1854,27 @@ struct PERMUTE_V128
         e.vpcmpgtb(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMPermuteControl15));
         e.vpandn(i.dest, e.xmm0, i.dest);
       }
+    } else if (e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512VBMI)) {
+      // vpermi2b selects between src2 and src3 with bit 4 of the indices and
+      // ignores the higher bits, so only the byte order needs to be fixed up.
+      if (i.src1.is_constant) {
+        e.LoadConstantXmm(e.xmm0, i.src1.constant());
+        e.vxorps(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMSwapWordMask));
+      } else {
+        e.vxorps(e.xmm0, i.src1, e.GetXmmConstPtr(XMMSwapWordMask));
+      }
+      Xmm src2 = i.src2;
+      if (i.src2.is_constant) {
+        src2 = e.xmm1;
+        e.LoadConstantXmm(src2, i.src2.constant());
+      }
+      Xmm src3 = i.src3;
+      if (i.src3.is_constant) {
+        src3 = e.xmm2;
+        e.LoadConstantXmm(src3, i.src3.constant());
+      }
+      e.vpermi2b(e.xmm0, src2, src3);
+      e.vmovdqa(i.dest, e.xmm0);
     } else {
       // General permute.
       // Control mask needs to be shuffled.
@@ -2072,7 +2259,20 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
-        if (IsPackOutSaturate(flags)) {
+        if (IsPackOutSaturate(flags) &&
+            e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW)) {
+          // unsigned -> unsigned + saturate
+          // VPMOVUSWB / SaturateUnsignedWordToUnsignedByte
+          e.vpmovuswb(e.xmm0, i.src1);
+          if (i.src2.is_constant) {
+            e.LoadConstantXmm(e.xmm1, i.src2.constant());
+            e.vpmovuswb(e.xmm1, e.xmm1);
+          } else {
+            e.vpmovuswb(e.xmm1, i.src2);
+          }
+          e.vpunpcklqdq(i.dest, e.xmm0, e.xmm1);
+          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+        } else if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
           if (i.src2.is_constant) {
             e.lea(e.GetNativeParam(1),
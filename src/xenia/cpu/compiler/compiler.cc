@@ -9,6 +9,9 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include <algorithm>
+
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
@@ -33,6 +36,16 @@ bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
     scratch_arena_.Reset();
+    if (pass_stats_enabled_) {
+      PassRun run;
+      BeginPassRun(builder, &run);
+      bool result = pass->Run(builder);
+      EndPassRun(pass.get(), builder, run);
+      if (!result) {
+        return false;
+      }
+      continue;
+    }
     if (!pass->Run(builder)) {
       return false;
     }
@@ -41,6 +54,41 @@ bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
   return true;
 }
 
+void Compiler::BeginPassRun(hir::HIRBuilder* builder, PassRun* run) {
+  run->instr_count = CountInstrs(builder);
+  run->builder_arena_size = builder->arena()->CalculateSize();
+  run->start_tick = Clock::QueryHostTickCount();
+}
+
+void Compiler::EndPassRun(const CompilerPass* pass, hir::HIRBuilder* builder,
+                          const PassRun& run) {
+  uint64_t ticks = Clock::QueryHostTickCount() - run.start_tick;
+  PassStats& stats = pass_stats_[pass->name()];
+  ++stats.run_count;
+  stats.ticks += ticks;
+  stats.instr_in_count += run.instr_count;
+  stats.instr_out_count += CountInstrs(builder);
+  // The builder arena may be rewound, but the scratch arena is only reset
+  // before the runs.
+  size_t builder_arena_size = builder->arena()->CalculateSize();
+  stats.allocated_bytes +=
+      std::max(builder_arena_size, run.builder_arena_size) -
+      run.builder_arena_size + scratch_arena_.CalculateSize();
+}
+
+uint32_t Compiler::CountInstrs(hir::HIRBuilder* builder) {
+  uint32_t count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      if (instr->opcode != &hir::OPCODE_COMMENT_info &&
+          instr->opcode != &hir::OPCODE_SOURCE_OFFSET_info) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
 }  // namespace compiler
 }  // namespace cpu
 }  // namespace xe
@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_COMPILER_COMPILER_H_
 #define XENIA_CPU_COMPILER_COMPILER_H_
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "xenia/base/arena.h"
@@ -42,10 +44,45 @@ class Compiler {
 
   bool Compile(hir::HIRBuilder* builder);
 
+  // Totals of the runs of the passes with the same name, gathered only while
+  // enabled as the instructions have to be counted before and after each run.
+  // The runs of pass groups include the runs of the passes in them.
+  struct PassStats {
+    uint64_t run_count = 0;
+    uint64_t ticks = 0;
+    uint64_t instr_in_count = 0;
+    uint64_t instr_out_count = 0;
+    // Builder and scratch arena bytes.
+    uint64_t allocated_bytes = 0;
+  };
+  bool pass_stats_enabled() const { return pass_stats_enabled_; }
+  void set_pass_stats_enabled(bool enabled) { pass_stats_enabled_ = enabled; }
+  const std::map<std::string, PassStats>& pass_stats() const {
+    return pass_stats_;
+  }
+  void ResetPassStats() { pass_stats_.clear(); }
+
+  // Used around each run of a pass, including the ones in pass groups, when
+  // the stats are enabled.
+  struct PassRun {
+    uint64_t start_tick;
+    uint32_t instr_count;
+    size_t builder_arena_size;
+  };
+  void BeginPassRun(hir::HIRBuilder* builder, PassRun* run);
+  void EndPassRun(const CompilerPass* pass, hir::HIRBuilder* builder,
+                  const PassRun& run);
+
+  // Excluding comments and source offsets.
+  static uint32_t CountInstrs(hir::HIRBuilder* builder);
+
  private:
   Processor* processor_;
   Arena scratch_arena_;
 
+  bool pass_stats_enabled_ = false;
+  std::map<std::string, PassStats> pass_stats_;
+
   std::vector<std::unique_ptr<CompilerPass>> passes_;
 };
 
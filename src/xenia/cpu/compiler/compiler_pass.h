@@ -32,6 +32,9 @@ class CompilerPass {
 
   virtual bool Initialize(Compiler* compiler);
 
+  // For profiling.
+  virtual const char* name() const = 0;
+
   virtual bool Run(hir::HIRBuilder* builder) = 0;
 
  protected:
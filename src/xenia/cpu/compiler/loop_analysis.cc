@@ -0,0 +1,182 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+#include <algorithm>
+
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+
+bool LoopAnalysis::Analyze(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  blocks_.clear();
+  loops_.clear();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    if (blocks_.size() >= UINT16_MAX) {
+      blocks_.clear();
+      return false;
+    }
+    block->ordinal = uint16_t(blocks_.size());
+    blocks_.push_back(block);
+  }
+  auto block_count = uint32_t(blocks_.size());
+  if (!block_count) {
+    return true;
+  }
+
+  // The CFG edges don't include branches in the middle of blocks.
+  std::vector<Block*> successor_blocks;
+  successors_.resize(block_count);
+  predecessors_.resize(block_count);
+  for (auto& predecessors : predecessors_) {
+    predecessors.clear();
+  }
+  for (uint32_t n = 0; n < block_count; ++n) {
+    HIRBuilder::GetSuccessors(blocks_[n], successor_blocks);
+    auto& successors = successors_[n];
+    successors.clear();
+    for (Block* successor : successor_blocks) {
+      if (successor &&
+          std::find(successors.begin(), successors.end(),
+                    successor->ordinal) == successors.end()) {
+        successors.push_back(successor->ordinal);
+        predecessors_[successor->ordinal].push_back(uint16_t(n));
+      }
+    }
+  }
+
+  ComputeDominators();
+
+  // An edge to a block dominating the source is a back-edge, and the loop
+  // consists of all the blocks reaching it without passing the header.
+  std::vector<uint16_t> worklist;
+  for (uint32_t n = 0; n < block_count; ++n) {
+    if (!reachable_.test(n)) {
+      continue;
+    }
+    for (uint16_t header : successors_[n]) {
+      if (!dominators_[n].test(header)) {
+        continue;
+      }
+      auto loop_it = std::find_if(
+          loops_.begin(), loops_.end(),
+          [&](const Loop& loop) { return loop.header->ordinal == header; });
+      if (loop_it == loops_.end()) {
+        Loop loop;
+        loop.header = blocks_[header];
+        loop.preheader = nullptr;
+        loop.blocks.resize(block_count);
+        loop.blocks.set(header);
+        loop.block_count = 1;
+        loops_.push_back(std::move(loop));
+        loop_it = loops_.end() - 1;
+      }
+      Loop& loop = *loop_it;
+      worklist.clear();
+      if (!loop.blocks.test(n)) {
+        loop.blocks.set(n);
+        ++loop.block_count;
+        worklist.push_back(uint16_t(n));
+      }
+      while (!worklist.empty()) {
+        uint16_t block_ordinal = worklist.back();
+        worklist.pop_back();
+        for (uint16_t predecessor : predecessors_[block_ordinal]) {
+          if (reachable_.test(predecessor) && !loop.blocks.test(predecessor)) {
+            loop.blocks.set(predecessor);
+            ++loop.block_count;
+            worklist.push_back(predecessor);
+          }
+        }
+      }
+    }
+  }
+
+  for (Loop& loop : loops_) {
+    for (uint16_t predecessor : predecessors_[loop.header->ordinal]) {
+      if (loop.blocks.test(predecessor)) {
+        continue;
+      }
+      if (loop.preheader) {
+        loop.preheader = nullptr;
+        break;
+      }
+      loop.preheader = blocks_[predecessor];
+    }
+  }
+
+  // Nested loops are smaller than the loops containing them.
+  std::stable_sort(loops_.begin(), loops_.end(),
+                   [](const Loop& a, const Loop& b) {
+                     return a.block_count < b.block_count;
+                   });
+  return true;
+}
+
+void LoopAnalysis::ComputeDominators() {
+  auto block_count = uint32_t(blocks_.size());
+
+  reachable_.resize(block_count);
+  reachable_.reset();
+  std::vector<uint16_t> worklist;
+  reachable_.set(0);
+  worklist.push_back(0);
+  while (!worklist.empty()) {
+    uint16_t block_ordinal = worklist.back();
+    worklist.pop_back();
+    for (uint16_t successor : successors_[block_ordinal]) {
+      if (!reachable_.test(successor)) {
+        reachable_.set(successor);
+        worklist.push_back(successor);
+      }
+    }
+  }
+
+  // Iterative data flow, in block order which is close to reverse postorder.
+  dominators_.resize(block_count);
+  for (uint32_t n = 0; n < block_count; ++n) {
+    dominators_[n].resize(block_count);
+    dominators_[n].set();
+  }
+  dominators_[0].reset();
+  dominators_[0].set(0);
+  llvm::BitVector dominators(block_count);
+  bool changed;
+  do {
+    changed = false;
+    for (uint32_t n = 1; n < block_count; ++n) {
+      if (!reachable_.test(n)) {
+        continue;
+      }
+      dominators.set();
+      for (uint16_t predecessor : predecessors_[n]) {
+        if (reachable_.test(predecessor)) {
+          dominators &= dominators_[predecessor];
+        }
+      }
+      dominators.set(n);
+      if (dominators != dominators_[n]) {
+        dominators_[n] = dominators;
+        changed = true;
+      }
+    }
+  } while (changed);
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
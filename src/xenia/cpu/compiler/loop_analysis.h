@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
+#define XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/hir/hir_builder.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Finds the natural loops of a function from the dominators of its blocks.
+// The block ordinals are reassigned, and the results are invalidated by any
+// change to the control flow.
+class LoopAnalysis {
+ public:
+  struct Loop {
+    hir::Block* header;
+    // The only block outside the loop branching to the header, or null if
+    // there are multiple.
+    hir::Block* preheader;
+    // Indexed by block ordinal.
+    llvm::BitVector blocks;
+    uint32_t block_count;
+
+    bool Contains(const hir::Block* block) const {
+      return blocks.test(block->ordinal);
+    }
+  };
+
+  // Loops with the same header are merged. Returns false if the function is
+  // too large to be analyzed.
+  bool Analyze(hir::HIRBuilder* builder);
+
+  // Innermost loops first.
+  const std::vector<Loop>& loops() const { return loops_; }
+  // Blocks in order, indexed by ordinal.
+  const std::vector<hir::Block*>& blocks() const { return blocks_; }
+  // Whether all paths from the entry to the block pass through the dominator
+  // (always true for unreachable blocks).
+  bool Dominates(const hir::Block* dominator, const hir::Block* block) const {
+    return dominators_[block->ordinal].test(dominator->ordinal);
+  }
+
+ private:
+  void ComputeDominators();
+
+  std::vector<hir::Block*> blocks_;
+  std::vector<std::vector<uint16_t>> successors_;
+  std::vector<std::vector<uint16_t>> predecessors_;
+  llvm::BitVector reachable_;
+  std::vector<llvm::BitVector> dominators_;
+  std::vector<Loop> loops_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
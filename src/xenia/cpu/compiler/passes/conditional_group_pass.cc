@@ -56,17 +56,24 @@ bool ConditionalGroupPass::Run(HIRBuilder* builder) {
       scratch_arena()->Reset();
       auto& pass = passes_[i];
       auto subpass = dynamic_cast<ConditionalGroupSubpass*>(pass.get());
+      Compiler::PassRun run;
+      if (compiler_->pass_stats_enabled()) {
+        compiler_->BeginPassRun(builder, &run);
+      }
+      bool succeeded;
       if (!subpass) {
-        if (!pass->Run(builder)) {
-          return false;
-        }
+        succeeded = pass->Run(builder);
       } else {
         bool result = false;
-        if (!subpass->Run(builder, result)) {
-          return false;
-        }
+        succeeded = subpass->Run(builder, result);
         dirty |= result;
       }
+      if (compiler_->pass_stats_enabled()) {
+        compiler_->EndPassRun(pass.get(), builder, run);
+      }
+      if (!succeeded) {
+        return false;
+      }
     }
     loops++;
   } while (dirty);
@@ -26,6 +26,7 @@ class ConditionalGroupPass : public CompilerPass {
  public:
   ConditionalGroupPass();
   virtual ~ConditionalGroupPass() override;
+  const char* name() const override { return "ConditionalGroupPass"; }
 
   bool Initialize(Compiler* compiler) override;
 
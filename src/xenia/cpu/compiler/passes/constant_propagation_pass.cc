@@ -19,6 +19,11 @@
 
 DEFINE_bool(inline_mmio_access, true, "Inline constant MMIO loads and stores.",
             "CPU");
+DEFINE_bool(fold_read_only_loads, true,
+            "Replace loads from constant addresses in the code and read-only "
+            "data sections of the modules with the loaded values, allowing "
+            "calls through constant function tables to be made direct.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -228,9 +233,16 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
               i->src2.offset = address;
               result = true;
             } else {
+              // Only the read-only sections of the modules are known to never
+              // change, other read-only pages may be made writable and
+              // modified later. The protection is still checked in case the
+              // title has done that to its own sections before this.
               auto heap = memory->LookupHeap(address);
               uint32_t protect;
-              if (heap && heap->QueryProtect(address, &protect) &&
+              if (cvars::fold_read_only_loads &&
+                  processor_->IsReadOnlyModuleRange(
+                      address, uint32_t(GetTypeSize(v->type))) &&
+                  heap && heap->QueryProtect(address, &protect) &&
                   !(protect & kMemoryProtectWrite) &&
                   (protect & kMemoryProtectRead)) {
                 // Memory is readonly - can just return the value.
@@ -21,6 +21,7 @@ class ConstantPropagationPass : public ConditionalGroupSubpass {
  public:
   ConstantPropagationPass();
   ~ConstantPropagationPass() override;
+  const char* name() const override { return "ConstantPropagationPass"; }
 
   bool Run(hir::HIRBuilder* builder, bool& result) override;
 
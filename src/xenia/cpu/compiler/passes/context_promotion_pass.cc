@@ -67,10 +67,35 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // instead as it may be faster (at least on the block-level).
 
   // Promote loads to values.
-  // Process each block independently, for now.
+  // Blocks only entered from the previous block continue with its values,
+  // which are then live across the blocks. Others start from scratch.
+  uint16_t block_ordinal = 0;
   auto block = builder->first_block();
   while (block) {
-    PromoteBlock(block);
+    block->ordinal = block_ordinal++;
+    block = block->next;
+  }
+  predecessor_counts_.assign(block_ordinal, 0);
+  entered_from_previous_.assign(block_ordinal, false);
+  std::vector<Block*> successors;
+  block = builder->first_block();
+  while (block) {
+    HIRBuilder::GetSuccessors(block, successors);
+    for (Block* successor : successors) {
+      if (!successor) {
+        continue;
+      }
+      ++predecessor_counts_[successor->ordinal];
+      if (successor->prev == block) {
+        entered_from_previous_[successor->ordinal] = true;
+      }
+    }
+    block = block->next;
+  }
+  block = builder->first_block();
+  while (block) {
+    PromoteBlock(block, predecessor_counts_[block->ordinal] == 1 &&
+                            entered_from_previous_[block->ordinal]);
     block = block->next;
   }
 
@@ -88,14 +113,18 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   return true;
 }
 
-void ContextPromotionPass::PromoteBlock(Block* block) {
+void ContextPromotionPass::PromoteBlock(Block* block, bool continue_previous) {
   auto& validity = context_validity_;
-  validity.reset();
+  if (!continue_previous) {
+    validity.reset();
+  }
 
   Instr* i = block->instr_head;
   while (i) {
     auto next = i->next;
-    if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
+    if ((i->opcode->flags & OPCODE_FLAG_VOLATILE) &&
+        i->opcode != &OPCODE_BRANCH_TRUE_info &&
+        i->opcode != &OPCODE_BRANCH_FALSE_info) {
       // Volatile instruction - requires all context values be flushed.
       validity.reset();
     } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
@@ -35,18 +35,24 @@ class ContextPromotionPass : public CompilerPass {
  public:
   ContextPromotionPass();
   virtual ~ContextPromotionPass() override;
+  const char* name() const override { return "ContextPromotionPass"; }
 
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
-  void PromoteBlock(hir::Block* block);
+  // Starts with the context values of the end of the previous block if
+  // continue_previous is set.
+  void PromoteBlock(hir::Block* block, bool continue_previous);
   void RemoveDeadStoresBlock(hir::Block* block);
 
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+  // Indexed by block ordinal.
+  std::vector<uint32_t> predecessor_counts_;
+  std::vector<bool> entered_from_previous_;
 };
 
 }  // namespace passes
@@ -21,6 +21,7 @@ class ControlFlowAnalysisPass : public CompilerPass {
  public:
   ControlFlowAnalysisPass();
   ~ControlFlowAnalysisPass() override;
+  const char* name() const override { return "ControlFlowAnalysisPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
@@ -21,6 +21,7 @@ class ControlFlowSimplificationPass : public CompilerPass {
  public:
   ControlFlowSimplificationPass();
   ~ControlFlowSimplificationPass() override;
+  const char* name() const override { return "ControlFlowSimplificationPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
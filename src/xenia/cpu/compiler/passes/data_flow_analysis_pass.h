@@ -21,6 +21,7 @@ class DataFlowAnalysisPass : public CompilerPass {
  public:
   DataFlowAnalysisPass();
   ~DataFlowAnalysisPass() override;
+  const char* name() const override { return "DataFlowAnalysisPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
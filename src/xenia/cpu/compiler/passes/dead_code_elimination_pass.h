@@ -21,6 +21,7 @@ class DeadCodeEliminationPass : public CompilerPass {
  public:
   DeadCodeEliminationPass();
   ~DeadCodeEliminationPass() override;
+  const char* name() const override { return "DeadCodeEliminationPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
@@ -0,0 +1,155 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+DECLARE_bool(debug);
+DECLARE_bool(store_all_context_values);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+// Successor index standing for leaving the function, with all context live.
+static const uint16_t kExitSuccessor = UINT16_MAX;
+
+DeadStoreEliminationPass::DeadStoreEliminationPass() : CompilerPass() {}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {}
+
+bool DeadStoreEliminationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  // Same as ContextPromotionPass, the stores are needed to inspect the
+  // registers when debugging.
+  if (cvars::debug || cvars::store_all_context_values) {
+    return true;
+  }
+
+  blocks_.clear();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    if (blocks_.size() >= kExitSuccessor) {
+      // Not worth it for this many blocks.
+      return true;
+    }
+    block->ordinal = uint16_t(blocks_.size());
+    blocks_.push_back(block);
+  }
+
+  // Gather the successors from the branches directly, as the edges may be
+  // stale after the control flow simplification.
+  std::vector<Block*> successor_blocks;
+  successors_.resize(blocks_.size());
+  for (size_t n = 0; n < blocks_.size(); ++n) {
+    HIRBuilder::GetSuccessors(blocks_[n], successor_blocks);
+    auto& successors = successors_[n];
+    successors.clear();
+    for (Block* successor : successor_blocks) {
+      successors.push_back(successor ? successor->ordinal : kExitSuccessor);
+    }
+  }
+
+  // Backward data flow until the live context bytes at the start of each
+  // block stop changing.
+  const size_t context_size = sizeof(ppc::PPCContext);
+  live_in_.resize(blocks_.size());
+  for (auto& live_in : live_in_) {
+    live_in.resize(context_size);
+    live_in.reset();
+  }
+  llvm::BitVector live(context_size);
+  bool changed;
+  do {
+    changed = false;
+    for (size_t n = blocks_.size(); n-- > 0;) {
+      live.reset();
+      for (uint16_t successor : successors_[n]) {
+        if (successor == kExitSuccessor) {
+          live.set();
+          break;
+        }
+        live |= live_in_[successor];
+      }
+      ProcessBlock(blocks_[n], live, false);
+      if (live != live_in_[n]) {
+        live_in_[n] = live;
+        changed = true;
+      }
+    }
+  } while (changed);
+
+  // Remove the stores not live on any path.
+  for (size_t n = 0; n < blocks_.size(); ++n) {
+    live.reset();
+    for (uint16_t successor : successors_[n]) {
+      if (successor == kExitSuccessor) {
+        live.set();
+        break;
+      }
+      live |= live_in_[successor];
+    }
+    ProcessBlock(blocks_[n], live, true);
+  }
+
+  return true;
+}
+
+void DeadStoreEliminationPass::ProcessBlock(Block* block,
+                                            llvm::BitVector& live,
+                                            bool remove_stores) {
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      size_t offset = i->src1.offset;
+      live.set(unsigned(offset), unsigned(offset + GetTypeSize(i->dest->type)));
+    } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+      unsigned begin = unsigned(i->src1.offset);
+      unsigned end = unsigned(begin + GetTypeSize(i->src2.value->type));
+      bool is_live = false;
+      for (unsigned offset = begin; offset < end; ++offset) {
+        if (live.test(offset)) {
+          is_live = true;
+          break;
+        }
+      }
+      live.reset(begin, end);
+      if (!is_live && remove_stores) {
+        i->Remove();
+      }
+    } else if (i->opcode == &OPCODE_CONTEXT_BARRIER_info ||
+               ((i->opcode->flags &
+                 (OPCODE_FLAG_BRANCH | OPCODE_FLAG_VOLATILE)) &&
+                i->opcode != &OPCODE_BRANCH_info &&
+                i->opcode != &OPCODE_BRANCH_TRUE_info &&
+                i->opcode != &OPCODE_BRANCH_FALSE_info)) {
+      // Calls, returns, traps and such may read anything from the context.
+      live.set();
+    }
+    i = prev;
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,61 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Removes context stores overwritten on all paths before being read, across
+// blocks - ContextPromotionPass only handles stores overwritten in the same
+// block. Context liveness is tracked per byte, and everything is live at
+// volatile instructions (calls, traps) and function exits.
+class DeadStoreEliminationPass : public CompilerPass {
+ public:
+  DeadStoreEliminationPass();
+  ~DeadStoreEliminationPass() override;
+  const char* name() const override { return "DeadStoreEliminationPass"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  // Walks the block backwards from the context bytes live after it, leaving
+  // the bytes live before it, and removes the dead stores if requested.
+  void ProcessBlock(hir::Block* block, llvm::BitVector& live,
+                    bool remove_stores);
+
+  std::vector<hir::Block*> blocks_;
+  std::vector<std::vector<uint16_t>> successors_;
+  std::vector<llvm::BitVector> live_in_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
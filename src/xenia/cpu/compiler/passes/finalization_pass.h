@@ -21,6 +21,7 @@ class FinalizationPass : public CompilerPass {
  public:
   FinalizationPass();
   ~FinalizationPass() override;
+  const char* name() const override { return "FinalizationPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
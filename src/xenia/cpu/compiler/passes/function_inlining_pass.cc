@@ -0,0 +1,200 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/function_inlining_pass.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+DEFINE_int32(inline_max_guest_instructions, 20,
+             "Maximum number of instructions of a guest leaf function inlined "
+             "into its callers (20 covers all the register save helpers). 0 "
+             "to disable inlining.",
+             "CPU");
+DEFINE_int32(inline_budget_instructions, 512,
+             "Maximum number of HIR instructions inlined into a single "
+             "function.",
+             "CPU");
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+FunctionInliningPass::FunctionInliningPass(EmitCalleeFunction emit_callee)
+    : CompilerPass(), emit_callee_(std::move(emit_callee)) {}
+
+FunctionInliningPass::~FunctionInliningPass() {}
+
+bool FunctionInliningPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  inlined_functions_.clear();
+  if (cvars::inline_max_guest_instructions <= 0) {
+    return true;
+  }
+  uint32_t max_guest_size =
+      uint32_t(cvars::inline_max_guest_instructions - 1) * 4;
+  int32_t budget = cvars::inline_budget_instructions;
+
+  auto block = builder->first_block();
+  while (block) {
+    Instr* i = block->instr_head;
+    while (i) {
+      Instr* next = i->next;
+      // Only plain calls - with a tail call, the return of the callee would
+      // leave the caller. The register save and restore helpers are fine.
+      if (i->opcode != &OPCODE_CALL_info || (i->flags & CALL_TAIL) ||
+          !i->src1.symbol->is_guest()) {
+        i = next;
+        continue;
+      }
+      auto behavior = i->src1.symbol->behavior();
+      if (behavior != Function::Behavior::kDefault &&
+          behavior != Function::Behavior::kProlog &&
+          behavior != Function::Behavior::kEpilog) {
+        i = next;
+        continue;
+      }
+      auto function = static_cast<GuestFunction*>(i->src1.symbol);
+      HIRBuilder* callee_builder = emit_callee_(function, max_guest_size);
+      uint32_t instr_count;
+      if (callee_builder && CanInline(callee_builder, &instr_count) &&
+          int32_t(instr_count) <= budget) {
+        budget -= int32_t(instr_count);
+        Inline(builder, i, callee_builder);
+        if (std::find(inlined_functions_.begin(), inlined_functions_.end(),
+                      function) == inlined_functions_.end()) {
+          inlined_functions_.push_back(function);
+        }
+      }
+      i = next;
+    }
+    block = block->next;
+  }
+
+  return true;
+}
+
+bool FunctionInliningPass::CanInline(HIRBuilder* callee_builder,
+                                     uint32_t* instr_count_out) {
+  // Only a single block ending with the return, without locals.
+  Block* block = callee_builder->first_block();
+  if (!block || block->next || !block->instr_tail ||
+      !callee_builder->locals().empty()) {
+    return false;
+  }
+  Instr* return_instr = block->instr_tail;
+  if (return_instr->opcode != &OPCODE_CALL_INDIRECT_info ||
+      (return_instr->flags & (CALL_TAIL | CALL_POSSIBLE_RETURN)) !=
+          (CALL_TAIL | CALL_POSSIBLE_RETURN)) {
+    return false;
+  }
+
+  uint32_t instr_count = 0;
+  for (Instr* i = block->instr_head; i != return_instr; i = i->next) {
+    if (i->opcode == &OPCODE_COMMENT_info ||
+        i->opcode == &OPCODE_SOURCE_OFFSET_info) {
+      continue;
+    }
+    // Any other control flow, including calls, makes it not a leaf.
+    if (i->opcode->flags & OPCODE_FLAG_BRANCH) {
+      return false;
+    }
+    uint32_t signature = i->opcode->signature;
+    OpcodeSignatureType sig_types[] = {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                       GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                       GET_OPCODE_SIG_TYPE_SRC3(signature)};
+    for (OpcodeSignatureType sig_type : sig_types) {
+      if (sig_type == OPCODE_SIG_TYPE_L || sig_type == OPCODE_SIG_TYPE_S) {
+        return false;
+      }
+    }
+    // The return address must be the one the caller has set, so after the
+    // inlined code execution simply continues after the call.
+    if (i->opcode == &OPCODE_STORE_CONTEXT_info &&
+        i->src1.offset == offsetof(ppc::PPCContext, lr)) {
+      return false;
+    }
+    ++instr_count;
+  }
+  *instr_count_out = instr_count;
+  return true;
+}
+
+Value* FunctionInliningPass::MapValue(HIRBuilder* builder,
+                                      Value* callee_value) {
+  auto it = value_map_.find(callee_value);
+  if (it != value_map_.end()) {
+    return it->second;
+  }
+  // Constants are not defined by instructions.
+  Value* value = builder->CloneValue(callee_value);
+  value_map_.emplace(callee_value, value);
+  return value;
+}
+
+void FunctionInliningPass::Inline(HIRBuilder* builder, Instr* call_instr,
+                                  HIRBuilder* callee_builder) {
+  value_map_.clear();
+  Block* callee_block = callee_builder->first_block();
+  for (Instr* i = callee_block->instr_head; i != callee_block->instr_tail;
+       i = i->next) {
+    // Keep the source offset of the call site for the inlined code, the
+    // source map of the caller can't describe other functions.
+    if (i->opcode == &OPCODE_COMMENT_info ||
+        i->opcode == &OPCODE_SOURCE_OFFSET_info) {
+      continue;
+    }
+    Value* dest = i->dest ? MapValue(builder, i->dest) : nullptr;
+    Instr* new_instr = builder->InsertInstr(call_instr, *i->opcode, i->flags);
+    if (dest) {
+      new_instr->dest = dest;
+      dest->def = new_instr;
+    }
+    uint32_t signature = i->opcode->signature;
+    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+      new_instr->set_src1(MapValue(builder, i->src1.value));
+    } else {
+      new_instr->src1.offset = i->src1.offset;
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+      new_instr->set_src2(MapValue(builder, i->src2.value));
+    } else {
+      new_instr->src2.offset = i->src2.offset;
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+      new_instr->set_src3(MapValue(builder, i->src3.value));
+    } else {
+      new_instr->src3.offset = i->src3.offset;
+    }
+  }
+  // The branch to the next block added by the builder for the call remains.
+  call_instr->Remove();
+  value_map_.clear();
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,74 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_FUNCTION_INLINING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_FUNCTION_INLINING_PASS_H_
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+class GuestFunction;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Replaces calls to small straight-line leaf functions with a copy of their
+// HIR, so the following passes can see through the former call boundary.
+// Must run before control flow analysis, as the call instructions are removed.
+class FunctionInliningPass : public CompilerPass {
+ public:
+  // Builds the unoptimized HIR of a callee, or returns null if it must not be
+  // inlined or its guest code is longer than max_guest_size bytes. The extent
+  // of the callee must be found the same way whether or not it has been
+  // translated itself, so the inlining decisions are deterministic. The
+  // builder is owned by the frontend and only needs to be valid until the next
+  // call.
+  using EmitCalleeFunction = std::function<hir::HIRBuilder*(
+      GuestFunction* function, uint32_t max_guest_size)>;
+
+  explicit FunctionInliningPass(EmitCalleeFunction emit_callee);
+  ~FunctionInliningPass() override;
+  const char* name() const override { return "FunctionInliningPass"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+  // Functions inlined by the last run, their code modifications must
+  // invalidate the caller too.
+  const std::vector<GuestFunction*>& inlined_functions() const {
+    return inlined_functions_;
+  }
+
+ private:
+  // Returns false if the callee HIR can't be inlined.
+  bool CanInline(hir::HIRBuilder* callee_builder, uint32_t* instr_count_out);
+  void Inline(hir::HIRBuilder* builder, hir::Instr* call_instr,
+              hir::HIRBuilder* callee_builder);
+  hir::Value* MapValue(hir::HIRBuilder* builder, hir::Value* callee_value);
+
+  EmitCalleeFunction emit_callee_;
+  std::vector<GuestFunction*> inlined_functions_;
+  // Callee values to their copies in the caller.
+  std::unordered_map<hir::Value*, hir::Value*> value_map_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_FUNCTION_INLINING_PASS_H_
@@ -0,0 +1,192 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/loop_invariant_code_motion_pass.h"
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+
+DEFINE_bool(loop_invariant_code_motion, true,
+            "Move computations repeated in every iteration of guest loops out "
+            "of the loops.",
+            "CPU");
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+LoopInvariantCodeMotionPass::LoopInvariantCodeMotionPass() : CompilerPass() {}
+
+LoopInvariantCodeMotionPass::~LoopInvariantCodeMotionPass() {}
+
+bool LoopInvariantCodeMotionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  if (!cvars::loop_invariant_code_motion ||
+      !loop_analysis_.Analyze(builder)) {
+    return true;
+  }
+
+  // Inner loops first, so the values hoisted into an outer loop may be
+  // hoisted again out of it.
+  const auto& blocks = loop_analysis_.blocks();
+  for (const LoopAnalysis::Loop& loop : loop_analysis_.loops()) {
+    if (!CanOptimizeLoop(loop)) {
+      continue;
+    }
+    Instr* insertion_point = GetInsertionPoint(loop);
+    bool changed;
+    do {
+      changed = false;
+      for (Block* block : blocks) {
+        if (!loop.Contains(block)) {
+          continue;
+        }
+        Instr* i = block->instr_head;
+        while (i) {
+          Instr* next = i->next;
+          if (IsInvariant(loop, i)) {
+            if (insertion_point) {
+              i->MoveBefore(insertion_point);
+            } else {
+              i->MoveToEnd(loop.preheader);
+            }
+            changed = true;
+          }
+          i = next;
+        }
+      }
+    } while (changed);
+  }
+
+  return true;
+}
+
+bool LoopInvariantCodeMotionPass::CanOptimizeLoop(
+    const LoopAnalysis::Loop& loop) {
+  if (!loop.preheader) {
+    return false;
+  }
+  // The hoisted instructions must be executed on all paths from the
+  // preheader to the header.
+  Instr* insertion_point = GetInsertionPoint(loop);
+  for (Instr* i = loop.preheader->instr_head; i != insertion_point;
+       i = i->next) {
+    if ((i->opcode == &OPCODE_BRANCH_info &&
+         i->src1.label->block == loop.header) ||
+        ((i->opcode == &OPCODE_BRANCH_TRUE_info ||
+          i->opcode == &OPCODE_BRANCH_FALSE_info) &&
+         i->src2.label->block == loop.header)) {
+      return false;
+    }
+  }
+  for (Block* block : loop_analysis_.blocks()) {
+    if (!loop.Contains(block)) {
+      continue;
+    }
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      // Calls may change the context, and the rounding mode affects the
+      // results of conversions.
+      if (((i->opcode->flags & OPCODE_FLAG_VOLATILE) &&
+           i->opcode != &OPCODE_BRANCH_TRUE_info &&
+           i->opcode != &OPCODE_BRANCH_FALSE_info) ||
+          i->opcode == &OPCODE_CONTEXT_BARRIER_info ||
+          i->opcode == &OPCODE_SET_ROUNDING_MODE_info) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool LoopInvariantCodeMotionPass::IsInvariant(const LoopAnalysis::Loop& loop,
+                                              const Instr* i) {
+  if (!i->dest ||
+      (i->opcode->flags &
+       (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE |
+        OPCODE_FLAG_PAIRED_PREV)) ||
+      (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV))) {
+    return false;
+  }
+  // Integer division may fault when executed speculatively.
+  if (i->opcode == &OPCODE_DIV_info || i->opcode == &OPCODE_LOAD_CLOCK_info) {
+    return false;
+  }
+
+  uint32_t signature = i->opcode->signature;
+  OpcodeSignatureType sig_types[] = {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC3(signature)};
+  const Instr::Op* srcs[] = {&i->src1, &i->src2, &i->src3};
+  for (size_t n = 0; n < 3; ++n) {
+    if (sig_types[n] == OPCODE_SIG_TYPE_L ||
+        sig_types[n] == OPCODE_SIG_TYPE_S) {
+      return false;
+    }
+    if (sig_types[n] != OPCODE_SIG_TYPE_V) {
+      continue;
+    }
+    const Value* value = srcs[n]->value;
+    if (!value->IsConstant() &&
+        (!value->def || loop.Contains(value->def->block))) {
+      return false;
+    }
+  }
+
+  if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+    // Invariant if no store in the loop overlaps it.
+    size_t begin = i->src1.offset;
+    size_t end = begin + GetTypeSize(i->dest->type);
+    for (Block* block : loop_analysis_.blocks()) {
+      if (!loop.Contains(block)) {
+        continue;
+      }
+      for (Instr* j = block->instr_head; j; j = j->next) {
+        if (j->opcode != &OPCODE_STORE_CONTEXT_info) {
+          continue;
+        }
+        size_t store_begin = j->src1.offset;
+        size_t store_end = store_begin + GetTypeSize(j->src2.value->type);
+        if (store_begin < end && begin < store_end) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+Instr* LoopInvariantCodeMotionPass::GetInsertionPoint(
+    const LoopAnalysis::Loop& loop) {
+  // Before the branches ending the preheader.
+  Instr* insertion_point = nullptr;
+  for (Instr* i = loop.preheader->instr_tail;
+       i && (i->opcode == &OPCODE_BRANCH_info ||
+             i->opcode == &OPCODE_BRANCH_TRUE_info ||
+             i->opcode == &OPCODE_BRANCH_FALSE_info);
+       i = i->prev) {
+    insertion_point = i;
+  }
+  return insertion_point;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
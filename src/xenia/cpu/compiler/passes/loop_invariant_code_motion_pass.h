@@ -0,0 +1,48 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Moves computations with the same result in every iteration of a loop, such
+// as address arithmetic and loads of context values not stored in the loop,
+// to the block entering the loop. Only loops without calls and with a single
+// entering block are handled, and no new blocks are created.
+class LoopInvariantCodeMotionPass : public CompilerPass {
+ public:
+  LoopInvariantCodeMotionPass();
+  ~LoopInvariantCodeMotionPass() override;
+  const char* name() const override { return "LoopInvariantCodeMotionPass"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  bool CanOptimizeLoop(const LoopAnalysis::Loop& loop);
+  bool IsInvariant(const LoopAnalysis::Loop& loop, const hir::Instr* i);
+  // Returns the instruction to hoist before, or null to append to the end of
+  // the preheader.
+  hir::Instr* GetInsertionPoint(const LoopAnalysis::Loop& loop);
+
+  LoopAnalysis loop_analysis_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
@@ -9,7 +9,10 @@
 
 #include "xenia/cpu/compiler/passes/memory_sequence_combination_pass.h"
 
+#include <cstddef>
+
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/ppc/ppc_context.h"
 
 namespace xe {
 namespace cpu {
@@ -19,6 +22,7 @@ namespace passes {
 // TODO(benvanik): remove when enums redefined.
 using namespace xe::cpu::hir;
 
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
@@ -46,6 +50,14 @@ bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
     }
     block = block->next;
   }
+
+  // With the swaps merged, a value spilled to the stack and reloaded becomes
+  // a store and a load with the same swap flag.
+  block = builder->first_block();
+  while (block) {
+    ForwardStackStores(block);
+    block = block->next;
+  }
   return true;
 }
 
@@ -150,6 +162,108 @@ void MemorySequenceCombinationPass::CombineStoreSequence(Instr* i) {
   // TODO(benvanik): extend/truncate.
 }
 
+// Gets the address as an offset from the stack pointer (r1). Other addresses
+// may be aliased by anything or be MMIO, so they're not considered.
+static bool GetStackAddress(Value* address, Value** root_out,
+                            int64_t* offset_out) {
+  int64_t offset = 0;
+  Instr* def = address->def;
+  while (def) {
+    if (def->opcode == &OPCODE_ASSIGN_info) {
+      def = def->src1.value->def;
+    } else if (def->opcode == &OPCODE_ADD_info &&
+               def->src2.value->IsConstant()) {
+      offset += def->src2.value->constant.i64;
+      def = def->src1.value->def;
+    } else {
+      break;
+    }
+  }
+  if (!def || def->opcode != &OPCODE_LOAD_CONTEXT_info ||
+      def->src1.offset != offsetof(ppc::PPCContext, r[1]) ||
+      def->dest->type != INT64_TYPE) {
+    return false;
+  }
+  *root_out = def->dest;
+  *offset_out = offset;
+  return true;
+}
+
+void MemorySequenceCombinationPass::ForwardStackStores(Block* block) {
+  // Stack round trip:
+  //   store_offset v0, 16, v1.i32, [swap]
+  //   ...
+  //   v2.i32 = load_offset v0, 16, [swap]
+  // becomes:
+  //   store_offset v0, 16, v1.i32, [swap]
+  //   ...
+  //   v2.i32 = assign v1.i32
+  stack_stores_.clear();
+  for (auto i = block->instr_head; i; i = i->next) {
+    bool is_load = i->opcode == &OPCODE_LOAD_info ||
+                   i->opcode == &OPCODE_LOAD_OFFSET_info;
+    bool is_store = i->opcode == &OPCODE_STORE_info ||
+                    i->opcode == &OPCODE_STORE_OFFSET_info;
+    if (!is_load && !is_store) {
+      if ((i->opcode->flags & (OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) &&
+          i->opcode != &OPCODE_BRANCH_TRUE_info &&
+          i->opcode != &OPCODE_BRANCH_FALSE_info) {
+        // Calls, barriers, dcbz and such.
+        stack_stores_.clear();
+      }
+      continue;
+    }
+
+    bool has_offset = i->opcode == &OPCODE_LOAD_OFFSET_info ||
+                      i->opcode == &OPCODE_STORE_OFFSET_info;
+    Value* root;
+    int64_t offset;
+    if ((has_offset && !i->src2.value->IsConstant()) ||
+        !GetStackAddress(i->src1.value, &root, &offset)) {
+      if (is_store) {
+        // May be anywhere, including the stack.
+        stack_stores_.clear();
+      }
+      continue;
+    }
+    if (has_offset) {
+      offset += i->src2.value->constant.i64;
+    }
+
+    if (is_load) {
+      for (const StackStore& store : stack_stores_) {
+        if (store.root == root && store.offset == offset &&
+            store.value->type == i->dest->type &&
+            store.flags == (i->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP)) {
+          i->Replace(&OPCODE_ASSIGN_info, 0);
+          i->set_src1(store.value);
+          break;
+        }
+      }
+      continue;
+    }
+
+    Value* value = has_offset ? i->src3.value : i->src2.value;
+    int64_t size = int64_t(GetTypeSize(value->type));
+    for (auto it = stack_stores_.begin(); it != stack_stores_.end();) {
+      if (it->root != root) {
+        // The same stack from another load of r1 - can't tell the offsets.
+        stack_stores_.clear();
+        break;
+      }
+      if (it->offset < offset + size &&
+          offset < it->offset + int64_t(GetTypeSize(it->value->type))) {
+        it = stack_stores_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    stack_stores_.push_back(
+        {root, offset, value,
+         uint16_t(i->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP)});
+  }
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
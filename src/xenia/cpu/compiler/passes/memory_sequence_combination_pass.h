@@ -10,6 +10,9 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_MEMORY_SEQUENCE_COMBINATION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_MEMORY_SEQUENCE_COMBINATION_PASS_H_
 
+#include <cstdint>
+#include <vector>
+
 #include "xenia/cpu/compiler/compiler_pass.h"
 
 namespace xe {
@@ -21,6 +24,7 @@ class MemorySequenceCombinationPass : public CompilerPass {
  public:
   MemorySequenceCombinationPass();
   ~MemorySequenceCombinationPass() override;
+  const char* name() const override { return "MemorySequenceCombinationPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
@@ -28,6 +32,16 @@ class MemorySequenceCombinationPass : public CompilerPass {
   void CombineMemorySequences(hir::HIRBuilder* builder);
   void CombineLoadSequence(hir::Instr* i);
   void CombineStoreSequence(hir::Instr* i);
+  void ForwardStackStores(hir::Block* block);
+
+  // A store to the stack with the value still in memory.
+  struct StackStore {
+    hir::Value* root;
+    int64_t offset;
+    hir::Value* value;
+    uint16_t flags;
+  };
+  std::vector<StackStore> stack_stores_;
 };
 
 }  // namespace passes
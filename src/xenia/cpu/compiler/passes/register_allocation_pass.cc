@@ -10,13 +10,20 @@
 #include "xenia/cpu/compiler/passes/register_allocation_pass.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
 
+DEFINE_bool(global_register_allocation, true,
+            "Keep values used across blocks in host registers instead of "
+            "spilling them to the stack at the block boundaries.",
+            "CPU");
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -35,6 +42,45 @@ using xe::cpu::hir::Value;
 
 #define ASSERT_NO_CYCLES 0
 
+namespace {
+// Registers of each set never given to values live across blocks, so the
+// per-block allocation can always make progress by spilling.
+constexpr uint32_t kLocalRegisterReserve = 4;
+
+std::atomic<uint64_t> spill_count_(0);
+std::atomic<uint64_t> reload_count_(0);
+std::atomic<uint64_t> global_value_count_(0);
+std::atomic<uint64_t> global_spilled_count_(0);
+
+// Guest calls don't preserve any of the allocatable host registers.
+bool IsClobber(const Instr* instr) {
+  return instr->opcode == &OPCODE_CALL_info ||
+         instr->opcode == &OPCODE_CALL_TRUE_info ||
+         instr->opcode == &OPCODE_CALL_INDIRECT_info ||
+         instr->opcode == &OPCODE_CALL_INDIRECT_TRUE_info ||
+         instr->opcode == &OPCODE_CALL_EXTERN_info;
+}
+
+void ReplaceSources(Instr* instr, Value* old_value, Value* new_value) {
+  uint32_t signature = instr->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+    if (instr->src1.value == old_value) {
+      instr->set_src1(new_value);
+    }
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+    if (instr->src2.value == old_value) {
+      instr->set_src2(new_value);
+    }
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+    if (instr->src3.value == old_value) {
+      instr->set_src3(new_value);
+    }
+  }
+}
+}  // namespace
+
 RegisterAllocationPass::RegisterAllocationPass(const MachineInfo* machine_info)
     : CompilerPass() {
   // Initialize register sets.
@@ -70,12 +116,31 @@ RegisterAllocationPass::~RegisterAllocationPass() {
   }
 }
 
+RegisterAllocationPass::Stats RegisterAllocationPass::QueryStats() {
+  Stats stats;
+  stats.spill_count = spill_count_;
+  stats.reload_count = reload_count_;
+  stats.global_value_count = global_value_count_;
+  stats.global_spilled_count = global_spilled_count_;
+  return stats;
+}
+
+void RegisterAllocationPass::ResetStats() {
+  spill_count_ = 0;
+  reload_count_ = 0;
+  global_value_count_ = 0;
+  global_spilled_count_ = 0;
+}
+
 bool RegisterAllocationPass::Run(HIRBuilder* builder) {
-  // Simple per-block allocator that operates on SSA form.
-  // Registers do not move across blocks, though this could be
-  // optimized with some intra-block analysis (dominators/etc).
+  // Values live across blocks (mostly context values promoted through
+  // fall-throughs) are allocated first over the whole function with a linear
+  // scan. Everything else is then allocated with a simple per-block allocator
+  // that operates on SSA form, working around the registers of the former.
   // Really, it'd just be nice to have someone who knew what they
   // were doing lower SSA and do this right.
+  NumberInstrs(builder);
+  AllocateGlobalValues(builder);
 
   uint16_t block_ordinal = 0;
   uint32_t instr_ordinal = 0;
@@ -96,6 +161,8 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
       instr = instr->next;
     }
 
+    PrepareBlockGlobalValues(block);
+
     instr = block->instr_head;
     while (instr) {
       const auto info = instr->opcode;
@@ -125,27 +192,31 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
         }
       }
 
-      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
-        // Must not have been set already.
-        assert_null(instr->dest->reg.set);
-
+      // Values live across blocks already have their registers.
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V &&
+          !instr->dest->reg.set) {
         // Sort the usage list. We depend on this in future uses of this
         // variable.
         SortUsageList(instr->dest);
 
+        // Must not take the registers of values live across blocks at any
+        // point of its lifetime.
+        auto excluded_regs = GetGlobalRegsOverlapping(instr->dest);
+
         // If we have a preferred register, use that.
         // This way we can help along the stupid X86 two opcode instructions.
         bool allocated;
         if (has_preferred_reg) {
           // Allocate with the given preferred register. If the register is in
           // the wrong set it will not be reused.
-          allocated = TryAllocateRegister(instr->dest, preferred_reg);
+          allocated =
+              TryAllocateRegister(instr->dest, preferred_reg, excluded_regs);
         } else {
           // Allocate a register. This will either reserve a free one or
           // spill and reuse an active one.
-          allocated = TryAllocateRegister(instr->dest);
+          allocated = TryAllocateRegister(instr->dest, excluded_regs);
         }
-        if (!allocated) {
+        while (!allocated) {
           // Failed to allocate register -- need to spill and try again.
           // We spill only those registers we aren't using.
           if (!SpillOneRegister(builder, block, instr->dest->type)) {
@@ -156,12 +227,7 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
           }
 
           // Demand allocation.
-          if (!TryAllocateRegister(instr->dest)) {
-            // Boned.
-            XELOGE("Register allocation failed");
-            assert_always();
-            return false;
-          }
+          allocated = TryAllocateRegister(instr->dest, excluded_regs);
         }
       }
 
@@ -173,6 +239,333 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
   return true;
 }
 
+void RegisterAllocationPass::NumberInstrs(HIRBuilder* builder) {
+  blocks_.clear();
+  block_start_ordinals_.clear();
+  block_end_ordinals_.clear();
+  clobber_ordinals_.clear();
+  uint32_t instr_ordinal = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block->ordinal = uint16_t(blocks_.size());
+    blocks_.push_back(block);
+    block_start_ordinals_.push_back(instr_ordinal);
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      instr->ordinal = instr_ordinal++;
+      if (IsClobber(instr)) {
+        clobber_ordinals_.push_back(instr->ordinal);
+      }
+    }
+    block_end_ordinals_.push_back(instr_ordinal);
+  }
+
+  // The CFG edges don't include branches in the middle of blocks.
+  std::vector<Block*> successor_blocks;
+  successors_.resize(blocks_.size());
+  for (size_t n = 0; n < blocks_.size(); ++n) {
+    HIRBuilder::GetSuccessors(blocks_[n], successor_blocks);
+    auto& successors = successors_[n];
+    successors.clear();
+    for (Block* successor : successor_blocks) {
+      // Nothing is live when leaving the function.
+      if (successor) {
+        successors.push_back(successor->ordinal);
+      }
+    }
+  }
+}
+
+void RegisterAllocationPass::ComputeGlobalLiveness() {
+  auto value_count = uint32_t(global_values_.size());
+  std::vector<llvm::BitVector> uses(blocks_.size(),
+                                    llvm::BitVector(value_count));
+  std::vector<llvm::BitVector> defs(blocks_.size(),
+                                    llvm::BitVector(value_count));
+  for (uint32_t n = 0; n < value_count; ++n) {
+    Value* value = global_values_[n].value;
+    Block* def_block = value->def->block;
+    defs[def_block->ordinal].set(n);
+    for (auto use = value->use_head; use; use = use->next) {
+      if (use->instr->block != def_block) {
+        uses[use->instr->block->ordinal].set(n);
+      }
+    }
+  }
+
+  // Backward data flow until nothing changes, loops make values live in all
+  // their blocks.
+  live_in_.assign(blocks_.size(), llvm::BitVector(value_count));
+  live_out_.assign(blocks_.size(), llvm::BitVector(value_count));
+  llvm::BitVector live(value_count);
+  bool changed;
+  do {
+    changed = false;
+    for (size_t n = blocks_.size(); n-- > 0;) {
+      live.reset();
+      for (uint16_t successor : successors_[n]) {
+        live |= live_in_[successor];
+      }
+      live_out_[n] = live;
+      live.reset(defs[n]);
+      live |= uses[n];
+      if (live != live_in_[n]) {
+        live_in_[n] = live;
+        changed = true;
+      }
+    }
+  } while (changed);
+}
+
+bool RegisterAllocationPass::GetBlockLiveRange(uint32_t global_index,
+                                               uint16_t block_ordinal,
+                                               uint32_t* start_out,
+                                               uint32_t* end_out) {
+  uint32_t block_start = block_start_ordinals_[block_ordinal];
+  uint32_t block_end = block_end_ordinals_[block_ordinal];
+  if (block_start == block_end) {
+    return false;
+  }
+  Value* value = global_values_[global_index].value;
+  uint32_t start;
+  if (live_in_[block_ordinal].test(global_index)) {
+    start = block_start;
+  } else if (value->def->block->ordinal == block_ordinal) {
+    start = value->def->ordinal;
+  } else {
+    return false;
+  }
+  uint32_t end;
+  if (live_out_[block_ordinal].test(global_index)) {
+    // Past the tail, so calls ending the block are crossed.
+    end = block_end;
+  } else {
+    end = start;
+    for (auto use = value->use_head; use; use = use->next) {
+      if (use->instr->block->ordinal == block_ordinal) {
+        end = std::max(end, use->instr->ordinal);
+      }
+    }
+  }
+  *start_out = start;
+  *end_out = end;
+  return true;
+}
+
+bool RegisterAllocationPass::IsLiveAcrossCall(uint32_t global_index) {
+  for (uint16_t n = 0; n < blocks_.size(); ++n) {
+    uint32_t start, end;
+    if (!GetBlockLiveRange(global_index, n, &start, &end)) {
+      continue;
+    }
+    // Calls using the value themselves are fine.
+    auto it = std::upper_bound(clobber_ordinals_.begin(),
+                               clobber_ordinals_.end(), start);
+    if (it != clobber_ordinals_.end() && *it < end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RegisterAllocationPass::AllocateGlobalValues(HIRBuilder* builder) {
+  global_values_.clear();
+  global_indices_.clear();
+  block_global_values_.clear();
+  for (Block* block : blocks_) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      if (!instr->dest) {
+        continue;
+      }
+      for (auto use = instr->dest->use_head; use; use = use->next) {
+        if (use->instr->block != block) {
+          global_indices_.emplace(instr->dest, uint32_t(global_values_.size()));
+          global_values_.push_back({instr->dest, 0, 0});
+          break;
+        }
+      }
+    }
+  }
+  if (global_values_.empty()) {
+    return;
+  }
+  global_value_count_ += global_values_.size();
+
+  ComputeGlobalLiveness();
+
+  // Values live across calls can't be in registers at all, and with the
+  // global allocation disabled nothing can.
+  std::vector<Value*> spilled_values;
+  std::vector<uint32_t> candidates;
+  for (uint32_t n = 0; n < global_values_.size(); ++n) {
+    auto& range = global_values_[n];
+    range.start = UINT32_MAX;
+    range.end = 0;
+    for (uint16_t block_ordinal = 0; block_ordinal < blocks_.size();
+         ++block_ordinal) {
+      uint32_t start, end;
+      if (GetBlockLiveRange(n, block_ordinal, &start, &end)) {
+        range.start = std::min(range.start, start);
+        range.end = std::max(range.end, end);
+      }
+    }
+    if (!cvars::global_register_allocation || IsLiveAcrossCall(n)) {
+      spilled_values.push_back(range.value);
+    } else {
+      candidates.push_back(n);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [this](uint32_t a, uint32_t b) {
+              return global_values_[a].start < global_values_[b].start;
+            });
+
+  // Linear scan over the whole function, in the top registers of each set.
+  std::vector<LiveRange*> active;
+  for (uint32_t index : candidates) {
+    LiveRange& range = global_values_[index];
+    auto usage_set = RegisterSetForValue(range.value);
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&range](const LiveRange* active_range) {
+                                  return active_range->end < range.start;
+                                }),
+                 active.end());
+    std::bitset<32> used_regs;
+    LiveRange* furthest = nullptr;
+    for (LiveRange* active_range : active) {
+      if (RegisterSetForValue(active_range->value) != usage_set) {
+        continue;
+      }
+      used_regs.set(active_range->value->reg.index);
+      if (!furthest || active_range->end > furthest->end) {
+        furthest = active_range;
+      }
+    }
+    bool allocated = false;
+    for (uint32_t reg_index = usage_set->count;
+         reg_index-- > kLocalRegisterReserve;) {
+      if (!used_regs.test(reg_index)) {
+        range.value->reg.set = usage_set->set;
+        range.value->reg.index = reg_index;
+        active.push_back(&range);
+        allocated = true;
+        break;
+      }
+    }
+    if (allocated) {
+      continue;
+    }
+    if (furthest && furthest->end > range.end) {
+      // Free the register of the value that would block it for the longest.
+      range.value->reg = furthest->value->reg;
+      furthest->value->reg.set = nullptr;
+      spilled_values.push_back(furthest->value);
+      *std::find(active.begin(), active.end(), furthest) = &range;
+    } else {
+      spilled_values.push_back(range.value);
+    }
+  }
+
+  global_spilled_count_ += spilled_values.size();
+  for (Value* value : spilled_values) {
+    SpillGlobalValue(builder, value);
+  }
+}
+
+void RegisterAllocationPass::SpillGlobalValue(HIRBuilder* builder,
+                                              Value* value) {
+  // Store right after the definition - past any instructions paired with it -
+  // so later spills of the value in its block can reuse the local.
+  Value* slot = builder->AllocLocal(value->type);
+  value->local_slot = slot;
+  Instr* def = value->def;
+  Instr* def_next = def->next;
+  while (def_next && def_next->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    def_next = def_next->next;
+  }
+  assert_not_null(def_next);
+  Instr* store = builder->InsertInstr(def_next, OPCODE_STORE_LOCAL_info, 0);
+  store->set_src1(slot);
+  store->set_src2(value);
+  ++spill_count_;
+
+  // Reload before the uses in other blocks and after calls.
+  std::vector<Instr*> reload_instrs;
+  for (auto use = value->use_head; use; use = use->next) {
+    Instr* instr = use->instr;
+    if (instr == store) {
+      continue;
+    }
+    if (instr->block == def->block) {
+      auto it = std::upper_bound(clobber_ordinals_.begin(),
+                                 clobber_ordinals_.end(), def->ordinal);
+      if (it == clobber_ordinals_.end() || *it >= instr->ordinal) {
+        continue;
+      }
+    }
+    if (std::find(reload_instrs.begin(), reload_instrs.end(), instr) ==
+        reload_instrs.end()) {
+      reload_instrs.push_back(instr);
+    }
+  }
+  for (Instr* instr : reload_instrs) {
+    Instr* insert_before = instr;
+    while (insert_before->prev &&
+           insert_before->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+      insert_before = insert_before->prev;
+    }
+    Instr* load =
+        builder->InsertInstr(insert_before, OPCODE_LOAD_LOCAL_info, 0,
+                             builder->AllocValue(value->type));
+    load->set_src1(slot);
+    load->dest->local_slot = slot;
+    ReplaceSources(instr, value, load->dest);
+    ++reload_count_;
+  }
+}
+
+void RegisterAllocationPass::PrepareBlockGlobalValues(Block* block) {
+  block_global_values_.clear();
+  // Blocks may only be appended by spilling.
+  uint16_t block_ordinal = block->ordinal;
+  if (global_values_.empty() || block_ordinal >= blocks_.size()) {
+    return;
+  }
+  // The instructions have been renumbered since the liveness analysis.
+  uint32_t block_start =
+      block->instr_head ? block->instr_head->ordinal : uint32_t(0);
+  block_start_ordinals_[block_ordinal] = block_start;
+  block_end_ordinals_[block_ordinal] =
+      block->instr_tail ? block->instr_tail->ordinal + 1 : block_start;
+  for (uint32_t n = 0; n < global_values_.size(); ++n) {
+    Value* value = global_values_[n].value;
+    if (!value->reg.set) {
+      // Moved to a local.
+      continue;
+    }
+    uint32_t start, end;
+    if (GetBlockLiveRange(n, block_ordinal, &start, &end)) {
+      block_global_values_.push_back({value, start, end});
+    }
+  }
+}
+
+std::bitset<32> RegisterAllocationPass::GetGlobalRegsOverlapping(
+    const Value* value) {
+  std::bitset<32> regs;
+  if (block_global_values_.empty()) {
+    return regs;
+  }
+  uint32_t start = value->def->ordinal;
+  uint32_t end = value->use_head ? value->last_use->ordinal : start;
+  auto usage_set = RegisterSetForValue(value);
+  for (const LiveRange& range : block_global_values_) {
+    if (RegisterSetForValue(range.value) == usage_set &&
+        range.start <= end && range.end >= start) {
+      regs.set(range.value->reg.index);
+    }
+  }
+  return regs;
+}
+
 void RegisterAllocationPass::DumpUsage(const char* name) {
 #if 0
   fprintf(stdout, "\n%s:\n", name);
@@ -294,12 +687,14 @@ RegisterAllocationPass::MarkRegAvailable(const hir::RegAssignment& reg) {
 }
 
 bool RegisterAllocationPass::TryAllocateRegister(
-    Value* value, const RegAssignment& preferred_reg) {
+    Value* value, const RegAssignment& preferred_reg,
+    std::bitset<32> excluded_regs) {
   // If the preferred register matches type and is available, use it.
   auto usage_set = RegisterSetForValue(value);
   if (usage_set->set == preferred_reg.set) {
     // Check if available.
-    if (!IsRegInUse(preferred_reg)) {
+    if (!IsRegInUse(preferred_reg) &&
+        !excluded_regs.test(preferred_reg.index)) {
       // Mark as in-use and return. Best case.
       MarkRegUsed(preferred_reg, value, value->use_head);
       value->reg = preferred_reg;
@@ -308,10 +703,11 @@ bool RegisterAllocationPass::TryAllocateRegister(
   }
 
   // Otherwise, fallback to allocating like normal.
-  return TryAllocateRegister(value);
+  return TryAllocateRegister(value, excluded_regs);
 }
 
-bool RegisterAllocationPass::TryAllocateRegister(Value* value) {
+bool RegisterAllocationPass::TryAllocateRegister(
+    Value* value, std::bitset<32> excluded_regs) {
   // Get the set this register is in.
   RegisterSetUsage* usage_set = RegisterSetForValue(value);
 
@@ -319,7 +715,9 @@ bool RegisterAllocationPass::TryAllocateRegister(Value* value) {
   // We have to ensure it's a valid one (in our count).
   uint32_t first_unused = 0;
   bool none_used = xe::bit_scan_forward(
-      static_cast<uint32_t>(usage_set->availability.to_ulong()), &first_unused);
+      static_cast<uint32_t>((usage_set->availability & ~excluded_regs)
+                                .to_ulong()),
+      &first_unused);
   if (none_used && first_unused < usage_set->count) {
     // Available! Use it!
     value->reg.set = usage_set->set;
@@ -347,6 +745,9 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   DumpUsage("SpillOneRegister (pre)");
   // Pick the one with the furthest next use.
   assert_true(!usage_set->upcoming_uses.empty());
+  if (usage_set->upcoming_uses.empty()) {
+    return false;
+  }
   auto furthest_usage =
       std::max_element(usage_set->upcoming_uses.begin(),
                        usage_set->upcoming_uses.end(), &RegisterUsage::Compare);
@@ -378,6 +779,7 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
     // Add store.
     builder->StoreLocal(spill_value->local_slot, spill_value);
     auto spill_store = builder->last_instr();
+    ++spill_count_;
     auto spill_store_use = spill_store->src2_use;
     assert_null(spill_store_use->prev);
     if (prev_use && prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
@@ -420,6 +822,9 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   auto new_value = builder->LoadLocal(spill_value->local_slot);
   auto spill_load = builder->last_instr();
   spill_load->MoveBefore(next_use->instr);
+  // For the overlap checks with the values live across blocks.
+  spill_load->ordinal = next_use->instr->ordinal;
+  ++reload_count_;
   // Note: implicit first use added.
 
 #if ASSERT_NO_CYCLES
@@ -439,24 +844,7 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   auto new_use_tail = walk_use;
   while (walk_use) {
     auto next_walk_use = walk_use->next;
-    auto instr = walk_use->instr;
-
-    uint32_t signature = instr->opcode->signature;
-    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src1.value == spill_value) {
-        instr->set_src1(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src2.value == spill_value) {
-        instr->set_src2(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src3.value == spill_value) {
-        instr->set_src3(new_value);
-      }
-    }
+    ReplaceSources(walk_use->instr, spill_value, new_value);
 
     walk_use = next_walk_use;
     if (walk_use) {
@@ -13,11 +13,23 @@
 #include <algorithm>
 #include <bitset>
 #include <functional>
+#include <unordered_map>
 #include <vector>
 
+#include "xenia/base/platform.h"
 #include "xenia/cpu/backend/machine_info.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -27,9 +39,22 @@ class RegisterAllocationPass : public CompilerPass {
  public:
   explicit RegisterAllocationPass(const backend::MachineInfo* machine_info);
   ~RegisterAllocationPass() override;
+  const char* name() const override { return "RegisterAllocationPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
+  struct Stats {
+    // Values stored to and reloaded from locals in the stack frame.
+    uint64_t spill_count;
+    uint64_t reload_count;
+    // Values live across blocks, and how many of them were kept in locals.
+    uint64_t global_value_count;
+    uint64_t global_spilled_count;
+  };
+  // Totals over all the functions allocated in the process.
+  static Stats QueryStats();
+  static void ResetStats();
+
  private:
   // TODO(benvanik): rewrite all this set shit -- too much indirection, the
   // complexity is not needed.
@@ -51,6 +76,30 @@ class RegisterAllocationPass : public CompilerPass {
     std::vector<RegisterUsage> upcoming_uses;
   };
 
+  // Instruction ordinal range a value live across blocks is in - either over
+  // the whole function, from the first to the last block containing it, or
+  // only in the block being allocated.
+  struct LiveRange {
+    hir::Value* value;
+    uint32_t start;
+    uint32_t end;
+  };
+
+  void NumberInstrs(hir::HIRBuilder* builder);
+  void ComputeGlobalLiveness();
+  // Gets the ordinal range the global value with the index is live in within
+  // the block, or returns false if it's not live there.
+  bool GetBlockLiveRange(uint32_t global_index, uint16_t block_ordinal,
+                         uint32_t* start_out, uint32_t* end_out);
+  bool IsLiveAcrossCall(uint32_t global_index);
+  // Assigns host registers to the values live across blocks with a linear
+  // scan, moving the ones that can't stay in registers to locals.
+  void AllocateGlobalValues(hir::HIRBuilder* builder);
+  void SpillGlobalValue(hir::HIRBuilder* builder, hir::Value* value);
+  void PrepareBlockGlobalValues(hir::Block* block);
+  // Registers of values live across blocks overlapping the value.
+  std::bitset<32> GetGlobalRegsOverlapping(const hir::Value* value);
+
   void DumpUsage(const char* name);
   void PrepareBlockState();
   void AdvanceUses(hir::Instr* instr);
@@ -60,8 +109,9 @@ class RegisterAllocationPass : public CompilerPass {
   RegisterSetUsage* MarkRegAvailable(const hir::RegAssignment& reg);
 
   bool TryAllocateRegister(hir::Value* value,
-                           const hir::RegAssignment& preferred_reg);
-  bool TryAllocateRegister(hir::Value* value);
+                           const hir::RegAssignment& preferred_reg,
+                           std::bitset<32> excluded_regs);
+  bool TryAllocateRegister(hir::Value* value, std::bitset<32> excluded_regs);
   bool SpillOneRegister(hir::HIRBuilder* builder, hir::Block* block,
                         hir::TypeName required_type);
 
@@ -76,6 +126,20 @@ class RegisterAllocationPass : public CompilerPass {
     RegisterSetUsage* vec_set = nullptr;
     RegisterSetUsage* all_sets[3];
   } usage_sets_;
+
+  std::vector<hir::Block*> blocks_;
+  std::vector<std::vector<uint16_t>> successors_;
+  // Ordinal of the first instruction of each block, and past the last one.
+  std::vector<uint32_t> block_start_ordinals_;
+  std::vector<uint32_t> block_end_ordinals_;
+  // Ordinals of the calls, which clobber all the allocatable host registers.
+  std::vector<uint32_t> clobber_ordinals_;
+  std::vector<LiveRange> global_values_;
+  std::unordered_map<const hir::Value*, uint32_t> global_indices_;
+  // Global values live at the start and the end of each block.
+  std::vector<llvm::BitVector> live_in_;
+  std::vector<llvm::BitVector> live_out_;
+  std::vector<LiveRange> block_global_values_;
 };
 
 }  // namespace passes
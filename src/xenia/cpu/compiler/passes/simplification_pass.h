@@ -21,6 +21,7 @@ class SimplificationPass : public ConditionalGroupSubpass {
  public:
   SimplificationPass();
   ~SimplificationPass() override;
+  const char* name() const override { return "SimplificationPass"; }
 
   bool Run(hir::HIRBuilder* builder, bool& result) override;
 
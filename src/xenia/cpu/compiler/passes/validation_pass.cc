@@ -42,6 +42,8 @@ bool ValidationPass::Run(HIRBuilder* builder) {
   str.Reset();
 #endif  // 0
 
+  dominance_analyzed_ = dominance_analysis_.Analyze(builder);
+
   auto block = builder->first_block();
   while (block) {
     auto label = block->label_head;
@@ -75,9 +77,20 @@ bool ValidationPass::ValidateInstruction(Block* block, Instr* instr) {
 
   if (instr->dest) {
     assert_true(instr->dest->def == instr);
+    // Values may be used in the blocks dominated by the definition, such as
+    // after context promotion or loop-invariant code motion. Register
+    // allocation moves the ones not getting a register to locals, reloading
+    // them in the blocks of the uses.
     auto use = instr->dest->use_head;
     while (use) {
-      assert_true(use->instr->block == block);
+      Block* use_block = use->instr->block;
+      assert_not_null(use_block);
+      if (use_block != block && dominance_analyzed_) {
+        assert_true(dominance_analysis_.Dominates(block, use_block));
+        if (!dominance_analysis_.Dominates(block, use_block)) {
+          return false;
+        }
+      }
       use = use->next;
     }
   }
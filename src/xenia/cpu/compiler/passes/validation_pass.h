@@ -11,6 +11,7 @@
 #define XENIA_CPU_COMPILER_PASSES_VALIDATION_PASS_H_
 
 #include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/loop_analysis.h"
 
 namespace xe {
 namespace cpu {
@@ -21,12 +22,17 @@ class ValidationPass : public CompilerPass {
  public:
   ValidationPass();
   ~ValidationPass() override;
+  const char* name() const override { return "ValidationPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   bool ValidateInstruction(hir::Block* block, hir::Instr* instr);
   bool ValidateValue(hir::Block* block, hir::Instr* instr, hir::Value* value);
+
+  // For the uses of values in other blocks.
+  LoopAnalysis dominance_analysis_;
+  bool dominance_analyzed_ = false;
 };
 
 }  // namespace passes
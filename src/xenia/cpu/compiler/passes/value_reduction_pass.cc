@@ -9,23 +9,11 @@
 
 #include "xenia/cpu/compiler/passes/value_reduction_pass.h"
 
-#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/processor.h"
 
-#if XE_COMPILER_MSVC
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#pragma warning(disable : 4267)
-#include <llvm/ADT/BitVector.h>
-#pragma warning(pop)
-#else
-#include <llvm/ADT/BitVector.h>
-#include <cmath>
-#endif  // XE_COMPILER_MSVC
-
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -35,6 +23,7 @@ namespace passes {
 using namespace xe::cpu::hir;
 
 using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
 using xe::cpu::hir::OpcodeInfo;
 using xe::cpu::hir::Value;
 
@@ -45,7 +34,8 @@ ValueReductionPass::~ValueReductionPass() {}
 void ValueReductionPass::ComputeLastUse(Value* value) {
   // TODO(benvanik): compute during construction?
   // Note that this list isn't sorted (unfortunately), so we have to scan
-  // them all.
+  // them all. Only called for values used solely in their defining block, so
+  // the instruction ordinals are comparable.
   uint32_t max_ordinal = 0;
   Value::Use* last_use = nullptr;
   auto use = value->use_head;
@@ -59,25 +49,58 @@ void ValueReductionPass::ComputeLastUse(Value* value) {
   value->last_use = last_use ? last_use->instr : nullptr;
 }
 
+bool ValueReductionPass::IsBlockLocal(Value* value) {
+  if (value->IsConstant() || !value->def) {
+    return false;
+  }
+  for (auto use = value->use_head; use; use = use->next) {
+    if (use->instr->block != value->def->block) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ValueReductionPass::ReleaseSource(Instr* instr, Value* value,
+                                       llvm::BitVector& ordinals) {
+  if (!IsBlockLocal(value)) {
+    return;
+  }
+  if (value->last_use == instr) {
+    // Available.
+    ordinals.reset(value->ordinal);
+  }
+}
+
 bool ValueReductionPass::Run(HIRBuilder* builder) {
-  // Walk each block and reuse variable ordinals as much as possible.
+  SCOPE_profile_cpu_f("cpu");
 
-  llvm::BitVector ordinals(builder->max_value_ordinal());
+  // Walk each block and reuse variable ordinals as much as possible.
 
+  // Values living across blocks keep their ordinals, reserved in all blocks.
+  llvm::BitVector global_ordinals(builder->max_value_ordinal());
   auto block = builder->first_block();
   while (block) {
-    // Reset used ordinals.
-    ordinals.reset();
-
     // Renumber all instructions to make liveness tracking easier.
     uint32_t instr_ordinal = 0;
     auto instr = block->instr_head;
     while (instr) {
       instr->ordinal = instr_ordinal++;
+      if (instr->dest && !IsBlockLocal(instr->dest)) {
+        global_ordinals.set(instr->dest->ordinal);
+      }
       instr = instr->next;
     }
+    block = block->next;
+  }
 
-    instr = block->instr_head;
+  llvm::BitVector ordinals(builder->max_value_ordinal());
+  block = builder->first_block();
+  while (block) {
+    // Reset used ordinals.
+    ordinals = global_ordinals;
+
+    auto instr = block->instr_head;
     while (instr) {
       const OpcodeInfo* info = instr->opcode;
       auto dest_type = GET_OPCODE_SIG_TYPE_DEST(info->signature);
@@ -85,45 +108,20 @@ bool ValueReductionPass::Run(HIRBuilder* builder) {
       auto src2_type = GET_OPCODE_SIG_TYPE_SRC2(info->signature);
       auto src3_type = GET_OPCODE_SIG_TYPE_SRC3(info->signature);
       if (src1_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src1.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src1.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+        ReleaseSource(instr, instr->src1.value, ordinals);
       }
       if (src2_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src2.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src2.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+        ReleaseSource(instr, instr->src2.value, ordinals);
       }
       if (src3_type == OPCODE_SIG_TYPE_V) {
-        auto v = instr->src3.value;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-        if (v->last_use == instr) {
-          // Available.
-          if (!instr->src3.value->IsConstant()) {
-            ordinals.reset(v->ordinal);
-          }
-        }
+        ReleaseSource(instr, instr->src3.value, ordinals);
       }
-      if (dest_type == OPCODE_SIG_TYPE_V) {
+      if (dest_type == OPCODE_SIG_TYPE_V && IsBlockLocal(instr->dest)) {
         // Dest values are processed last, as they may be able to reuse a
-        // source value ordinal.
+        // source value ordinal. The last use may be stale after the
+        // previous passes, so always recompute it.
         auto v = instr->dest;
+        ComputeLastUse(v);
         // Find a lower ordinal.
         for (auto n = 0u; n < ordinals.size(); n++) {
           if (!ordinals.test(n)) {
@@ -132,6 +130,10 @@ bool ValueReductionPass::Run(HIRBuilder* builder) {
             break;
           }
         }
+        if (!v->last_use) {
+          // Never used, free right away.
+          ordinals.reset(v->ordinal);
+        }
       }
 
       instr = instr->next;
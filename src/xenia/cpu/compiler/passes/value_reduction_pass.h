@@ -10,22 +10,40 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_VALUE_REDUCTION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_VALUE_REDUCTION_PASS_H_
 
+#include "xenia/base/platform.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
 namespace xe {
 namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Renumbers the values local to a single block so their ordinals are reused
+// once they are dead, keeping the ordinals of values used across blocks.
 class ValueReductionPass : public CompilerPass {
  public:
   ValueReductionPass();
   ~ValueReductionPass() override;
+  const char* name() const override { return "ValueReductionPass"; }
 
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
   void ComputeLastUse(hir::Value* value);
+  // Whether the value is defined and only used in the same block.
+  bool IsBlockLocal(hir::Value* value);
+  void ReleaseSource(hir::Instr* instr, hir::Value* value,
+                     llvm::BitVector& ordinals);
 };
 
 }  // namespace passes
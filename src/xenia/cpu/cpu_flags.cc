@@ -38,6 +38,32 @@ DEFINE_bool(
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
+DEFINE_int32(jit_worker_threads, 0,
+             "Number of background threads compiling guest functions before "
+             "they're called (callees of compiled functions and functions "
+             "listed in the module). 0 to compile only on demand, -1 to pick "
+             "based on the number of host processors.",
+             "CPU");
+DEFINE_bool(precompile_functions, false,
+            "Compile all the functions known in a module (from the exception "
+            "directory, import thunks and their callees) on all host "
+            "processors when it's loaded, before any of its code runs.",
+            "CPU");
+DEFINE_bool(tiered_compilation, false,
+            "Compile functions quickly with few optimizations first, and "
+            "recompile them with all optimizations once they're called "
+            "tier_up_call_count times.",
+            "CPU");
+DEFINE_int32(tier_up_call_count, 1000,
+             "Number of calls after which a function compiled with "
+             "tiered_compilation is recompiled with all optimizations.",
+             "CPU");
+DEFINE_bool(learn_mmio_access_sites, true,
+            "Recompile functions with loads and stores that caught an access "
+            "violation on MMIO to check the address inline and call the MMIO "
+            "handler directly.",
+            "CPU");
+
 // Breakpoints:
 DEFINE_uint64(break_on_instruction, 0,
               "int3 before the given guest address is executed.", "CPU");
@@ -26,6 +26,12 @@ DECLARE_bool(disable_global_lock);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_int32(jit_worker_threads);
+DECLARE_bool(precompile_functions);
+DECLARE_bool(tiered_compilation);
+DECLARE_int32(tier_up_call_count);
+DECLARE_bool(learn_mmio_access_sites);
+
 DECLARE_uint64(break_on_instruction);
 DECLARE_int32(break_condition_gpr);
 DECLARE_uint64(break_condition_value);
@@ -9,77 +9,175 @@
 
 #include "xenia/cpu/entry_table.h"
 
+#include "xenia/base/assert.h"
 #include "xenia/base/profiling.h"
-#include "xenia/base/threading.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::EntryTable() {
+  pages_ = std::make_unique<std::atomic<Page*>[]>(kPageCount);
+  for (uint32_t i = 0; i < kPageCount; ++i) {
+    pages_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
 
 EntryTable::~EntryTable() {
-  auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_) {
-    Entry* entry = it.second;
-    delete entry;
+  for (uint32_t i = 0; i < kPageCount; ++i) {
+    Page* page = pages_[i].load(std::memory_order_acquire);
+    if (!page) {
+      continue;
+    }
+    for (uint32_t j = 0; j < kSlotsPerPage; ++j) {
+      delete page->slots[j].load(std::memory_order_acquire);
+    }
+    delete page;
+  }
+}
+
+std::atomic<Entry*>* EntryTable::GetSlot(uint32_t address, bool create) {
+  std::atomic<Page*>& page_ref = pages_[address >> kPageShift];
+  Page* page = page_ref.load(std::memory_order_acquire);
+  if (!page) {
+    if (!create) {
+      return nullptr;
+    }
+    Page* new_page = new Page;
+    for (uint32_t i = 0; i < kSlotsPerPage; ++i) {
+      new_page->slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+    if (page_ref.compare_exchange_strong(page, new_page,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+      page = new_page;
+    } else {
+      // Another thread has installed the page first.
+      delete new_page;
+    }
   }
+  return &page->slots[(address & ((1 << kPageShift) - 1)) >> 2];
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  std::atomic<Entry*>* slot = GetSlot(address, false);
+  if (!slot) {
+    return nullptr;
+  }
+  Entry* entry = slot->load(std::memory_order_acquire);
   if (entry) {
     // TODO(benvanik): wait if needed?
-    if (entry->status != Entry::STATUS_READY) {
+    if (entry->address != address ||
+        entry->status.load(std::memory_order_acquire) != Entry::STATUS_READY) {
       entry = nullptr;
     }
   }
   return entry;
 }
 
-Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
+bool EntryTable::Contains(uint32_t address) {
+  std::atomic<Entry*>* slot = GetSlot(address, false);
+  return slot && slot->load(std::memory_order_acquire) != nullptr;
+}
 
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
-    }
-    status = entry->status;
-  } else {
+Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
+  std::atomic<Entry*>* slot = GetSlot(address, true);
+  Entry* entry = slot->load(std::memory_order_acquire);
+  if (!entry) {
     // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    Entry* new_entry = new Entry();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status.store(Entry::STATUS_COMPILING, std::memory_order_relaxed);
+    new_entry->function = nullptr;
+    if (slot->compare_exchange_strong(entry, new_entry,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      *out_entry = new_entry;
+      return Entry::STATUS_NEW;
+    }
+    // Lost the race - wait for the winner instead.
+    delete new_entry;
+  }
+  if (entry->address != address) {
+    // Misaligned guest code address sharing the slot of another entry.
+    assert_always();
+    *out_entry = entry;
+    return Entry::STATUS_FAILED;
+  }
+  Entry::Status status = entry->status.load(std::memory_order_acquire);
+  if (status == Entry::STATUS_COMPILING) {
+    WaitWhileCompiling(entry);
+    status = entry->status.load(std::memory_order_acquire);
   }
-  global_lock.unlock();
   *out_entry = entry;
   return status;
 }
 
+void EntryTable::SetStatus(Entry* entry, Entry::Status status) {
+  assert_true(status != Entry::STATUS_NEW &&
+              status != Entry::STATUS_COMPILING);
+  if (status == Entry::STATUS_READY && entry->end_address > entry->address) {
+    uint32_t size = entry->end_address - entry->address;
+    uint32_t max_size = max_function_size_.load(std::memory_order_relaxed);
+    while (size > max_size &&
+           !max_function_size_.compare_exchange_weak(
+               max_size, size, std::memory_order_relaxed)) {
+    }
+  }
+  entry->status.store(status, std::memory_order_seq_cst);
+  if (waiter_count_.load(std::memory_order_seq_cst)) {
+    // Taking the mutex ensures a waiter that has seen STATUS_COMPILING is
+    // already sleeping on the condition variable, so it doesn't miss the wake.
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    wait_cond_.notify_all();
+  }
+}
+
+void EntryTable::WaitWhileCompiling(Entry* entry) {
+  SCOPE_profile_cpu_f("cpu");
+  waiter_count_.fetch_add(1, std::memory_order_seq_cst);
+  {
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    wait_cond_.wait(lock, [entry]() {
+      return entry->status.load(std::memory_order_seq_cst) !=
+             Entry::STATUS_COMPILING;
+    });
+  }
+  waiter_count_.fetch_sub(1, std::memory_order_seq_cst);
+}
+
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
+  return FindWithAddressRange(address, address);
+}
+
+std::vector<Function*> EntryTable::FindWithAddressRange(uint32_t low,
+                                                        uint32_t high) {
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
-    if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
+  if (low > high) {
+    return fns;
+  }
+  // Only the functions starting within the largest function size below the
+  // range may contain any of it.
+  uint32_t max_size = max_function_size_.load(std::memory_order_seq_cst);
+  uint32_t start = low > max_size ? low - max_size : 0;
+  for (uint32_t i = start >> kPageShift; i <= high >> kPageShift; ++i) {
+    Page* page = pages_[i].load(std::memory_order_acquire);
+    if (!page) {
+      continue;
+    }
+    uint32_t first_slot =
+        i == start >> kPageShift ? (start & ((1 << kPageShift) - 1)) >> 2 : 0;
+    uint32_t last_slot = i == high >> kPageShift
+                             ? (high & ((1 << kPageShift) - 1)) >> 2
+                             : kSlotsPerPage - 1;
+    for (uint32_t j = first_slot; j <= last_slot; ++j) {
+      Entry* entry = page->slots[j].load(std::memory_order_acquire);
+      if (!entry ||
+          entry->status.load(std::memory_order_acquire) !=
+              Entry::STATUS_READY) {
+        continue;
+      }
+      if (high >= entry->address && low <= entry->end_address) {
         fns.push_back(entry->function);
       }
     }
@@ -10,11 +10,13 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 
-#include "xenia/base/mutex.h"
-
 namespace xe {
 namespace cpu {
 
@@ -30,24 +32,60 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
+  // Only changed through EntryTable::SetStatus, which publishes end_address
+  // and function along with it.
+  std::atomic<Status> status;
   Function* function;
 } Entry;
 
+// Maps guest function addresses to their entries.
+// Direct-mapped over the 32-bit guest address space: the top level is indexed
+// by the upper bits of the address and points to lazily allocated pages with a
+// slot per instruction. Lookups never lock - slots and pages are only ever
+// installed once with a compare-exchange, and entries live as long as the
+// table.
 class EntryTable {
  public:
   EntryTable();
   ~EntryTable();
 
   Entry* Get(uint32_t address);
+  // Whether an entry exists in any state, including still compiling.
+  bool Contains(uint32_t address);
+  // Returns STATUS_NEW if the caller has created the entry and must compile
+  // it, finishing with SetStatus. If another thread is compiling the entry,
+  // waits until it's done.
   Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
+  // Leaves STATUS_COMPILING, waking up the threads waiting for the entry.
+  void SetStatus(Entry* entry, Entry::Status status);
 
   std::vector<Function*> FindWithAddress(uint32_t address);
+  // Ready functions with any instructions in [low, high] (both inclusive).
+  std::vector<Function*> FindWithAddressRange(uint32_t low, uint32_t high);
 
  private:
-  xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  std::unordered_map<uint32_t, Entry*> map_;
+  static constexpr uint32_t kPageShift = 16;
+  static constexpr uint32_t kPageCount = 1 << (32 - kPageShift);
+  // Guest instructions are 4-byte aligned.
+  static constexpr uint32_t kSlotsPerPage = (1 << kPageShift) >> 2;
+
+  struct Page {
+    std::atomic<Entry*> slots[kSlotsPerPage];
+  };
+
+  std::atomic<Entry*>* GetSlot(uint32_t address, bool create);
+  void WaitWhileCompiling(Entry* entry);
+
+  std::unique_ptr<std::atomic<Page*>[]> pages_;
+  // Largest end_address - address of the ready entries, so range queries only
+  // need to look at the entries starting up to this far below the range.
+  std::atomic<uint32_t> max_function_size_ = {0};
+
+  // Futex-like wait for entries being compiled - only the threads that have to
+  // wait and the compiling thread when there are waiters take the mutex.
+  std::atomic<uint32_t> waiter_count_ = {0};
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cond_;
 };
 
 }  // namespace cpu
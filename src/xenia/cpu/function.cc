@@ -58,7 +58,37 @@ GuestFunction::GuestFunction(Module* module, uint32_t address)
   behavior_ = Behavior::kDefault;
 }
 
-GuestFunction::~GuestFunction() = default;
+GuestFunction::~GuestFunction() {
+  // The machine code is freed by the code cache.
+  const Code* code = code_.load(std::memory_order_relaxed);
+  while (code) {
+    const Code* previous = code->previous;
+    delete code;
+    code = previous;
+  }
+}
+
+void GuestFunction::PublishCode(std::unique_ptr<Code> code) {
+  // May be translated again on multiple threads at once (for instance, when
+  // it becomes hot and when an MMIO access is learned).
+  Code* new_code = code.release();
+  Code* previous = code_.load(std::memory_order_relaxed);
+  do {
+    new_code->previous = previous;
+  } while (!code_.compare_exchange_weak(previous, new_code,
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_relaxed));
+}
+
+const GuestFunction::Code* GuestFunction::FindCode(
+    uintptr_t host_address) const {
+  for (const Code* code = this->code(); code; code = code->previous) {
+    if (code->ContainsMachineCode(host_address)) {
+      return code;
+    }
+  }
+  return nullptr;
+}
 
 void GuestFunction::SetupExtern(ExternHandler handler, Export* export_data) {
   behavior_ = Behavior::kExtern;
@@ -66,11 +96,17 @@ void GuestFunction::SetupExtern(ExternHandler handler, Export* export_data) {
   export_data_ = export_data;
 }
 
-const SourceMapEntry* GuestFunction::LookupGuestAddress(
-    uint32_t guest_address) const {
+// Lookups in the source map of the specific translation, so the results of
+// multiple lookups belong to the same translation.
+static const SourceMapEntry* LookupCodeGuestAddress(
+    const GuestFunction::Code* code, uint32_t guest_address) {
+  if (!code) {
+    return nullptr;
+  }
   // TODO(benvanik): binary search? We know the list is sorted by code order.
-  for (size_t i = 0; i < source_map_.size(); ++i) {
-    const auto& entry = source_map_[i];
+  const auto& source_map = code->source_map;
+  for (size_t i = 0; i < source_map.size(); ++i) {
+    const auto& entry = source_map[i];
     if (entry.guest_address == guest_address) {
       return &entry;
     }
@@ -78,10 +114,36 @@ const SourceMapEntry* GuestFunction::LookupGuestAddress(
   return nullptr;
 }
 
+static const SourceMapEntry* LookupCodeMachineCodeOffset(
+    const GuestFunction::Code* code, uint32_t offset) {
+  if (!code) {
+    return nullptr;
+  }
+  // TODO(benvanik): binary search? We know the list is sorted by code order.
+  const auto& source_map = code->source_map;
+  for (int64_t i = source_map.size() - 1; i >= 0; --i) {
+    const auto& entry = source_map[i];
+    if (entry.code_offset <= offset) {
+      return &entry;
+    }
+  }
+  return source_map.empty() ? nullptr : &source_map[0];
+}
+
+const SourceMapEntry* GuestFunction::LookupGuestAddress(
+    uint32_t guest_address) const {
+  return LookupCodeGuestAddress(code(), guest_address);
+}
+
 const SourceMapEntry* GuestFunction::LookupHIROffset(uint32_t offset) const {
+  const Code* code = this->code();
+  if (!code) {
+    return nullptr;
+  }
   // TODO(benvanik): binary search? We know the list is sorted by code order.
-  for (size_t i = 0; i < source_map_.size(); ++i) {
-    const auto& entry = source_map_[i];
+  const auto& source_map = code->source_map;
+  for (size_t i = 0; i < source_map.size(); ++i) {
+    const auto& entry = source_map[i];
     if (entry.hir_offset >= offset) {
       return &entry;
     }
@@ -91,14 +153,7 @@ const SourceMapEntry* GuestFunction::LookupHIROffset(uint32_t offset) const {
 
 const SourceMapEntry* GuestFunction::LookupMachineCodeOffset(
     uint32_t offset) const {
-  // TODO(benvanik): binary search? We know the list is sorted by code order.
-  for (int64_t i = source_map_.size() - 1; i >= 0; --i) {
-    const auto& entry = source_map_[i];
-    if (entry.code_offset <= offset) {
-      return &entry;
-    }
-  }
-  return source_map_.empty() ? nullptr : &source_map_[0];
+  return LookupCodeMachineCodeOffset(code(), offset);
 }
 
 uint32_t GuestFunction::MapGuestAddressToMachineCodeOffset(
@@ -109,15 +164,28 @@ uint32_t GuestFunction::MapGuestAddressToMachineCodeOffset(
 
 uintptr_t GuestFunction::MapGuestAddressToMachineCode(
     uint32_t guest_address) const {
-  auto entry = LookupGuestAddress(guest_address);
-  return reinterpret_cast<uintptr_t>(machine_code()) +
+  const Code* code = this->code();
+  if (!code) {
+    return 0;
+  }
+  auto entry = LookupCodeGuestAddress(code, guest_address);
+  return reinterpret_cast<uintptr_t>(code->machine_code) +
          (entry ? entry->code_offset : 0);
 }
 
 uint32_t GuestFunction::MapMachineCodeToGuestAddress(
     uintptr_t host_address) const {
-  auto entry = LookupMachineCodeOffset(static_cast<uint32_t>(
-      host_address - reinterpret_cast<uintptr_t>(machine_code())));
+  // The host address may be in the code replaced by a newer translation.
+  const Code* code = FindCode(host_address);
+  if (!code) {
+    code = this->code();
+    if (!code) {
+      return address();
+    }
+  }
+  uintptr_t code_address = reinterpret_cast<uintptr_t>(code->machine_code);
+  auto entry = LookupCodeMachineCodeOffset(
+      code, static_cast<uint32_t>(host_address - code_address));
   return entry ? entry->guest_address : address();
 }
 
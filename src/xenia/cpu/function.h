@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_FUNCTION_H_
 #define XENIA_CPU_FUNCTION_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -46,19 +47,25 @@ class Function : public Symbol {
   ~Function() override;
 
   uint32_t address() const { return address_; }
-  bool has_end_address() const { return end_address_ > 0; }
-  uint32_t end_address() const { return end_address_; }
-  void set_end_address(uint32_t value) { end_address_ = value; }
+  bool has_end_address() const { return end_address() > 0; }
+  // Read while the function may be scanned on another thread.
+  uint32_t end_address() const {
+    return end_address_.load(std::memory_order_acquire);
+  }
+  void set_end_address(uint32_t value) {
+    end_address_.store(value, std::memory_order_release);
+  }
   Behavior behavior() const { return behavior_; }
   void set_behavior(Behavior value) { behavior_ = value; }
   bool is_guest() const { return behavior_ != Behavior::kBuiltin; }
 
   bool ContainsAddress(uint32_t address) const {
-    if (!address_ || !end_address_) {
+    uint32_t end_address = this->end_address();
+    if (!address_ || !end_address) {
       return false;
     }
 
-    if (address >= address_ && address < end_address_) {
+    if (address >= address_ && address < end_address) {
       return true;
     }
 
@@ -70,7 +77,7 @@ class Function : public Symbol {
  protected:
   Function(Module* module, uint32_t address);
 
-  uint32_t end_address_ = 0;
+  std::atomic<uint32_t> end_address_ = {0};
   Behavior behavior_ = Behavior::kDefault;
 };
 
@@ -100,23 +107,73 @@ class GuestFunction : public Function {
   typedef void (*ExternHandler)(ppc::PPCContext* ppc_context,
                                 kernel::KernelState* kernel_state);
 
+  // Machine code of a translation of the function and its mapping to the
+  // guest code. Translating the function again publishes a new one while the
+  // old code may still be running or looked up on other threads, so it's
+  // immutable once published and kept until the function is destroyed.
+  struct Code {
+    uint8_t* machine_code = nullptr;
+    size_t machine_code_length = 0;
+    std::vector<SourceMapEntry> source_map;
+    // The translation replaced by this one.
+    const Code* previous = nullptr;
+
+    bool ContainsMachineCode(uintptr_t host_address) const {
+      return host_address - reinterpret_cast<uintptr_t>(machine_code) <
+             machine_code_length;
+    }
+  };
+
   GuestFunction(Module* module, uint32_t address);
   ~GuestFunction() override;
 
-  uint32_t address() const { return address_; }
-  bool has_end_address() const { return end_address_ > 0; }
-  uint32_t end_address() const { return end_address_; }
-  void set_end_address(uint32_t value) { end_address_ = value; }
-
-  virtual uint8_t* machine_code() const = 0;
-  virtual size_t machine_code_length() const = 0;
+  // The current translation, or null if not translated yet. Read it once
+  // rather than calling the accessors below multiple times if the values
+  // must belong to the same translation.
+  const Code* code() const { return code_.load(std::memory_order_acquire); }
+  // Replaces the current translation - callers already in the old machine
+  // code keep running it.
+  void PublishCode(std::unique_ptr<Code> code);
+  // The current or a replaced translation containing the host address, or
+  // null if none. Doesn't lock.
+  const Code* FindCode(uintptr_t host_address) const;
+
+  uint8_t* machine_code() const {
+    const Code* code = this->code();
+    return code ? code->machine_code : nullptr;
+  }
+  size_t machine_code_length() const {
+    const Code* code = this->code();
+    return code ? code->machine_code_length : 0;
+  }
 
   FunctionDebugInfo* debug_info() const { return debug_info_.get(); }
   void set_debug_info(std::unique_ptr<FunctionDebugInfo> debug_info) {
     debug_info_ = std::move(debug_info);
   }
   FunctionTraceData& trace_data() { return trace_data_; }
-  std::vector<SourceMapEntry>& source_map() { return source_map_; }
+
+  // Whether the current machine code is the quick baseline translation that
+  // counts calls and gets replaced once the function is hot (see the
+  // tiered_compilation cvar).
+  bool is_baseline_tier() const {
+    return baseline_tier_.load(std::memory_order_acquire);
+  }
+  void set_baseline_tier(bool value) {
+    baseline_tier_.store(value, std::memory_order_release);
+  }
+  // Calls left until the baseline code requests the recompilation, decremented
+  // by the generated code itself.
+  int32_t* tier_up_counter() { return &tier_up_counter_; }
+  // Returns true only for the first request, the counter may reach zero on
+  // multiple threads.
+  bool BeginTierUp() { return !tier_up_requested_.exchange(true); }
+  // Requests the function to be translated again even if it's not in the
+  // baseline tier, for instance, after learning about new MMIO access sites.
+  // Returns true only for the first request since the last recompilation.
+  bool BeginRecompile() { return !recompile_requested_.exchange(true); }
+  // Returns whether the recompilation was requested, and allows new requests.
+  bool EndRecompile() { return recompile_requested_.exchange(false); }
 
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
@@ -138,7 +195,11 @@ class GuestFunction : public Function {
  protected:
   std::unique_ptr<FunctionDebugInfo> debug_info_;
   FunctionTraceData trace_data_;
-  std::vector<SourceMapEntry> source_map_;
+  std::atomic<Code*> code_ = {nullptr};
+  std::atomic<bool> baseline_tier_ = {false};
+  int32_t tier_up_counter_ = 0;
+  std::atomic<bool> tier_up_requested_ = {false};
+  std::atomic<bool> recompile_requested_ = {false};
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
 };
@@ -18,7 +18,11 @@ namespace xe {
 namespace cpu {
 
 FunctionDebugInfo::FunctionDebugInfo()
-    : source_disasm_(nullptr),
+    : raw_hir_instr_count_(0),
+      hir_instr_count_(0),
+      raw_context_store_count_(0),
+      context_store_count_(0),
+      source_disasm_(nullptr),
       raw_hir_disasm_(nullptr),
       hir_disasm_(nullptr),
       machine_code_disasm_(nullptr) {}
@@ -37,6 +41,11 @@ void FunctionDebugInfo::Dump() {
   if (raw_hir_disasm_) {
     XELOGD("Unoptimized HIR:\n{}\n", raw_hir_disasm_);
   }
+  if (raw_hir_instr_count_) {
+    XELOGD("HIR instructions: {} -> {}, context stores: {} -> {}",
+           raw_hir_instr_count_, hir_instr_count_, raw_context_store_count_,
+           context_store_count_);
+  }
   if (hir_disasm_) {
     XELOGD("Optimized HIR:\n{}\n", hir_disasm_);
   }
@@ -54,6 +54,21 @@ class FunctionDebugInfo {
     instruction_result_count_ = value;
   }
 
+  // HIR statistics of the function before and after the optimization passes,
+  // not counting comments and source offsets.
+  uint32_t raw_hir_instr_count() const { return raw_hir_instr_count_; }
+  uint32_t hir_instr_count() const { return hir_instr_count_; }
+  uint32_t raw_context_store_count() const { return raw_context_store_count_; }
+  uint32_t context_store_count() const { return context_store_count_; }
+  void set_raw_hir_stats(uint32_t instr_count, uint32_t context_store_count) {
+    raw_hir_instr_count_ = instr_count;
+    raw_context_store_count_ = context_store_count;
+  }
+  void set_hir_stats(uint32_t instr_count, uint32_t context_store_count) {
+    hir_instr_count_ = instr_count;
+    context_store_count_ = context_store_count;
+  }
+
   const char* source_disasm() const { return source_disasm_; }
   void set_source_disasm(char* value) { source_disasm_ = value; }
   const char* raw_hir_disasm() const { return raw_hir_disasm_; }
@@ -68,6 +83,10 @@ class FunctionDebugInfo {
  private:
   uint32_t address_reference_count_;
   uint32_t instruction_result_count_;
+  uint32_t raw_hir_instr_count_;
+  uint32_t hir_instr_count_;
+  uint32_t raw_context_store_count_;
+  uint32_t context_store_count_;
 
   char* source_disasm_;
   char* raw_hir_disasm_;
@@ -64,6 +64,7 @@ void HIRBuilder::Reset() {
   locals_.clear();
   block_head_ = block_tail_ = NULL;
   current_block_ = NULL;
+  mmio_check_ = false;
 #if SCRIBBLE_ARENA_ON_RESET
   arena_->DebugFill();
 #endif
@@ -659,7 +660,7 @@ void HIRBuilder::EndBlock() {
   current_block_ = NULL;
 }
 
-bool HIRBuilder::IsUnconditionalJump(Instr* instr) {
+bool HIRBuilder::IsUnconditionalJump(const Instr* instr) {
   if (instr->opcode == &OPCODE_CALL_info ||
       instr->opcode == &OPCODE_CALL_INDIRECT_info) {
     return (instr->flags & CALL_TAIL) != 0;
@@ -671,6 +672,22 @@ bool HIRBuilder::IsUnconditionalJump(Instr* instr) {
   return false;
 }
 
+void HIRBuilder::GetSuccessors(Block* block,
+                               std::vector<Block*>& successors_out) {
+  successors_out.clear();
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    if (i->opcode == &OPCODE_BRANCH_info) {
+      successors_out.push_back(i->src1.label->block);
+    } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+               i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      successors_out.push_back(i->src2.label->block);
+    }
+  }
+  if (!block->instr_tail || !IsUnconditionalJump(block->instr_tail)) {
+    successors_out.push_back(block->next);
+  }
+}
+
 Instr* HIRBuilder::AppendInstr(const OpcodeInfo& opcode_info, uint16_t flags,
                                Value* dest) {
   if (!current_block_) {
@@ -703,6 +720,31 @@ Instr* HIRBuilder::AppendInstr(const OpcodeInfo& opcode_info, uint16_t flags,
   return instr;
 }
 
+Instr* HIRBuilder::InsertInstr(Instr* next_instr, const OpcodeInfo& opcode,
+                               uint16_t flags, Value* dest) {
+  Block* block = next_instr->block;
+  Instr* instr = arena_->Alloc<Instr>();
+  instr->next = next_instr;
+  instr->prev = next_instr->prev;
+  if (next_instr->prev) {
+    next_instr->prev->next = instr;
+  } else {
+    block->instr_head = instr;
+  }
+  next_instr->prev = instr;
+  instr->ordinal = UINT32_MAX;
+  instr->block = block;
+  instr->opcode = &opcode;
+  instr->flags = flags;
+  instr->dest = dest;
+  instr->src1.value = instr->src2.value = instr->src3.value = NULL;
+  instr->src1_use = instr->src2_use = instr->src3_use = NULL;
+  if (dest) {
+    dest->def = instr;
+  }
+  return instr;
+}
+
 Value* HIRBuilder::AllocValue(TypeName type) {
   Value* value = arena_->Alloc<Value>();
   value->ordinal = next_value_ordinal_++;
@@ -1230,6 +1272,9 @@ void HIRBuilder::StoreMmio(cpu::MMIORange* mmio_range, uint32_t address,
 Value* HIRBuilder::LoadOffset(Value* address, Value* offset, TypeName type,
                               uint32_t load_flags) {
   ASSERT_ADDRESS_TYPE(address);
+  if (mmio_check_ && type == INT32_TYPE) {
+    load_flags |= LoadStoreFlags::LOAD_STORE_MMIO_CHECK;
+  }
   Instr* i = AppendInstr(OPCODE_LOAD_OFFSET_info, load_flags, AllocValue(type));
   i->set_src1(address);
   i->set_src2(offset);
@@ -1240,6 +1285,9 @@ Value* HIRBuilder::LoadOffset(Value* address, Value* offset, TypeName type,
 void HIRBuilder::StoreOffset(Value* address, Value* offset, Value* value,
                              uint32_t store_flags) {
   ASSERT_ADDRESS_TYPE(address);
+  if (mmio_check_ && value->type == INT32_TYPE) {
+    store_flags |= LoadStoreFlags::LOAD_STORE_MMIO_CHECK;
+  }
   Instr* i = AppendInstr(OPCODE_STORE_OFFSET_info, store_flags);
   i->set_src1(address);
   i->set_src2(offset);
@@ -1248,6 +1296,9 @@ void HIRBuilder::StoreOffset(Value* address, Value* offset, Value* value,
 
 Value* HIRBuilder::Load(Value* address, TypeName type, uint32_t load_flags) {
   ASSERT_ADDRESS_TYPE(address);
+  if (mmio_check_ && type == INT32_TYPE) {
+    load_flags |= LoadStoreFlags::LOAD_STORE_MMIO_CHECK;
+  }
   Instr* i = AppendInstr(OPCODE_LOAD_info, load_flags, AllocValue(type));
   i->set_src1(address);
   i->src2.value = i->src3.value = NULL;
@@ -1256,6 +1307,9 @@ Value* HIRBuilder::Load(Value* address, TypeName type, uint32_t load_flags) {
 
 void HIRBuilder::Store(Value* address, Value* value, uint32_t store_flags) {
   ASSERT_ADDRESS_TYPE(address);
+  if (mmio_check_ && value->type == INT32_TYPE) {
+    store_flags |= LoadStoreFlags::LOAD_STORE_MMIO_CHECK;
+  }
   Instr* i = AppendInstr(OPCODE_STORE_info, store_flags);
   i->set_src1(address);
   i->set_src2(value);
@@ -2124,6 +2178,25 @@ Value* HIRBuilder::AtomicCompareExchange(Value* address, Value* old_value,
   return i->dest;
 }
 
+Value* HIRBuilder::ReservedLoad(Value* address, TypeName type) {
+  ASSERT_ADDRESS_TYPE(address);
+  assert_true(type == INT32_TYPE || type == INT64_TYPE);
+  Instr* i = AppendInstr(OPCODE_RESERVED_LOAD_info, 0, AllocValue(type));
+  i->set_src1(address);
+  i->src2.value = i->src3.value = NULL;
+  return i->dest;
+}
+
+Value* HIRBuilder::ReservedStore(Value* address, Value* value) {
+  ASSERT_ADDRESS_TYPE(address);
+  assert_true(value->type == INT32_TYPE || value->type == INT64_TYPE);
+  Instr* i = AppendInstr(OPCODE_RESERVED_STORE_info, 0, AllocValue(INT8_TYPE));
+  i->set_src1(address);
+  i->set_src2(value);
+  i->src3.value = NULL;
+  return i->dest;
+}
+
 }  // namespace hir
 }  // namespace cpu
 }  // namespace xe
@@ -48,6 +48,10 @@ class HIRBuilder {
 
   std::vector<Value*>& locals() { return locals_; }
 
+  // Makes the subsequent 32-bit loads and stores check whether the address is
+  // in an MMIO range at runtime instead of relying on the access violation.
+  void set_mmio_check(bool value) { mmio_check_ = value; }
+
   uint32_t max_value_ordinal() const { return next_value_ordinal_; }
 
   Block* first_block() const { return block_head_; }
@@ -55,6 +59,13 @@ class HIRBuilder {
   Block* current_block() const;
   Instr* last_instr() const;
 
+  // Whether execution never continues past the instruction in its block.
+  static bool IsUnconditionalJump(const Instr* instr);
+  // Gathers the blocks execution may continue in after the block, including
+  // branches in the middle of it that the CFG edges don't contain. Null stands
+  // for falling off the end of the function.
+  static void GetSuccessors(Block* block, std::vector<Block*>& successors_out);
+
   Label* NewLabel();
   void MarkLabel(Label* label, Block* block = 0);
   void InsertLabel(Label* label, Instr* prev_instr);
@@ -111,6 +122,11 @@ class HIRBuilder {
   Value* AllocValue(TypeName type = INT64_TYPE);
   Value* CloneValue(Value* source);
 
+  // Creates an instruction before an existing one, for passes copying code.
+  // The sources are left for the caller to set.
+  Instr* InsertInstr(Instr* next_instr, const OpcodeInfo& opcode,
+                     uint16_t flags, Value* dest = nullptr);
+
   // phi type_name, Block* b1, Value* v1, Block* b2, Value* v2, etc
   Value* Assign(Value* value);
   Value* Cast(Value* value, TypeName target_type);
@@ -260,6 +276,14 @@ class HIRBuilder {
   Value* AtomicExchange(Value* address, Value* new_value);
   Value* AtomicCompareExchange(Value* address, Value* old_value,
                                Value* new_value);
+  // Loads a value like Load and reserves the guest cache line containing it
+  // for ReservedStore, like lwarx/ldarx.
+  Value* ReservedLoad(Value* address, TypeName type);
+  // Stores a value like Store if the reservation made by the last ReservedLoad
+  // on the thread is still held, like stwcx./stdcx. Returns nonzero if stored.
+  // The reservation is lost either way.
+  Value* ReservedStore(Value* address, Value* value);
+
   Value* AtomicAdd(Value* address, Value* value);
   Value* AtomicSub(Value* address, Value* value);
 
@@ -270,7 +294,6 @@ class HIRBuilder {
  private:
   Block* AppendBlock();
   void EndBlock();
-  bool IsUnconditionalJump(Instr* instr);
   Instr* AppendInstr(const OpcodeInfo& opcode, uint16_t flags, Value* dest = 0);
   void CommentBuffer(const char* p);
   Value* CompareXX(const OpcodeInfo& opcode, Value* value1, Value* value2);
@@ -290,6 +313,8 @@ class HIRBuilder {
   Block* block_head_;
   Block* block_tail_;
   Block* current_block_;
+
+  bool mmio_check_ = false;
 };
 
 }  // namespace hir
@@ -78,6 +78,35 @@ void Instr::MoveBefore(Instr* other) {
   }
 }
 
+void Instr::MoveToEnd(Block* target) {
+  if (block == target && !next) {
+    return;
+  }
+
+  // Remove from current location.
+  if (prev) {
+    prev->next = next;
+  } else {
+    block->instr_head = next;
+  }
+  if (next) {
+    next->prev = prev;
+  } else {
+    block->instr_tail = prev;
+  }
+
+  // Append to the target block.
+  block = target;
+  next = NULL;
+  prev = target->instr_tail;
+  if (prev) {
+    prev->next = this;
+  } else {
+    target->instr_head = this;
+  }
+  target->instr_tail = this;
+}
+
 void Instr::Replace(const OpcodeInfo* new_opcode, uint16_t new_flags) {
   opcode = new_opcode;
   flags = new_flags;
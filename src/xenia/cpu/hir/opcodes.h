@@ -37,6 +37,9 @@ enum RoundMode {
 
 enum LoadStoreFlags {
   LOAD_STORE_BYTE_SWAP = 1 << 0,
+  // The address may be in an MMIO range, checked before the access (32-bit
+  // only).
+  LOAD_STORE_MMIO_CHECK = 1 << 1,
 };
 
 enum CacheControlType {
@@ -278,6 +281,8 @@ enum Opcode {
   OPCODE_UNPACK,
   OPCODE_ATOMIC_EXCHANGE,
   OPCODE_ATOMIC_COMPARE_EXCHANGE,
+  OPCODE_RESERVED_LOAD,
+  OPCODE_RESERVED_STORE,
   OPCODE_SET_ROUNDING_MODE,
   __OPCODE_MAX_VALUE,  // Keep at end.
 };
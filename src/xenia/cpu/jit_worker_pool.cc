@@ -0,0 +1,252 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/jit_worker_pool.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/entry_table.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+// Translation recurses through the HIR and the register allocator.
+static const size_t kCompileThreadStackSize = 16 * 1024 * 1024;
+
+JitWorkerPool::JitWorkerPool(Processor* processor, EntryTable* entry_table)
+    : processor_(processor), entry_table_(entry_table) {}
+
+JitWorkerPool::~JitWorkerPool() { Shutdown(); }
+
+bool JitWorkerPool::Initialize(uint32_t worker_count) {
+  Shutdown();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    shutting_down_ = false;
+  }
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    xe::threading::Thread::CreationParameters params;
+    params.stack_size = kCompileThreadStackSize;
+    params.initial_priority = xe::threading::ThreadPriority::kBelowNormal;
+    auto thread = xe::threading::Thread::Create(
+        params, [this]() { WorkerThreadMain(); });
+    if (!thread) {
+      XELOGE("Failed to create JIT worker thread {}", i);
+      Shutdown();
+      return false;
+    }
+    thread->set_name(fmt::format("JIT Worker {}", i));
+    worker_threads_.push_back(std::move(thread));
+  }
+  if (worker_count) {
+    XELOGI("Compiling guest functions ahead of time on {} JIT worker threads",
+           worker_count);
+  }
+  return true;
+}
+
+void JitWorkerPool::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    shutting_down_ = true;
+    tier_up_queue_.clear();
+    high_priority_queue_.clear();
+    low_priority_queue_.clear();
+  }
+  queue_cond_.notify_all();
+  idle_cond_.notify_all();
+  for (auto& thread : worker_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  worker_threads_.clear();
+}
+
+void JitWorkerPool::Enqueue(uint32_t address, Priority priority) {
+  bool precompiling;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_ || (worker_threads_.empty() && !precompile_count_) ||
+        !queued_addresses_.insert(address).second) {
+      return;
+    }
+    if (priority == Priority::kHigh) {
+      high_priority_queue_.push_back(address);
+    } else {
+      low_priority_queue_.push_back(address);
+    }
+    precompiling = precompile_count_ != 0;
+  }
+  queue_cond_.notify_one();
+  if (precompiling) {
+    idle_cond_.notify_all();
+  }
+}
+
+bool JitWorkerPool::EnqueueTierUp(GuestFunction* function) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_ || worker_threads_.empty()) {
+      return false;
+    }
+    tier_up_queue_.push_back(function);
+  }
+  queue_cond_.notify_one();
+  return true;
+}
+
+void JitWorkerPool::Precompile(const std::vector<uint32_t>& addresses,
+                               uint32_t thread_count,
+                               std::vector<uint32_t>* failed_out) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    ++precompile_count_;
+  }
+  for (uint32_t address : addresses) {
+    if (!entry_table_->Contains(address)) {
+      Enqueue(address, Priority::kLow);
+    }
+  }
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> precompile_threads;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    xe::threading::Thread::CreationParameters params;
+    params.stack_size = kCompileThreadStackSize;
+    auto thread = xe::threading::Thread::Create(
+        params, [this]() { PrecompileThreadMain(); });
+    if (!thread) {
+      break;
+    }
+    thread->set_name(fmt::format("JIT Precompile {}", i));
+    precompile_threads.push_back(std::move(thread));
+  }
+  if (precompile_threads.empty()) {
+    // Do all the work on the calling thread.
+    PrecompileThreadMain();
+  }
+  for (auto& thread : precompile_threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+
+  // Wait for what the background workers may still be compiling.
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  idle_cond_.wait(lock, [this]() {
+    return shutting_down_ ||
+           (!active_count_ && tier_up_queue_.empty() &&
+            high_priority_queue_.empty() && low_priority_queue_.empty());
+  });
+  --precompile_count_;
+  if (failed_out) {
+    failed_out->insert(failed_out->end(), failed_addresses_.begin(),
+                       failed_addresses_.end());
+  }
+  failed_addresses_.clear();
+}
+
+bool JitWorkerPool::Dequeue(bool wait, uint32_t* address_out,
+                            GuestFunction** tier_up_out) {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (true) {
+    if (shutting_down_) {
+      return false;
+    }
+    if (!tier_up_queue_.empty() || !high_priority_queue_.empty() ||
+        !low_priority_queue_.empty()) {
+      break;
+    }
+    if (!wait) {
+      // Other threads may still discover more work while compiling.
+      if (!active_count_) {
+        return false;
+      }
+      idle_cond_.wait(lock);
+    } else {
+      queue_cond_.wait(lock);
+    }
+  }
+  ++active_count_;
+  // Hot functions are being called right now, unlike the predicted ones.
+  if (!tier_up_queue_.empty()) {
+    *address_out = 0;
+    *tier_up_out = tier_up_queue_.front();
+    tier_up_queue_.pop_front();
+    return true;
+  }
+  auto& queue =
+      high_priority_queue_.empty() ? low_priority_queue_ : high_priority_queue_;
+  *address_out = queue.front();
+  *tier_up_out = nullptr;
+  queue.pop_front();
+  return true;
+}
+
+void JitWorkerPool::Compile(uint32_t address) {
+  // Skip whatever a guest thread has already started compiling, waiting for
+  // it here would just take a worker away from the queue.
+  bool failed = false;
+  if (!entry_table_->Contains(address)) {
+    SCOPE_profile_cpu_i("cpu", "JitWorkerPool::Compile");
+    if (processor_->ResolveFunction(address)) {
+      ++compiled_count_;
+    } else {
+      ++failed_count_;
+      failed = true;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (failed && precompile_count_) {
+      failed_addresses_.push_back(address);
+    }
+    --active_count_;
+  }
+  // Wake up the precompile threads waiting for either new work or completion.
+  idle_cond_.notify_all();
+}
+
+void JitWorkerPool::TierUp(GuestFunction* function) {
+  {
+    SCOPE_profile_cpu_i("cpu", "JitWorkerPool::TierUp");
+    processor_->TierUpFunction(function);
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    --active_count_;
+  }
+  idle_cond_.notify_all();
+}
+
+void JitWorkerPool::RunWork(uint32_t address,
+                            GuestFunction* tier_up_function) {
+  if (tier_up_function) {
+    TierUp(tier_up_function);
+  } else {
+    Compile(address);
+  }
+}
+
+void JitWorkerPool::WorkerThreadMain() {
+  uint32_t address;
+  GuestFunction* tier_up_function;
+  while (Dequeue(true, &address, &tier_up_function)) {
+    RunWork(address, tier_up_function);
+  }
+}
+
+void JitWorkerPool::PrecompileThreadMain() {
+  uint32_t address;
+  GuestFunction* tier_up_function;
+  while (Dequeue(false, &address, &tier_up_function)) {
+    RunWork(address, tier_up_function);
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
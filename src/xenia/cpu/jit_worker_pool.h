@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_JIT_WORKER_POOL_H_
+#define XENIA_CPU_JIT_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class EntryTable;
+class GuestFunction;
+class Processor;
+
+// Background threads compiling guest functions before they're first called,
+// so guest threads only stall on the functions nobody has predicted.
+// Compilation goes through Processor::ResolveFunction like on guest threads,
+// so a guest thread needing a function being compiled here just waits for that
+// entry.
+class JitWorkerPool {
+ public:
+  enum class Priority {
+    // Callees of just compiled functions - likely to be called soon.
+    kHigh,
+    // Bulk function lists, such as the module's exception directory.
+    kLow,
+  };
+
+  JitWorkerPool(Processor* processor, EntryTable* entry_table);
+  ~JitWorkerPool();
+
+  // Starts the background workers. With no workers, functions are only
+  // compiled while Precompile is running.
+  bool Initialize(uint32_t worker_count);
+  void Shutdown();
+
+  uint32_t worker_count() const {
+    return uint32_t(worker_threads_.size());
+  }
+  uint32_t compiled_count() const { return compiled_count_; }
+  uint32_t failed_count() const { return failed_count_; }
+
+  // Queues a function for compilation, if it hasn't been queued yet.
+  void Enqueue(uint32_t address, Priority priority);
+
+  // Queues a hot baseline function for the tier up translation, ahead of
+  // everything else. Returns false if there are no workers to do it.
+  bool EnqueueTierUp(GuestFunction* function);
+
+  // Compiles the functions, the callees discovered along the way and anything
+  // else queued on thread_count additional threads, and waits until all the
+  // work is done. Addresses that failed to compile are appended to failed_out.
+  void Precompile(const std::vector<uint32_t>& addresses,
+                  uint32_t thread_count, std::vector<uint32_t>* failed_out);
+
+ private:
+  void WorkerThreadMain();
+  void PrecompileThreadMain();
+  // Waits for work if wait is true, returns false when there's nothing more to
+  // do for the calling thread. Either the address of a function to compile or
+  // a function to tier up is returned.
+  bool Dequeue(bool wait, uint32_t* address_out, GuestFunction** tier_up_out);
+  void Compile(uint32_t address);
+  void TierUp(GuestFunction* function);
+  void RunWork(uint32_t address, GuestFunction* tier_up_function);
+
+  Processor* processor_;
+  EntryTable* entry_table_;
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> worker_threads_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  bool shutting_down_ = false;
+  // Number of Precompile calls in progress, accepting work without workers.
+  uint32_t precompile_count_ = 0;
+  // Number of functions being compiled by any thread of the pool.
+  uint32_t active_count_ = 0;
+  std::condition_variable idle_cond_;
+  std::deque<GuestFunction*> tier_up_queue_;
+  std::deque<uint32_t> high_priority_queue_;
+  std::deque<uint32_t> low_priority_queue_;
+  // Every address ever queued, to avoid requeueing on each call site.
+  std::unordered_set<uint32_t> queued_addresses_;
+  std::vector<uint32_t> failed_addresses_;
+
+  std::atomic<uint32_t> compiled_count_ = {0};
+  std::atomic<uint32_t> failed_count_ = {0};
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_JIT_WORKER_POOL_H_
@@ -65,10 +65,20 @@ MMIOHandler::MMIOHandler(uint8_t* virtual_membase, uint8_t* physical_membase,
 MMIOHandler::~MMIOHandler() {
   ExceptionHandler::Uninstall(ExceptionCallbackThunk, this);
 
+  XELOGI("MMIO accesses: {} via access violations, {} checked inline",
+         faulting_access_count(), checked_access_count());
+
   assert_true(global_handler_ == this);
   global_handler_ = nullptr;
 }
 
+void MMIOHandler::SetFaultingAccessCallback(FaultingAccessCallback callback,
+                                            void* context) {
+  faulting_access_callback_.store(nullptr, std::memory_order_release);
+  faulting_access_callback_context_.store(context, std::memory_order_release);
+  faulting_access_callback_.store(callback, std::memory_order_release);
+}
+
 bool MMIOHandler::RegisterRange(uint32_t virtual_address, uint32_t mask,
                                 uint32_t size, void* context,
                                 MMIOReadCallback read_callback,
@@ -375,6 +385,15 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
   // Advance RIP to the next instruction so that we resume properly.
   ex->set_resume_pc(rip + mov.length);
 
+  faulting_access_count_.fetch_add(1, std::memory_order_relaxed);
+  FaultingAccessCallback faulting_access_callback =
+      faulting_access_callback_.load(std::memory_order_acquire);
+  if (faulting_access_callback) {
+    faulting_access_callback(
+        faulting_access_callback_context_.load(std::memory_order_acquire),
+        reinterpret_cast<void*>(rip));
+  }
+
   return true;
 }
 
@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_MMIO_HANDLER_H_
 #define XENIA_CPU_MMIO_HANDLER_H_
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -60,6 +61,13 @@ class MMIOHandler {
       void* access_violation_callback_context);
   static MMIOHandler* global_handler() { return global_handler_; }
 
+  // Called after emulating an MMIO access that caused an access violation, so
+  // the code at host_pc can be changed to call the handlers directly.
+  // Must be set before and reset after the guest code that may fault runs.
+  typedef void (*FaultingAccessCallback)(void* context, void* host_pc);
+  void SetFaultingAccessCallback(FaultingAccessCallback callback,
+                                 void* context);
+
   bool RegisterRange(uint32_t virtual_address, uint32_t mask, uint32_t size,
                      void* context, MMIOReadCallback read_callback,
                      MMIOWriteCallback write_callback);
@@ -68,6 +76,23 @@ class MMIOHandler {
   bool CheckLoad(uint32_t virtual_address, uint32_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint32_t value);
 
+  const std::vector<MMIORange>& mapped_ranges() const {
+    return mapped_ranges_;
+  }
+
+  // MMIO accesses emulated in the access violation handler.
+  uint64_t faulting_access_count() const {
+    return faulting_access_count_.load(std::memory_order_relaxed);
+  }
+  // MMIO accesses done by code checking the address before the access,
+  // incremented by the generated code itself.
+  uint64_t checked_access_count() const {
+    return checked_access_count_.load(std::memory_order_relaxed);
+  }
+  std::atomic<uint64_t>* checked_access_counter() {
+    return &checked_access_count_;
+  }
+
  protected:
   MMIOHandler(uint8_t* virtual_membase, uint8_t* physical_membase,
               uint8_t* membase_end, HostToGuestVirtual host_to_guest_virtual,
@@ -90,6 +115,12 @@ class MMIOHandler {
   AccessViolationCallback access_violation_callback_;
   void* access_violation_callback_context_;
 
+  std::atomic<FaultingAccessCallback> faulting_access_callback_ = {nullptr};
+  std::atomic<void*> faulting_access_callback_context_ = {nullptr};
+
+  std::atomic<uint64_t> faulting_access_count_ = {0};
+  std::atomic<uint64_t> checked_access_count_ = {0};
+
   static MMIOHandler* global_handler_;
 
   xe::global_critical_region global_critical_region_;
@@ -37,6 +37,11 @@ class Module {
   virtual bool is_executable() const = 0;
 
   virtual bool ContainsAddress(uint32_t address);
+  // Whether the whole range is in sections never modified after loading, so
+  // loads from it can be replaced with the values when translating.
+  virtual bool IsReadOnlyRange(uint32_t address, uint32_t size) {
+    return false;
+  }
 
   Symbol* LookupSymbol(uint32_t address, bool wait = true);
   virtual Symbol::Status DeclareFunction(uint32_t address,
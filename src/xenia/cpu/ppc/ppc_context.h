@@ -19,6 +19,7 @@
 namespace xe {
 namespace cpu {
 class Processor;
+struct ReservationTable;
 class ThreadState;
 }  // namespace cpu
 namespace kernel {
@@ -425,6 +426,16 @@ typedef struct PPCContext_s {
 
   // Value of last reserved load
   uint64_t reserved_val;
+  // Guest cache line of the last reserved load with
+  // ReservationTable::kReservedLineValid, or 0 if not holding a reservation.
+  uint32_t reserved_line;
+  // Version of the reserved cache line at the time of the reserved load.
+  uint32_t reserved_version;
+  // Shared among all threads and comes from the processor.
+  ReservationTable* reservation_table;
+
+  // Keeps the size a multiple of 64 bytes.
+  uint8_t padding[48];
 
   static std::string GetRegisterName(PPCRegister reg);
   std::string GetStringFromValue(PPCRegister reg) const;
@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include "xenia/base/assert.h"
 #include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/ppc/ppc_hir_builder.h"
 
 namespace xe {
@@ -743,7 +744,11 @@ int InstrEmit_sync(PPCHIRBuilder& f, const InstrData& i) {
 }
 
 int InstrEmit_isync(PPCHIRBuilder& f, const InstrData& i) {
-  // XEINSTRNOTIMPLEMENTED();
+  if (f.guest_code_written()) {
+    // The modified instructions may be executed after this.
+    f.CallExtern(f.builtins()->invalidate_written_guest_code);
+    return 0;
+  }
   f.Nop();
   return 0;
 }
@@ -759,16 +764,12 @@ int InstrEmit_ldarx(PPCHIRBuilder& f, const InstrData& i) {
   // RESERVE_ADDR <- real_addr(EA)
   // RT <- MEM(EA, 8)
 
-  // NOTE: we assume we are within a global lock.
-  // We could assert here that the block (or its parent) has taken a global lock
-  // already, but I haven't see anything but interrupt callbacks (which are
-  // always under a global lock) do that yet.
-  // We issue a memory barrier here to make sure that we get good values.
-  f.MemoryBarrier();
+  // The reservation is tracked per cache line in the processor's reservation
+  // table, see ReservationTable. No barrier is needed for the load, the guest
+  // uses sync/lwsync around it where it needs ordering.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
-  Value* rt = f.ByteSwap(f.Load(ea, INT64_TYPE));
-  f.StoreReserved(rt);
+  Value* rt = f.ByteSwap(f.ReservedLoad(ea, INT64_TYPE));
   f.StoreGPR(i.X.RT, rt);
   return 0;
 }
@@ -784,16 +785,13 @@ int InstrEmit_lwarx(PPCHIRBuilder& f, const InstrData& i) {
   // RESERVE_ADDR <- real_addr(EA)
   // RT <- i32.0 || MEM(EA, 4)
 
-  // NOTE: we assume we are within a global lock.
-  // We could assert here that the block (or its parent) has taken a global lock
-  // already, but I haven't see anything but interrupt callbacks (which are
-  // always under a global lock) do that yet.
-  // We issue a memory barrier here to make sure that we get good values.
-  f.MemoryBarrier();
+  // The reservation is tracked per cache line in the processor's reservation
+  // table, see ReservationTable. No barrier is needed for the load, the guest
+  // uses sync/lwsync around it where it needs ordering.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
-  Value* rt = f.ZeroExtend(f.ByteSwap(f.Load(ea, INT32_TYPE)), INT64_TYPE);
-  f.StoreReserved(rt);
+  Value* rt =
+      f.ZeroExtend(f.ByteSwap(f.ReservedLoad(ea, INT32_TYPE)), INT64_TYPE);
   f.StoreGPR(i.X.RT, rt);
   return 0;
 }
@@ -809,25 +807,18 @@ int InstrEmit_stdcx(PPCHIRBuilder& f, const InstrData& i) {
   // n <- 1 if store performed
   // CR0[LT GT EQ SO] = 0b00 || n || XER[SO]
 
-  // NOTE: we assume we are within a global lock.
-  // As we have been exclusively executing this entire time, we assume that no
-  // one else could have possibly touched the memory and must always succeed.
-  // We use atomic compare exchange here to support reserved load/store without
-  // being under the global lock (flag disable_global_lock - see mtmsr/mtmsrd).
-  // This will always succeed if under the global lock, however.
+  // Fails if another thread has done a conditional store to the reserved cache
+  // line or changed the reserved value since the reserved load, see
+  // ReservationTable. Both checks are atomic compare exchanges, which are also
+  // full barriers on the host.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ByteSwap(f.LoadGPR(i.X.RT));
-  Value* res = f.ByteSwap(f.LoadReserved());
-  Value* v = f.AtomicCompareExchange(ea, res, rt);
+  Value* v = f.ReservedStore(ea, rt);
   f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), v);
   f.StoreContext(offsetof(PPCContext, cr0.cr0_lt), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_gt), f.LoadZeroInt8());
 
-  // Issue memory barrier for when we go out of lock and want others to see our
-  // updates.
-  f.MemoryBarrier();
-
   return 0;
 }
 
@@ -842,25 +833,18 @@ int InstrEmit_stwcx(PPCHIRBuilder& f, const InstrData& i) {
   // n <- 1 if store performed
   // CR0[LT GT EQ SO] = 0b00 || n || XER[SO]
 
-  // NOTE: we assume we are within a global lock.
-  // As we have been exclusively executing this entire time, we assume that no
-  // one else could have possibly touched the memory and must always succeed.
-  // We use atomic compare exchange here to support reserved load/store without
-  // being under the global lock (flag disable_global_lock - see mtmsr/mtmsrd).
-  // This will always succeed if under the global lock, however.
+  // Fails if another thread has done a conditional store to the reserved cache
+  // line or changed the reserved value since the reserved load, see
+  // ReservationTable. Both checks are atomic compare exchanges, which are also
+  // full barriers on the host.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ByteSwap(f.Truncate(f.LoadGPR(i.X.RT), INT32_TYPE));
-  Value* res = f.ByteSwap(f.Truncate(f.LoadReserved(), INT32_TYPE));
-  Value* v = f.AtomicCompareExchange(ea, res, rt);
+  Value* v = f.ReservedStore(ea, rt);
   f.StoreContext(offsetof(PPCContext, cr0.cr0_eq), v);
   f.StoreContext(offsetof(PPCContext, cr0.cr0_lt), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_gt), f.LoadZeroInt8());
 
-  // Issue memory barrier for when we go out of lock and want others to see our
-  // updates.
-  f.MemoryBarrier();
-
   return 0;
 }
 
@@ -1130,8 +1114,12 @@ int InstrEmit_dcbz128(PPCHIRBuilder& f, const InstrData& i) {
 }
 
 int InstrEmit_icbi(PPCHIRBuilder& f, const InstrData& i) {
-  // XEINSTRNOTIMPLEMENTED();
-  f.Nop();
+  // EA <- (RA) + (RB)
+  // Only recorded, the code is replaced at the next isync.
+  Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
+  f.StoreContext(offsetof(PPCContext, scratch), ea);
+  f.CallExtern(f.builtins()->note_guest_code_write);
+  f.set_guest_code_written();
   return 0;
 }
 
@@ -78,6 +78,19 @@ void LeaveGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
   global_mutex->unlock();
 }
 
+// Records the cache block containing the address in scratch as modified code.
+void NoteGuestCodeWrite(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto processor = reinterpret_cast<Processor*>(arg0);
+  processor->OnGuestCodeWritten(uint32_t(ppc_context->scratch) & ~uint32_t(31),
+                                32);
+}
+
+// Replaces the code of the functions modified since the last call.
+void InvalidateWrittenGuestCode(PPCContext* ppc_context, void* arg0,
+                                void* arg1) {
+  reinterpret_cast<Processor*>(arg0)->InvalidateWrittenGuestCode();
+}
+
 bool PPCFrontend::Initialize() {
   void* arg0 = reinterpret_cast<void*>(&xe::global_critical_region::mutex());
   void* arg1 = reinterpret_cast<void*>(&builtins_.global_lock_count);
@@ -87,6 +100,11 @@ bool PPCFrontend::Initialize() {
       processor_->DefineBuiltin("EnterGlobalLock", EnterGlobalLock, arg0, arg1);
   builtins_.leave_global_lock =
       processor_->DefineBuiltin("LeaveGlobalLock", LeaveGlobalLock, arg0, arg1);
+  builtins_.note_guest_code_write = processor_->DefineBuiltin(
+      "NoteGuestCodeWrite", NoteGuestCodeWrite, processor_, nullptr);
+  builtins_.invalidate_written_guest_code = processor_->DefineBuiltin(
+      "InvalidateWrittenGuestCode", InvalidateWrittenGuestCode, processor_,
+      nullptr);
   return true;
 }
 
@@ -107,6 +125,13 @@ bool PPCFrontend::DefineFunction(GuestFunction* function,
   return result;
 }
 
+bool PPCFrontend::TierUpFunction(GuestFunction* function) {
+  auto translator = translator_pool_.Allocate(this);
+  bool result = translator->Translate(function, 0, true);
+  translator_pool_.Release(translator);
+  return result;
+}
+
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
@@ -33,6 +33,8 @@ struct PPCBuiltins {
   Function* check_global_lock;
   Function* enter_global_lock;
   Function* leave_global_lock;
+  Function* note_guest_code_write;
+  Function* invalidate_written_guest_code;
 };
 
 class PPCFrontend {
@@ -48,6 +50,8 @@ class PPCFrontend {
 
   bool DeclareFunction(GuestFunction* function);
   bool DefineFunction(GuestFunction* function, uint32_t debug_info_flags);
+  // Replaces the baseline code of a defined function with fully optimized code.
+  bool TierUpFunction(GuestFunction* function);
 
  private:
   Processor* processor_;
@@ -81,19 +81,24 @@ void PPCHIRBuilder::Reset() {
   HIRBuilder::Reset();
 }
 
-bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
+bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags,
+                         uint32_t end_address) {
   SCOPE_profile_cpu_f("cpu");
 
   Memory* memory = frontend_->memory();
 
   function_ = function;
+  guest_code_written_ = false;
   start_address_ = function_->address();
-  instr_count_ = (function_->end_address() - function_->address()) / 4 + 1;
+  if (!end_address) {
+    end_address = function_->end_address();
+  }
+  instr_count_ = (end_address - function_->address()) / 4 + 1;
 
   with_debug_info_ = (flags & EMIT_DEBUG_COMMENTS) == EMIT_DEBUG_COMMENTS;
   if (with_debug_info_) {
     CommentFormat("{} fn {:08X}-{:08X} {}", function_->module()->name().c_str(),
-                  function_->address(), function_->end_address(),
+                  function_->address(), end_address,
                   function_->name().c_str());
   }
 
@@ -113,7 +118,6 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   label_list_[0] = NewLabel();
 
   uint32_t start_address = function_->address();
-  uint32_t end_address = function_->end_address();
   for (uint32_t address = start_address, offset = 0; address <= end_address;
        address += 4, offset++) {
     trace_info_.dest_count = 0;
@@ -169,6 +173,9 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
 
     MaybeBreakOnInstruction(address);
 
+    // Accesses known to hit MMIO check the address inline instead of faulting.
+    set_mmio_check(frontend_->processor()->IsMMIOAccessSite(address));
+
     InstrData i;
     i.address = address;
     i.code = code;
@@ -186,6 +193,7 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
       }
     }
   }
+  set_mmio_check(false);
 
   if (false) {
     DumpAllOpcodeCounts();
@@ -558,15 +566,6 @@ void PPCHIRBuilder::StoreVR(uint32_t reg, Value* value) {
   trace_reg.value = value;
 }
 
-void PPCHIRBuilder::StoreReserved(Value* val) {
-  assert_true(val->type == INT64_TYPE);
-  StoreContext(offsetof(PPCContext, reserved_val), val);
-}
-
-Value* PPCHIRBuilder::LoadReserved() {
-  return LoadContext(offsetof(PPCContext, reserved_val), INT64_TYPE);
-}
-
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
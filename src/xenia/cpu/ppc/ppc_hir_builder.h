@@ -38,7 +38,9 @@ class PPCHIRBuilder : public hir::HIRBuilder {
     // Emit comment nodes.
     EMIT_DEBUG_COMMENTS = 1 << 0,
   };
-  bool Emit(GuestFunction* function, uint32_t flags);
+  // end_address, if not 0, is used instead of the end address of the function,
+  // so callees can be emitted without modifying them.
+  bool Emit(GuestFunction* function, uint32_t flags, uint32_t end_address = 0);
 
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
@@ -78,8 +80,10 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   Value* LoadVR(uint32_t reg);
   void StoreVR(uint32_t reg, Value* value);
 
-  void StoreReserved(Value* val);
-  Value* LoadReserved();
+  // Whether an icbi has been emitted in the function, so the following isync
+  // must replace the modified code.
+  bool guest_code_written() const { return guest_code_written_; }
+  void set_guest_code_written() { guest_code_written_ = true; }
 
  private:
   void MaybeBreakOnInstruction(uint32_t address);
@@ -93,6 +97,7 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   // Reset each Emit:
   bool with_debug_info_;
   GuestFunction* function_;
+  bool guest_code_written_;
   uint64_t start_address_;
   uint64_t instr_count_;
   Instr** instr_offset_list_;
@@ -42,6 +42,18 @@ bool PPCScanner::IsRestGprLr(uint32_t address) {
 }
 
 bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
+  function->set_end_address(
+      ScanExtent(function, function->end_address(), debug_info));
+  return true;
+}
+
+uint32_t PPCScanner::FindEndAddress(GuestFunction* function,
+                                    uint32_t max_end_address) {
+  return ScanExtent(function, max_end_address, nullptr);
+}
+
+uint32_t PPCScanner::ScanExtent(GuestFunction* function, uint32_t end_address,
+                                FunctionDebugInfo* debug_info) {
   // This is a simple basic block analyizer. It walks the start address to the
   // end address looking for branches. Each span of instructions between
   // branches is considered a basic block. When the last blr (that has no
@@ -58,7 +70,6 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
   uint32_t instruction_result_count = 0;
 
   uint32_t start_address = static_cast<uint32_t>(function->address());
-  uint32_t end_address = static_cast<uint32_t>(function->end_address());
   uint32_t address = start_address;
   uint32_t furthest_target = start_address;
   size_t blocks_found = 0;
@@ -140,8 +151,10 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
       uint32_t target = d.I.ADDR();
       if (d.I.LK()) {
         LOGPPC("bl {:08X} -> {:08X}", address, target);
-        // Queue call target if needed.
-        // GetOrInsertFunction(target);
+        // Queue call target for background compilation if enabled.
+        if (function->module()->ContainsAddress(target)) {
+          frontend_->processor()->QueueFunctionCompile(target, true);
+        }
       } else {
         LOGPPC("b {:08X} -> {:08X}", address, target);
 
@@ -273,8 +286,6 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
     LOGPPC("Function ran under: {:08X}-{:08X} ended at {:08X}", start_address,
            end_address, address + 4);
   }
-  function->set_end_address(address);
-
   // If there's spare bits at the end, split the function.
   // TODO(benvanik): splitting?
 
@@ -289,7 +300,7 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
   }
 
   LOGPPC("Finished analyzing {:08X}", start_address);
-  return true;
+  return address;
 }
 
 std::vector<BlockInfo> PPCScanner::FindBlocks(GuestFunction* function) {
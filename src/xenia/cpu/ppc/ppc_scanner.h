@@ -32,11 +32,18 @@ class PPCScanner {
   ~PPCScanner();
 
   bool Scan(GuestFunction* function, FunctionDebugInfo* debug_info);
+  // Finds where the function ends like Scan, not past max_end_address, without
+  // modifying the function.
+  uint32_t FindEndAddress(GuestFunction* function, uint32_t max_end_address);
 
   std::vector<BlockInfo> FindBlocks(GuestFunction* function);
 
  private:
   bool IsRestGprLr(uint32_t address);
+  // Returns the address of the last instruction, end_address is the expected
+  // one or 0 if unknown.
+  uint32_t ScanExtent(GuestFunction* function, uint32_t end_address,
+                      FunctionDebugInfo* debug_info);
 
   PPCFrontend* frontend_ = nullptr;
 };
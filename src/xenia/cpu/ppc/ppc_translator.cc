@@ -9,8 +9,11 @@
 
 #include "xenia/cpu/ppc/ppc_translator.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
@@ -35,12 +38,23 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   scanner_.reset(new PPCScanner(frontend));
   builder_.reset(new PPCHIRBuilder(frontend));
+  inline_builder_.reset(new PPCHIRBuilder(frontend));
   compiler_.reset(new Compiler(frontend->processor()));
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
   assembler_ = backend->CreateAssembler();
   assembler_->Initialize();
 
   bool validate = cvars::validate_hir;
 
+  // Inline first, so all the other passes see the inlined code.
+  auto inlining_pass = std::make_unique<passes::FunctionInliningPass>(
+      [this](GuestFunction* function, uint32_t max_guest_size) {
+        return EmitInlinedFunction(function, max_guest_size);
+      });
+  inlining_pass_ = inlining_pass.get();
+  compiler_->AddPass(std::move(inlining_pass));
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+
   // Merge blocks early. This will let us use more context in other passes.
   // The CFG is required for simplification and dirtied by it.
   compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
@@ -69,17 +83,29 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
     if (validate)
       compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   }
+  if (cvars::tiered_compilation) {
+    // Only hot functions get here, so spend more time on them - the combined
+    // loads and stores often expose more constants.
+    auto sap2 = std::make_unique<passes::ConditionalGroupPass>();
+    sap2->AddPass(std::make_unique<passes::SimplificationPass>());
+    if (validate) sap2->AddPass(std::make_unique<passes::ValidationPass>());
+    sap2->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+    if (validate) sap2->AddPass(std::make_unique<passes::ValidationPass>());
+    compiler_->AddPass(std::move(sap2));
+  }
+  // After the simplification, so the address arithmetic is in its final form.
+  compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  // if (validate)
-  // compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
-  //// Removes all unneeded variables. Try not to add new ones after this.
-  // compiler_->AddPass(new passes::ValueReductionPass());
-  // if (validate) compiler_->AddPass(new passes::ValidationPass());
+  // Removes all unneeded variables. Try not to add new ones after this.
+  compiler_->AddPass(std::make_unique<passes::ValueReductionPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
   // Register allocation for the target backend.
   // Will modify the HIR to add loads/stores.
@@ -91,17 +117,28 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // Baseline tier - only what the backend requires to emit the raw HIR.
+  if (validate)
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate)
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
 
 bool PPCTranslator::Translate(GuestFunction* function,
-                              uint32_t debug_info_flags) {
+                              uint32_t debug_info_flags, bool tier_up) {
   SCOPE_profile_cpu_f("cpu");
 
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
+  xe::make_reset_scope(inline_builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -121,15 +158,41 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (cvars::trace_function_data) {
     debug_info_flags |= DebugInfoFlags::kDebugInfoTraceFunctionData;
   }
+  // Debugging and tracing need the code of a function to stay the same, and
+  // to match the guest code of the function.
+  bool baseline = cvars::tiered_compilation && !tier_up && !debug_info_flags;
+  function_ = function;
+  inlining_enabled_ = !debug_info_flags;
   std::unique_ptr<FunctionDebugInfo> debug_info;
   if (debug_info_flags) {
     debug_info.reset(new FunctionDebugInfo());
   }
 
-  // Scan the function to find its extents and gather debug data.
-  if (!scanner_->Scan(function, debug_info.get())) {
+  uint64_t stage_start_tick = 0;
+  if (stats_enabled_) {
+    ++stats_.function_count;
+    stage_start_tick = Clock::QueryHostTickCount();
+  }
+  // Returns the ticks since the last call.
+  auto end_stage = [&stage_start_tick]() {
+    uint64_t tick = Clock::QueryHostTickCount();
+    uint64_t ticks = tick - stage_start_tick;
+    stage_start_tick = tick;
+    return ticks;
+  };
+
+  // Scan the function to find its extents and gather debug data. When
+  // translating a function again, the guest code is the same, and the end
+  // address is not written while other threads may be reading it.
+  if ((!tier_up || !function->has_end_address() || debug_info) &&
+      !scanner_->Scan(function, debug_info.get())) {
     return false;
   }
+  if (stats_enabled_) {
+    stats_.scan_ticks += end_stage();
+    stats_.guest_instr_count +=
+        (function->end_address() - function->address()) / 4 + 1;
+  }
 
   // Setup trace data, if needed.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctions) {
@@ -164,11 +227,24 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
+  if (stats_enabled_) {
+    end_stage();
+  }
   if (!builder_->Emit(function, emit_flags)) {
     return false;
   }
+  if (stats_enabled_) {
+    stats_.emit_ticks += end_stage();
+    stats_.hir_instr_count += Compiler::CountInstrs(builder_.get());
+    end_stage();
+  }
 
   // Stash raw HIR.
+  if (debug_info) {
+    uint32_t instr_count, context_store_count;
+    CountHIRInstrs(builder_.get(), &instr_count, &context_store_count);
+    debug_info->set_raw_hir_stats(instr_count, context_store_count);
+  }
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmRawHir) {
     builder_->Dump(&string_buffer_);
     debug_info->set_raw_hir_disasm(strdup(string_buffer_.buffer()));
@@ -176,26 +252,127 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  Compiler* compiler = baseline ? baseline_compiler_.get() : compiler_.get();
+  if (!compiler->Compile(builder_.get())) {
     return false;
   }
+  if (stats_enabled_) {
+    stats_.compile_ticks += end_stage();
+  }
+  if (!baseline && !inlining_pass_->inlined_functions().empty()) {
+    frontend_->processor()->AddInlinedFunctions(
+        function, inlining_pass_->inlined_functions());
+  }
 
   // Stash optimized HIR.
+  if (debug_info) {
+    uint32_t instr_count, context_store_count;
+    CountHIRInstrs(builder_.get(), &instr_count, &context_store_count);
+    debug_info->set_hir_stats(instr_count, context_store_count);
+  }
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmHir) {
+    string_buffer_.AppendFormat(
+        "; {} HIR instructions ({} before optimization), {} context stores "
+        "({} before optimization)\n",
+        debug_info->hir_instr_count(), debug_info->raw_hir_instr_count(),
+        debug_info->context_store_count(),
+        debug_info->raw_context_store_count());
     builder_->Dump(&string_buffer_);
     debug_info->set_hir_disasm(strdup(string_buffer_.buffer()));
     string_buffer_.Reset();
   }
 
+  // Tells the emitter whether to instrument the function.
+  if (baseline) {
+    *function->tier_up_counter() =
+        std::max(cvars::tier_up_call_count, int32_t(1));
+  }
+  function->set_baseline_tier(baseline);
+
   // Assemble to backend machine code.
+  if (stats_enabled_) {
+    end_stage();
+  }
   if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
                             std::move(debug_info))) {
     return false;
   }
+  if (stats_enabled_) {
+    stats_.assemble_ticks += end_stage();
+    stats_.code_bytes += function->machine_code_length();
+  }
 
   return true;
 }
 
+void PPCTranslator::set_stats_enabled(bool enabled) {
+  stats_enabled_ = enabled;
+  compiler_->set_pass_stats_enabled(enabled);
+  baseline_compiler_->set_pass_stats_enabled(enabled);
+}
+
+std::map<std::string, Compiler::PassStats> PPCTranslator::QueryPassStats()
+    const {
+  auto pass_stats = compiler_->pass_stats();
+  for (const auto& it : baseline_compiler_->pass_stats()) {
+    Compiler::PassStats& stats = pass_stats[it.first];
+    stats.run_count += it.second.run_count;
+    stats.ticks += it.second.ticks;
+    stats.instr_in_count += it.second.instr_in_count;
+    stats.instr_out_count += it.second.instr_out_count;
+    stats.allocated_bytes += it.second.allocated_bytes;
+  }
+  return pass_stats;
+}
+
+void PPCTranslator::ResetStats() {
+  stats_ = Stats();
+  compiler_->ResetPassStats();
+  baseline_compiler_->ResetPassStats();
+}
+
+void PPCTranslator::CountHIRInstrs(hir::HIRBuilder* builder,
+                                   uint32_t* instr_count_out,
+                                   uint32_t* context_store_count_out) {
+  uint32_t instr_count = 0;
+  uint32_t context_store_count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &hir::OPCODE_COMMENT_info ||
+          i->opcode == &hir::OPCODE_SOURCE_OFFSET_info) {
+        continue;
+      }
+      ++instr_count;
+      if (i->opcode == &hir::OPCODE_STORE_CONTEXT_info) {
+        ++context_store_count;
+      }
+    }
+  }
+  *instr_count_out = instr_count;
+  *context_store_count_out = context_store_count;
+}
+
+hir::HIRBuilder* PPCTranslator::EmitInlinedFunction(GuestFunction* function,
+                                                    uint32_t max_guest_size) {
+  if (!inlining_enabled_ || function == function_) {
+    return nullptr;
+  }
+  // Always scanned within the same limit rather than using the end address of
+  // the callee, which is only known if it has been translated already. The
+  // end address of the callee isn't modified, as its own translation may be
+  // reading it on another thread.
+  uint32_t max_end_address = function->address() + max_guest_size;
+  uint32_t end_address = scanner_->FindEndAddress(function, max_end_address);
+  if (end_address > max_end_address) {
+    return nullptr;
+  }
+  inline_builder_->Reset();
+  if (!inline_builder_->Emit(function, 0, end_address)) {
+    return nullptr;
+  }
+  return inline_builder_.get();
+}
+
 void PPCTranslator::DumpSource(GuestFunction* function,
                                StringBuffer* string_buffer) {
   Memory* memory = frontend_->memory();
@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_PPC_PPC_TRANSLATOR_H_
 #define XENIA_CPU_PPC_PPC_TRANSLATOR_H_
 
+#include <map>
 #include <memory>
+#include <string>
 
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/backend/assembler.h"
@@ -19,6 +21,12 @@
 
 namespace xe {
 namespace cpu {
+namespace compiler {
+namespace passes {
+class FunctionInliningPass;
+}  // namespace passes
+}  // namespace compiler
+
 namespace ppc {
 
 class PPCFrontend;
@@ -30,18 +38,58 @@ class PPCTranslator {
   explicit PPCTranslator(PPCFrontend* frontend);
   ~PPCTranslator();
 
-  bool Translate(GuestFunction* function, uint32_t debug_info_flags);
+  // With tiered compilation, functions are first translated with a minimal
+  // pass list and instrumented to request the tier up translation with all
+  // the passes once they're hot.
+  bool Translate(GuestFunction* function, uint32_t debug_info_flags,
+                 bool tier_up = false);
+
+  // Totals of the translations done while enabled, for benchmarking the JIT.
+  struct Stats {
+    uint64_t function_count = 0;
+    uint64_t guest_instr_count = 0;
+    // Raw HIR built from the guest code.
+    uint64_t hir_instr_count = 0;
+    uint64_t code_bytes = 0;
+    uint64_t scan_ticks = 0;
+    uint64_t emit_ticks = 0;
+    uint64_t compile_ticks = 0;
+    uint64_t assemble_ticks = 0;
+  };
+  bool stats_enabled() const { return stats_enabled_; }
+  void set_stats_enabled(bool enabled);
+  const Stats& stats() const { return stats_; }
+  // Of all compilers, see Compiler::PassStats.
+  std::map<std::string, compiler::Compiler::PassStats> QueryPassStats() const;
+  void ResetStats();
 
  private:
   void DumpSource(GuestFunction* function, StringBuffer* string_buffer);
+  // Counts the HIR instructions other than comments and source offsets.
+  static void CountHIRInstrs(hir::HIRBuilder* builder,
+                             uint32_t* instr_count_out,
+                             uint32_t* context_store_count_out);
+  // Builds the HIR of a function called by the one being translated for the
+  // inlining pass.
+  hir::HIRBuilder* EmitInlinedFunction(GuestFunction* function,
+                                       uint32_t max_guest_size);
 
   PPCFrontend* frontend_;
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
+  std::unique_ptr<PPCHIRBuilder> inline_builder_;
+  GuestFunction* function_ = nullptr;
+  bool inlining_enabled_ = false;
   std::unique_ptr<compiler::Compiler> compiler_;
+  // Owned by compiler_.
+  compiler::passes::FunctionInliningPass* inlining_pass_ = nullptr;
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
   std::unique_ptr<backend::Assembler> assembler_;
 
   StringBuffer string_buffer_;
+
+  bool stats_enabled_ = false;
+  Stats stats_;
 };
 
 }  // namespace ppc
@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_PPC_TESTING_HEADLESS_GRAPHICS_SYSTEM_H_
+#define XENIA_CPU_PPC_TESTING_HEADLESS_GRAPHICS_SYSTEM_H_
+
+#include <memory>
+#include <string>
+
+#include "xenia/gpu/command_processor.h"
+#include "xenia/gpu/graphics_system.h"
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+// For the tools loading titles without running them. The emulator requires a
+// graphics system, but this one creates neither a graphics provider nor a
+// command processor, so the tools work on machines without a GPU.
+class HeadlessGraphicsSystem : public gpu::GraphicsSystem {
+ public:
+  std::string name() const override { return "Headless"; }
+
+  X_STATUS Setup(cpu::Processor* processor, kernel::KernelState* kernel_state,
+                 ui::Window* target_window) override {
+    memory_ = processor->memory();
+    processor_ = processor;
+    kernel_state_ = kernel_state;
+    return X_STATUS_SUCCESS;
+  }
+
+ private:
+  std::unique_ptr<gpu::CommandProcessor> CreateCommandProcessor() override {
+    return nullptr;
+  }
+  void Swap(xe::ui::UIEvent* e) override {}
+};
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_PPC_TESTING_HEADLESS_GRAPHICS_SYSTEM_H_
@@ -0,0 +1,278 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/math.h"
+#include "xenia/base/string_buffer.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/ppc/ppc_translator.h"
+#include "xenia/cpu/ppc/testing/headless_graphics_system.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
+#include "xenia/cpu/xex_module.h"
+#include "xenia/emulator.h"
+#include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/user_module.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+DEFINE_path(target, "",
+            "Title module (.xex) to translate, or empty to translate the test "
+            "binaries in test_bin_path.",
+            "General");
+DEFINE_path(test_bin_path, "src/xenia/cpu/ppc/testing/bin/",
+            "Directory with binary outputs of the test files.", "Other");
+DEFINE_int32(bench_iterations, 1,
+             "Number of times to translate every function. All of the code is "
+             "kept in the code cache, so large modules can only be translated "
+             "a few times.",
+             "General");
+DEFINE_path(json_output, "",
+            "File to write the results to as JSON, for tracking them over "
+            "time.",
+            "General");
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+using xe::cpu::ppc::PPCTranslator;
+
+const uint32_t START_ADDRESS = 0x80000000;
+
+struct BenchFunction {
+  Module* module;
+  uint32_t address;
+};
+
+// Maps the test binaries one after another like they're a single module, with
+// the test_ labels from their maps as the functions.
+bool LoadTestBinaries(Processor* processor,
+                      std::vector<BenchFunction>* functions) {
+  auto entries = filesystem::ListFiles(cvars::test_bin_path);
+  std::sort(entries.begin(), entries.end(),
+            [](const filesystem::FileInfo& a, const filesystem::FileInfo& b) {
+              return a.name < b.name;
+            });
+  uint32_t base_address = START_ADDRESS;
+  for (auto& entry : entries) {
+    if (entry.name.extension() != ".bin") {
+      continue;
+    }
+    auto bin_path = entry.path / entry.name;
+    auto map_path = bin_path;
+    map_path.replace_extension(".map");
+    FILE* f = filesystem::OpenFile(map_path, "r");
+    if (!f) {
+      continue;
+    }
+    auto module = std::make_unique<RawModule>(processor);
+    if (!module->LoadFile(base_address, bin_path)) {
+      XELOGE("Unable to load test binary {}", xe::path_to_utf8(bin_path));
+      fclose(f);
+      return false;
+    }
+    char line_buffer[BUFSIZ];
+    while (fgets(line_buffer, sizeof(line_buffer), f)) {
+      // 0000000000000000 t test_add1\n
+      char* t_test_ = strstr(line_buffer, " t test_");
+      if (!t_test_) {
+        continue;
+      }
+      std::string address(line_buffer, t_test_ - line_buffer);
+      functions->push_back(
+          {module.get(),
+           base_address + uint32_t(std::stoul(address, nullptr, 16))});
+    }
+    fclose(f);
+    base_address += xe::round_up(uint32_t(entry.total_size), 0x10000u);
+    processor->AddModule(std::move(module));
+  }
+  return true;
+}
+
+std::string EscapeJsonString(const std::string_view value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+// Translates all known functions of a title module or of the test binaries
+// with the full pass list, reporting where the time goes in the JIT.
+int JitBenchMain(const std::vector<std::string>& args) {
+  std::unique_ptr<Emulator> emulator;
+  std::unique_ptr<Memory> memory;
+  std::unique_ptr<Processor> owned_processor;
+  Processor* processor;
+  std::vector<BenchFunction> functions;
+
+  std::filesystem::path path = cvars::target;
+  if (!path.empty()) {
+    path = std::filesystem::absolute(path);
+    emulator = std::make_unique<Emulator>("", "", "", "");
+    X_STATUS result = emulator->Setup(
+        nullptr, nullptr,
+        []() -> std::unique_ptr<gpu::GraphicsSystem> {
+          return std::make_unique<HeadlessGraphicsSystem>();
+        },
+        nullptr);
+    if (XFAILED(result)) {
+      XELOGE("Failed to setup the emulator: {:08X}", result);
+      return 1;
+    }
+    // Same layout as Emulator::LaunchXexFile.
+    auto mount_path = "\\Device\\Harddisk0\\Partition0";
+    auto device = std::make_unique<vfs::HostPathDevice>(
+        mount_path, path.parent_path(), true);
+    if (!device->Initialize() ||
+        !emulator->file_system()->RegisterDevice(std::move(device))) {
+      XELOGE("Unable to mount {}", xe::path_to_utf8(path.parent_path()));
+      return 1;
+    }
+    emulator->file_system()->RegisterSymbolicLink("game:", mount_path);
+    emulator->file_system()->RegisterSymbolicLink("d:", mount_path);
+    auto module = emulator->kernel_state()->LoadUserModule(
+        "game:\\" + xe::path_to_utf8(path.filename()), false);
+    if (!module) {
+      XELOGE("Failed to load {}", xe::path_to_utf8(path));
+      return 1;
+    }
+    processor = emulator->processor();
+    for (uint32_t address : module->xex_module()->GetKnownFunctionAddresses()) {
+      functions.push_back({module->xex_module(), address});
+    }
+  } else {
+    memory = std::make_unique<Memory>();
+    if (!memory->Initialize()) {
+      return 1;
+    }
+    owned_processor = std::make_unique<Processor>(memory.get(), nullptr);
+    if (!owned_processor->Setup(
+            std::make_unique<backend::x64::X64Backend>())) {
+      XELOGE("Failed to setup the processor");
+      return 1;
+    }
+    processor = owned_processor.get();
+    if (!LoadTestBinaries(processor, &functions)) {
+      return 1;
+    }
+  }
+  if (functions.empty()) {
+    XELOGE("No functions to translate");
+    return 1;
+  }
+
+  // A translator of its own rather than the ones of the frontend, so nothing
+  // else is measured.
+  PPCTranslator translator(processor->frontend());
+  translator.set_stats_enabled(true);
+  // The functions are not declared in the modules so they don't replace the
+  // real ones, but the code cache may still reference them.
+  std::vector<std::unique_ptr<GuestFunction>> translated_functions;
+  uint32_t failed_count = 0;
+  uint64_t start_tick = Clock::QueryHostTickCount();
+  for (int32_t i = 0; i < std::max(cvars::bench_iterations, 1); ++i) {
+    for (const BenchFunction& bench_function : functions) {
+      auto function = processor->backend()->CreateGuestFunction(
+          bench_function.module, bench_function.address);
+      if (!translator.Translate(function.get(), 0, true)) {
+        ++failed_count;
+      }
+      translated_functions.push_back(std::move(function));
+    }
+  }
+  uint64_t total_ticks = Clock::QueryHostTickCount() - start_tick;
+
+  const PPCTranslator::Stats& stats = translator.stats();
+  auto pass_stats = translator.QueryPassStats();
+  double ms_per_tick = 1000.0 / Clock::QueryHostTickFrequency();
+  XELOGI("Translated {} functions ({} failed) in {:.1f} ms",
+         stats.function_count, failed_count, total_ticks * ms_per_tick);
+  XELOGI("  Guest instructions: {}, raw HIR instructions: {}, code: {} bytes",
+         stats.guest_instr_count, stats.hir_instr_count, stats.code_bytes);
+  XELOGI("  Scan:     {:10.1f} ms", stats.scan_ticks * ms_per_tick);
+  XELOGI("  HIR:      {:10.1f} ms", stats.emit_ticks * ms_per_tick);
+  XELOGI("  Passes:   {:10.1f} ms", stats.compile_ticks * ms_per_tick);
+  XELOGI("  Assemble: {:10.1f} ms", stats.assemble_ticks * ms_per_tick);
+  for (const auto& it : pass_stats) {
+    XELOGI("  {:32} {:10.1f} ms, {} runs, {} -> {} instructions, {} KB",
+           it.first, it.second.ticks * ms_per_tick, it.second.run_count,
+           it.second.instr_in_count, it.second.instr_out_count,
+           it.second.allocated_bytes >> 10);
+  }
+
+  if (!cvars::json_output.empty()) {
+    StringBuffer json;
+    auto target = xe::path_to_utf8(path.empty() ? cvars::test_bin_path : path);
+    json.AppendFormat("{{\n  \"target\": \"{}\",\n",
+                      EscapeJsonString(target));
+    json.AppendFormat("  \"iterations\": {},\n",
+                      std::max(cvars::bench_iterations, 1));
+    json.AppendFormat("  \"function_count\": {},\n", stats.function_count);
+    json.AppendFormat("  \"failed_count\": {},\n", failed_count);
+    json.AppendFormat("  \"guest_instr_count\": {},\n",
+                      stats.guest_instr_count);
+    json.AppendFormat("  \"hir_instr_count\": {},\n", stats.hir_instr_count);
+    json.AppendFormat("  \"code_bytes\": {},\n", stats.code_bytes);
+    json.AppendFormat("  \"total_ms\": {:.3f},\n", total_ticks * ms_per_tick);
+    json.AppendFormat("  \"scan_ms\": {:.3f},\n",
+                      stats.scan_ticks * ms_per_tick);
+    json.AppendFormat("  \"hir_build_ms\": {:.3f},\n",
+                      stats.emit_ticks * ms_per_tick);
+    json.AppendFormat("  \"passes_ms\": {:.3f},\n",
+                      stats.compile_ticks * ms_per_tick);
+    json.AppendFormat("  \"assemble_ms\": {:.3f},\n",
+                      stats.assemble_ticks * ms_per_tick);
+    json.Append("  \"passes\": {");
+    bool first_pass = true;
+    for (const auto& it : pass_stats) {
+      json.AppendFormat(
+          "{}\n    \"{}\": {{\"runs\": {}, \"ms\": {:.3f}, \"instrs_in\": {}, "
+          "\"instrs_out\": {}, \"allocated_bytes\": {}}}",
+          first_pass ? "" : ",", it.first, it.second.run_count,
+          it.second.ticks * ms_per_tick, it.second.instr_in_count,
+          it.second.instr_out_count, it.second.allocated_bytes);
+      first_pass = false;
+    }
+    json.Append("\n  }\n}\n");
+    FILE* f = filesystem::OpenFile(cvars::json_output, "w");
+    if (!f) {
+      XELOGE("Unable to open {}", xe::path_to_utf8(cvars::json_output));
+      return 1;
+    }
+    fwrite(json.buffer(), 1, json.length(), f);
+    fclose(f);
+  }
+
+  return failed_count ? 1 : 0;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-cpu-jit-bench", xe::cpu::test::JitBenchMain,
+                   "[some.xex]", "target");
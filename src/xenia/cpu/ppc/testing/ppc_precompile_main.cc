@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/cpu/ppc/testing/headless_graphics_system.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/xex_module.h"
+#include "xenia/emulator.h"
+#include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/user_module.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+DEFINE_path(target, "", "Title module (.xex) to precompile.", "General");
+DEFINE_path(
+    cache_root, "",
+    "Root path for the persistent JIT code storage, populated with "
+    "--store_jit_code.",
+    "Storage");
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+// Loads a title module without launching it and compiles all of its known
+// functions like --precompile_functions does, reporting the results.
+int PrecompileMain(const std::vector<std::string>& args) {
+  std::filesystem::path path = cvars::target;
+  if (path.empty()) {
+    XELOGE("No module specified, pass the path to a .xex");
+    return 1;
+  }
+  path = std::filesystem::absolute(path);
+
+  auto emulator = std::make_unique<Emulator>("", "", "", cvars::cache_root);
+  // The title is never run, so no GPU is needed.
+  X_STATUS result = emulator->Setup(
+      nullptr, nullptr,
+      []() -> std::unique_ptr<gpu::GraphicsSystem> {
+        return std::make_unique<HeadlessGraphicsSystem>();
+      },
+      nullptr);
+  if (XFAILED(result)) {
+    XELOGE("Failed to setup the emulator: {:08X}", result);
+    return 1;
+  }
+
+  // Same layout as Emulator::LaunchXexFile.
+  auto mount_path = "\\Device\\Harddisk0\\Partition0";
+  auto device = std::make_unique<vfs::HostPathDevice>(
+      mount_path, path.parent_path(), true);
+  if (!device->Initialize() ||
+      !emulator->file_system()->RegisterDevice(std::move(device))) {
+    XELOGE("Unable to mount {}", xe::path_to_utf8(path.parent_path()));
+    return 1;
+  }
+  emulator->file_system()->RegisterSymbolicLink("game:", mount_path);
+  emulator->file_system()->RegisterSymbolicLink("d:", mount_path);
+
+  auto module = emulator->kernel_state()->LoadUserModule(
+      "game:\\" + xe::path_to_utf8(path.filename()), false);
+  if (!module) {
+    XELOGE("Failed to load {}", xe::path_to_utf8(path));
+    return 1;
+  }
+
+  auto addresses = module->xex_module()->GetKnownFunctionAddresses();
+  auto stats = emulator->processor()->PrecompileFunctions(addresses);
+
+  XELOGI("Known functions:    {}", stats.requested_count);
+  XELOGI("Compiled functions: {}", stats.compiled_count);
+  XELOGI("Failed functions:   {}", stats.failed_addresses.size());
+  XELOGI("Time:               {} ms", stats.elapsed_ms);
+  return stats.failed_addresses.empty() ? 0 : 1;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-cpu-precompile", xe::cpu::test::PrecompileMain,
+                   "some.xex", "target");
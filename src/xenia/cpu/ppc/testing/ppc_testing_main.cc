@@ -15,6 +15,7 @@
 #include "xenia/base/platform.h"
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/compiler/passes/register_allocation_pass.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -30,6 +31,11 @@ DEFINE_path(test_path, "src/xenia/cpu/ppc/testing/",
 DEFINE_path(test_bin_path, "src/xenia/cpu/ppc/testing/bin/",
             "Directory with binary outputs of the test files.", "Other");
 DEFINE_transient_string(test_name, "", "Test suite name.", "General");
+DEFINE_bool(test_debug_info, false,
+            "Compile the tests with debug info, to dump the code of the failed "
+            "tests. Disables the optimizations that don't keep the code of a "
+            "function matching its guest code, such as inlining.",
+            "Other");
 
 namespace xe {
 namespace cpu {
@@ -211,7 +217,9 @@ class TestRunner {
     // Setup a fresh processor.
     processor_.reset(new Processor(memory_.get(), nullptr));
     processor_->Setup(std::move(backend));
-    processor_->set_debug_info_flags(DebugInfoFlags::kDebugInfoAll);
+    if (cvars::test_debug_info) {
+      processor_->set_debug_info_flags(DebugInfoFlags::kDebugInfoAll);
+    }
 
     // Load the binary module.
     auto module = std::make_unique<xe::cpu::RawModule>(processor_.get());
@@ -263,8 +271,14 @@ class TestRunner {
     bool result = CheckTestResults(test_case);
     if (!result) {
       // Also dump all disasm/etc.
+      xe::cpu::FunctionDebugInfo* debug_info = nullptr;
       if (fn->is_guest()) {
-        static_cast<xe::cpu::GuestFunction*>(fn)->debug_info()->Dump();
+        debug_info = static_cast<xe::cpu::GuestFunction*>(fn)->debug_info();
+      }
+      if (debug_info) {
+        debug_info->Dump();
+      } else {
+        XELOGE("Run with --test_debug_info to dump the code of the test");
       }
     }
 
@@ -454,6 +468,7 @@ bool RunTests(const std::string_view test_name) {
   }
 
   XELOGI("{} tests loaded.", test_suites.size());
+  compiler::passes::RegisterAllocationPass::ResetStats();
   TestRunner runner;
   for (auto& test_suite : test_suites) {
     XELOGI("{}.s:", test_suite.name());
@@ -472,6 +487,16 @@ bool RunTests(const std::string_view test_name) {
   XELOGI("Passed: {}", passed_count);
   XELOGI("Failed: {}", failed_count);
 
+  // To compare register allocation changes on the corpus.
+  auto allocation_stats =
+      compiler::passes::RegisterAllocationPass::QueryStats();
+  XELOGI("");
+  XELOGI("Values live across blocks: {} ({} kept in locals)",
+         allocation_stats.global_value_count,
+         allocation_stats.global_spilled_count);
+  XELOGI("Register spills: {}, reloads: {}", allocation_stats.spill_count,
+         allocation_stats.reload_count);
+
   return failed_count ? false : true;
 }
 
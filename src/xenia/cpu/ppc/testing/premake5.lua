@@ -33,6 +33,111 @@ project("xenia-cpu-ppc-tests")
 
     -- xenia-base needs this
     links({"xenia-ui"})
+  filter({})
+
+group("tests")
+project("xenia-cpu-precompile")
+  uuid("6b0cf6f4-3b2e-4a7d-9f0e-2c4e0b8d5a31")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "xenia-apu",
+    "xenia-apu-nop",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-cpu-backend-x64",
+    "xenia-gpu",
+    "xenia-gpu-null",
+    "xenia-hid",
+    "xenia-hid-nop",
+    "xenia-kernel",
+    "xenia-ui",
+    "xenia-ui-spirv",
+    "xenia-ui-vulkan",
+    "xenia-vfs",
+  })
+  links({
+    "aes_128",
+    "capstone",
+    "fmt",
+    "glslang-spirv",
+    "imgui",
+    "libavcodec",
+    "libavutil",
+    "mspack",
+    "snappy",
+    "spirv-tools",
+    "volk",
+    "xxhash",
+  })
+  files({
+    "ppc_precompile_main.cc",
+    "../../../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Linux")
+    links({
+      "X11",
+      "xcb",
+      "X11-xcb",
+      "GL",
+      "vulkan",
+    })
+  filter("platforms:Windows")
+    debugdir(project_root)
+  filter({})
+
+group("tests")
+project("xenia-cpu-jit-bench")
+  uuid("c4e1b0d2-7f3a-4e8b-9a56-1d2f3e4b5c6d")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "xenia-apu",
+    "xenia-apu-nop",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-cpu-backend-x64",
+    "xenia-gpu",
+    "xenia-gpu-null",
+    "xenia-hid",
+    "xenia-hid-nop",
+    "xenia-kernel",
+    "xenia-ui",
+    "xenia-ui-spirv",
+    "xenia-ui-vulkan",
+    "xenia-vfs",
+  })
+  links({
+    "aes_128",
+    "capstone",
+    "fmt",
+    "glslang-spirv",
+    "imgui",
+    "libavcodec",
+    "libavutil",
+    "mspack",
+    "snappy",
+    "spirv-tools",
+    "volk",
+    "xxhash",
+  })
+  files({
+    "ppc_jit_bench_main.cc",
+    "../../../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Linux")
+    links({
+      "X11",
+      "xcb",
+      "X11-xcb",
+      "GL",
+      "vulkan",
+    })
+  filter("platforms:Windows")
+    debugdir(project_root)
+  filter({})
 
 if ARCH == "ppc64" or ARCH == "powerpc64" then
 
@@ -0,0 +1,30 @@
+test_cross_block_1:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 7
+  add r5, r3, r4
+  cmpwi r5, 0
+  beq cross_block_1_skip
+  mullw r6, r5, r3
+  add r7, r6, r4
+cross_block_1_skip:
+  blr
+  #_ REGISTER_OUT r3 5
+  #_ REGISTER_OUT r4 7
+  #_ REGISTER_OUT r5 12
+  #_ REGISTER_OUT r6 60
+  #_ REGISTER_OUT r7 67
+
+test_cross_block_2:
+  #_ REGISTER_IN r3 10
+  #_ REGISTER_IN r4 3
+  li r5, 0
+  mtctr r3
+cross_block_2_loop:
+  add r5, r5, r4
+  bdnz cross_block_2_loop
+  addi r6, r5, 1
+  blr
+  #_ REGISTER_OUT r3 10
+  #_ REGISTER_OUT r4 3
+  #_ REGISTER_OUT r5 30
+  #_ REGISTER_OUT r6 31
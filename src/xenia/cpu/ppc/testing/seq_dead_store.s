@@ -0,0 +1,64 @@
+dead_store_callee:
+  addi r7, r6, 1
+  blr
+
+# The first store of r5 is overwritten on both paths.
+test_dead_store_1:
+  #_ REGISTER_IN r3 1
+  li r5, 1
+  cmpwi r3, 0
+  beq dead_store_1_else
+  li r5, 2
+  b dead_store_1_end
+dead_store_1_else:
+  li r5, 3
+dead_store_1_end:
+  blr
+  #_ REGISTER_OUT r3 1
+  #_ REGISTER_OUT r5 2
+
+test_dead_store_2:
+  #_ REGISTER_IN r3 0
+  li r5, 1
+  cmpwi r3, 0
+  beq dead_store_2_else
+  li r5, 2
+  b dead_store_2_end
+dead_store_2_else:
+  li r5, 3
+dead_store_2_end:
+  blr
+  #_ REGISTER_OUT r3 0
+  #_ REGISTER_OUT r5 3
+
+# r6 is overwritten after the branch, but read by the callee on one path.
+test_dead_store_call:
+  #_ REGISTER_IN r3 9
+  mfspr r12, lr
+  or r6, r3, r3
+  cmpwi r3, 0
+  beq dead_store_call_skip
+  bl dead_store_callee
+dead_store_call_skip:
+  li r6, 1
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 9
+  #_ REGISTER_OUT r6 1
+  #_ REGISTER_OUT r7 10
+
+# cr1 is overwritten after the branch, but read as a part of the whole CR on
+# one path.
+test_dead_store_alias:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 0
+  cmpwi cr1, r3, 5
+  cmpwi r4, 0
+  bne dead_store_alias_skip
+  mfcr r8
+dead_store_alias_skip:
+  cmpwi cr1, r3, 6
+  blr
+  #_ REGISTER_OUT r3 5
+  #_ REGISTER_OUT r4 0
+  #_ REGISTER_OUT r8 0x22000000
@@ -0,0 +1,82 @@
+inline_leaf:
+  add r3, r3, r4
+  blr
+
+inline_over_budget:
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  addi r3, r3, 1
+  blr
+
+inline_recursive:
+  cmpwi r4, 0
+  beqlr
+  mfspr r0, lr
+  stwu r1, -16(r1)
+  stw r0, 8(r1)
+  add r3, r3, r4
+  addi r4, r4, -1
+  bl inline_recursive
+  lwz r0, 8(r1)
+  addi r1, r1, 16
+  mtspr lr, r0
+  blr
+
+# The callees are not defined yet when this is compiled, so not inlined.
+test_inline_call_1:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 7
+  mfspr r12, lr
+  bl inline_leaf
+  bl inline_over_budget
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 36
+  #_ REGISTER_OUT r4 7
+
+# The leaf is inlined now, the callee above the size limit is still called.
+test_inline_call_2:
+  #_ REGISTER_IN r3 1
+  #_ REGISTER_IN r4 2
+  mfspr r12, lr
+  bl inline_leaf
+  or r4, r3, r3
+  bl inline_leaf
+  bl inline_over_budget
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 30
+  #_ REGISTER_OUT r4 3
+
+# Not a leaf, and not inlined into itself.
+test_inline_call_recursive:
+  #_ REGISTER_IN r3 0
+  #_ REGISTER_IN r4 4
+  mfspr r12, lr
+  bl inline_recursive
+  bl inline_recursive
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 10
+  #_ REGISTER_OUT r4 0
@@ -0,0 +1,32 @@
+test_loop_invariant_1:
+  #_ REGISTER_IN r3 4
+  #_ REGISTER_IN r4 3
+  #_ REGISTER_IN r5 5
+  li r6, 0
+  mtctr r3
+loop_invariant_1_loop:
+  mullw r7, r4, r5
+  add r6, r6, r7
+  stw r6, -16(r1)
+  lwz r8, -16(r1)
+  addi r8, r8, 1
+  bdnz loop_invariant_1_loop
+  blr
+  #_ REGISTER_OUT r3 4
+  #_ REGISTER_OUT r4 3
+  #_ REGISTER_OUT r5 5
+  #_ REGISTER_OUT r6 60
+  #_ REGISTER_OUT r7 15
+  #_ REGISTER_OUT r8 61
+
+test_loop_invariant_2:
+  #_ REGISTER_IN r3 0x12345678
+  stw r3, -8(r1)
+  lwz r4, -8(r1)
+  lbz r5, -8(r1)
+  lhz r6, -6(r1)
+  blr
+  #_ REGISTER_OUT r3 0x12345678
+  #_ REGISTER_OUT r4 0x12345678
+  #_ REGISTER_OUT r5 0x12
+  #_ REGISTER_OUT r6 0x5678
@@ -0,0 +1,53 @@
+# The invariant r4 * r5 is hoisted out of the loop and must keep its value
+# slot across the loop blocks while the temporaries reuse theirs.
+test_value_reduction_1:
+  #_ REGISTER_IN r3 3
+  #_ REGISTER_IN r4 6
+  #_ REGISTER_IN r5 7
+  li r6, 0
+  mtctr r3
+value_reduction_1_loop:
+  mullw r7, r4, r5
+  addi r8, r6, 1
+  addi r9, r8, 2
+  add r10, r9, r7
+  subf r11, r8, r10
+  add r6, r6, r11
+  bdnz value_reduction_1_loop
+  add r3, r6, r7
+  blr
+  #_ REGISTER_OUT r3 174
+  #_ REGISTER_OUT r4 6
+  #_ REGISTER_OUT r5 7
+  #_ REGISTER_OUT r6 132
+  #_ REGISTER_OUT r7 42
+  #_ REGISTER_OUT r8 89
+  #_ REGISTER_OUT r9 91
+  #_ REGISTER_OUT r10 133
+  #_ REGISTER_OUT r11 44
+
+# The hoisted r4 << 2 is used on both paths of a branch in the loop.
+test_value_reduction_2:
+  #_ REGISTER_IN r3 4
+  #_ REGISTER_IN r4 5
+  li r6, 0
+  li r7, 0
+  mtctr r3
+value_reduction_2_loop:
+  slwi r8, r4, 2
+  mfctr r9
+  andi. r9, r9, 1
+  beq value_reduction_2_even
+  add r6, r6, r8
+  b value_reduction_2_next
+value_reduction_2_even:
+  subf r7, r8, r7
+value_reduction_2_next:
+  bdnz value_reduction_2_loop
+  blr
+  #_ REGISTER_OUT r3 4
+  #_ REGISTER_OUT r4 5
+  #_ REGISTER_OUT r6 40
+  #_ REGISTER_OUT r7 0xFFFFFFFFFFFFFFD8
+  #_ REGISTER_OUT r8 20
+  #_ REGISTER_OUT r9 1
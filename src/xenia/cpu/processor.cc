@@ -9,10 +9,13 @@
 
 #include "xenia/cpu/processor.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
@@ -20,6 +23,7 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
@@ -47,6 +51,8 @@ DEFINE_path(trace_function_data_path, "", "File to write trace data to.",
 DEFINE_bool(break_on_start, false, "Break into the debugger on startup.",
             "CPU");
 
+DECLARE_int32(inline_max_guest_instructions);
+
 namespace xe {
 namespace kernel {
 class XThread;
@@ -79,11 +85,32 @@ class BuiltinModule : public Module {
 };
 
 Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
-    : memory_(memory), export_resolver_(export_resolver) {}
+    : memory_(memory),
+      export_resolver_(export_resolver),
+      reservation_table_(std::make_unique<ReservationTable>()) {
+  for (uint32_t i = 0; i < kMMIOFaultingAccessQueueSize; ++i) {
+    mmio_faulting_accesses_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
 
 Processor::~Processor() {
+  cpu::MMIOHandler* mmio_handler = memory_->mmio_handler();
+  if (mmio_handler) {
+    mmio_handler->SetFaultingAccessCallback(nullptr, nullptr);
+  }
+  if (mmio_faulting_access_thread_) {
+    mmio_faulting_access_shutdown_event_->Set();
+    xe::threading::Wait(mmio_faulting_access_thread_.get(), false);
+    mmio_faulting_access_thread_.reset();
+  }
+
+  // Stop compiling before the modules and the translator go away.
+  jit_worker_pool_.reset();
+
   {
     auto global_lock = global_critical_region_.Acquire();
+    module_snapshot_.store(nullptr, std::memory_order_release);
+    module_snapshots_.clear();
     modules_.clear();
   }
 
@@ -146,6 +173,32 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
         functions_trace_path_, 32 * 1024 * 1024, true);
   }
 
+  int32_t jit_worker_count = cvars::jit_worker_threads;
+  if (jit_worker_count < 0) {
+    // Leave some processors to the guest threads and the GPU.
+    jit_worker_count =
+        int32_t(std::max(xe::threading::logical_processor_count(), 4u) / 4);
+  }
+  // Without workers, the pool only compiles during PrecompileFunctions.
+  jit_worker_pool_ = std::make_unique<JitWorkerPool>(this, &entry_table_);
+  if (!jit_worker_pool_->Initialize(uint32_t(jit_worker_count))) {
+    jit_worker_pool_->Initialize(0);
+  }
+
+  cpu::MMIOHandler* mmio_handler = memory_->mmio_handler();
+  if (cvars::learn_mmio_access_sites && mmio_handler) {
+    mmio_faulting_access_shutdown_event_ =
+        xe::threading::Event::CreateManualResetEvent(false);
+    xe::threading::Thread::CreationParameters params;
+    params.initial_priority = xe::threading::ThreadPriority::kBelowNormal;
+    mmio_faulting_access_thread_ = xe::threading::Thread::Create(
+        params, [this]() { MMIOFaultingAccessThreadMain(); });
+    if (mmio_faulting_access_thread_) {
+      mmio_faulting_access_thread_->set_name("MMIO Access Site Learning");
+    }
+    mmio_handler->SetFaultingAccessCallback(OnMMIOFaultingAccessThunk, this);
+  }
+
   return true;
 }
 
@@ -164,6 +217,13 @@ void Processor::PreLaunch() {
 bool Processor::AddModule(std::unique_ptr<Module> module) {
   auto global_lock = global_critical_region_.Acquire();
   modules_.push_back(std::move(module));
+  auto snapshot = std::make_unique<std::vector<Module*>>();
+  snapshot->reserve(modules_.size());
+  for (const auto& snapshot_module : modules_) {
+    snapshot->push_back(snapshot_module.get());
+  }
+  module_snapshot_.store(snapshot.get(), std::memory_order_release);
+  module_snapshots_.push_back(std::move(snapshot));
   return true;
 }
 
@@ -225,17 +285,21 @@ Function* Processor::ResolveFunction(uint32_t address) {
     // Grab symbol declaration.
     auto function = LookupFunction(address);
     if (!function) {
-      entry->status = Entry::STATUS_FAILED;
+      entry_table_.SetStatus(entry, Entry::STATUS_FAILED);
       return nullptr;
     }
 
     if (!DemandFunction(function)) {
-      entry->status = Entry::STATUS_FAILED;
+      entry_table_.SetStatus(entry, Entry::STATUS_FAILED);
       return nullptr;
     }
     entry->function = function;
     entry->end_address = function->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    status = Entry::STATUS_READY;
+    entry_table_.SetStatus(entry, status);
+    // New code is being reached, a good point to also take care of the code
+    // that has been faulting on MMIO.
+    ProcessMMIOFaultingAccesses();
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
@@ -246,6 +310,249 @@ Function* Processor::ResolveFunction(uint32_t address) {
   }
 }
 
+void Processor::QueueFunctionCompile(uint32_t address, bool high_priority) {
+  if (!jit_worker_pool_ || entry_table_.Contains(address)) {
+    return;
+  }
+  jit_worker_pool_->Enqueue(address, high_priority
+                                         ? JitWorkerPool::Priority::kHigh
+                                         : JitWorkerPool::Priority::kLow);
+}
+
+void Processor::RequestFunctionTierUp(GuestFunction* function) {
+  ProcessMMIOFaultingAccesses();
+  if (!function->BeginTierUp()) {
+    return;
+  }
+  if (!jit_worker_pool_ || !jit_worker_pool_->EnqueueTierUp(function)) {
+    TierUpFunction(function);
+  }
+}
+
+bool Processor::TierUpFunction(GuestFunction* function) {
+  bool recompile = function->EndRecompile();
+  if (!function->is_baseline_tier() && !recompile) {
+    return true;
+  }
+  if (function->debug_info()) {
+    // Debugging and tracing need the code of the function to stay the same.
+    return true;
+  }
+  // The new code is published atomically, other threads keep running and
+  // looking up the old one until then.
+  if (!frontend_->TierUpFunction(function)) {
+    // The baseline code is still valid, keep using it.
+    XELOGW("Failed to recompile hot function {:08X}", function->address());
+    return false;
+  }
+  return true;
+}
+
+bool Processor::IsMMIOAccessSite(uint32_t address) {
+  if (!has_mmio_access_sites_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mmio_access_sites_mutex_);
+  return mmio_access_sites_.count(address) != 0;
+}
+
+void Processor::OnMMIOFaultingAccessThunk(void* context, void* host_pc) {
+  reinterpret_cast<Processor*>(context)->OnMMIOFaultingAccess(host_pc);
+}
+
+void Processor::OnMMIOFaultingAccess(void* host_pc) {
+  // Called from the exception handler - only recording the access without
+  // locking, allocating or logging, it's learned at the next safe point (see
+  // ProcessMMIOFaultingAccesses).
+  uint32_t index =
+      mmio_faulting_access_enqueue_index_.load(std::memory_order_relaxed);
+  MMIOFaultingAccess* access;
+  while (true) {
+    access = &mmio_faulting_accesses_[index % kMMIOFaultingAccessQueueSize];
+    int32_t difference = int32_t(
+        access->sequence.load(std::memory_order_acquire) - index);
+    if (!difference) {
+      if (mmio_faulting_access_enqueue_index_.compare_exchange_weak(
+              index, index + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The queue is full.
+      return;
+    } else {
+      index =
+          mmio_faulting_access_enqueue_index_.load(std::memory_order_relaxed);
+    }
+  }
+  access->host_pc = host_pc;
+  access->sequence.store(index + 1, std::memory_order_release);
+}
+
+void Processor::MMIOFaultingAccessThreadMain() {
+  // The exception handler can't signal anything, so polling.
+  while (xe::threading::Wait(mmio_faulting_access_shutdown_event_.get(), false,
+                             std::chrono::milliseconds(100)) ==
+         xe::threading::WaitResult::kTimeout) {
+    ProcessMMIOFaultingAccesses();
+  }
+}
+
+void Processor::ProcessMMIOFaultingAccesses() {
+  if (mmio_faulting_access_enqueue_index_.load(std::memory_order_relaxed) ==
+      mmio_faulting_access_dequeue_index_.load(std::memory_order_relaxed)) {
+    // Likely nothing recorded (racy, but will be checked again later).
+    return;
+  }
+  std::vector<GuestFunction*> recompile_functions;
+  {
+    std::lock_guard<std::mutex> lock(mmio_access_sites_mutex_);
+    while (true) {
+      uint32_t index =
+          mmio_faulting_access_dequeue_index_.load(std::memory_order_relaxed);
+      MMIOFaultingAccess& access =
+          mmio_faulting_accesses_[index % kMMIOFaultingAccessQueueSize];
+      if (access.sequence.load(std::memory_order_acquire) != index + 1) {
+        // Empty, or the access is still being recorded.
+        break;
+      }
+      void* host_pc = access.host_pc;
+      access.sequence.store(index + kMMIOFaultingAccessQueueSize,
+                            std::memory_order_release);
+      mmio_faulting_access_dequeue_index_.store(index + 1,
+                                                std::memory_order_relaxed);
+
+      auto function =
+          backend_->code_cache()->LookupFunction(uint64_t(host_pc));
+      if (!function) {
+        continue;
+      }
+      // May be old code still running after the function was recompiled,
+      // which has its own source map.
+      if (!function->FindCode(uintptr_t(host_pc))) {
+        continue;
+      }
+      uint32_t guest_address =
+          function->MapMachineCodeToGuestAddress(uintptr_t(host_pc));
+      if (!mmio_access_sites_.insert(guest_address).second) {
+        continue;
+      }
+      has_mmio_access_sites_.store(true, std::memory_order_release);
+      XELOGD("Learned MMIO access site {:08X} in function {:08X}",
+             guest_address, function->address());
+      if (function->BeginRecompile()) {
+        // Otherwise will be checked by the pending recompilation.
+        recompile_functions.push_back(function);
+      }
+    }
+  }
+  // IsMMIOAccessSite locks the sites during the recompilation.
+  for (GuestFunction* function : recompile_functions) {
+    if (!jit_worker_pool_ || !jit_worker_pool_->EnqueueTierUp(function)) {
+      TierUpFunction(function);
+    }
+  }
+}
+
+void Processor::OnGuestCodeWritten(uint32_t address, uint32_t length) {
+  if (!length) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(written_guest_code_mutex_);
+  written_guest_code_low_ = std::min(written_guest_code_low_, address);
+  written_guest_code_high_ =
+      std::max(written_guest_code_high_, address + (length - 1));
+}
+
+void Processor::InvalidateWrittenGuestCode() {
+  uint32_t low, high;
+  std::vector<GuestFunction*> inlining_callers;
+  {
+    std::lock_guard<std::mutex> lock(written_guest_code_mutex_);
+    if (written_guest_code_low_ > written_guest_code_high_) {
+      return;
+    }
+    low = written_guest_code_low_;
+    high = written_guest_code_high_;
+    written_guest_code_low_ = UINT32_MAX;
+    written_guest_code_high_ = 0;
+    // The extent of the inlined functions isn't kept, but they're not longer
+    // than the inlining limit.
+    uint32_t max_inlined_size =
+        uint32_t(std::max(cvars::inline_max_guest_instructions, 0)) * 4;
+    auto it = inlining_callers_.lower_bound(
+        low > max_inlined_size ? low - max_inlined_size : 0);
+    for (; it != inlining_callers_.end() && it->first <= high; ++it) {
+      inlining_callers.insert(inlining_callers.end(), it->second.begin(),
+                              it->second.end());
+    }
+  }
+  std::vector<GuestFunction*> functions;
+  for (Function* function : entry_table_.FindWithAddressRange(low, high)) {
+    if (function->is_guest()) {
+      functions.push_back(static_cast<GuestFunction*>(function));
+    }
+  }
+  for (GuestFunction* caller : inlining_callers) {
+    if (std::find(functions.begin(), functions.end(), caller) ==
+        functions.end()) {
+      functions.push_back(caller);
+    }
+  }
+  for (GuestFunction* guest_function : functions) {
+    XELOGD("Guest code of function {:08X} modified, recompiling",
+           guest_function->address());
+    // The calls linked to the old code resolve the function again until the
+    // new code is placed (or keep using the old code if it can't be
+    // recompiled). Invocations already running finish in the old code.
+    backend_->InvalidateGuestCode(guest_function->address());
+    guest_function->BeginRecompile();
+    TierUpFunction(guest_function);
+  }
+}
+
+void Processor::AddInlinedFunctions(
+    GuestFunction* caller, const std::vector<GuestFunction*>& functions) {
+  std::lock_guard<std::mutex> lock(written_guest_code_mutex_);
+  for (GuestFunction* function : functions) {
+    std::vector<GuestFunction*>& callers =
+        inlining_callers_[function->address()];
+    if (std::find(callers.begin(), callers.end(), caller) == callers.end()) {
+      callers.push_back(caller);
+    }
+  }
+}
+
+Processor::PrecompileStats Processor::PrecompileFunctions(
+    const std::vector<uint32_t>& addresses) {
+  SCOPE_profile_cpu_f("cpu");
+
+  PrecompileStats stats;
+  stats.requested_count = uint32_t(addresses.size());
+  if (!jit_worker_pool_) {
+    return stats;
+  }
+  uint64_t start_time = Clock::QueryHostTickCount();
+  uint32_t start_compiled_count = jit_worker_pool_->compiled_count();
+  // The guest hasn't started running yet, so take all the host cores.
+  uint32_t thread_count = xe::threading::logical_processor_count();
+  jit_worker_pool_->Precompile(addresses, thread_count,
+                               &stats.failed_addresses);
+  stats.compiled_count =
+      jit_worker_pool_->compiled_count() - start_compiled_count;
+  stats.elapsed_ms = (Clock::QueryHostTickCount() - start_time) * 1000 /
+                     Clock::QueryHostTickFrequency();
+
+  for (uint32_t address : stats.failed_addresses) {
+    XELOGW("Failed to precompile function {:08X}", address);
+  }
+  XELOGI(
+      "Precompiled {} functions ({} known, the rest discovered as callees) on "
+      "{} threads in {} ms, {} failed",
+      stats.compiled_count, stats.requested_count, thread_count,
+      stats.elapsed_ms, stats.failed_addresses.size());
+  return stats;
+}
+
 Function* Processor::LookupFunction(uint32_t address) {
   // TODO(benvanik): fast reject invalid addresses/log errors.
 
@@ -270,6 +577,19 @@ Function* Processor::LookupFunction(uint32_t address) {
   return LookupFunction(code_module, address);
 }
 
+bool Processor::IsReadOnlyModuleRange(uint32_t address, uint32_t size) {
+  auto modules = module_snapshot_.load(std::memory_order_acquire);
+  if (!modules) {
+    return false;
+  }
+  for (Module* module : *modules) {
+    if (module->IsReadOnlyRange(address, size)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Function* Processor::LookupFunction(Module* module, uint32_t address) {
   // Atomic create/lookup symbol in module.
   // If we get back the NEW flag we must declare it now.
@@ -10,9 +10,12 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "xenia/base/cvar.h"
@@ -21,10 +24,12 @@
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/entry_table.h"
+#include "xenia/cpu/jit_worker_pool.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/reservation_table.h"
 #include "xenia/cpu/thread_debug_info.h"
 #include "xenia/cpu/thread_state.h"
 #include "xenia/memory.h"
@@ -68,6 +73,9 @@ class Processor {
   StackWalker* stack_walker() const { return stack_walker_.get(); }
   ppc::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
+  ReservationTable* reservation_table() const {
+    return reservation_table_.get();
+  }
   ExportResolver* export_resolver() const { return export_resolver_; }
 
   bool Setup(std::unique_ptr<backend::Backend> backend);
@@ -112,7 +120,56 @@ class Processor {
 
   Function* LookupFunction(uint32_t address);
   Function* LookupFunction(Module* module, uint32_t address);
+  // Whether the whole guest range is in read-only sections of a loaded module
+  // (see Module::IsReadOnlyRange).
+  bool IsReadOnlyModuleRange(uint32_t address, uint32_t size);
   Function* ResolveFunction(uint32_t address);
+  // Requests a guest function to be compiled on the JIT worker threads before
+  // it's called. Does nothing if background compilation is disabled.
+  void QueueFunctionCompile(uint32_t address, bool high_priority);
+  // Called by the baseline code of a function once it's hot (see the
+  // tiered_compilation cvar). The tier up happens on a JIT worker thread if
+  // there are any, or on the calling thread otherwise.
+  void RequestFunctionTierUp(GuestFunction* function);
+  // Recompiles a baseline function with all the passes and redirects all
+  // subsequent calls to the new code. Invocations already running finish in
+  // the baseline code. Optimized functions are recompiled too if requested
+  // with GuestFunction::BeginRecompile.
+  bool TierUpFunction(GuestFunction* function);
+
+  // Whether a load or a store at the guest address has accessed MMIO via an
+  // access violation before, so it should check the address inline instead
+  // (see the learn_mmio_access_sites cvar).
+  bool IsMMIOAccessSite(uint32_t address);
+  // Learns the MMIO access sites recorded by the exception handler since the
+  // last call and recompiles their functions. Must not be called while holding
+  // any locks of the emulator.
+  void ProcessMMIOFaultingAccesses();
+
+  // Called by the guest code for icbi after modifying instructions. The code
+  // of the functions containing them is replaced at the next
+  // InvalidateWrittenGuestCode (isync), as the guest must execute isync before
+  // the modified instructions.
+  void OnGuestCodeWritten(uint32_t address, uint32_t length);
+  void InvalidateWrittenGuestCode();
+  // Called by the translator for the functions whose code has been copied
+  // into the caller, so the caller is recompiled too when it's modified.
+  void AddInlinedFunctions(GuestFunction* caller,
+                           const std::vector<GuestFunction*>& functions);
+
+  struct PrecompileStats {
+    // Functions passed to PrecompileFunctions.
+    uint32_t requested_count = 0;
+    // Functions actually compiled, including the discovered callees, but not
+    // the ones already compiled before.
+    uint32_t compiled_count = 0;
+    std::vector<uint32_t> failed_addresses;
+    uint64_t elapsed_ms = 0;
+  };
+  // Compiles the given functions and everything they call on all host cores,
+  // returning when done, so the code doesn't have to be compiled on the guest
+  // threads later.
+  PrecompileStats PrecompileFunctions(const std::vector<uint32_t>& addresses);
 
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
@@ -235,6 +292,10 @@ class Processor {
 
   bool DemandFunction(Function* function);
 
+  static void OnMMIOFaultingAccessThunk(void* context, void* host_pc);
+  void OnMMIOFaultingAccess(void* host_pc);
+  void MMIOFaultingAccessThreadMain();
+
   Memory* memory_ = nullptr;
   std::unique_ptr<StackWalker> stack_walker_;
 
@@ -252,9 +313,49 @@ class Processor {
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
+  std::unique_ptr<ReservationTable> reservation_table_;
+  std::unique_ptr<JitWorkerPool> jit_worker_pool_;
+
+  // Host addresses of the faulting MMIO accesses, recorded by the exception
+  // handler, which must not lock or allocate, in a bounded lock-free queue.
+  // Accesses not fitting in the queue are dropped - they'll fault again.
+  static constexpr uint32_t kMMIOFaultingAccessQueueSize = 256;
+  struct MMIOFaultingAccess {
+    // The index of the access in the queue when recorded, plus one.
+    std::atomic<uint32_t> sequence;
+    void* host_pc;
+  };
+  MMIOFaultingAccess mmio_faulting_accesses_[kMMIOFaultingAccessQueueSize];
+  std::atomic<uint32_t> mmio_faulting_access_enqueue_index_ = {0};
+  // Only modified with mmio_access_sites_mutex_ held, atomic for checking if
+  // the queue is empty without it.
+  std::atomic<uint32_t> mmio_faulting_access_dequeue_index_ = {0};
+  // Drains the queue periodically, as the accesses may be made by functions
+  // that are never resolved or tiered up again, such as a polling loop.
+  std::unique_ptr<xe::threading::Thread> mmio_faulting_access_thread_;
+  std::unique_ptr<xe::threading::Event> mmio_faulting_access_shutdown_event_;
+
+  std::mutex written_guest_code_mutex_;
+  // Inclusive bounds of the instructions written since the last
+  // InvalidateWrittenGuestCode, low > high if none.
+  uint32_t written_guest_code_low_ = UINT32_MAX;
+  uint32_t written_guest_code_high_ = 0;
+  // Guest addresses of the inlined functions to the functions containing
+  // copies of them, with written_guest_code_mutex_ held.
+  std::map<uint32_t, std::vector<GuestFunction*>> inlining_callers_;
+
+  std::mutex mmio_access_sites_mutex_;
+  std::unordered_set<uint32_t> mmio_access_sites_;
+  // Lets the translation skip the lookup until any sites are learned.
+  std::atomic<bool> has_mmio_access_sites_ = {false};
   xe::global_critical_region global_critical_region_;
   ExecutionState execution_state_ = ExecutionState::kPaused;
   std::vector<std::unique_ptr<Module>> modules_;
+  // Copies of the module list for IsReadOnlyModuleRange, which is called for
+  // every constant load when translating and doesn't lock. The old ones are
+  // kept until shutdown, as translations may still be reading them.
+  std::vector<std::unique_ptr<std::vector<Module*>>> module_snapshots_;
+  std::atomic<const std::vector<Module*>*> module_snapshot_ = {nullptr};
   Module* builtin_module_ = nullptr;
   uint32_t next_builtin_address_ = 0xFFFF0000u;
 
@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_RESERVATION_TABLE_H_
+#define XENIA_CPU_RESERVATION_TABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+namespace cpu {
+
+// Versions of guest cache lines for the lwarx/ldarx and stwcx./stdcx.
+// emulation, shared by all threads and accessed by the generated code directly.
+//
+// A reserving load records the version of the line along with the loaded
+// value. A conditional store first advances the version with a compare
+// exchange, which fails if any other conditional store to the line succeeded
+// since the reservation, even if it has put the old value back. Then it stores
+// the value with a compare exchange against the reserved one. Plain stores
+// don't touch the table, they only break the reservation when they actually
+// change the value, which the second compare exchange catches.
+//
+// Lines are hashed into a fixed number of entries, so unrelated lines may
+// break each other's reservations, which is allowed to happen on the real
+// hardware too and only makes the guest retry.
+struct ReservationTable {
+  // Xenon cache line size.
+  static constexpr uint32_t kLineSizeLog2 = 7;
+  static constexpr uint32_t kEntryCountLog2 = 12;
+  static constexpr uint32_t kEntryCount = uint32_t(1) << kEntryCountLog2;
+  // Each entry is on its own host cache line to avoid false sharing.
+  static constexpr uint32_t kEntrySizeLog2 = 6;
+  // Set in PPCContext::reserved_line while a reservation is held.
+  static constexpr uint32_t kReservedLineValid = uint32_t(1) << 31;
+
+  struct alignas(64) Entry {
+    std::atomic<uint32_t> version;
+  };
+
+  static uint32_t GetLine(uint32_t address) { return address >> kLineSizeLog2; }
+  static uint32_t GetEntryIndex(uint32_t line) {
+    return line & (kEntryCount - 1);
+  }
+
+  Entry entries[kEntryCount] = {};
+};
+static_assert(sizeof(ReservationTable::Entry) ==
+                  (size_t(1) << ReservationTable::kEntrySizeLog2),
+              "Reservation table entries must be indexable with a shift");
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_RESERVATION_TABLE_H_
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+constexpr uint32_t kCallerAddress = 0x80000000;
+constexpr uint32_t kCalleeAddress = 0x80000100;
+
+TEST_CASE("LINKED_CALL_INVALIDATE", "[call_linking]") {
+  auto memory = std::make_unique<xe::Memory>();
+  REQUIRE(memory->Initialize());
+  auto processor = std::make_unique<Processor>(memory.get(), nullptr);
+  REQUIRE(processor->Setup(
+      std::make_unique<xe::cpu::backend::x64::X64Backend>()));
+  auto code_cache =
+      static_cast<xe::cpu::backend::x64::X64Backend*>(processor->backend())
+          ->code_cache();
+
+  // The callee is generated first, then the caller calling it.
+  Function* callee = nullptr;
+  processor->AddModule(std::make_unique<xe::cpu::TestModule>(
+      processor.get(), "Test",
+      [](uint32_t address) {
+        return address == kCallerAddress || address == kCalleeAddress;
+      },
+      [&callee](HIRBuilder& b) {
+        if (callee) {
+          b.Call(callee);
+        } else {
+          StoreGPR(b, 3, b.LoadConstantUint64(42));
+        }
+        b.Return();
+        return true;
+      }));
+  processor->backend()->CommitExecutableRange(0x80000000, 0x80010000);
+  callee = processor->ResolveFunction(kCalleeAddress);
+  REQUIRE(callee);
+  auto caller = processor->ResolveFunction(kCallerAddress);
+  REQUIRE(caller);
+
+  auto thread_state = std::make_unique<ThreadState>(processor.get(), 0x100);
+  PPCContext* ctx = thread_state->context();
+  auto call_caller = [&]() {
+    ctx->r[3] = 0;
+    ctx->lr = 0xBCBCBCBC;
+    caller->Call(thread_state.get(), uint32_t(ctx->lr));
+    return ctx->r[3];
+  };
+
+  // Patched to call the code of the callee directly.
+  auto stats = code_cache->QueryCallSiteStats();
+  REQUIRE(stats.linked_count == 1);
+  REQUIRE(stats.unlinked_count == 0);
+  REQUIRE(call_caller() == 42);
+
+  // Back to the stub, which resolves the callee through the indirection table.
+  code_cache->InvalidateGuestCode(kCalleeAddress);
+  stats = code_cache->QueryCallSiteStats();
+  REQUIRE(stats.linked_count == 0);
+  REQUIRE(stats.unlinked_count == 1);
+  REQUIRE(call_caller() == 42);
+
+  thread_state.reset();
+  processor.reset();
+  memory.reset();
+}
@@ -0,0 +1,111 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+
+#include "xenia/cpu/testing/util.h"
+
+#include "xenia/base/byte_order.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/compiler/passes/constant_propagation_pass.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+
+constexpr uint32_t kCalleeAddress = 0x80000100;
+// Read-only in the guest page table, but only the first page is a read-only
+// section of the module.
+constexpr uint32_t kReadOnlySectionAddress = 0x82000000;
+constexpr uint32_t kReadOnlyPageAddress = 0x82010000;
+constexpr uint32_t kPageSize = 0x10000;
+
+class ReadOnlySectionTestModule : public TestModule {
+ public:
+  explicit ReadOnlySectionTestModule(Processor* processor)
+      : TestModule(
+            processor, "Test",
+            [](uint32_t address) { return address == kCalleeAddress; },
+            [](HIRBuilder& b) {
+              b.Return();
+              return true;
+            }) {}
+
+  bool IsReadOnlyRange(uint32_t address, uint32_t size) override {
+    return address >= kReadOnlySectionAddress &&
+           uint64_t(address) + size <= kReadOnlySectionAddress + kPageSize;
+  }
+};
+
+// Calls the function whose address is loaded from the guest address, returns
+// the instructions after constant propagation.
+static std::vector<Opcode> PropagateIndirectCall(Processor* processor,
+                                                 uint32_t address) {
+  HIRBuilder builder;
+  Value* target = builder.Load(builder.LoadConstantUint32(address), INT32_TYPE);
+  builder.CallIndirect(target);
+  builder.Return();
+
+  compiler::Compiler compiler(processor);
+  compiler.AddPass(
+      std::make_unique<compiler::passes::ConstantPropagationPass>());
+  REQUIRE(compiler.Compile(&builder));
+
+  std::vector<Opcode> opcodes;
+  for (Block* block = builder.first_block(); block; block = block->next) {
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      opcodes.push_back(i->opcode->num);
+    }
+  }
+  return opcodes;
+}
+
+TEST_CASE("CONSTANT_PROPAGATION_READ_ONLY_SECTION_LOAD",
+          "[constant_propagation]") {
+  auto memory = std::make_unique<xe::Memory>();
+  REQUIRE(memory->Initialize());
+  auto processor = std::make_unique<Processor>(memory.get(), nullptr);
+  REQUIRE(processor->Setup(
+      std::make_unique<xe::cpu::backend::x64::X64Backend>()));
+  processor->AddModule(
+      std::make_unique<ReadOnlySectionTestModule>(processor.get()));
+
+  auto heap = memory->LookupHeap(kReadOnlySectionAddress);
+  REQUIRE(heap->AllocFixed(kReadOnlySectionAddress, kPageSize * 2, kPageSize,
+                           xe::kMemoryAllocationReserve |
+                               xe::kMemoryAllocationCommit,
+                           xe::kMemoryProtectRead | xe::kMemoryProtectWrite));
+  // The loads are folded as they are, without swapping.
+  xe::store<uint32_t>(memory->TranslateVirtual(kReadOnlySectionAddress),
+                      kCalleeAddress);
+  xe::store<uint32_t>(memory->TranslateVirtual(kReadOnlyPageAddress),
+                      kCalleeAddress);
+  REQUIRE(heap->Protect(kReadOnlySectionAddress, kPageSize * 2,
+                        xe::kMemoryProtectRead));
+
+  // Devirtualized to a direct call.
+  auto opcodes =
+      PropagateIndirectCall(processor.get(), kReadOnlySectionAddress);
+  REQUIRE(std::find(opcodes.begin(), opcodes.end(), OPCODE_LOAD) ==
+          opcodes.end());
+  REQUIRE(std::find(opcodes.begin(), opcodes.end(), OPCODE_CALL_INDIRECT) ==
+          opcodes.end());
+  REQUIRE(std::find(opcodes.begin(), opcodes.end(), OPCODE_CALL) !=
+          opcodes.end());
+
+  // Other read-only pages may be made writable by the title later.
+  opcodes = PropagateIndirectCall(processor.get(), kReadOnlyPageAddress);
+  REQUIRE(std::find(opcodes.begin(), opcodes.end(), OPCODE_LOAD) !=
+          opcodes.end());
+  REQUIRE(std::find(opcodes.begin(), opcodes.end(), OPCODE_CALL_INDIRECT) !=
+          opcodes.end());
+
+  processor.reset();
+  memory.reset();
+}
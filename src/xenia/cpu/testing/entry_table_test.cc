@@ -0,0 +1,164 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/cpu/entry_table.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+static Function* FakeFunction(uint32_t address) {
+  return reinterpret_cast<Function*>(uintptr_t(address) | 1);
+}
+
+TEST_CASE("ENTRY_TABLE_CREATE", "[entry_table]") {
+  EntryTable table;
+  REQUIRE(table.Get(0x82000000) == nullptr);
+
+  Entry* entry;
+  REQUIRE(table.GetOrCreate(0x82000000, &entry) == Entry::STATUS_NEW);
+  REQUIRE(entry->address == 0x82000000);
+  // Not visible until ready.
+  REQUIRE(table.Get(0x82000000) == nullptr);
+  entry->function = FakeFunction(0x82000000);
+  entry->end_address = 0x82000010;
+  table.SetStatus(entry, Entry::STATUS_READY);
+  REQUIRE(table.Get(0x82000000) == entry);
+
+  Entry* existing_entry;
+  REQUIRE(table.GetOrCreate(0x82000000, &existing_entry) ==
+          Entry::STATUS_READY);
+  REQUIRE(existing_entry == entry);
+
+  // Neighbor slots and pages are independent.
+  REQUIRE(table.Get(0x82000004) == nullptr);
+  REQUIRE(table.GetOrCreate(0x82010000, &entry) == Entry::STATUS_NEW);
+  table.SetStatus(entry, Entry::STATUS_FAILED);
+  REQUIRE(table.Get(0x82010000) == nullptr);
+  REQUIRE(table.GetOrCreate(0x82010000, &entry) == Entry::STATUS_FAILED);
+
+  auto functions = table.FindWithAddress(0x82000008);
+  REQUIRE(functions.size() == 1);
+  REQUIRE(functions[0] == FakeFunction(0x82000000));
+}
+
+TEST_CASE("ENTRY_TABLE_FIND_RANGE", "[entry_table]") {
+  EntryTable table;
+  auto add_function = [&table](uint32_t address, uint32_t end_address) {
+    Entry* entry;
+    REQUIRE(table.GetOrCreate(address, &entry) == Entry::STATUS_NEW);
+    entry->function = FakeFunction(address);
+    entry->end_address = end_address;
+    table.SetStatus(entry, Entry::STATUS_READY);
+  };
+  // Crossing into the next page of the table.
+  add_function(0x8200FF00, 0x82010100);
+  add_function(0x82010200, 0x82010210);
+  add_function(0x82020000, 0x82020004);
+
+  auto functions = table.FindWithAddressRange(0x82010080, 0x82010200);
+  std::sort(functions.begin(), functions.end());
+  REQUIRE(functions.size() == 2);
+  REQUIRE(functions[0] == FakeFunction(0x8200FF00));
+  REQUIRE(functions[1] == FakeFunction(0x82010200));
+
+  REQUIRE(table.FindWithAddressRange(0x82010104, 0x820101FC).empty());
+  REQUIRE(table.FindWithAddress(0x82020004).size() == 1);
+  REQUIRE(table.FindWithAddress(0x82020008).empty());
+}
+
+TEST_CASE("ENTRY_TABLE_CONTENDED_CREATE", "[entry_table]") {
+  EntryTable table;
+  const uint32_t kThreadCount = 8;
+  const uint32_t kAddressCount = 4096;
+  std::atomic<uint32_t> created_count = {0};
+  std::atomic<uint32_t> bad_count = {0};
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&]() {
+      for (uint32_t j = 0; j < kAddressCount; ++j) {
+        uint32_t address = 0x82000000 + j * 4;
+        Entry* entry;
+        Entry::Status status = table.GetOrCreate(address, &entry);
+        if (status == Entry::STATUS_NEW) {
+          created_count.fetch_add(1);
+          std::this_thread::yield();
+          entry->function = FakeFunction(address);
+          table.SetStatus(entry, Entry::STATUS_READY);
+        } else if (status != Entry::STATUS_READY ||
+                   entry->function != FakeFunction(address)) {
+          bad_count.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(created_count == kAddressCount);
+  REQUIRE(bad_count == 0);
+}
+
+// Not run by default, use the [benchmark] tag to run.
+TEST_CASE("ENTRY_TABLE_CONTENDED_LOOKUP", "[.][benchmark]") {
+  EntryTable table;
+  const uint32_t kAddressCount = 16384;
+  const uint32_t kLookupsPerThread = 1 << 22;
+  for (uint32_t i = 0; i < kAddressCount; ++i) {
+    Entry* entry;
+    table.GetOrCreate(0x82000000 + i * 4, &entry);
+    entry->function = FakeFunction(entry->address);
+    table.SetStatus(entry, Entry::STATUS_READY);
+  }
+
+  uint32_t max_thread_count =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  for (uint32_t thread_count = 1; thread_count <= max_thread_count;
+       thread_count *= 2) {
+    std::atomic<uint32_t> miss_count = {0};
+    std::vector<std::thread> threads;
+    uint64_t start = Clock::QueryHostTickCount();
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back([&, i]() {
+        uint32_t misses = 0;
+        uint32_t index = i * 7919;
+        for (uint32_t j = 0; j < kLookupsPerThread; ++j) {
+          index = (index + 4099) & (kAddressCount - 1);
+          Entry* entry;
+          if (table.GetOrCreate(0x82000000 + index * 4, &entry) !=
+              Entry::STATUS_READY) {
+            ++misses;
+          }
+        }
+        miss_count.fetch_add(misses);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    uint64_t ticks = Clock::QueryHostTickCount() - start;
+    double seconds = double(ticks) / double(Clock::QueryHostTickFrequency());
+    std::printf("EntryTable: %u threads, %.1f M lookups/s\n", thread_count,
+                double(kLookupsPerThread) * thread_count / seconds / 1.0e6);
+    REQUIRE(miss_count == 0);
+  }
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
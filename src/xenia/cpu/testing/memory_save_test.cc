@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/platform.h"
+#include "xenia/memory.h"
+
+#if XE_PLATFORM_LINUX
+#include <sys/wait.h>
+#include <unistd.h>
+#endif  // XE_PLATFORM_LINUX
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+constexpr uint32_t kTestBase = 0x10000000;
+constexpr uint32_t kTestPageSize = 4096;
+
+// Fills the pages with a mix of zero, compressible and incompressible data.
+static void FillTestPages(Memory* memory, uint32_t page_count, uint32_t seed) {
+  auto data = memory->TranslateVirtual<uint8_t*>(kTestBase);
+  uint32_t random = seed;
+  for (uint32_t i = 0; i < page_count; ++i) {
+    uint8_t* page = data + i * kTestPageSize;
+    switch (i & 3) {
+      case 0:
+        std::memset(page, 0, kTestPageSize);
+        break;
+      case 1:
+      case 2:
+        for (uint32_t j = 0; j < kTestPageSize; ++j) {
+          page[j] = uint8_t((j / 16 + i + seed) & 7);
+        }
+        break;
+      case 3:
+        for (uint32_t j = 0; j < kTestPageSize; ++j) {
+          random = random * 1103515245 + 12345;
+          page[j] = uint8_t(random >> 16);
+        }
+        break;
+    }
+  }
+}
+
+static std::unique_ptr<Memory> CreateTestMemory(uint32_t page_count) {
+  auto memory = std::make_unique<Memory>();
+  REQUIRE(memory->Initialize());
+  REQUIRE(memory->LookupHeap(kTestBase)->AllocFixed(
+      kTestBase, page_count * kTestPageSize, kTestPageSize,
+      kMemoryAllocationReserve | kMemoryAllocationCommit,
+      kMemoryProtectRead | kMemoryProtectWrite));
+  return memory;
+}
+
+TEST_CASE("MEMORY_SAVE_RESTORE", "[memory]") {
+  const uint32_t page_count = 64;
+  auto memory = CreateTestMemory(page_count);
+  FillTestPages(memory.get(), page_count, 1);
+  auto data = memory->TranslateVirtual<uint8_t*>(kTestBase);
+  std::vector<uint8_t> expected_full(data, data + page_count * kTestPageSize);
+
+  std::vector<uint8_t> full(64 * 1024 * 1024);
+  ByteStream full_stream(full.data(), full.size());
+  REQUIRE(memory->Save(&full_stream));
+
+  // Only the modified page is written in the incremental state.
+  data[5 * kTestPageSize + 7] ^= 0xFF;
+  std::vector<uint8_t> expected_incremental(data,
+                                            data + page_count * kTestPageSize);
+  std::vector<uint8_t> incremental(full.size());
+  ByteStream incremental_stream(incremental.data(), incremental.size());
+  REQUIRE(memory->Save(&incremental_stream, true));
+  REQUIRE(incremental_stream.offset() + kTestPageSize < full_stream.offset());
+
+  // Full restore.
+  FillTestPages(memory.get(), page_count, 2);
+  full_stream.set_offset(0);
+  REQUIRE(memory->Restore(&full_stream));
+  REQUIRE(!std::memcmp(data, expected_full.data(), expected_full.size()));
+  // Incremental saving is based on the last save, not possible after restoring.
+  REQUIRE(!memory->has_saved_state());
+
+  // Incremental restore on top of the base state.
+  FillTestPages(memory.get(), page_count, 3);
+  full_stream.set_offset(0);
+  REQUIRE(memory->Restore(&full_stream));
+  incremental_stream.set_offset(0);
+  REQUIRE(memory->Restore(&incremental_stream));
+  REQUIRE(!std::memcmp(data, expected_incremental.data(),
+                       expected_incremental.size()));
+}
+
+#if XE_PLATFORM_LINUX
+// Saves the memory to a file from a forked process, like with save_state_fork.
+static bool SaveToFileForked(Memory* memory, const std::filesystem::path& path,
+                             bool incremental) {
+  if (!filesystem::CreateFile(path)) {
+    return false;
+  }
+  // Much larger than the state, like in Emulator::SaveToFile.
+  auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0,
+                                256 * 1024 * 1024);
+  if (!map) {
+    return false;
+  }
+  ByteStream stream(map->data(), map->size());
+  pid_t pid = fork();
+  if (!pid) {
+    if (!memory->SaveRaw(&stream, incremental)) {
+      _exit(1);
+    }
+    map->Flush();
+    map->Close(stream.offset());
+    _exit(0);
+  }
+  if (pid < 0) {
+    return false;
+  }
+  map.reset();
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+         !WEXITSTATUS(status);
+}
+
+static bool RestoreFromFile(Memory* memory, const std::filesystem::path& path) {
+  auto map = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!map) {
+    return false;
+  }
+  ByteStream stream(map->data(), map->size());
+  return memory->Restore(&stream) && stream.offset() == map->size();
+}
+
+TEST_CASE("MEMORY_SAVE_RESTORE_FORK", "[memory]") {
+  const uint32_t page_count = 64;
+  auto memory = CreateTestMemory(page_count);
+  FillTestPages(memory.get(), page_count, 1);
+  auto data = memory->TranslateVirtual<uint8_t*>(kTestBase);
+  std::vector<uint8_t> expected_full(data, data + page_count * kTestPageSize);
+  auto full_path =
+      std::filesystem::temp_directory_path() / "xenia_memory_save_full";
+  auto incremental_path =
+      std::filesystem::temp_directory_path() / "xenia_memory_save_incremental";
+
+  // Truncated to the size of the state when closed in the child.
+  REQUIRE(SaveToFileForked(memory.get(), full_path, false));
+  REQUIRE(std::filesystem::file_size(full_path) < 64 * 1024 * 1024);
+
+  // Incremental on top of a state saved in this process.
+  std::vector<uint8_t> base(64 * 1024 * 1024);
+  ByteStream base_stream(base.data(), base.size());
+  REQUIRE(memory->Save(&base_stream));
+  data[5 * kTestPageSize + 7] ^= 0xFF;
+  std::vector<uint8_t> expected_incremental(data,
+                                            data + page_count * kTestPageSize);
+  REQUIRE(SaveToFileForked(memory.get(), incremental_path, true));
+  REQUIRE(std::filesystem::file_size(incremental_path) + kTestPageSize <
+          std::filesystem::file_size(full_path));
+
+  FillTestPages(memory.get(), page_count, 2);
+  REQUIRE(RestoreFromFile(memory.get(), full_path));
+  REQUIRE(!std::memcmp(data, expected_full.data(), expected_full.size()));
+
+  FillTestPages(memory.get(), page_count, 3);
+  base_stream.set_offset(0);
+  REQUIRE(memory->Restore(&base_stream));
+  REQUIRE(RestoreFromFile(memory.get(), incremental_path));
+  REQUIRE(!std::memcmp(data, expected_incremental.data(),
+                       expected_incremental.size()));
+
+  std::filesystem::remove(full_path);
+  std::filesystem::remove(incremental_path);
+}
+#endif  // XE_PLATFORM_LINUX
+
+TEST_CASE("MEMORY_SAVE_RESTORE_BENCHMARK", "[.][benchmark]") {
+  const uint32_t page_count = 64 * 1024 * 1024 / kTestPageSize;
+  auto memory = CreateTestMemory(page_count);
+  FillTestPages(memory.get(), page_count, 1);
+  const uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+
+  std::vector<uint8_t> full(256 * 1024 * 1024);
+  ByteStream full_stream(full.data(), full.size());
+  uint64_t start_tick = Clock::QueryHostTickCount();
+  REQUIRE(memory->Save(&full_stream));
+  uint64_t save_ticks = Clock::QueryHostTickCount() - start_tick;
+  std::printf("Full save: %zu KB (%u KB of pages) in %.1f ms\n",
+              full_stream.offset() >> 10, page_count * kTestPageSize >> 10,
+              save_ticks * 1000.0 / tick_frequency);
+
+  // Modify 1/16 of the pages.
+  auto data = memory->TranslateVirtual<uint8_t*>(kTestBase);
+  for (uint32_t i = 0; i < page_count; i += 16) {
+    data[i * kTestPageSize] ^= 0xFF;
+  }
+  std::vector<uint8_t> incremental(full.size());
+  ByteStream incremental_stream(incremental.data(), incremental.size());
+  start_tick = Clock::QueryHostTickCount();
+  REQUIRE(memory->Save(&incremental_stream, true));
+  save_ticks = Clock::QueryHostTickCount() - start_tick;
+  std::printf("Incremental save: %zu KB in %.1f ms\n",
+              incremental_stream.offset() >> 10,
+              save_ticks * 1000.0 / tick_frequency);
+
+  full_stream.set_offset(0);
+  start_tick = Clock::QueryHostTickCount();
+  REQUIRE(memory->Restore(&full_stream));
+  uint64_t restore_ticks = Clock::QueryHostTickCount() - start_tick;
+  std::printf("Full restore: %.1f ms\n",
+              restore_ticks * 1000.0 / tick_frequency);
+
+  incremental_stream.set_offset(0);
+  start_tick = Clock::QueryHostTickCount();
+  REQUIRE(memory->Restore(&incremental_stream));
+  restore_ticks = Clock::QueryHostTickCount() - start_tick;
+  std::printf("Incremental restore: %.1f ms\n",
+              restore_ticks * 1000.0 / tick_frequency);
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
@@ -111,3 +111,26 @@ TEST_CASE("PACK_SHORT_2", "[instr]") {
         REQUIRE(result == vec128i(0, 0, 0, 0x80018001));
       });
 }
+
+TEST_CASE("PACK_8_IN_16_UN_UN_SAT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                   PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                       PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0000, 0x0001, 0x00FF, 0x0100, 0x7FFF, 0x8000,
+                            0xFFFF, 0x0080);
+        ctx->v[5] = vec128s(0x0010, 0x0200, 0x00FE, 0x1234, 0x0003, 0x00AB,
+                            0xABCD, 0x0040);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                  0x80, 0x10, 0xFF, 0xFE, 0xFF, 0x03, 0xAB,
+                                  0xFF, 0x40));
+      });
+}
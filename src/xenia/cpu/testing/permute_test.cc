@@ -153,3 +153,26 @@ TEST_CASE("PERMUTE_V128_BY_V128", "[instr]") {
                                   20, 19, 18, 17, 16));
       });
 }
+
+TEST_CASE("PERMUTE_V128_BY_V128_HIGH_BITS", "[instr]") {
+  // Only the low 5 bits of the control bytes are used.
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Permute(LoadVR(b, 3), LoadVR(b, 4), LoadVR(b, 5), INT8_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[3] = vec128b(0x3F, 0x40, 0x90, 0xE1, 0x05, 0x15, 0x0A, 0x1A,
+                            0xFF, 0x00, 0x10, 0x8F, 0x33, 0x44, 0x55, 0x66);
+        ctx->v[4] =
+            vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        ctx->v[5] = vec128b(16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+                            29, 30, 31);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(31, 0, 16, 1, 5, 21, 10, 26, 31, 0, 16, 15,
+                                  19, 4, 21, 6));
+      });
+}
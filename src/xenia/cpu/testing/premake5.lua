@@ -5,10 +5,12 @@ test_suite("xenia-cpu-tests", project_root, ".", {
   links = {
     "capstone",
     "fmt",
+    "snappy",
     "xenia-base",
     "xenia-core",
     "xenia-cpu",
     "xenia-cpu-backend-x64",
+    "xxhash",
 
     -- TODO(benvanik): cut these dependencies?
     "xenia-kernel",
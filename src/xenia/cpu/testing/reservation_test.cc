@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+constexpr uint32_t kCounterAddress = 0x10000000;
+
+// Increments the big-endian counter at r4 r5 times with a reserved load and
+// store loop, counting the failed conditional stores in r6.
+static void GenerateAtomicIncrementLoop(HIRBuilder& b) {
+  auto retry_label = b.NewLabel();
+  auto stored_label = b.NewLabel();
+  b.MarkLabel(retry_label);
+  auto value = b.ReservedLoad(LoadGPR(b, 4), INT32_TYPE);
+  auto new_value =
+      b.ByteSwap(b.Add(b.ByteSwap(value), b.LoadConstantInt32(1)));
+  b.BranchTrue(b.ReservedStore(LoadGPR(b, 4), new_value), stored_label);
+  StoreGPR(b, 6, b.Add(LoadGPR(b, 6), b.LoadConstantInt64(1)));
+  b.Branch(retry_label);
+  b.MarkLabel(stored_label);
+  auto remaining = b.Sub(LoadGPR(b, 5), b.LoadConstantInt64(1));
+  StoreGPR(b, 5, remaining);
+  b.BranchTrue(remaining, retry_label);
+  b.Return();
+}
+
+// Runs the loop on thread_count host threads at once, returning the number of
+// failed conditional stores.
+static uint64_t RunAtomicIncrementLoop(TestFunction& test,
+                                       uint32_t thread_count,
+                                       uint32_t iteration_count) {
+  auto processor = test.processors[0].get();
+  auto fn = processor->ResolveFunction(0x80000000);
+  REQUIRE(fn);
+  std::atomic<uint64_t> failure_count(0);
+  std::vector<std::thread> threads;
+  for (uint32_t n = 0; n < thread_count; ++n) {
+    threads.emplace_back([&, n]() {
+      ThreadState thread_state(processor, 0x100 + n);
+      auto ctx = thread_state.context();
+      ctx->lr = 0xBCBCBCBC;
+      ctx->r[4] = kCounterAddress;
+      ctx->r[5] = iteration_count;
+      ctx->r[6] = 0;
+      fn->Call(&thread_state, uint32_t(ctx->lr));
+      failure_count += ctx->r[6];
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return failure_count;
+}
+
+static uint32_t* AllocCounter(TestFunction& test) {
+  REQUIRE(test.memory->LookupHeap(kCounterAddress)
+              ->AllocFixed(
+                  kCounterAddress, 4096, 4096,
+                  xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+                  xe::kMemoryProtectRead | xe::kMemoryProtectWrite));
+  auto counter = test.memory->TranslateVirtual<uint32_t*>(kCounterAddress);
+  *counter = 0;
+  return counter;
+}
+
+TEST_CASE("RESERVED_LOAD_STORE_MT", "[instr]") {
+  TestFunction test(GenerateAtomicIncrementLoop);
+  auto counter = AllocCounter(test);
+  const uint32_t thread_count = 4;
+  const uint32_t iteration_count = 100000;
+  RunAtomicIncrementLoop(test, thread_count, iteration_count);
+  // No increments are lost.
+  REQUIRE(xe::byte_swap(*counter) == thread_count * iteration_count);
+}
+
+TEST_CASE("RESERVED_STORE_ABA", "[instr]") {
+  // r7 = 0: r3 = reserved load from r4.
+  // r7 != 0: r3 = whether stored r5 to r4 conditionally.
+  TestFunction test([](HIRBuilder& b) {
+    auto store_label = b.NewLabel();
+    b.BranchTrue(LoadGPR(b, 7), store_label);
+    StoreGPR(b, 3,
+             b.ZeroExtend(b.ReservedLoad(LoadGPR(b, 4), INT32_TYPE),
+                          INT64_TYPE));
+    b.Return();
+    b.MarkLabel(store_label);
+    auto stored = b.ReservedStore(LoadGPR(b, 4),
+                                  b.Truncate(LoadGPR(b, 5), INT32_TYPE));
+    StoreGPR(b, 3, b.ZeroExtend(stored, INT64_TYPE));
+    b.Return();
+  });
+  auto counter = AllocCounter(test);
+  auto processor = test.processors[0].get();
+  auto fn = processor->ResolveFunction(0x80000000);
+  REQUIRE(fn);
+  ThreadState thread_state_a(processor, 0x100);
+  ThreadState thread_state_b(processor, 0x101);
+  auto reserved_load = [&](ThreadState& thread_state) {
+    auto ctx = thread_state.context();
+    ctx->lr = 0xBCBCBCBC;
+    ctx->r[4] = kCounterAddress;
+    ctx->r[7] = 0;
+    fn->Call(&thread_state, uint32_t(ctx->lr));
+    return uint32_t(ctx->r[3]);
+  };
+  auto reserved_store = [&](ThreadState& thread_state, uint32_t value) {
+    auto ctx = thread_state.context();
+    ctx->lr = 0xBCBCBCBC;
+    ctx->r[4] = kCounterAddress;
+    ctx->r[5] = value;
+    ctx->r[7] = 1;
+    fn->Call(&thread_state, uint32_t(ctx->lr));
+    return ctx->r[3] != 0;
+  };
+
+  *counter = 1;
+  // Uncontended.
+  REQUIRE(reserved_load(thread_state_a) == 1);
+  REQUIRE(reserved_store(thread_state_a, 2));
+  REQUIRE(*counter == 2);
+  // The reservation is lost after the store.
+  REQUIRE(!reserved_store(thread_state_a, 3));
+  REQUIRE(*counter == 2);
+  // Lost after a plain store changing the value.
+  REQUIRE(reserved_load(thread_state_a) == 2);
+  *counter = 4;
+  REQUIRE(!reserved_store(thread_state_a, 5));
+  REQUIRE(*counter == 4);
+  // Lost after a conditional store by another thread, even if the value was
+  // changed back.
+  REQUIRE(reserved_load(thread_state_a) == 4);
+  REQUIRE(reserved_load(thread_state_b) == 4);
+  REQUIRE(reserved_store(thread_state_b, 6));
+  REQUIRE(reserved_load(thread_state_b) == 6);
+  REQUIRE(reserved_store(thread_state_b, 4));
+  REQUIRE(!reserved_store(thread_state_a, 7));
+  REQUIRE(*counter == 4);
+}
+
+// Run explicitly with the [.][benchmark] tags.
+TEST_CASE("RESERVED_LOAD_STORE_BENCHMARK", "[.][benchmark]") {
+  TestFunction test(GenerateAtomicIncrementLoop);
+  auto counter = AllocCounter(test);
+  const uint32_t iteration_count = 1000000;
+  const uint64_t tick_frequency = xe::Clock::QueryHostTickFrequency();
+  uint32_t max_thread_count =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  for (uint32_t thread_count = 1; thread_count <= max_thread_count;
+       thread_count *= 2) {
+    *counter = 0;
+    uint64_t start_tick = xe::Clock::QueryHostTickCount();
+    uint64_t failure_count =
+        RunAtomicIncrementLoop(test, thread_count, iteration_count);
+    double seconds =
+        double(xe::Clock::QueryHostTickCount() - start_tick) / tick_frequency;
+    REQUIRE(xe::byte_swap(*counter) == thread_count * iteration_count);
+    std::printf(
+        "%u threads: %.2f M increments/s, %.3f failed stores per increment\n",
+        thread_count, thread_count * iteration_count / seconds / 1000000.0,
+        double(failure_count) / (thread_count * iteration_count));
+  }
+}
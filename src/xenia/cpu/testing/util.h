@@ -14,6 +14,7 @@
 
 #include "xenia/base/main.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -32,17 +33,37 @@ using xe::cpu::ppc::PPCContext;
 
 class TestFunction {
  public:
-  TestFunction(std::function<void(hir::HIRBuilder& b)> generator) {
+  TestFunction(std::function<void(hir::HIRBuilder& b)> generator)
+      : generator(generator) {
     memory_size = 16 * 1024 * 1024;
     memory.reset(new Memory());
     memory->Initialize();
 
+#if XENIA_TEST_X64
+    // The sequences used without AVX-512 are tested too on hosts supporting
+    // it.
+    test_without_avx512 =
+        cvars::use_avx512_instructions &&
+        (xe::cpu::backend::x64::X64Emitter::QueryFeatureFlags() &
+         xe::cpu::backend::x64::kX64EmitAVX512Ortho);
+#endif  // XENIA_TEST_X64
+    CreateProcessors(true);
+  }
+
+  // Recreates the processors, as the code cache of only one can exist at once.
+  void CreateProcessors(bool use_avx512) {
+    processors.clear();
+    using_avx512 = use_avx512;
+
 #if XENIA_TEST_X64
     {
+      bool use_avx512_instructions = cvars::use_avx512_instructions;
+      cvars::use_avx512_instructions = use_avx512_instructions && use_avx512;
       auto backend = std::make_unique<xe::cpu::backend::x64::X64Backend>();
       auto processor = std::make_unique<Processor>(memory.get(), nullptr);
       processor->Setup(std::move(backend));
       processors.emplace_back(std::move(processor));
+      cvars::use_avx512_instructions = use_avx512_instructions;
     }
 #endif  // XENIA_TEST_X64
 
@@ -50,7 +71,7 @@ class TestFunction {
       auto module = std::make_unique<xe::cpu::TestModule>(
           processor.get(), "Test",
           [](uint64_t address) { return address == 0x80000000; },
-          [generator](hir::HIRBuilder& b) {
+          [generator = generator](hir::HIRBuilder& b) {
             generator(b);
             return true;
           });
@@ -66,6 +87,15 @@ class TestFunction {
 
   void Run(std::function<void(PPCContext*)> pre_call,
            std::function<void(PPCContext*)> post_call) {
+    RunOnProcessors(pre_call, post_call);
+    if (test_without_avx512) {
+      CreateProcessors(!using_avx512);
+      RunOnProcessors(pre_call, post_call);
+    }
+  }
+
+  void RunOnProcessors(std::function<void(PPCContext*)> pre_call,
+                       std::function<void(PPCContext*)> post_call) {
     for (auto& processor : processors) {
       auto fn = processor->ResolveFunction(0x80000000);
 
@@ -85,6 +115,9 @@ class TestFunction {
     }
   }
 
+  std::function<void(hir::HIRBuilder& b)> generator;
+  bool test_without_avx512 = false;
+  bool using_avx512 = true;
   uint32_t memory_size;
   std::unique_ptr<Memory> memory;
   std::vector<std::unique_ptr<Processor>> processors;
@@ -0,0 +1,120 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <cstdio>
+
+#include "xenia/base/clock.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+typedef std::function<Value*(HIRBuilder& b, Value* value, Value* operand)>
+    VectorOpGenerator;
+
+// Applies the op to v3 with v4 as the other operand, 16 times in a chain per
+// iteration, r5 iterations.
+static void GenerateVectorOpLoop(HIRBuilder& b, const VectorOpGenerator& op) {
+  auto loop_label = b.NewLabel();
+  b.MarkLabel(loop_label);
+  auto value = LoadVR(b, 3);
+  auto operand = LoadVR(b, 4);
+  for (uint32_t n = 0; n < 16; ++n) {
+    value = op(b, value, operand);
+  }
+  StoreVR(b, 3, value);
+  auto remaining = b.Sub(LoadGPR(b, 5), b.LoadConstantInt64(1));
+  StoreGPR(b, 5, remaining);
+  b.BranchTrue(remaining, loop_label);
+  b.Return();
+}
+
+static double MeasureVectorOpLoop(TestFunction& test,
+                                  uint32_t iteration_count) {
+  auto processor = test.processors[0].get();
+  auto fn = processor->ResolveFunction(0x80000000);
+  REQUIRE(fn);
+  ThreadState thread_state(processor, 0x100);
+  auto ctx = thread_state.context();
+  ctx->lr = 0xBCBCBCBC;
+  ctx->v[3] = vec128i(0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210);
+  ctx->v[4] = vec128i(0x0F1E2D3C, 0x4B5A6978, 0x8796A5B4, 0xC3D2E1F0);
+  ctx->r[5] = iteration_count;
+  uint64_t start_tick = Clock::QueryHostTickCount();
+  fn->Call(&thread_state, uint32_t(ctx->lr));
+  return double(Clock::QueryHostTickCount() - start_tick) /
+         Clock::QueryHostTickFrequency();
+}
+
+// Prints the throughput of the op with and without the AVX-512 sequences.
+static void BenchmarkVectorOp(const char* name, const VectorOpGenerator& op) {
+  const uint32_t iteration_count = 1000000;
+  TestFunction test([&op](HIRBuilder& b) { GenerateVectorOpLoop(b, op); });
+  if (!test.test_without_avx512) {
+    std::printf("%s: %.1f M ops/s (AVX-512 unavailable)\n", name,
+                16 * iteration_count / 1000000.0 /
+                    MeasureVectorOpLoop(test, iteration_count));
+    return;
+  }
+  double avx512_seconds = MeasureVectorOpLoop(test, iteration_count);
+  test.CreateProcessors(false);
+  double fallback_seconds = MeasureVectorOpLoop(test, iteration_count);
+  std::printf("%s: %.1f M ops/s with AVX-512, %.1f M ops/s without\n", name,
+              16 * iteration_count / 1000000.0 / avx512_seconds,
+              16 * iteration_count / 1000000.0 / fallback_seconds);
+}
+
+// Run explicitly with the [.][benchmark] tags.
+TEST_CASE("VECTOR_OP_BENCHMARK", "[.][benchmark]") {
+  BenchmarkVectorOp("VECTOR_SHL_I8", [](HIRBuilder& b, Value* v, Value* o) {
+    return b.VectorShl(v, o, INT8_TYPE);
+  });
+  BenchmarkVectorOp("VECTOR_SHL_I16", [](HIRBuilder& b, Value* v, Value* o) {
+    return b.VectorShl(v, o, INT16_TYPE);
+  });
+  BenchmarkVectorOp("VECTOR_SHR_I8", [](HIRBuilder& b, Value* v, Value* o) {
+    return b.VectorShr(v, o, INT8_TYPE);
+  });
+  BenchmarkVectorOp("VECTOR_SHR_I16", [](HIRBuilder& b, Value* v, Value* o) {
+    return b.VectorShr(v, o, INT16_TYPE);
+  });
+  BenchmarkVectorOp("VECTOR_SHA_I8", [](HIRBuilder& b, Value* v, Value* o) {
+    return b.VectorSha(v, o, INT8_TYPE);
+  });
+  BenchmarkVectorOp("VECTOR_SHA_I16", [](HIRBuilder& b, Value* v, Value* o) {
+    return b.VectorSha(v, o, INT16_TYPE);
+  });
+  BenchmarkVectorOp("VECTOR_ROTATE_LEFT_I8",
+                    [](HIRBuilder& b, Value* v, Value* o) {
+                      return b.VectorRotateLeft(v, o, INT8_TYPE);
+                    });
+  BenchmarkVectorOp("VECTOR_ROTATE_LEFT_I16",
+                    [](HIRBuilder& b, Value* v, Value* o) {
+                      return b.VectorRotateLeft(v, o, INT16_TYPE);
+                    });
+  BenchmarkVectorOp("VECTOR_ROTATE_LEFT_I32",
+                    [](HIRBuilder& b, Value* v, Value* o) {
+                      return b.VectorRotateLeft(v, o, INT32_TYPE);
+                    });
+  BenchmarkVectorOp("PERMUTE_V128_BY_V128",
+                    [](HIRBuilder& b, Value* v, Value* o) {
+                      return b.Permute(v, o, v, INT8_TYPE);
+                    });
+  BenchmarkVectorOp("PACK_8_IN_16_UN_UN_SAT",
+                    [](HIRBuilder& b, Value* v, Value* o) {
+                      return b.Pack(v, o,
+                                    PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                                        PACK_TYPE_OUT_UNSIGNED |
+                                        PACK_TYPE_OUT_SATURATE);
+                    });
+}
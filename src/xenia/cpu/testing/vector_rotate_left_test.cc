@@ -70,3 +70,58 @@ TEST_CASE("VECTOR_ROTATE_LEFT_I32", "[instr]") {
                 vec128i(0x00000001, 0x00000002, 0x00000001, 0x00000002));
       });
 }
+
+TEST_CASE("VECTOR_ROTATE_LEFT_I8_PER_LANE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorRotateLeft(LoadVR(b, 4), LoadVR(b, 5), INT8_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128b(0x81, 0x81, 0x12, 0xF0, 0x01, 0x80, 0xA5, 0x3C,
+                            0x81, 0x12, 0xF0, 0xA5, 0x3C, 0x7E, 0xFF, 0x00);
+        ctx->v[5] = vec128b(0, 1, 4, 7, 8, 9, 15, 0xFF, 0x13, 0x22, 0x83, 6, 5,
+                            3, 2, 1);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x81, 0x03, 0x21, 0x78, 0x01, 0x01, 0xD2,
+                                  0x1E, 0x0C, 0x48, 0x87, 0x69, 0x87, 0xF3,
+                                  0xFF, 0x00));
+      });
+}
+
+TEST_CASE("VECTOR_ROTATE_LEFT_I16_PER_LANE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorRotateLeft(LoadVR(b, 4), LoadVR(b, 5), INT16_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x8001, 0x1234, 0xF00F, 0x0001, 0x8000, 0xABCD,
+                            0xFFFE, 0x1234);
+        ctx->v[5] = vec128s(1, 4, 8, 15, 16, 17, 31, 0xFFF3);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128s(0x0003, 0x2341, 0x0FF0, 0x8000, 0x8000,
+                                  0x579B, 0x7FFF, 0x91A0));
+      });
+}
+
+TEST_CASE("VECTOR_ROTATE_LEFT_I32_PER_LANE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorRotateLeft(LoadVR(b, 4), LoadVR(b, 5), INT32_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x80000001, 0x12345678, 0xF000000F, 0xABCDEF01);
+        ctx->v[5] = vec128i(31, 32, 33, 0xFFFFFFF8);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result ==
+                vec128i(0xC0000000, 0x12345678, 0xE000001F, 0x01ABCDEF));
+      });
+}
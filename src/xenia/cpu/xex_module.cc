@@ -17,6 +17,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/lzx.h"
@@ -120,6 +121,48 @@ const PESection* XexModule::GetPESection(const char* name) {
   return nullptr;
 }
 
+std::vector<uint32_t> XexModule::GetPDataFunctionAddresses() {
+  std::vector<uint32_t> addresses;
+  const PESection* pdata = GetPESection(".pdata");
+  if (!pdata) {
+    return addresses;
+  }
+  // IMAGE_CE_RUNTIME_FUNCTION_ENTRY.
+  struct RuntimeFunctionEntry {
+    xe::be<uint32_t> begin_address;
+    // PrologLength:8, FunctionLength:22, ThirtyTwoBit:1, ExceptionFlag:1.
+    xe::be<uint32_t> data;
+  };
+  auto entries = memory()->TranslateVirtual<const RuntimeFunctionEntry*>(
+      pdata->address);
+  uint32_t entry_count = pdata->size / sizeof(RuntimeFunctionEntry);
+  addresses.reserve(entry_count);
+  for (uint32_t i = 0; i < entry_count; ++i) {
+    uint32_t begin_address = entries[i].begin_address;
+    uint32_t function_length = (uint32_t(entries[i].data) >> 8) & 0x3FFFFF;
+    if (!begin_address || !function_length || (begin_address & 3) ||
+        !ContainsAddress(begin_address)) {
+      continue;
+    }
+    addresses.push_back(begin_address);
+  }
+  return addresses;
+}
+
+std::vector<uint32_t> XexModule::GetKnownFunctionAddresses() {
+  std::vector<uint32_t> addresses = GetPDataFunctionAddresses();
+  // Import thunks, __savegprlr_* and the like.
+  ForEachFunction([&addresses](Function* function) {
+    if (function->is_guest()) {
+      addresses.push_back(function->address());
+    }
+  });
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+  return addresses;
+}
+
 uint32_t XexModule::GetProcAddress(uint16_t ordinal) const {
   // First: Check the xex2 export table.
   if (xex_security_info()->export_table) {
@@ -971,6 +1014,7 @@ bool XexModule::LoadContinue() {
 
   low_address_ = UINT_MAX;
   high_address_ = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> read_only_ranges;
 
   auto sec_header = xex_security_info();
   for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count; i++) {
@@ -984,6 +1028,16 @@ bool XexModule::LoadContinue() {
       low_address_ = std::min(low_address_, start_address);
       high_address_ = std::max(high_address_, end_address);
     }
+    if ((desc.info == XEX_SECTION_CODE ||
+         desc.info == XEX_SECTION_READONLY_DATA) &&
+        desc.page_count) {
+      if (!read_only_ranges.empty() &&
+          read_only_ranges.back().second == start_address) {
+        read_only_ranges.back().second = end_address;
+      } else {
+        read_only_ranges.emplace_back(start_address, end_address);
+      }
+    }
 
     page += desc.page_count;
   }
@@ -1041,6 +1095,38 @@ bool XexModule::LoadContinue() {
     return false;
   }
 
+  // The read-only sections won't change anymore now that the imports are
+  // written, so loads from them can be folded when translating. Only written
+  // once, as the sections of a module are the same if it's loaded again.
+  if (read_only_ranges_.empty()) {
+    read_only_ranges_ = read_only_ranges;
+  }
+  read_only_ranges_published_.store(true, std::memory_order_release);
+
+  // Let the backend restore any previously generated code now that all code
+  // (including the rewritten import thunks) is in place. The read-only data
+  // is hashed too, as the generated code may contain values loaded from it.
+  if (high_address_ > low_address_) {
+    XXH3_state_t hash_state;
+    XXH3_64bits_reset(&hash_state);
+    for (const auto& range : read_only_ranges) {
+      XXH3_64bits_update(&hash_state, memory()->TranslateVirtual(range.first),
+                         range.second - range.first);
+    }
+    processor_->backend()->OnModuleLoaded(this,
+                                          XXH3_64bits_digest(&hash_state));
+  }
+
+  // Compile all the known functions before any code of the module runs, or
+  // start compiling them in the background, if enabled.
+  if (cvars::precompile_functions) {
+    processor_->PrecompileFunctions(GetKnownFunctionAddresses());
+  } else {
+    for (uint32_t address : GetPDataFunctionAddresses()) {
+      processor_->QueueFunctionCompile(address, false);
+    }
+  }
+
   // Load a specified module map and diff.
   if (cvars::load_module_map.size()) {
     if (!ReadMap(cvars::load_module_map.c_str())) {
@@ -1078,6 +1164,11 @@ bool XexModule::Unload() {
   }
   loaded_ = false;
 
+  // Not cleared, as translations on other threads may still be reading it.
+  read_only_ranges_published_.store(false, std::memory_order_release);
+
+  processor_->backend()->OnModuleUnloaded(this);
+
   // If this isn't a patch, just deallocate the memory occupied by the exe
   if (!is_patch()) {
     assert_not_zero(base_address_);
@@ -1273,6 +1364,22 @@ bool XexModule::ContainsAddress(uint32_t address) {
   return address >= low_address_ && address < high_address_;
 }
 
+bool XexModule::IsReadOnlyRange(uint32_t address, uint32_t size) {
+  if (!read_only_ranges_published_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  auto it = std::upper_bound(
+      read_only_ranges_.begin(), read_only_ranges_.end(), address,
+      [](uint32_t address, const std::pair<uint32_t, uint32_t>& range) {
+        return address < range.first;
+      });
+  if (it == read_only_ranges_.begin()) {
+    return false;
+  }
+  --it;
+  return address >= it->first && uint64_t(address) + size <= it->second;
+}
+
 std::unique_ptr<Function> XexModule::CreateFunction(uint32_t address) {
   return std::unique_ptr<Function>(
       processor_->backend()->CreateGuestFunction(this, address));
@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_XEX_MODULE_H_
 #define XENIA_CPU_XEX_MODULE_H_
 
+#include <atomic>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "xenia/cpu/module.h"
@@ -130,6 +132,12 @@ class XexModule : public xe::cpu::Module {
   static const void* GetSecurityInfo(const xex2_header* header);
 
   const PESection* GetPESection(const char* name);
+  // Gets the start addresses of the functions listed in the exception
+  // directory (the .pdata section), if the module has one.
+  std::vector<uint32_t> GetPDataFunctionAddresses();
+  // Gets the start addresses of all the functions found in the module so far,
+  // sorted.
+  std::vector<uint32_t> GetKnownFunctionAddresses();
 
   uint32_t GetProcAddress(uint16_t ordinal) const;
   uint32_t GetProcAddress(const std::string_view name) const;
@@ -141,6 +149,7 @@ class XexModule : public xe::cpu::Module {
   bool Unload();
 
   bool ContainsAddress(uint32_t address) override;
+  bool IsReadOnlyRange(uint32_t address, uint32_t size) override;
 
   const std::string& name() const override { return name_; }
   bool is_executable() const override {
@@ -201,6 +210,11 @@ class XexModule : public xe::cpu::Module {
   uint32_t base_address_ = 0;
   uint32_t low_address_ = 0;
   uint32_t high_address_ = 0;
+  // Code and read-only data sections as sorted [start, end) pairs, with
+  // adjacent ones merged. Set once all imports have been written, and not
+  // modified after being published, so it's read without locking.
+  std::vector<std::pair<uint32_t, uint32_t>> read_only_ranges_;
+  std::atomic<bool> read_only_ranges_published_ = {false};
 
   XexFormat xex_format_ = kFormatUnknown;
   SecurityInfoContext security_info_ = {};
@@ -447,7 +447,12 @@ void DebugWindow::DrawGuestFunctionSource() {
   //     if historical data for memory/etc present, show combo boxes
   auto memory = emulator_->memory();
   auto function = static_cast<cpu::GuestFunction*>(state_.function);
-  auto& source_map = function->source_map();
+  // The function may be translated again while drawing.
+  const cpu::GuestFunction::Code* function_code = function->code();
+  if (!function_code) {
+    return;
+  }
+  auto& source_map = function_code->source_map;
   uint32_t source_map_index = 0;
 
   bool draw_hir = false;
@@ -480,7 +485,8 @@ void DebugWindow::DrawGuestFunctionSource() {
   }
   if (draw_x64) {
     // x64 preamble.
-    DrawMachineCodeSource(function->machine_code(), source_map[0].code_offset);
+    DrawMachineCodeSource(function_code->machine_code,
+                          source_map[0].code_offset);
   }
 
   StringBuffer str;
@@ -530,10 +536,11 @@ void DebugWindow::DrawGuestFunctionSource() {
       }
       if (draw_x64) {
         const uint8_t* machine_code_start =
-            function->machine_code() + source_map[source_map_index].code_offset;
+            function_code->machine_code +
+            source_map[source_map_index].code_offset;
         const size_t machine_code_length =
             (source_map_index == source_map.size() - 1
-                 ? function->machine_code_length()
+                 ? function_code->machine_code_length
                  : source_map[source_map_index + 1].code_offset) -
             source_map[source_map_index].code_offset;
         DrawMachineCodeSource(machine_code_start, machine_code_length);
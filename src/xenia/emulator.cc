@@ -10,6 +10,7 @@
 #include "xenia/emulator.h"
 
 #include <cinttypes>
+#include <cstring>
 
 #include "config.h"
 #include "third_party/fmt/include/fmt/format.h"
@@ -20,8 +21,10 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/backend/code_cache.h"
@@ -45,6 +48,11 @@
 #include "xenia/vfs/devices/stfs_container_device.h"
 #include "xenia/vfs/virtual_file_system.h"
 
+#if XE_PLATFORM_LINUX
+#include <sys/wait.h>
+#include <unistd.h>
+#endif  // XE_PLATFORM_LINUX
+
 DEFINE_double(time_scalar, 1.0,
               "Scalar used to speed or slow time (1x, 2x, 1/2x, etc).",
               "General");
@@ -54,6 +62,13 @@ DEFINE_string(
     "or the module specified by the game. Leave blank to launch the default "
     "module.",
     "General");
+DEFINE_bool(
+    save_state_fork, false,
+    "Save the guest memory in states from a forked process (on Linux), which "
+    "gets a copy-on-write snapshot of it, so the emulation continues without "
+    "waiting for the memory to be serialized. Incremental saving can't be "
+    "based on states saved this way.",
+    "General");
 
 namespace xe {
 
@@ -106,6 +121,8 @@ Emulator::~Emulator() {
   export_resolver_.reset();
 
   ExceptionHandler::Uninstall(Emulator::ExceptionCallbackThunk, this);
+
+  AwaitSaveStateWrite();
 }
 
 X_STATUS Emulator::Setup(
@@ -163,6 +180,9 @@ X_STATUS Emulator::Setup(
   if (!processor_->Setup(std::move(backend))) {
     return X_STATUS_UNSUCCESSFUL;
   }
+  // Must be set up before any modules are loaded so their code can be
+  // restored.
+  processor_->backend()->InitializeCodeStorage(cache_root_);
 
   // Initialize the APU.
   if (audio_system_factory) {
@@ -406,20 +426,72 @@ void Emulator::Resume() {
   }
 }
 
-bool Emulator::SaveToFile(const std::filesystem::path& path) {
+// Incremented when the layout of saved states changes.
+constexpr uint32_t kSaveStateVersion = 1;
+
+struct SaveStateHeader {
+  uint32_t title_id;
+  uint64_t state_id;
+  // The state the memory of an incremental state is based on, or 0.
+  uint64_t base_state_id;
+  std::string base_path;
+  uint64_t memory_offset;
+};
+
+static bool ReadSaveStateHeader(ByteStream* stream, SaveStateHeader& header) {
+  if (stream->Read<uint32_t>() != 'XSAV') {
+    return false;
+  }
+  auto version = stream->Read<uint32_t>();
+  if (version != kSaveStateVersion) {
+    XELOGE("Unsupported save state version {}", version);
+    return false;
+  }
+  header.title_id = stream->Read<uint32_t>();
+  header.state_id = stream->Read<uint64_t>();
+  header.base_state_id = stream->Read<uint64_t>();
+  header.base_path = stream->Read<std::string>();
+  header.memory_offset = stream->Read<uint64_t>();
+  return true;
+}
+
+bool Emulator::SaveToFile(const std::filesystem::path& path,
+                          bool incremental) {
+  AwaitSaveStateWrite();
+
   Pause();
 
+  if (incremental &&
+      (!memory_->has_saved_state() || path == last_save_state_path_)) {
+    XELOGW("No base state for incremental saving, saving the full state");
+    incremental = false;
+  }
+  uint64_t start_tick = Clock::QueryHostTickCount();
+
   filesystem::CreateFile(path);
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0,
                                 1024ull * 1024ull * 1024ull * 2ull);
   if (!map) {
+    Resume();
     return false;
   }
 
   // Save the emulator state to a file
   ByteStream stream(map->data(), map->size());
   stream.Write('XSAV');
+  stream.Write(kSaveStateVersion);
   stream.Write(title_id_);
+  uint64_t state_id = Clock::QueryHostSystemTime();
+  stream.Write(state_id);
+  if (incremental) {
+    stream.Write(last_save_state_id_);
+    stream.Write(std::string_view(xe::path_to_utf8(last_save_state_path_)));
+  } else {
+    stream.Write(uint64_t(0));
+    stream.Write(std::string_view());
+  }
+  size_t memory_offset_offset = stream.offset();
+  stream.Write(uint64_t(0));
 
   // It's important we don't hold the global lock here! XThreads need to step
   // forward (possibly through guarded regions) without worry!
@@ -427,19 +499,104 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   graphics_system_->Save(&stream);
   audio_system_->Save(&stream);
   kernel_state_->Save(&stream);
-  memory_->Save(&stream);
-  map->Close(stream.offset());
+  uint64_t memory_offset = stream.offset();
+  std::memcpy(map->data() + memory_offset_offset, &memory_offset,
+              sizeof(memory_offset));
+
+#if XE_PLATFORM_LINUX
+  if (cvars::save_state_fork) {
+    // Only this thread exists in the child, so it must not wait for anything
+    // the other threads may be holding.
+    pid_t pid = fork();
+    if (!pid) {
+      // Only system calls and copying of the pages from here.
+      if (!memory_->SaveRaw(&stream, incremental)) {
+        _exit(1);
+      }
+      map->Flush();
+      map->Close(stream.offset());
+      _exit(0);
+    }
+    if (pid > 0) {
+      Resume();
+      // The child doesn't update the page hashes for incremental saving.
+      memory_->DiscardSavedState();
+      last_save_state_path_.clear();
+      last_save_state_id_ = 0;
+      XELOGI("Saved state in {} ms, writing memory in process {}",
+             (Clock::QueryHostTickCount() - start_tick) * 1000 /
+                 Clock::QueryHostTickFrequency(),
+             pid);
+      save_state_write_thread_ = std::thread([pid]() {
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+            WEXITSTATUS(status)) {
+          XELOGE("Failed to write the memory of the saved state");
+        }
+      });
+      return true;
+    }
+    XELOGW("Failed to fork for saving the state, saving on this thread");
+  }
+#endif  // XE_PLATFORM_LINUX
+
+  memory_->Save(&stream, incremental);
+  size_t size = stream.offset();
 
   Resume();
+
+  last_save_state_path_ = path;
+  last_save_state_id_ = state_id;
+  XELOGI("Saved {} state: {} KB in {} ms", incremental ? "incremental" : "full",
+         size >> 10,
+         (Clock::QueryHostTickCount() - start_tick) * 1000 /
+             Clock::QueryHostTickFrequency());
+
+  // Let the OS write the pages to the disk without blocking the emulation.
+  save_state_write_thread_ = std::thread([map = std::move(map), size]() {
+    map->Flush();
+    map->Close(size);
+  });
   return true;
 }
 
+void Emulator::AwaitSaveStateWrite() {
+  if (save_state_write_thread_.joinable()) {
+    save_state_write_thread_.join();
+  }
+}
+
+bool Emulator::RestoreBaseStateMemory(const std::filesystem::path& path,
+                                      uint64_t state_id) {
+  auto map = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!map) {
+    XELOGE("Could not open the base state {}", xe::path_to_utf8(path));
+    return false;
+  }
+  ByteStream stream(map->data(), map->size());
+  SaveStateHeader header;
+  if (!ReadSaveStateHeader(&stream, header) || header.state_id != state_id) {
+    XELOGE("The base state {} has been modified", xe::path_to_utf8(path));
+    return false;
+  }
+  if (header.base_state_id &&
+      !RestoreBaseStateMemory(xe::to_path(header.base_path),
+                              header.base_state_id)) {
+    return false;
+  }
+  stream.set_offset(header.memory_offset);
+  return memory_->Restore(&stream);
+}
+
 bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
+  AwaitSaveStateWrite();
+
   // Restore the emulator state from a file
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite);
   if (!map) {
     return false;
   }
+  uint64_t start_tick = Clock::QueryHostTickCount();
 
   restoring_ = true;
 
@@ -449,12 +606,12 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
 
   auto lock = global_critical_region::AcquireDirect();
   ByteStream stream(map->data(), map->size());
-  if (stream.Read<uint32_t>() != 'XSAV') {
+  SaveStateHeader header;
+  if (!ReadSaveStateHeader(&stream, header)) {
     return false;
   }
 
-  auto title_id = stream.Read<uint32_t>();
-  if (title_id != title_id_) {
+  if (header.title_id != title_id_) {
     // Swapping between titles is unsupported at the moment.
     assert_always();
     return false;
@@ -476,10 +633,19 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
     XELOGE("Could not restore kernel state!");
     return false;
   }
+  // Unchanged pages of incremental states are taken from the base states.
+  if (header.base_state_id &&
+      !RestoreBaseStateMemory(xe::to_path(header.base_path),
+                              header.base_state_id)) {
+    XELOGE("Could not restore memory from the base state!");
+    return false;
+  }
   if (!memory_->Restore(&stream)) {
     XELOGE("Could not restore memory!");
     return false;
   }
+  last_save_state_path_.clear();
+  last_save_state_id_ = 0;
 
   // Update the main thread.
   auto threads =
@@ -496,6 +662,10 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
   restore_fence_.Signal();
   restoring_ = false;
 
+  XELOGI("Restored state in {} ms", (Clock::QueryHostTickCount() - start_tick) *
+                                        1000 /
+                                        Clock::QueryHostTickFrequency());
+
   return true;
 }
 
@@ -12,6 +12,7 @@
 
 #include <functional>
 #include <string>
+#include <thread>
 
 #include "xenia/base/delegate.h"
 #include "xenia/base/exception_handler.h"
@@ -143,7 +144,10 @@ class Emulator {
   void Resume();
   bool is_paused() const { return paused_; }
 
-  bool SaveToFile(const std::filesystem::path& path);
+  // With incremental, only the memory pages modified since the previous save
+  // are written, and restoring requires the previous file to be unchanged.
+  // The file is written to the disk in the background.
+  bool SaveToFile(const std::filesystem::path& path, bool incremental = false);
   bool RestoreFromFile(const std::filesystem::path& path);
 
   // The game can request another title to be loaded.
@@ -164,6 +168,12 @@ class Emulator {
 
   std::string FindLaunchModule();
 
+  // Waits until the last saved state is written to the disk.
+  void AwaitSaveStateWrite();
+  // Restores the memory from the states an incremental state is based on.
+  bool RestoreBaseStateMemory(const std::filesystem::path& path,
+                              uint64_t state_id);
+
   X_STATUS CompleteLaunch(const std::filesystem::path& path,
                           const std::string_view module_path);
 
@@ -193,6 +203,11 @@ class Emulator {
   bool paused_;
   bool restoring_;
   threading::Fence restore_fence_;  // Fired on restore finish.
+
+  // The last saved state, which the next incremental state is based on.
+  std::filesystem::path last_save_state_path_;
+  uint64_t last_save_state_id_ = 0;
+  std::thread save_state_write_thread_;
 };
 
 }  // namespace xe
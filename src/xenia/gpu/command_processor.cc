@@ -15,6 +15,7 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -67,6 +68,17 @@ bool CommandProcessor::Initialize(
   dirty_gamma_ramp_normal_ = true;
   dirty_gamma_ramp_pwl_ = true;
 
+  if (cvars::gpu_predecode_packets) {
+    packet_decoder_ = std::make_unique<PacketDecoder>(memory_);
+    if (!packet_decoder_->Initialize()) {
+      XELOGE("Unable to initialize the GPU packet decoder");
+      packet_decoder_.reset();
+    } else {
+      packet_decoder_->Reset(primary_buffer_ptr_, primary_buffer_size_,
+                             read_ptr_index_, write_ptr_index_.load());
+    }
+  }
+
   worker_running_ = true;
   worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(kernel_state_, 128 * 1024, 0, [this]() {
@@ -82,10 +94,17 @@ bool CommandProcessor::Initialize(
 void CommandProcessor::Shutdown() {
   EndTracing();
 
+  // Makes the worker thread stop waiting for decoded packets.
+  if (packet_decoder_) {
+    packet_decoder_->Shutdown();
+  }
+
   worker_running_ = false;
   write_ptr_index_event_->Set();
   worker_thread_->Wait(0, 0, 0, nullptr);
   worker_thread_.reset();
+
+  packet_decoder_.reset();
 }
 
 void CommandProcessor::InitializeShaderStorage(
@@ -141,7 +160,10 @@ void CommandProcessor::CallInThread(std::function<void()> fn) {
 void CommandProcessor::ClearCaches() {}
 
 void CommandProcessor::WorkerThreadMain() {
-  context_->MakeCurrent();
+  // Backends not drawing anything may work without a context.
+  if (context_) {
+    context_->MakeCurrent();
+  }
   if (!SetupContext()) {
     xe::FatalError("Unable to setup command processor internal state");
     return;
@@ -185,10 +207,14 @@ void CommandProcessor::WorkerThreadMain() {
 
     // Execute. Note that we handle wraparound transparently.
     read_ptr_index_ = ExecutePrimaryBuffer(read_ptr_index_, write_ptr_index);
+    if (cvars::log_gpu_thread_utilization) {
+      LogThreadUtilization();
+    }
 
     // TODO(benvanik): use reader->Read_update_freq_ and only issue after moving
     //     that many indices.
     if (read_ptr_writeback_ptr_) {
+      PrepareForGuestSignal();
       xe::store_and_swap<uint32_t>(
           memory_->TranslatePhysical(read_ptr_writeback_ptr_), read_ptr_index_);
     }
@@ -250,6 +276,11 @@ bool CommandProcessor::Restore(ByteStream* stream) {
   read_ptr_writeback_ptr_ = stream->Read<uint32_t>();
   write_ptr_index_.store(stream->Read<uint32_t>());
 
+  if (packet_decoder_) {
+    packet_decoder_->Reset(primary_buffer_ptr_, primary_buffer_size_,
+                           read_ptr_index_, write_ptr_index_.load());
+  }
+
   return true;
 }
 
@@ -261,6 +292,10 @@ void CommandProcessor::InitializeRingBuffer(uint32_t ptr, uint32_t log2_size) {
   read_ptr_index_ = 0;
   primary_buffer_ptr_ = ptr;
   primary_buffer_size_ = 1 << log2_size;
+  if (packet_decoder_) {
+    packet_decoder_->Reset(primary_buffer_ptr_, primary_buffer_size_,
+                           read_ptr_index_, write_ptr_index_.load());
+  }
 }
 
 void CommandProcessor::EnableReadPointerWriteBack(uint32_t ptr,
@@ -276,6 +311,10 @@ void CommandProcessor::EnableReadPointerWriteBack(uint32_t ptr,
 }
 
 void CommandProcessor::UpdateWritePointer(uint32_t value) {
+  // Before the worker thread sees the new pointer and waits for the decoder.
+  if (packet_decoder_) {
+    packet_decoder_->UpdateWritePointer(value);
+  }
   write_ptr_index_ = value;
   write_ptr_index_event_->Set();
 }
@@ -288,6 +327,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 
   regs->values[index].u32 = value;
+  regs->MarkDirty(index);
   if (!regs->GetRegisterInfo(index)) {
     XELOGW("GPU: Write to unknown register ({:04X} = {:08X})", index, value);
   }
@@ -304,6 +344,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
     uint32_t scratch_reg = index - XE_GPU_REG_SCRATCH_REG0;
     if ((1 << scratch_reg) & regs->values[XE_GPU_REG_SCRATCH_UMSK].u32) {
       // Enabled - write to address.
+      PrepareForGuestSignal();
       uint32_t scratch_addr = regs->values[XE_GPU_REG_SCRATCH_ADDR].u32;
       uint32_t mem_addr = scratch_addr + (scratch_reg * 4);
       xe::store_and_swap<uint32_t>(memory_->TranslatePhysical(mem_addr), value);
@@ -311,6 +352,50 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   }
 }
 
+void CommandProcessor::WriteRegisterRange(uint32_t index,
+                                          const uint32_t* values,
+                                          uint32_t count) {
+  if (RegisterFile::IsShaderConstantRange(index, count)) {
+    register_file_->WriteRange(index, values, count);
+    OnShaderConstantsWritten(index, count);
+    return;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    WriteRegister(index + i, values[i]);
+  }
+}
+
+void CommandProcessor::WriteRegisterRangeFromMem(uint32_t index,
+                                                 const void* values,
+                                                 uint32_t count) {
+  if (RegisterFile::IsShaderConstantRange(index, count)) {
+    register_file_->WriteRangeSwapped(index, values, count);
+    OnShaderConstantsWritten(index, count);
+    return;
+  }
+  auto values_u32 = static_cast<const uint32_t*>(values);
+  for (uint32_t i = 0; i < count; ++i) {
+    WriteRegister(index + i, xe::load_and_swap<uint32_t>(values_u32 + i));
+  }
+}
+
+void CommandProcessor::WriteRegisterRangeFromRing(RingBuffer* reader,
+                                                  uint32_t index,
+                                                  uint32_t count) {
+  if (!count) {
+    return;
+  }
+  RingBuffer::ReadRange range = reader->BeginRead(count * sizeof(uint32_t));
+  uint32_t first_count = uint32_t(range.first_length / sizeof(uint32_t));
+  WriteRegisterRangeFromMem(index, range.first, first_count);
+  if (range.second) {
+    WriteRegisterRangeFromMem(
+        index + first_count, range.second,
+        uint32_t(range.second_length / sizeof(uint32_t)));
+  }
+  reader->EndRead(range);
+}
+
 void CommandProcessor::UpdateGammaRampValue(GammaRampType type,
                                             uint32_t value) {
   RegisterFile* regs = register_file_;
@@ -435,6 +520,23 @@ uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
                                                 uint32_t write_index) {
   SCOPE_profile_cpu_f("gpu");
 
+  std::unique_ptr<PacketDecoder::Buffer> decoded_buffer;
+  if (packet_decoder_) {
+    decoded_buffer = packet_decoder_->AcquireBuffer(read_index);
+    if (decoded_buffer) {
+      // May have been decoded up to a newer write pointer.
+      write_index = decoded_buffer->write_index;
+    } else {
+      // Out of sync, execute from the guest memory and decode from the end.
+      // The decoder gets the write pointer before write_ptr_index_, so it
+      // keeps its own rather than going back to an older one and waiting.
+      packet_decoder_->Resync(write_index);
+    }
+  }
+  // Not including the time spent waiting for the decoder.
+  uint64_t start_tick =
+      cvars::log_gpu_thread_utilization ? Clock::QueryHostTickCount() : 0;
+
   // If we have a pending trace stream open it now. That way we ensure we get
   // all commands.
   if (!trace_writer_.is_open() && trace_state_ == TraceState::kStreaming) {
@@ -456,26 +558,152 @@ uint32_t CommandProcessor::ExecutePrimaryBuffer(uint32_t read_index,
   trace_writer_.WritePrimaryBufferStart(start_ptr, write_index - read_index);
 
   // Execute commands!
-  RingBuffer reader(memory_->TranslatePhysical(primary_buffer_ptr_),
-                    primary_buffer_size_);
-  reader.set_read_offset(read_index * sizeof(uint32_t));
-  reader.set_write_offset(write_index * sizeof(uint32_t));
-  do {
-    if (!ExecutePacket(&reader)) {
-      // This probably should be fatal - but we're going to continue anyways.
+  // Traces need the guest addresses of the packets, so they're written while
+  // executing from the guest memory.
+  if (decoded_buffer && !trace_writer_.is_open()) {
+    bool direct = false;
+    if (!ExecuteDecodedPackets(*decoded_buffer, 0,
+                               uint32_t(decoded_buffer->packets.size()),
+                               primary_buffer_ptr_, primary_buffer_size_,
+                               write_index * sizeof(uint32_t), &direct)) {
       XELOGE("**** PRIMARY RINGBUFFER: Failed to execute packet.");
       assert_always();
-      break;
     }
-  } while (reader.read_count());
+  } else {
+    RingBuffer reader(memory_->TranslatePhysical(primary_buffer_ptr_),
+                      primary_buffer_size_);
+    reader.set_read_offset(read_index * sizeof(uint32_t));
+    reader.set_write_offset(write_index * sizeof(uint32_t));
+    do {
+      if (!ExecutePacket(&reader)) {
+        // This probably should be fatal - but we're going to continue anyways.
+        XELOGE("**** PRIMARY RINGBUFFER: Failed to execute packet.");
+        assert_always();
+        break;
+      }
+    } while (reader.read_count());
+  }
+  if (decoded_buffer) {
+    packet_decoder_->ReleaseBuffer(std::move(decoded_buffer));
+  }
 
   OnPrimaryBufferEnd();
 
   trace_writer_.WritePrimaryBufferEnd();
 
+  if (cvars::log_gpu_thread_utilization) {
+    utilization_busy_ticks_ += Clock::QueryHostTickCount() - start_tick;
+  }
+
   return write_index;
 }
 
+bool CommandProcessor::ExecuteDecodedPackets(
+    const PacketDecoder::Buffer& buffer, uint32_t packet_index,
+    uint32_t packet_end, uint32_t source_ptr, uint32_t source_size,
+    uint32_t source_end_offset, bool* direct) {
+  SCOPE_profile_cpu_f("gpu");
+
+  while (packet_index < packet_end) {
+    const PacketDecoder::Packet& decoded_packet =
+        buffer.packets[packet_index++];
+    uint32_t packet = decoded_packet.packet;
+    const uint32_t* data = buffer.data.data() + decoded_packet.data_index;
+    uint32_t packet_type = packet >> 30;
+    if (packet_type == 0x00 && packet) {
+      // Type-0 packet, already byte-swapped.
+      uint32_t count = ((packet >> 16) & 0x3FFF) + 1;
+      uint32_t base_index = (packet & 0x7FFF);
+      if ((packet >> 15) & 0x1) {
+        for (uint32_t m = 0; m < count; m++) {
+          WriteRegister(base_index, data[m]);
+        }
+      } else {
+        WriteRegisterRange(base_index, data, count);
+      }
+    } else if (packet_type == 0x01) {
+      // Type-1 packet, already byte-swapped.
+      WriteRegister(packet & 0x7FF, data[0]);
+      WriteRegister((packet >> 11) & 0x7FF, data[1]);
+    } else if (packet_type == 0x03) {
+      uint32_t opcode = (packet >> 8) & 0x7F;
+      uint32_t count = ((packet >> 16) & 0x3FFF) + 1;
+      if ((opcode == PM4_INDIRECT_BUFFER ||
+           opcode == PM4_INDIRECT_BUFFER_PFD) &&
+          count >= 2) {
+        // The packets of the indirect buffer follow, with the address and the
+        // size already decoded.
+        uint32_t nested_end = packet_index + decoded_packet.nested_packet_count;
+        // Same predication as in ExecutePacketType3.
+        if ((!(packet & 1) || (bin_select_ & bin_mask_)) && data[1]) {
+          if (!ExecuteDecodedPackets(buffer, packet_index, nested_end, data[0],
+                                     data[1] * sizeof(uint32_t),
+                                     data[1] * sizeof(uint32_t), direct)) {
+            // Return up a level if we encounter a bad packet.
+            XELOGE("**** INDIRECT RINGBUFFER: Failed to execute packet.");
+            assert_always();
+          }
+        }
+        packet_index = nested_end;
+      } else {
+        // Copied with the header as in the guest memory.
+        RingBuffer reader(
+            reinterpret_cast<uint8_t*>(const_cast<uint32_t*>(data)),
+            (1 + count) * sizeof(uint32_t));
+        reader.set_read_offset(sizeof(uint32_t));
+        reader.set_write_offset((1 + count) * sizeof(uint32_t));
+        if (!ExecutePacketType3(&reader, packet)) {
+          return false;
+        }
+      }
+    }
+
+    // The packets after a barrier packet haven't been decoded, and the guest
+    // addresses are needed if a trace was started by this packet.
+    if (*direct || trace_writer_.is_open() ||
+        (buffer.barrier && packet_index == buffer.packets.size())) {
+      *direct = true;
+      RingBuffer reader(memory_->TranslatePhysical(source_ptr), source_size);
+      reader.set_read_offset(decoded_packet.source_offset +
+                             PacketDecoder::GetPacketSize(packet) *
+                                 sizeof(uint32_t));
+      reader.set_write_offset(source_end_offset);
+      while (reader.read_count()) {
+        if (!ExecutePacket(&reader)) {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  return true;
+}
+
+void CommandProcessor::LogThreadUtilization() {
+  uint64_t tick = Clock::QueryHostTickCount();
+  uint64_t decoder_ticks = packet_decoder_ ? packet_decoder_->busy_ticks() : 0;
+  if (!utilization_start_tick_) {
+    utilization_start_tick_ = tick;
+    utilization_busy_ticks_ = 0;
+    utilization_decoder_start_ticks_ = decoder_ticks;
+    return;
+  }
+  uint64_t elapsed_ticks = tick - utilization_start_tick_;
+  if (elapsed_ticks < Clock::QueryHostTickFrequency() * 5) {
+    return;
+  }
+  XELOGI(
+      "GPU thread utilization: {:.1f}% executing packets, {:.1f}% decoding "
+      "packets ahead{}",
+      100.0 * utilization_busy_ticks_ / elapsed_ticks,
+      100.0 * (decoder_ticks - utilization_decoder_start_ticks_) /
+          elapsed_ticks,
+      packet_decoder_ ? "" : " (packet decoder disabled)");
+  utilization_start_tick_ = tick;
+  utilization_busy_ticks_ = 0;
+  utilization_decoder_start_ticks_ = decoder_ticks;
+}
+
 void CommandProcessor::ExecuteIndirectBuffer(uint32_t ptr, uint32_t count) {
   SCOPE_profile_cpu_f("gpu");
 
@@ -550,10 +778,12 @@ bool CommandProcessor::ExecutePacketType0(RingBuffer* reader, uint32_t packet) {
 
   uint32_t base_index = (packet & 0x7FFF);
   uint32_t write_one_reg = (packet >> 15) & 0x1;
-  for (uint32_t m = 0; m < count; m++) {
-    uint32_t reg_data = reader->ReadAndSwap<uint32_t>();
-    uint32_t target_index = write_one_reg ? base_index : base_index + m;
-    WriteRegister(target_index, reg_data);
+  if (write_one_reg) {
+    for (uint32_t m = 0; m < count; m++) {
+      WriteRegister(base_index, reader->ReadAndSwap<uint32_t>());
+    }
+  } else {
+    WriteRegisterRangeFromRing(reader, base_index, count);
   }
 
   trace_writer_.WritePacketEnd();
@@ -614,6 +844,25 @@ bool CommandProcessor::ExecutePacketType3(RingBuffer* reader, uint32_t packet) {
     }
   }
 
+  // The watched memory used by the packet (by draws, copies, constant and
+  // shader loads, swaps) may have been written by the CPU without the
+  // invalidation callbacks triggered yet.
+  memory_->DispatchPhysicalMemoryWrites();
+
+  switch (opcode) {
+    case PM4_INTERRUPT:
+    case PM4_REG_TO_MEM:
+    case PM4_MEM_WRITE:
+    case PM4_COND_WRITE:
+    case PM4_EVENT_WRITE_SHD:
+    case PM4_EVENT_WRITE_EXT:
+    case PM4_EVENT_WRITE_ZPD:
+      PrepareForGuestSignal();
+      break;
+    default:
+      break;
+  }
+
   bool result = false;
   switch (opcode) {
     case PM4_ME_INIT:
@@ -819,6 +1068,7 @@ bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingBuffer* reader,
 
   XELOGI("XE_SWAP");
 
+  memory_->UpdateProfileCounters();
   Profiler::Flip();
 
   // Xenia-specific VdSwap hook.
@@ -1312,10 +1562,7 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT(RingBuffer* reader,
       reader->AdvanceRead((count - 1) * sizeof(uint32_t));
       return true;
   }
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromRing(reader, index, count - 1);
   return true;
 }
 
@@ -1324,10 +1571,7 @@ bool CommandProcessor::ExecutePacketType3_SET_CONSTANT2(RingBuffer* reader,
                                                         uint32_t count) {
   uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromRing(reader, index, count - 1);
   return true;
 }
 
@@ -1363,11 +1607,8 @@ bool CommandProcessor::ExecutePacketType3_LOAD_ALU_CONSTANT(RingBuffer* reader,
       return true;
   }
   trace_writer_.WriteMemoryRead(CpuToGpu(address), size_dwords * 4);
-  for (uint32_t n = 0; n < size_dwords; n++, index++) {
-    uint32_t data = xe::load_and_swap<uint32_t>(
-        memory_->TranslatePhysical(address + n * 4));
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromMem(index, memory_->TranslatePhysical(address),
+                            size_dwords);
   return true;
 }
 
@@ -1375,10 +1616,7 @@ bool CommandProcessor::ExecutePacketType3_SET_SHADER_CONSTANTS(
     RingBuffer* reader, uint32_t packet, uint32_t count) {
   uint32_t offset_type = reader->ReadAndSwap<uint32_t>();
   uint32_t index = offset_type & 0xFFFF;
-  for (uint32_t n = 0; n < count - 1; n++, index++) {
-    uint32_t data = reader->ReadAndSwap<uint32_t>();
-    WriteRegister(index, data);
-  }
+  WriteRegisterRangeFromRing(reader, index, count - 1);
   return true;
 }
 
@@ -21,6 +21,7 @@
 
 #include "xenia/base/ring_buffer.h"
 #include "xenia/base/threading.h"
+#include "xenia/gpu/packet_decoder.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/xenos.h"
@@ -172,18 +173,45 @@ class CommandProcessor {
   virtual void ShutdownContext() = 0;
 
   virtual void WriteRegister(uint32_t index, uint32_t value);
+  // Write count registers in sequence, from host-endian values, big-endian
+  // values in memory or big-endian values read from the ring buffer. Shader
+  // constants are copied to the register file in bulk and reported with
+  // OnShaderConstantsWritten, other registers go through WriteRegister.
+  void WriteRegisterRange(uint32_t index, const uint32_t* values,
+                          uint32_t count);
+  void WriteRegisterRangeFromMem(uint32_t index, const void* values,
+                                 uint32_t count);
+  void WriteRegisterRangeFromRing(RingBuffer* reader, uint32_t index,
+                                  uint32_t count);
+  // Called instead of WriteRegister for shader constants written in bulk.
+  virtual void OnShaderConstantsWritten(uint32_t index, uint32_t count) {}
 
   void UpdateGammaRampValue(GammaRampType type, uint32_t value);
 
   virtual void MakeCoherent();
   virtual void PrepareForWait();
   virtual void ReturnFromWait();
+  // Called before the guest is told that the GPU has reached a point in the
+  // commands, by writing to the guest memory or interrupting it, after which
+  // the guest may reuse the memory the earlier commands have been reading.
+  virtual void PrepareForGuestSignal() {}
 
   virtual void PerformSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                            uint32_t frontbuffer_height) = 0;
 
   uint32_t ExecutePrimaryBuffer(uint32_t start_index, uint32_t end_index);
   virtual void OnPrimaryBufferEnd() {}
+  // Executes the packets of the primary buffer decoded ahead by the packet
+  // decoder, from packet_index to packet_end, which are in the buffer at
+  // source_ptr with the data ending at source_end_offset. After a barrier
+  // packet, or if a trace was started, executes the rest of the source buffer
+  // from the guest memory and sets *direct so the parent buffers do the same.
+  // Returns false if a packet failed.
+  bool ExecuteDecodedPackets(const PacketDecoder::Buffer& buffer,
+                             uint32_t packet_index, uint32_t packet_end,
+                             uint32_t source_ptr, uint32_t source_size,
+                             uint32_t source_end_offset, bool* direct);
+  void LogThreadUtilization();
   void ExecuteIndirectBuffer(uint32_t ptr, uint32_t length);
   bool ExecutePacket(RingBuffer* reader);
   bool ExecutePacketType0(RingBuffer* reader, uint32_t packet);
@@ -291,6 +319,14 @@ class CommandProcessor {
   std::unique_ptr<xe::threading::Event> write_ptr_index_event_;
   std::atomic<uint32_t> write_ptr_index_;
 
+  // Only if gpu_predecode_packets is enabled.
+  std::unique_ptr<PacketDecoder> packet_decoder_;
+
+  // For log_gpu_thread_utilization.
+  uint64_t utilization_start_tick_ = 0;
+  uint64_t utilization_busy_ticks_ = 0;
+  uint64_t utilization_decoder_start_ticks_ = 0;
+
   uint64_t bin_select_ = 0xFFFFFFFFull;
   uint64_t bin_mask_ = 0xFFFFFFFFull;
 
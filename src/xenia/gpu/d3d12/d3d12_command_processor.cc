@@ -1580,39 +1580,69 @@ void D3D12CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   CommandProcessor::WriteRegister(index, value);
 
   if (index >= XE_GPU_REG_SHADER_CONSTANT_000_X &&
-      index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
+      index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31) {
+    OnShaderConstantsWritten(index, 1);
+  } else if (index == XE_GPU_REG_DC_LUT_PWL_DATA) {
+    UpdateGammaRampValue(GammaRampType::kPWL, value);
+  } else if (index == XE_GPU_REG_DC_LUT_30_COLOR) {
+    UpdateGammaRampValue(GammaRampType::kNormal, value);
+  } else if (index == XE_GPU_REG_DC_LUT_RW_MODE) {
+    gamma_ramp_rw_subindex_ = 0;
+  }
+}
+
+void D3D12CommandProcessor::OnShaderConstantsWritten(uint32_t index,
+                                                     uint32_t count) {
+  uint32_t last = index + count - 1;
+  if (index <= XE_GPU_REG_SHADER_CONSTANT_511_W &&
+      last >= XE_GPU_REG_SHADER_CONSTANT_000_X) {
     if (frame_open_) {
-      uint32_t float_constant_index =
-          (index - XE_GPU_REG_SHADER_CONSTANT_000_X) >> 2;
-      if (float_constant_index >= 256) {
-        float_constant_index -= 256;
-        if (current_float_constant_map_pixel_[float_constant_index >> 6] &
-            (1ull << (float_constant_index & 63))) {
-          cbuffer_binding_float_pixel_.up_to_date = false;
-        }
-      } else {
-        if (current_float_constant_map_vertex_[float_constant_index >> 6] &
-            (1ull << (float_constant_index & 63))) {
-          cbuffer_binding_float_vertex_.up_to_date = false;
+      uint32_t float_constant_first =
+          (std::max(index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_000_X)) -
+           XE_GPU_REG_SHADER_CONSTANT_000_X) >>
+          2;
+      uint32_t float_constant_last =
+          (std::min(last, uint32_t(XE_GPU_REG_SHADER_CONSTANT_511_W)) -
+           XE_GPU_REG_SHADER_CONSTANT_000_X) >>
+          2;
+      for (uint32_t float_constant_index = float_constant_first;
+           float_constant_index <= float_constant_last;
+           ++float_constant_index) {
+        if (float_constant_index >= 256) {
+          uint32_t pixel_index = float_constant_index - 256;
+          if (current_float_constant_map_pixel_[pixel_index >> 6] &
+              (1ull << (pixel_index & 63))) {
+            cbuffer_binding_float_pixel_.up_to_date = false;
+          }
+        } else {
+          if (current_float_constant_map_vertex_[float_constant_index >> 6] &
+              (1ull << (float_constant_index & 63))) {
+            cbuffer_binding_float_vertex_.up_to_date = false;
+          }
         }
       }
     }
-  } else if (index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 &&
-             index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31) {
+  }
+  if (index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31 &&
+      last >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031) {
     cbuffer_binding_bool_loop_.up_to_date = false;
-  } else if (index >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 &&
-             index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5) {
+  }
+  if (index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5 &&
+      last >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) {
     cbuffer_binding_fetch_.up_to_date = false;
     if (texture_cache_ != nullptr) {
-      texture_cache_->TextureFetchConstantWritten(
-          (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
+      uint32_t fetch_first =
+          (std::max(index, uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0)) -
+           XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
+          6;
+      uint32_t fetch_last =
+          (std::min(last, uint32_t(XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5)) -
+           XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) /
+          6;
+      for (uint32_t i = fetch_first; i <= fetch_last; ++i) {
+        texture_cache_->TextureFetchConstantWritten(i);
+      }
     }
-  } else if (index == XE_GPU_REG_DC_LUT_PWL_DATA) {
-    UpdateGammaRampValue(GammaRampType::kPWL, value);
-  } else if (index == XE_GPU_REG_DC_LUT_30_COLOR) {
-    UpdateGammaRampValue(GammaRampType::kNormal, value);
-  } else if (index == XE_GPU_REG_DC_LUT_RW_MODE) {
-    gamma_ramp_rw_subindex_ = 0;
   }
 }
 
@@ -2657,6 +2687,8 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
     render_target_cache_->EndFrame();
 
     texture_cache_->EndFrame();
+
+    shared_memory_->UpdateLockProfileCounters();
   }
 
   if (submission_open_) {
@@ -91,6 +91,16 @@ DEFINE_int32(query_occlusion_fake_sample_count, 1000,
              "everything is reported as occluded.",
              "GPU");
 
+DEFINE_bool(gpu_predecode_packets, false,
+            "Split and byte-swap the PM4 packets on a separate thread ahead of "
+            "the GPU command processor thread (experimental).",
+            "GPU");
+
+DEFINE_bool(log_gpu_thread_utilization, false,
+            "Log how busy the GPU command processor thread and the packet "
+            "decoding thread are every few seconds.",
+            "GPU");
+
 namespace xe {
 namespace gpu {
 namespace flags {
@@ -28,6 +28,10 @@ DECLARE_string(depth_float24_conversion);
 
 DECLARE_int32(query_occlusion_fake_sample_count);
 
+DECLARE_bool(gpu_predecode_packets);
+
+DECLARE_bool(log_gpu_thread_utilization);
+
 namespace xe {
 namespace gpu {
 namespace flags {
@@ -9,6 +9,11 @@
 
 #include "xenia/gpu/null/null_command_processor.h"
 
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/gpu/draw_util.h"
+#include "xenia/gpu/registers.h"
+
 namespace xe {
 namespace gpu {
 namespace null {
@@ -28,28 +33,115 @@ bool NullCommandProcessor::SetupContext() {
 }
 
 void NullCommandProcessor::ShutdownContext() {
+  shaders_.clear();
   return CommandProcessor::ShutdownContext();
 }
 
 void NullCommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
                                        uint32_t frontbuffer_width,
-                                       uint32_t frontbuffer_height) {}
+                                       uint32_t frontbuffer_height) {
+  ++stats_.swap_count;
+}
 
 Shader* NullCommandProcessor::LoadShader(xenos::ShaderType shader_type,
                                          uint32_t guest_address,
                                          const uint32_t* host_address,
                                          uint32_t dword_count) {
-  return nullptr;
+  uint64_t data_hash =
+      XXH3_64bits(host_address, dword_count * sizeof(uint32_t));
+  auto it = shaders_.find(data_hash);
+  if (it != shaders_.end()) {
+    return it->second.get();
+  }
+  auto shader = std::make_unique<Shader>(shader_type, data_hash, host_address,
+                                         dword_count);
+  Shader* shader_ptr = shader.get();
+  shaders_.emplace(data_hash, std::move(shader));
+  ++stats_.shader_count;
+  return shader_ptr;
+}
+
+bool NullCommandProcessor::TranslateShader(Shader& shader) {
+  shader.AnalyzeUcode(ucode_disasm_buffer_);
+  auto sq_program_cntl = register_file_->Get<reg::SQ_PROGRAM_CNTL>();
+  bool is_vertex = shader.type() == xenos::ShaderType::kVertex;
+  uint64_t modification = shader_translator_.GetDefaultModification(
+      shader.type(), shader.GetDynamicAddressableRegisterCount(
+                         is_vertex ? sq_program_cntl.vs_num_reg
+                                   : sq_program_cntl.ps_num_reg));
+  bool is_new;
+  Shader::Translation* translation =
+      shader.GetOrCreateTranslation(modification, &is_new);
+  if (is_new) {
+    ++stats_.translation_count;
+    if (!shader_translator_.TranslateAnalyzedShader(*translation)) {
+      XELOGE("Failed to translate the {} shader {:016X}",
+             is_vertex ? "vertex" : "pixel", shader.ucode_data_hash());
+    }
+  }
+  return translation->is_valid();
 }
 
 bool NullCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
                                      uint32_t index_count,
                                      IndexBufferInfo* index_buffer_info,
                                      bool major_mode_explicit) {
+  // Same checks as in the host backends, so the same draws are skipped.
+  auto& regs = *register_file_;
+  xenos::ModeControl edram_mode = regs.Get<reg::RB_MODECONTROL>().edram_mode;
+  if (edram_mode == xenos::ModeControl::kCopy) {
+    return IssueCopy();
+  }
+  if (regs.Get<reg::RB_SURFACE_INFO>().surface_pitch == 0) {
+    ++stats_.skipped_draw_count;
+    return true;
+  }
+
+  Shader* vertex_shader = active_vertex_shader();
+  if (!vertex_shader) {
+    return false;
+  }
+  if (!TranslateShader(*vertex_shader)) {
+    return false;
+  }
+  bool tessellated = major_mode_explicit &&
+                     regs.Get<reg::VGT_OUTPUT_PATH_CNTL>().path_select ==
+                         xenos::VGTOutputPath::kTessellationEnable;
+  bool primitive_polygonal =
+      xenos::IsPrimitivePolygonal(tessellated, prim_type);
+  if (draw_util::IsRasterizationPotentiallyDone(regs, primitive_polygonal)) {
+    Shader* pixel_shader = active_pixel_shader();
+    if (edram_mode == xenos::ModeControl::kColorDepth && pixel_shader) {
+      pixel_shader->AnalyzeUcode(ucode_disasm_buffer_);
+      if (draw_util::IsPixelShaderNeededWithRasterization(*pixel_shader,
+                                                          regs) &&
+          !TranslateShader(*pixel_shader)) {
+        return false;
+      }
+    }
+  } else if (vertex_shader->memexport_stream_constants().empty()) {
+    ++stats_.skipped_draw_count;
+    return true;
+  }
+
+  draw_util::ViewportInfo viewport_info;
+  draw_util::GetHostViewportInfo(regs, 1.0f, 1.0f, true, 16384.0f, 16384.0f,
+                                 false, false, viewport_info);
+  draw_util::Scissor scissor;
+  draw_util::GetScissor(regs, scissor);
+  ++stats_.draw_count;
   return true;
 }
 
-bool NullCommandProcessor::IssueCopy() { return true; }
+bool NullCommandProcessor::IssueCopy() {
+  draw_util::ResolveInfo resolve_info;
+  if (!draw_util::GetResolveInfo(*register_file_, *memory_, trace_writer_, 1,
+                                 false, resolve_info)) {
+    return false;
+  }
+  ++stats_.copy_count;
+  return true;
+}
 
 void NullCommandProcessor::InitializeTrace() {}
 
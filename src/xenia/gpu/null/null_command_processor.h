@@ -10,8 +10,15 @@
 #ifndef XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
 #define XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include "xenia/base/string_buffer.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/kernel_state.h"
 
@@ -19,12 +26,28 @@ namespace xe {
 namespace gpu {
 namespace null {
 
+// Doesn't draw anything, but still loads and translates the shaders and
+// derives the host state from the registers for every draw and resolve, so it
+// can be used to measure the command processor overhead without a GPU.
 class NullCommandProcessor : public CommandProcessor {
  public:
+  struct Stats {
+    uint64_t draw_count = 0;
+    // Draws not reaching the host, such as with rasterization disabled.
+    uint64_t skipped_draw_count = 0;
+    uint64_t copy_count = 0;
+    uint64_t swap_count = 0;
+    uint64_t shader_count = 0;
+    uint64_t translation_count = 0;
+  };
+
   NullCommandProcessor(NullGraphicsSystem* graphics_system,
                        kernel::KernelState* kernel_state);
   ~NullCommandProcessor();
 
+  const Stats& stats() const { return stats_; }
+  void ResetStats() { stats_ = Stats(); }
+
   void TracePlaybackWroteMemory(uint32_t base_ptr, uint32_t length) override;
 
   void RestoreEdramSnapshot(const void* snapshot) override;
@@ -46,6 +69,19 @@ class NullCommandProcessor : public CommandProcessor {
   bool IssueCopy() override;
 
   void InitializeTrace() override;
+
+  // Analyzes the microcode and translates the shader with the modification for
+  // the current state, without emitting any host code.
+  bool TranslateShader(Shader& shader);
+
+  // Only walks the microcode with the common translation logic.
+  class NullShaderTranslator : public ShaderTranslator {};
+
+  NullShaderTranslator shader_translator_;
+  StringBuffer ucode_disasm_buffer_;
+  std::unordered_map<uint64_t, std::unique_ptr<Shader>> shaders_;
+
+  Stats stats_;
 };
 
 }  // namespace null
@@ -0,0 +1,338 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/string.h"
+#include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/graphics_system.h"
+#include "xenia/gpu/null/null_command_processor.h"
+#include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/packet_disassembler.h"
+#include "xenia/gpu/trace_protocol.h"
+#include "xenia/gpu/trace_reader.h"
+#include "xenia/memory.h"
+
+DECLARE_path(target_trace_file);
+
+DEFINE_int32(trace_bench_iterations, 3,
+             "Number of times to replay the trace. Shaders are only translated "
+             "in the first one.",
+             "GPU");
+DEFINE_path(trace_bench_json_output, "",
+            "File to write the results to as JSON, for tracking them over "
+            "time.",
+            "GPU");
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+// Replays the frames of a trace through the null command processor, timing
+// the execution of each packet.
+class TraceBench : public TraceReader {
+ public:
+  struct PacketTypeStats {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+  };
+
+  TraceBench(GraphicsSystem* graphics_system)
+      : graphics_system_(graphics_system),
+        command_processor_(static_cast<NullCommandProcessor*>(
+            graphics_system->command_processor())) {
+    // Same as in TracePlayer, all of physical memory may be written.
+    auto heap = graphics_system_->memory()->LookupHeapByType(true, 64 * 1024);
+    heap->AllocFixed(heap->heap_base(), heap->heap_size(), heap->page_size(),
+                     kMemoryAllocationReserve | kMemoryAllocationCommit,
+                     kMemoryProtectRead | kMemoryProtectWrite);
+    done_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+  }
+
+  // Ticks spent executing the packets of each frame, for every iteration.
+  const std::vector<uint64_t>& frame_ticks() const { return frame_ticks_; }
+  uint64_t packet_count() const { return packet_count_; }
+  const std::unordered_map<const char*, PacketTypeStats>& packet_type_stats()
+      const {
+    return packet_type_stats_;
+  }
+
+  void Run(uint32_t iteration_count) {
+    command_processor_->CallInThread([this, iteration_count]() {
+      command_processor_->set_swap_mode(SwapMode::kIgnored);
+      for (uint32_t i = 0; i < iteration_count; ++i) {
+        for (int j = 0; j < frame_count(); ++j) {
+          const Frame* frame = this->frame(j);
+          frame_ticks_.push_back(
+              PlayFrame(frame->start_ptr, frame->end_ptr - frame->start_ptr));
+        }
+      }
+      command_processor_->set_swap_mode(SwapMode::kNormal);
+      done_event_->Set();
+    });
+    xe::threading::Wait(done_event_.get(), false);
+  }
+
+ private:
+  uint64_t PlayFrame(const uint8_t* trace_data, size_t trace_size) {
+    auto memory = graphics_system_->memory();
+    uint64_t ticks = 0;
+    auto trace_ptr = trace_data;
+    const PacketStartCommand* pending_packet = nullptr;
+    while (trace_ptr < trace_data + trace_size) {
+      auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
+      switch (type) {
+        case TraceCommandType::kPrimaryBufferStart: {
+          auto cmd =
+              reinterpret_cast<const PrimaryBufferStartCommand*>(trace_ptr);
+          trace_ptr += sizeof(*cmd) + cmd->count * 4;
+          break;
+        }
+        case TraceCommandType::kPrimaryBufferEnd:
+          trace_ptr += sizeof(PrimaryBufferEndCommand);
+          break;
+        case TraceCommandType::kIndirectBufferStart: {
+          auto cmd =
+              reinterpret_cast<const IndirectBufferStartCommand*>(trace_ptr);
+          trace_ptr += sizeof(*cmd) + cmd->count * 4;
+          break;
+        }
+        case TraceCommandType::kIndirectBufferEnd:
+          trace_ptr += sizeof(IndirectBufferEndCommand);
+          break;
+        case TraceCommandType::kPacketStart: {
+          auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
+          trace_ptr += sizeof(*cmd);
+          std::memcpy(memory->TranslatePhysical(cmd->base_ptr), trace_ptr,
+                      cmd->count * 4);
+          trace_ptr += cmd->count * 4;
+          pending_packet = cmd;
+          break;
+        }
+        case TraceCommandType::kPacketEnd: {
+          trace_ptr += sizeof(PacketEndCommand);
+          if (pending_packet) {
+            ticks += ExecutePacket(pending_packet->base_ptr,
+                                   pending_packet->count);
+            pending_packet = nullptr;
+          }
+          break;
+        }
+        case TraceCommandType::kMemoryRead: {
+          auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
+          trace_ptr += sizeof(*cmd);
+          DecompressMemory(cmd->encoding_format, trace_ptr,
+                           cmd->encoded_length,
+                           memory->TranslatePhysical(cmd->base_ptr),
+                           cmd->decoded_length);
+          trace_ptr += cmd->encoded_length;
+          command_processor_->TracePlaybackWroteMemory(cmd->base_ptr,
+                                                       cmd->decoded_length);
+          break;
+        }
+        case TraceCommandType::kMemoryWrite: {
+          auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
+          trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+          break;
+        }
+        case TraceCommandType::kEdramSnapshot: {
+          // Not used by the null command processor.
+          auto cmd = reinterpret_cast<const EdramSnapshotCommand*>(trace_ptr);
+          trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+          break;
+        }
+        case TraceCommandType::kEvent:
+          trace_ptr += sizeof(EventCommand);
+          break;
+      }
+    }
+    return ticks;
+  }
+
+  uint64_t ExecutePacket(uint32_t base_ptr, uint32_t count) {
+    PacketInfo packet_info;
+    const char* type_name = "unknown";
+    if (PacketDisassembler::DisasmPacket(
+            graphics_system_->memory()->TranslatePhysical(base_ptr),
+            &packet_info)) {
+      type_name = packet_info.type_info->name;
+    }
+    uint64_t start_tick = Clock::QueryHostTickCount();
+    command_processor_->ExecutePacket(base_ptr, count);
+    uint64_t ticks = Clock::QueryHostTickCount() - start_tick;
+    PacketTypeStats& type_stats = packet_type_stats_[type_name];
+    ++type_stats.count;
+    type_stats.ticks += ticks;
+    ++packet_count_;
+    return ticks;
+  }
+
+  GraphicsSystem* graphics_system_;
+  NullCommandProcessor* command_processor_;
+  std::unique_ptr<xe::threading::Event> done_event_;
+
+  std::vector<uint64_t> frame_ticks_;
+  uint64_t packet_count_ = 0;
+  std::unordered_map<const char*, PacketTypeStats> packet_type_stats_;
+};
+
+bool WriteJson(const std::filesystem::path& trace_path,
+               uint32_t iteration_count, const TraceBench& bench,
+               const NullCommandProcessor::Stats& stats, double total_ms,
+               const std::vector<std::pair<const char*,
+                                           TraceBench::PacketTypeStats>>&
+                   packet_types) {
+  double ms_per_tick = 1000.0 / Clock::QueryHostTickFrequency();
+  StringBuffer json;
+  std::string trace = xe::path_to_utf8(trace_path);
+  std::replace(trace.begin(), trace.end(), '\\', '/');
+  json.AppendFormat("{{\n  \"trace\": \"{}\",\n", trace);
+  json.AppendFormat("  \"iterations\": {},\n", iteration_count);
+  json.AppendFormat("  \"frame_count\": {},\n", bench.frame_count());
+  json.AppendFormat("  \"packet_count\": {},\n", bench.packet_count());
+  json.AppendFormat("  \"draw_count\": {},\n", stats.draw_count);
+  json.AppendFormat("  \"skipped_draw_count\": {},\n",
+                    stats.skipped_draw_count);
+  json.AppendFormat("  \"copy_count\": {},\n", stats.copy_count);
+  json.AppendFormat("  \"shader_count\": {},\n", stats.shader_count);
+  json.AppendFormat("  \"total_ms\": {:.3f},\n", total_ms);
+  json.Append("  \"frame_ms\": [");
+  for (size_t i = 0; i < bench.frame_ticks().size(); ++i) {
+    json.AppendFormat("{}{:.3f}", i ? ", " : "",
+                      bench.frame_ticks()[i] * ms_per_tick);
+  }
+  json.Append("],\n  \"packet_types\": {");
+  for (size_t i = 0; i < packet_types.size(); ++i) {
+    json.AppendFormat("{}\n    \"{}\": {{\"count\": {}, \"ms\": {:.3f}}}",
+                      i ? "," : "", packet_types[i].first,
+                      packet_types[i].second.count,
+                      packet_types[i].second.ticks * ms_per_tick);
+  }
+  json.Append("\n  }\n}\n");
+  FILE* f = filesystem::OpenFile(cvars::trace_bench_json_output, "w");
+  if (!f) {
+    XELOGE("Unable to open {}",
+           xe::path_to_utf8(cvars::trace_bench_json_output));
+    return false;
+  }
+  fwrite(json.buffer(), 1, json.length(), f);
+  fclose(f);
+  return true;
+}
+
+int trace_bench_main(const std::vector<std::string>& args) {
+  std::filesystem::path path = cvars::target_trace_file;
+  if (path.empty() && args.size() >= 2) {
+    path = xe::to_path(args[1]);
+  }
+  if (path.empty()) {
+    XELOGE("No trace file specified");
+    return 5;
+  }
+  path = std::filesystem::absolute(path);
+
+  // No window, so the null graphics system doesn't need a GPU.
+  auto emulator = std::make_unique<Emulator>("", "", "", "");
+  X_STATUS result = emulator->Setup(
+      nullptr, nullptr,
+      []() -> std::unique_ptr<GraphicsSystem> {
+        return std::make_unique<NullGraphicsSystem>();
+      },
+      nullptr);
+  if (XFAILED(result)) {
+    XELOGE("Failed to setup the emulator: {:08X}", result);
+    return 4;
+  }
+  auto bench = std::make_unique<TraceBench>(emulator->graphics_system());
+  if (!bench->Open(path)) {
+    XELOGE("Unable to load trace file {}", xe::path_to_utf8(path));
+    return 5;
+  }
+  if (!bench->frame_count()) {
+    XELOGE("No frames in the trace");
+    return 5;
+  }
+
+  uint32_t iteration_count =
+      uint32_t(std::max(cvars::trace_bench_iterations, 1));
+  auto command_processor = static_cast<NullCommandProcessor*>(
+      emulator->graphics_system()->command_processor());
+  command_processor->ResetStats();
+  bench->Run(iteration_count);
+  NullCommandProcessor::Stats stats = command_processor->stats();
+
+  double ms_per_tick = 1000.0 / Clock::QueryHostTickFrequency();
+  std::vector<uint64_t> sorted_frame_ticks = bench->frame_ticks();
+  std::sort(sorted_frame_ticks.begin(), sorted_frame_ticks.end());
+  uint64_t total_ticks = 0;
+  for (uint64_t ticks : sorted_frame_ticks) {
+    total_ticks += ticks;
+  }
+  double total_ms = total_ticks * ms_per_tick;
+  double total_seconds = std::max(total_ms / 1000.0, 1e-9);
+  XELOGI("Replayed {} frames {} times in {:.1f} ms of packet execution",
+         bench->frame_count(), iteration_count, total_ms);
+  XELOGI("  Frame time: {:.3f} ms average, {:.3f} ms median, {:.3f} ms max",
+         total_ms / sorted_frame_ticks.size(),
+         sorted_frame_ticks[sorted_frame_ticks.size() / 2] * ms_per_tick,
+         sorted_frame_ticks.back() * ms_per_tick);
+  XELOGI("  Packets: {} ({:.0f}/s)", bench->packet_count(),
+         bench->packet_count() / total_seconds);
+  XELOGI("  Draws: {} ({:.0f}/s), {} skipped, {} resolves", stats.draw_count,
+         stats.draw_count / total_seconds, stats.skipped_draw_count,
+         stats.copy_count);
+  XELOGI("  Shaders: {}, translations: {}", stats.shader_count,
+         stats.translation_count);
+
+  // Hottest packet types first.
+  std::vector<std::pair<const char*, TraceBench::PacketTypeStats>>
+      packet_types(bench->packet_type_stats().begin(),
+                   bench->packet_type_stats().end());
+  std::sort(packet_types.begin(), packet_types.end(),
+            [](const auto& a, const auto& b) {
+              return a.second.ticks > b.second.ticks;
+            });
+  for (const auto& it : packet_types) {
+    XELOGI("  {:32} {:10.3f} ms, {:8} packets, {:6.0f} ns per packet",
+           it.first, it.second.ticks * ms_per_tick, it.second.count,
+           it.second.ticks * ms_per_tick * 1000000.0 /
+               std::max(it.second.count, uint64_t(1)));
+  }
+
+  int exit_code = 0;
+  if (!cvars::trace_bench_json_output.empty() &&
+      !WriteJson(path, iteration_count, *bench, stats, total_ms,
+                 packet_types)) {
+    exit_code = 1;
+  }
+
+  bench.reset();
+  emulator.reset();
+  return exit_code;
+}
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-gpu-trace-bench", xe::gpu::null::trace_bench_main,
+                   "some.xtr", "target_trace_file");
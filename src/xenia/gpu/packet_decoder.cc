@@ -0,0 +1,267 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/packet_decoder.h"
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/profiling.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+
+using namespace xe::gpu::xenos;
+
+PacketDecoder::PacketDecoder(Memory* memory) : memory_(memory) {}
+
+PacketDecoder::~PacketDecoder() { Shutdown(); }
+
+bool PacketDecoder::Initialize() {
+  shutting_down_ = false;
+  xe::threading::Thread::CreationParameters params;
+  worker_thread_ = xe::threading::Thread::Create(
+      params, [this]() { WorkerThreadMain(); });
+  if (!worker_thread_) {
+    return false;
+  }
+  worker_thread_->set_name("GPU Packet Decoder");
+  return true;
+}
+
+void PacketDecoder::Shutdown() {
+  if (!worker_thread_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  decode_cond_.notify_all();
+  ready_cond_.notify_all();
+  xe::threading::Wait(worker_thread_.get(), false);
+  worker_thread_.reset();
+  ready_buffers_.clear();
+  free_buffers_.clear();
+}
+
+void PacketDecoder::Reset(uint32_t primary_buffer_ptr,
+                          uint32_t primary_buffer_size, uint32_t read_index,
+                          uint32_t write_index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ResetLocked(primary_buffer_ptr, primary_buffer_size, read_index,
+              write_index);
+}
+
+void PacketDecoder::Resync(uint32_t read_index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ResetLocked(primary_buffer_ptr_, primary_buffer_size_, read_index,
+              write_index_);
+}
+
+void PacketDecoder::ResetLocked(uint32_t primary_buffer_ptr,
+                                uint32_t primary_buffer_size,
+                                uint32_t read_index, uint32_t write_index) {
+  ++generation_;
+  primary_buffer_ptr_ = primary_buffer_ptr;
+  primary_buffer_size_ = primary_buffer_size;
+  decode_index_ = read_index;
+  write_index_ = write_index;
+  barrier_pending_ = false;
+  while (!ready_buffers_.empty()) {
+    free_buffers_.push_back(std::move(ready_buffers_.front()));
+    ready_buffers_.pop_front();
+  }
+  decode_cond_.notify_all();
+}
+
+void PacketDecoder::UpdateWritePointer(uint32_t write_index) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_index_ = write_index;
+  }
+  decode_cond_.notify_all();
+}
+
+std::unique_ptr<PacketDecoder::Buffer> PacketDecoder::AcquireBuffer(
+    uint32_t read_index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_cond_.wait(lock, [this]() {
+    return shutting_down_ || !ready_buffers_.empty();
+  });
+  if (ready_buffers_.empty()) {
+    return nullptr;
+  }
+  std::unique_ptr<Buffer> buffer = std::move(ready_buffers_.front());
+  ready_buffers_.pop_front();
+  if (buffer->read_index != read_index) {
+    free_buffers_.push_back(std::move(buffer));
+    return nullptr;
+  }
+  return buffer;
+}
+
+void PacketDecoder::ReleaseBuffer(std::unique_ptr<Buffer> buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (buffer->barrier && buffer->generation == generation_) {
+      barrier_pending_ = false;
+    }
+    free_buffers_.push_back(std::move(buffer));
+  }
+  decode_cond_.notify_all();
+}
+
+bool PacketDecoder::IsBarrierPacket(uint32_t packet) {
+  if ((packet >> 30) != 0x03) {
+    return false;
+  }
+  uint32_t opcode = (packet >> 8) & 0x7F;
+  return opcode == PM4_WAIT_REG_MEM || opcode == PM4_INTERRUPT;
+}
+
+uint32_t PacketDecoder::GetPacketSize(uint32_t packet) {
+  if (packet == 0) {
+    return 1;
+  }
+  switch (packet >> 30) {
+    case 0x01:
+      return 3;
+    case 0x02:
+      return 1;
+    default:
+      return 1 + ((packet >> 16) & 0x3FFF) + 1;
+  }
+}
+
+void PacketDecoder::WorkerThreadMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    decode_cond_.wait(lock, [this]() {
+      return shutting_down_ ||
+             (!barrier_pending_ && primary_buffer_size_ &&
+              write_index_ != 0xBAADF00D && decode_index_ != write_index_);
+    });
+    if (shutting_down_) {
+      break;
+    }
+
+    std::unique_ptr<Buffer> buffer;
+    if (!free_buffers_.empty()) {
+      buffer = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    } else {
+      buffer = std::make_unique<Buffer>();
+    }
+    buffer->read_index = decode_index_;
+    buffer->write_index = write_index_;
+    buffer->barrier = false;
+    buffer->generation = generation_;
+    buffer->packets.clear();
+    buffer->data.clear();
+    uint32_t primary_buffer_ptr = primary_buffer_ptr_;
+    uint32_t primary_buffer_size = primary_buffer_size_;
+    lock.unlock();
+
+    {
+      SCOPE_profile_cpu_i("gpu", "xe::gpu::PacketDecoder::DecodePackets");
+      uint64_t start_tick = Clock::QueryHostTickCount();
+      RingBuffer reader(memory_->TranslatePhysical(primary_buffer_ptr),
+                        primary_buffer_size);
+      reader.set_read_offset(buffer->read_index * sizeof(uint32_t));
+      reader.set_write_offset(buffer->write_index * sizeof(uint32_t));
+      buffer->barrier = !DecodePackets(&reader, buffer.get());
+      busy_ticks_ += Clock::QueryHostTickCount() - start_tick;
+    }
+
+    lock.lock();
+    if (buffer->generation != generation_) {
+      // Reset while decoding.
+      free_buffers_.push_back(std::move(buffer));
+      continue;
+    }
+    decode_index_ = buffer->write_index;
+    barrier_pending_ = buffer->barrier;
+    ready_buffers_.push_back(std::move(buffer));
+    ready_cond_.notify_all();
+  }
+}
+
+bool PacketDecoder::DecodePackets(RingBuffer* reader, Buffer* buffer) {
+  do {
+    uint32_t source_offset = uint32_t(reader->read_offset());
+    uint32_t packet = reader->ReadAndSwap<uint32_t>();
+    uint32_t data_count = GetPacketSize(packet) - 1;
+    if (reader->read_count() < data_count * sizeof(uint32_t)) {
+      // Executed up to this packet, like a failed packet.
+      XELOGE("PacketDecoder: packet {:08X} overflows the buffer", packet);
+      return true;
+    }
+    size_t packet_index = buffer->packets.size();
+    uint32_t data_index = uint32_t(buffer->data.size());
+    buffer->packets.push_back({packet, source_offset, data_index, 0});
+    if (!packet) {
+      continue;
+    }
+    uint32_t packet_type = packet >> 30;
+    if (packet_type == 0x03) {
+      uint32_t opcode = (packet >> 8) & 0x7F;
+      if ((opcode == PM4_INDIRECT_BUFFER ||
+           opcode == PM4_INDIRECT_BUFFER_PFD) &&
+          data_count >= 2) {
+        uint32_t list_ptr = CpuToGpu(reader->ReadAndSwap<uint32_t>());
+        uint32_t list_length = reader->ReadAndSwap<uint32_t>() & 0xFFFFF;
+        reader->AdvanceRead((data_count - 2) * sizeof(uint32_t));
+        list_ptr = GpuToCpu(list_ptr);
+        buffer->data.push_back(list_ptr);
+        buffer->data.push_back(list_length);
+        if (!list_length) {
+          continue;
+        }
+        RingBuffer list_reader(memory_->TranslatePhysical(list_ptr),
+                               list_length * sizeof(uint32_t));
+        list_reader.set_write_offset(list_length * sizeof(uint32_t));
+        bool list_completed = DecodePackets(&list_reader, buffer);
+        buffer->packets[packet_index].nested_packet_count =
+            uint32_t(buffer->packets.size() - (packet_index + 1));
+        if (!list_completed) {
+          return false;
+        }
+        continue;
+      }
+      // Copied with the header for the handlers.
+      buffer->data.resize(data_index + 1 + data_count);
+      buffer->data[data_index] = xe::byte_swap(packet);
+      reader->Read(buffer->data.data() + data_index + 1,
+                   data_count * sizeof(uint32_t));
+    } else if (data_count) {
+      // Register writes.
+      buffer->data.resize(data_index + data_count);
+      uint32_t* data = buffer->data.data() + data_index;
+      RingBuffer::ReadRange range =
+          reader->BeginRead(data_count * sizeof(uint32_t));
+      xe::copy_and_swap_32_unaligned(data, range.first,
+                                     range.first_length / sizeof(uint32_t));
+      if (range.second) {
+        xe::copy_and_swap_32_unaligned(
+            data + range.first_length / sizeof(uint32_t), range.second,
+            range.second_length / sizeof(uint32_t));
+      }
+      reader->EndRead(range);
+    }
+    if (IsBarrierPacket(packet)) {
+      return false;
+    }
+  } while (reader->read_count());
+  return true;
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,123 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_PACKET_DECODER_H_
+#define XENIA_GPU_PACKET_DECODER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/ring_buffer.h"
+#include "xenia/base/threading.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace gpu {
+
+// Reads the PM4 packets of the primary buffer and of the indirect buffers it
+// calls on a thread of its own, ahead of the command processor, splitting them
+// and byte-swapping the data of the packets that only write registers.
+//
+// The guest may still be writing the indirect buffers after a packet waiting
+// for it, so decoding stops after PM4_WAIT_REG_MEM and PM4_INTERRUPT until the
+// command processor has executed them, and the command processor executes the
+// rest of the buffers from the guest memory.
+class PacketDecoder {
+ public:
+  struct Packet {
+    // Host-endian packet header.
+    uint32_t packet;
+    // Offset of the header in the buffer the packet is in, in bytes.
+    uint32_t source_offset;
+    // Index of the data of the packet in Buffer::data. Byte-swapped for type 0
+    // and type 1 packets. Type 3 packets are copied with the header as they
+    // are in the guest memory so the usual handlers can execute them.
+    uint32_t data_index;
+    // For PM4_INDIRECT_BUFFER, the number of the following packets that are
+    // from the indirect buffer, including the nested ones. The data is the
+    // address and the size in dwords of the indirect buffer.
+    uint32_t nested_packet_count;
+  };
+
+  // Packets of the primary buffer from read_index to write_index.
+  struct Buffer {
+    uint32_t read_index;
+    uint32_t write_index;
+    // Decoding was stopped after a barrier packet.
+    bool barrier;
+    uint32_t generation;
+    std::vector<Packet> packets;
+    std::vector<uint32_t> data;
+  };
+
+  explicit PacketDecoder(Memory* memory);
+  ~PacketDecoder();
+
+  bool Initialize();
+  void Shutdown();
+
+  // Discards everything decoded and starts decoding from read_index.
+  void Reset(uint32_t primary_buffer_ptr, uint32_t primary_buffer_size,
+             uint32_t read_index, uint32_t write_index);
+  // Like Reset, but keeps decoding up to the last write pointer it was given,
+  // which may be newer than the one the caller has seen.
+  void Resync(uint32_t read_index);
+  void UpdateWritePointer(uint32_t write_index);
+
+  // Waits for the next decoded part of the primary buffer, returns nullptr if
+  // it doesn't start at read_index. Must be returned with ReleaseBuffer after
+  // it's executed.
+  std::unique_ptr<Buffer> AcquireBuffer(uint32_t read_index);
+  void ReleaseBuffer(std::unique_ptr<Buffer> buffer);
+
+  // Type 3 packets after which the guest memory must be read again.
+  static bool IsBarrierPacket(uint32_t packet);
+  // Size of the packet in dwords, including the header.
+  static uint32_t GetPacketSize(uint32_t packet);
+
+  // Time spent decoding, for utilization statistics.
+  uint64_t busy_ticks() const { return busy_ticks_; }
+
+ private:
+  void ResetLocked(uint32_t primary_buffer_ptr, uint32_t primary_buffer_size,
+                   uint32_t read_index, uint32_t write_index);
+  void WorkerThreadMain();
+  // Returns false if decoding was stopped by a barrier packet.
+  bool DecodePackets(RingBuffer* reader, Buffer* buffer);
+
+  Memory* memory_;
+  std::unique_ptr<xe::threading::Thread> worker_thread_;
+
+  std::mutex mutex_;
+  std::condition_variable decode_cond_;
+  std::condition_variable ready_cond_;
+  bool shutting_down_ = false;
+  // Incremented on reset to discard the buffer being decoded.
+  uint32_t generation_ = 0;
+  uint32_t primary_buffer_ptr_ = 0;
+  uint32_t primary_buffer_size_ = 0;
+  uint32_t decode_index_ = 0;
+  uint32_t write_index_ = 0;
+  // A buffer ending with a barrier packet hasn't been executed yet.
+  bool barrier_pending_ = false;
+  std::deque<std::unique_ptr<Buffer>> ready_buffers_;
+  std::vector<std::unique_ptr<Buffer>> free_buffers_;
+
+  std::atomic<uint64_t> busy_ticks_ = {0};
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_PACKET_DECODER_H_
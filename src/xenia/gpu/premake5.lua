@@ -26,6 +26,55 @@ project("xenia-gpu")
   -- local_platform_files("spirv")
   -- local_platform_files("spirv/passes")
 
+group("tests")
+project("xenia-gpu-texture-conversion-bench")
+  uuid("5f0a9c3e-8b2d-4d6f-a1e7-3c9b4e2d1f80")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "dxbc",
+    "fmt",
+    "glslang-spirv",
+    "snappy",
+    "spirv-tools",
+    "xenia-base",
+    "xenia-gpu",
+    "xenia-ui",
+    "xenia-ui-spirv",
+    "xxhash",
+  })
+  files({
+    "texture_conversion_bench_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+  filter({})
+
+project("xenia-gpu-register-write-bench")
+  uuid("b3d8e1f4-6a2c-4e9b-9f57-2c1a8d4e6b93")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "dxbc",
+    "fmt",
+    "glslang-spirv",
+    "snappy",
+    "spirv-tools",
+    "xenia-base",
+    "xenia-gpu",
+    "xenia-ui",
+    "xenia-ui-spirv",
+    "xxhash",
+  })
+  files({
+    "register_write_bench_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+  filter({})
+
 group("src")
 project("xenia-gpu-shader-compiler")
   uuid("ad76d3e4-4c62-439b-a0f6-f83fcf0e83c5")
@@ -57,3 +106,5 @@ project("xenia-gpu-shader-compiler")
         "1>scratch/stdout-shader-compiler.txt",
       })
     end
+
+include("testing")
@@ -9,14 +9,20 @@
 
 #include "xenia/gpu/register_file.h"
 
+#include <algorithm>
 #include <cstring>
 
+#include "xenia/base/assert.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
 
 namespace xe {
 namespace gpu {
 
-RegisterFile::RegisterFile() { std::memset(values, 0, sizeof(values)); }
+RegisterFile::RegisterFile() {
+  std::memset(values, 0, sizeof(values));
+  std::memset(dirty_, 0xFF, sizeof(dirty_));
+}
 
 const RegisterInfo* RegisterFile::GetRegisterInfo(uint32_t index) {
   switch (index) {
@@ -35,5 +41,71 @@ const RegisterInfo* RegisterFile::GetRegisterInfo(uint32_t index) {
   }
 }
 
+bool RegisterFile::IsShaderConstantRange(uint32_t index, uint32_t count) {
+  if (!count) {
+    return false;
+  }
+  uint32_t last = index + count - 1;
+  // Float and fetch constants are contiguous, and so are bool and loop ones.
+  return (index >= XE_GPU_REG_SHADER_CONSTANT_000_X &&
+          last <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5) ||
+         (index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 &&
+          last <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31);
+}
+
+void RegisterFile::WriteRange(uint32_t index, const uint32_t* range_values,
+                              uint32_t count) {
+  assert_true(index + count <= kRegisterCount);
+  std::memcpy(&values[index], range_values, count * sizeof(uint32_t));
+  MarkRangeDirty(index, count);
+}
+
+void RegisterFile::WriteRangeSwapped(uint32_t index, const void* range_values,
+                                     uint32_t count) {
+  assert_true(index + count <= kRegisterCount);
+  xe::copy_and_swap_32_unaligned(&values[index], range_values, count);
+  MarkRangeDirty(index, count);
+}
+
+// Calls the function for each 64-bit word of the dirty bitmap in the range
+// with the mask of the bits of the range in it.
+template <typename F>
+static void ForEachDirtyWord(uint32_t index, uint32_t count, F&& f) {
+  uint32_t end = index + count;
+  while (index < end) {
+    uint32_t bit = index & 63;
+    uint32_t bit_count = std::min(64 - bit, end - index);
+    uint64_t mask = bit_count < 64 ? ((uint64_t(1) << bit_count) - 1) << bit
+                                   : ~uint64_t(0);
+    if (f(index >> 6, mask)) {
+      return;
+    }
+    index += bit_count;
+  }
+}
+
+bool RegisterFile::IsRangeDirty(uint32_t index, uint32_t count) const {
+  bool dirty = false;
+  ForEachDirtyWord(index, count, [this, &dirty](uint32_t word, uint64_t mask) {
+    dirty = (dirty_[word] & mask) != 0;
+    return dirty;
+  });
+  return dirty;
+}
+
+void RegisterFile::MarkRangeDirty(uint32_t index, uint32_t count) {
+  ForEachDirtyWord(index, count, [this](uint32_t word, uint64_t mask) {
+    dirty_[word] |= mask;
+    return false;
+  });
+}
+
+void RegisterFile::ClearRangeDirty(uint32_t index, uint32_t count) {
+  ForEachDirtyWord(index, count, [this](uint32_t word, uint64_t mask) {
+    dirty_[word] &= ~mask;
+    return false;
+  });
+}
+
 }  //  namespace gpu
 }  //  namespace xe
@@ -32,6 +32,10 @@ class RegisterFile {
   RegisterFile();
 
   static const RegisterInfo* GetRegisterInfo(uint32_t index);
+  // Whether all registers in the range are float, fetch, bool or loop shader
+  // constants, which have no side effects when written and can be written in
+  // bulk.
+  static bool IsShaderConstantRange(uint32_t index, uint32_t count);
 
   static const size_t kRegisterCount = 0x5003;
   union RegisterValue {
@@ -68,6 +72,29 @@ class RegisterFile {
   T& Get() {
     return *reinterpret_cast<T*>(&values[T::register_index]);
   }
+
+  // Copies host-endian or big-endian values to the registers starting at
+  // index and marks them as dirty.
+  void WriteRange(uint32_t index, const uint32_t* range_values,
+                  uint32_t count);
+  void WriteRangeSwapped(uint32_t index, const void* range_values,
+                         uint32_t count);
+
+  // Registers written by the command processor since they were last cleared,
+  // so backends can update only the state that has changed between draws. All
+  // registers are dirty initially.
+  bool IsDirty(uint32_t index) const {
+    return (dirty_[index >> 6] & (uint64_t(1) << (index & 63))) != 0;
+  }
+  void MarkDirty(uint32_t index) {
+    dirty_[index >> 6] |= uint64_t(1) << (index & 63);
+  }
+  bool IsRangeDirty(uint32_t index, uint32_t count) const;
+  void MarkRangeDirty(uint32_t index, uint32_t count);
+  void ClearRangeDirty(uint32_t index, uint32_t count);
+
+ private:
+  uint64_t dirty_[(kRegisterCount + 63) / 64];
 };
 
 }  // namespace gpu
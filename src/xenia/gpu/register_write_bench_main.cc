@@ -0,0 +1,268 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/gpu/register_file.h"
+#include "xenia/gpu/trace_protocol.h"
+#include "xenia/gpu/trace_reader.h"
+#include "xenia/gpu/xenos.h"
+
+DEFINE_path(register_write_bench_trace, "",
+            "Trace file to take the register writes from.", "GPU");
+DEFINE_int32(register_write_bench_iterations, 100,
+             "Number of times to replay the register writes.", "GPU");
+
+namespace xe {
+namespace gpu {
+
+using namespace xe::gpu::xenos;
+
+// Registers written in sequence by a packet, with big-endian values.
+struct RegisterWriteRun {
+  uint32_t index;
+  uint32_t count;
+  const uint32_t* values;
+};
+
+// Takes the type 0 packets and the constant packets writing registers in
+// sequence out of the trace.
+class RegisterWriteTraceReader : public TraceReader {
+ public:
+  std::vector<RegisterWriteRun> CollectRuns() const {
+    std::vector<RegisterWriteRun> runs;
+    for (int i = 0; i < frame_count(); ++i) {
+      const Frame* frame = this->frame(i);
+      auto trace_ptr = frame->start_ptr;
+      while (trace_ptr < frame->end_ptr) {
+        auto type =
+            static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
+        switch (type) {
+          case TraceCommandType::kPrimaryBufferStart: {
+            auto cmd =
+                reinterpret_cast<const PrimaryBufferStartCommand*>(trace_ptr);
+            trace_ptr += sizeof(*cmd) + cmd->count * 4;
+            break;
+          }
+          case TraceCommandType::kPrimaryBufferEnd:
+            trace_ptr += sizeof(PrimaryBufferEndCommand);
+            break;
+          case TraceCommandType::kIndirectBufferStart: {
+            auto cmd =
+                reinterpret_cast<const IndirectBufferStartCommand*>(trace_ptr);
+            trace_ptr += sizeof(*cmd) + cmd->count * 4;
+            break;
+          }
+          case TraceCommandType::kIndirectBufferEnd:
+            trace_ptr += sizeof(IndirectBufferEndCommand);
+            break;
+          case TraceCommandType::kPacketStart: {
+            auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
+            trace_ptr += sizeof(*cmd);
+            AddPacketRun(reinterpret_cast<const uint32_t*>(trace_ptr),
+                         cmd->count, &runs);
+            trace_ptr += cmd->count * 4;
+            break;
+          }
+          case TraceCommandType::kPacketEnd:
+            trace_ptr += sizeof(PacketEndCommand);
+            break;
+          case TraceCommandType::kMemoryRead:
+          case TraceCommandType::kMemoryWrite: {
+            auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
+            trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+            break;
+          }
+          case TraceCommandType::kEdramSnapshot: {
+            auto cmd =
+                reinterpret_cast<const EdramSnapshotCommand*>(trace_ptr);
+            trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+            break;
+          }
+          case TraceCommandType::kEvent:
+            trace_ptr += sizeof(EventCommand);
+            break;
+        }
+      }
+    }
+    return runs;
+  }
+
+ private:
+  static void AddPacketRun(const uint32_t* packet_ptr, uint32_t count,
+                           std::vector<RegisterWriteRun>* runs) {
+    uint32_t packet = xe::load_and_swap<uint32_t>(packet_ptr);
+    if (!packet || count < 2) {
+      return;
+    }
+    if ((packet >> 30) == 0x00) {
+      if (!((packet >> 15) & 0x1)) {
+        runs->push_back({packet & 0x7FFF, count - 1, packet_ptr + 1});
+      }
+      return;
+    }
+    if ((packet >> 30) != 0x03 || count < 3) {
+      return;
+    }
+    uint32_t offset_type = xe::load_and_swap<uint32_t>(packet_ptr + 1);
+    uint32_t index;
+    switch ((packet >> 8) & 0x7F) {
+      case PM4_SET_CONSTANT: {
+        // Same as in CommandProcessor::ExecutePacketType3_SET_CONSTANT.
+        const uint32_t type_bases[] = {0x4000, 0x4800, 0x4900, 0x4908, 0x2000};
+        uint32_t type = (offset_type >> 16) & 0xFF;
+        if (type >= xe::countof(type_bases)) {
+          return;
+        }
+        index = type_bases[type] + (offset_type & 0x7FF);
+      } break;
+      case PM4_SET_CONSTANT2:
+      case PM4_SET_SHADER_CONSTANTS:
+        index = offset_type & 0xFFFF;
+        break;
+      default:
+        return;
+    }
+    runs->push_back({index, count - 2, packet_ptr + 2});
+  }
+};
+
+// Does the register file work of CommandProcessor::WriteRegister, without the
+// scratch register memory writeback.
+static void WriteRegisterReference(RegisterFile* regs, uint32_t index,
+                                   uint32_t value) {
+  if (index >= RegisterFile::kRegisterCount) {
+    return;
+  }
+  regs->values[index].u32 = value;
+  regs->MarkDirty(index);
+  if (!RegisterFile::GetRegisterInfo(index)) {
+    return;
+  }
+  if (index == XE_GPU_REG_COHER_STATUS_HOST) {
+    regs->values[index].u32 |= 0x80000000ul;
+  }
+}
+
+static void WriteRunsReference(RegisterFile* regs,
+                               const std::vector<RegisterWriteRun>& runs) {
+  for (const RegisterWriteRun& run : runs) {
+    for (uint32_t i = 0; i < run.count; ++i) {
+      WriteRegisterReference(regs, run.index + i,
+                             xe::load_and_swap<uint32_t>(run.values + i));
+    }
+  }
+}
+
+// Same choice of the path as CommandProcessor::WriteRegisterRangeFromMem.
+static void WriteRunsBulk(RegisterFile* regs,
+                          const std::vector<RegisterWriteRun>& runs) {
+  for (const RegisterWriteRun& run : runs) {
+    if (RegisterFile::IsShaderConstantRange(run.index, run.count)) {
+      regs->WriteRangeSwapped(run.index, run.values, run.count);
+      continue;
+    }
+    for (uint32_t i = 0; i < run.count; ++i) {
+      WriteRegisterReference(regs, run.index + i,
+                             xe::load_and_swap<uint32_t>(run.values + i));
+    }
+  }
+}
+
+static double MeasureRuns(
+    RegisterFile* regs, const std::vector<RegisterWriteRun>& runs,
+    uint32_t iteration_count,
+    void (*write_runs)(RegisterFile* regs,
+                       const std::vector<RegisterWriteRun>& runs)) {
+  regs->ClearRangeDirty(0, RegisterFile::kRegisterCount);
+  uint64_t start_tick = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    write_runs(regs, runs);
+  }
+  return double(Clock::QueryHostTickCount() - start_tick) /
+         Clock::QueryHostTickFrequency();
+}
+
+// Replays the register writes of a trace one register at a time and with the
+// bulk shader constant path, returning an error if the resulting registers are
+// different.
+int register_write_bench_main(const std::vector<std::string>& args) {
+  if (cvars::register_write_bench_trace.empty()) {
+    XELOGE("No trace file specified");
+    return 1;
+  }
+  RegisterWriteTraceReader reader;
+  if (!reader.Open(cvars::register_write_bench_trace)) {
+    XELOGE("Unable to open {}",
+           xe::path_to_utf8(cvars::register_write_bench_trace));
+    return 1;
+  }
+  std::vector<RegisterWriteRun> runs = reader.CollectRuns();
+  uint64_t register_count = 0;
+  uint64_t bulk_register_count = 0;
+  for (const RegisterWriteRun& run : runs) {
+    register_count += run.count;
+    if (RegisterFile::IsShaderConstantRange(run.index, run.count)) {
+      bulk_register_count += run.count;
+    }
+  }
+  if (!register_count) {
+    XELOGE("No register writes in the trace");
+    return 1;
+  }
+  uint32_t iteration_count =
+      uint32_t(std::max(cvars::register_write_bench_iterations, 1));
+
+  auto reference_regs = std::make_unique<RegisterFile>();
+  auto regs = std::make_unique<RegisterFile>();
+  double reference_seconds = MeasureRuns(reference_regs.get(), runs,
+                                         iteration_count, WriteRunsReference);
+  double seconds =
+      MeasureRuns(regs.get(), runs, iteration_count, WriteRunsBulk);
+
+  bool matches = true;
+  for (uint32_t i = 0; i < RegisterFile::kRegisterCount; ++i) {
+    if (regs->values[i].u32 != reference_regs->values[i].u32 ||
+        regs->IsDirty(i) != reference_regs->IsDirty(i)) {
+      matches = false;
+      break;
+    }
+  }
+
+  double million_registers = double(register_count) * iteration_count / 1e6;
+  XELOGI("{} register write runs, {} registers, {:.1f}% shader constants",
+         runs.size(), register_count,
+         100.0 * bulk_register_count / register_count);
+  XELOGI("Per register: {:8.1f} M registers/s",
+         million_registers / reference_seconds);
+  XELOGI("Bulk:         {:8.1f} M registers/s{}", million_registers / seconds,
+         matches ? "" : " - MISMATCH");
+  if (!matches) {
+    XELOGE("Results are different from the reference");
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace gpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-gpu-register-write-bench",
+                   xe::gpu::register_write_bench_main, "some.xtr",
+                   "register_write_bench_trace");
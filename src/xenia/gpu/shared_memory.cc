@@ -14,6 +14,7 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/bit_range.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
@@ -105,7 +106,8 @@ void SharedMemory::ClearCache() {
   watch_range_pools_.clear();
 
   {
-    auto global_lock = global_critical_region_.Acquire();
+    PageFlagsLock page_flags_lock(*this, 0,
+                                  uint32_t(system_page_flags_.size() - 1));
     for (SystemPageFlagsBlock& block : system_page_flags_) {
       block.valid = block.valid_and_gpu_written;
     }
@@ -288,7 +290,7 @@ void SharedMemory::MakeRangeValid(uint32_t start, uint32_t length,
   uint32_t valid_block_last = valid_page_last >> 6;
 
   {
-    auto global_lock = global_critical_region_.Acquire();
+    PageFlagsLock page_flags_lock(*this, valid_block_first, valid_block_last);
 
     for (uint32_t i = valid_block_first; i <= valid_block_last; ++i) {
       uint64_t valid_bits = UINT64_MAX;
@@ -362,7 +364,7 @@ bool SharedMemory::RequestRange(uint32_t start, uint32_t length) {
   uint32_t block_last = page_last >> 6;
   uint32_t range_start = UINT32_MAX;
   {
-    auto global_lock = global_critical_region_.Acquire();
+    PageFlagsLock page_flags_lock(*this, block_first, block_last);
     for (uint32_t i = block_first; i <= block_last; ++i) {
       uint64_t block_valid = system_page_flags_[i].valid;
       // Consider pages in the block outside the requested range valid.
@@ -435,41 +437,45 @@ std::pair<uint32_t, uint32_t> SharedMemory::MemoryInvalidationCallback(
 
   auto global_lock = global_critical_region_.Acquire();
 
-  if (!exact_range) {
-    // Check if a somewhat wider range (up to 256 KB with 4 KB pages) can be
-    // invalidated - if no GPU-written data nearby that was not intended to be
-    // invalidated since it's not in sync with CPU memory and can't be
-    // reuploaded. It's a lot cheaper to upload some excess data than to catch
-    // access violations - with 4 KB callbacks, the original Doom runs at 4 FPS
-    // on Intel Core i7-3770, with 64 KB the CPU game code takes 3 ms to run per
-    // frame, but with 256 KB it's 0.7 ms.
-    if (page_first & 63) {
-      uint64_t gpu_written_start =
-          system_page_flags_[block_first].valid_and_gpu_written;
-      gpu_written_start &= (uint64_t(1) << (page_first & 63)) - 1;
-      page_first =
-          (page_first & ~uint32_t(63)) + (64 - xe::lzcnt(gpu_written_start));
-    }
-    if ((page_last & 63) != 63) {
-      uint64_t gpu_written_end =
-          system_page_flags_[block_last].valid_and_gpu_written;
-      gpu_written_end &= ~((uint64_t(1) << ((page_last & 63) + 1)) - 1);
-      page_last = (page_last & ~uint32_t(63)) +
-                  (std::max(xe::tzcnt(gpu_written_end), uint8_t(1)) - 1);
+  {
+    PageFlagsLock page_flags_lock(*this, block_first, block_last);
+
+    if (!exact_range) {
+      // Check if a somewhat wider range (up to 256 KB with 4 KB pages) can be
+      // invalidated - if no GPU-written data nearby that was not intended to
+      // be invalidated since it's not in sync with CPU memory and can't be
+      // reuploaded. It's a lot cheaper to upload some excess data than to
+      // catch access violations - with 4 KB callbacks, the original Doom runs
+      // at 4 FPS on Intel Core i7-3770, with 64 KB the CPU game code takes
+      // 3 ms to run per frame, but with 256 KB it's 0.7 ms.
+      if (page_first & 63) {
+        uint64_t gpu_written_start =
+            system_page_flags_[block_first].valid_and_gpu_written;
+        gpu_written_start &= (uint64_t(1) << (page_first & 63)) - 1;
+        page_first =
+            (page_first & ~uint32_t(63)) + (64 - xe::lzcnt(gpu_written_start));
+      }
+      if ((page_last & 63) != 63) {
+        uint64_t gpu_written_end =
+            system_page_flags_[block_last].valid_and_gpu_written;
+        gpu_written_end &= ~((uint64_t(1) << ((page_last & 63) + 1)) - 1);
+        page_last = (page_last & ~uint32_t(63)) +
+                    (std::max(xe::tzcnt(gpu_written_end), uint8_t(1)) - 1);
+      }
     }
-  }
 
-  for (uint32_t i = block_first; i <= block_last; ++i) {
-    uint64_t invalidate_bits = UINT64_MAX;
-    if (i == block_first) {
-      invalidate_bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
-    }
-    if (i == block_last && (page_last & 63) != 63) {
-      invalidate_bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+    for (uint32_t i = block_first; i <= block_last; ++i) {
+      uint64_t invalidate_bits = UINT64_MAX;
+      if (i == block_first) {
+        invalidate_bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
+      }
+      if (i == block_last && (page_last & 63) != 63) {
+        invalidate_bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+      }
+      SystemPageFlagsBlock& block = system_page_flags_[i];
+      block.valid &= ~invalidate_bits;
+      block.valid_and_gpu_written &= ~invalidate_bits;
     }
-    SystemPageFlagsBlock& block = system_page_flags_[i];
-    block.valid &= ~invalidate_bits;
-    block.valid_and_gpu_written &= ~invalidate_bits;
   }
 
   FireWatches(page_first, page_last, false);
@@ -490,6 +496,9 @@ void SharedMemory::PrepareForTraceDownload() {
   uint32_t fire_watches_range_start = UINT32_MAX;
   uint32_t gpu_written_range_start = UINT32_MAX;
   auto global_lock = global_critical_region_.Acquire();
+  // The watch callbacks don't access the page flags.
+  PageFlagsLock page_flags_lock(*this, 0,
+                                uint32_t(system_page_flags_.size() - 1));
   for (uint32_t i = 0; i < system_page_flags_.size(); ++i) {
     SystemPageFlagsBlock& page_flags_block = system_page_flags_[i];
     uint64_t previously_valid_block = page_flags_block.valid;
@@ -573,12 +582,42 @@ void SharedMemory::PrepareForTraceDownload() {
   }
 }
 
+void SharedMemory::UpdateLockProfileCounters() {
+  uint64_t contended = 0, hold_ticks = 0;
+  for (const PageFlagsStripeMutex& mutex : page_flags_stripe_mutexes_) {
+    contended += mutex.contended_count();
+    hold_ticks += mutex.hold_ticks();
+  }
+  COUNT_profile_set("gpu/shared_memory/page_flags_lock_contended", contended);
+  COUNT_profile_set(
+      "gpu/shared_memory/page_flags_lock_held_us",
+      hold_ticks / std::max(Clock::QueryHostTickFrequency() / 1000000,
+                            uint64_t(1)));
+}
+
 void SharedMemory::ReleaseTraceDownloadRanges() {
   trace_download_ranges_.clear();
   trace_download_ranges_.shrink_to_fit();
   trace_download_page_count_ = 0;
 }
 
+SharedMemory::PageFlagsLock::PageFlagsLock(SharedMemory& shared_memory,
+                                           uint32_t block_first,
+                                           uint32_t block_last)
+    : shared_memory_(shared_memory),
+      stripe_first_(shared_memory.GetPageFlagsStripe(block_first)),
+      stripe_last_(shared_memory.GetPageFlagsStripe(block_last)) {
+  for (uint32_t i = stripe_first_; i <= stripe_last_; ++i) {
+    shared_memory_.page_flags_stripe_mutexes_[i].lock();
+  }
+}
+
+SharedMemory::PageFlagsLock::~PageFlagsLock() {
+  for (uint32_t i = stripe_last_ + 1; i > stripe_first_; --i) {
+    shared_memory_.page_flags_stripe_mutexes_[i - 1].unlock();
+  }
+}
+
 bool SharedMemory::EnsureHostGpuMemoryAllocated(uint32_t start,
                                                 uint32_t length) {
   if (host_gpu_memory_sparse_granularity_log2_ == UINT32_MAX) {
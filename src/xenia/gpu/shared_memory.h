@@ -92,6 +92,10 @@ class SharedMemory {
   // regions in those pages.
   void RangeWrittenByGpu(uint32_t start, uint32_t length);
 
+  // Publishes the page validity lock contention and hold time counters to the
+  // profiler.
+  void UpdateLockProfileCounters();
+
  protected:
   SharedMemory(Memory& memory);
   // Call in implementation-specific initialization.
@@ -174,13 +178,34 @@ class SharedMemory {
   uint32_t trace_download_page_count_ = 0;
 
   // Mutex between the guest memory subsystem and the command processor, to be
-  // locked when checking or updating validity of pages/ranges and when firing
-  // watches.
+  // locked when firing watches.
   xe::global_critical_region global_critical_region_;
 
-  // ***************************************************************************
-  // Things below should be fully protected by global_critical_region.
-  // ***************************************************************************
+  // Validity of pages is split into address stripes locked independently, so
+  // checking and updating it in the command processor doesn't need the global
+  // critical region and doesn't contend with guest threads invalidating other
+  // memory. Where the global critical region is needed too, it's acquired
+  // first, and stripes are locked in ascending order.
+  static constexpr uint32_t kPageFlagsStripeSizeLog2 = 25;
+  static constexpr uint32_t kPageFlagsStripeCount =
+      1 << (kBufferSizeLog2 - kPageFlagsStripeSizeLog2);
+  typedef xe::profiled_mutex<std::mutex> PageFlagsStripeMutex;
+  PageFlagsStripeMutex page_flags_stripe_mutexes_[kPageFlagsStripeCount];
+  // Locks the stripes containing a range of system_page_flags_ blocks.
+  class PageFlagsLock {
+   public:
+    PageFlagsLock(SharedMemory& shared_memory, uint32_t block_first,
+                  uint32_t block_last);
+    ~PageFlagsLock();
+
+   private:
+    SharedMemory& shared_memory_;
+    uint32_t stripe_first_;
+    uint32_t stripe_last_;
+  };
+  uint32_t GetPageFlagsStripe(uint32_t block) const {
+    return (block << (6 + page_size_log2_)) >> kPageFlagsStripeSizeLog2;
+  }
 
   struct SystemPageFlagsBlock {
     // Whether each page is up to date in the GPU buffer.
@@ -190,9 +215,13 @@ class SharedMemory {
     uint64_t valid_and_gpu_written;
   };
   // Flags for each 64 system pages, interleaved as blocks, so bit scan can be
-  // used to quickly extract ranges.
+  // used to quickly extract ranges. Protected by the stripe locks.
   std::vector<SystemPageFlagsBlock> system_page_flags_;
 
+  // ***************************************************************************
+  // Things below should be fully protected by global_critical_region.
+  // ***************************************************************************
+
   static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
       void* context_ptr, uint32_t physical_address_start, uint32_t length,
       bool exact_range);
@@ -0,0 +1,220 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <initializer_list>
+#include <memory>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/gpu/command_processor.h"
+#include "xenia/gpu/graphics_system.h"
+#include "xenia/gpu/packet_decoder.h"
+#include "xenia/gpu/register_file.h"
+#include "xenia/gpu/registers.h"
+#include "xenia/gpu/xenos.h"
+#include "xenia/memory.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace gpu {
+namespace test {
+
+using namespace xe::gpu::xenos;
+
+constexpr uint32_t kTestPhysicalBase = 0x00100000;
+constexpr uint32_t kRingBufferPtr = kTestPhysicalBase;
+constexpr uint32_t kRingBufferLog2Size = 8;
+constexpr uint32_t kRingBufferDwordCount = (1 << kRingBufferLog2Size) / 4;
+constexpr uint32_t kIndirectBufferPtr = kTestPhysicalBase + 0x1000;
+constexpr uint32_t kNestedIndirectBufferPtr = kTestPhysicalBase + 0x2000;
+
+// Only provides the memory and the register file to the command processor.
+class TestGraphicsSystem : public GraphicsSystem {
+ public:
+  explicit TestGraphicsSystem(Memory* memory) { memory_ = memory; }
+
+  std::string name() const override { return "Test"; }
+
+ private:
+  std::unique_ptr<CommandProcessor> CreateCommandProcessor() override {
+    return nullptr;
+  }
+  void Swap(xe::ui::UIEvent* e) override {}
+};
+
+// Executes the primary buffer on the calling thread, without the worker thread
+// and the kernel, optionally with the packets decoded ahead.
+class TestCommandProcessor : public CommandProcessor {
+ public:
+  TestCommandProcessor(GraphicsSystem* graphics_system, bool predecode)
+      : CommandProcessor(graphics_system, nullptr) {
+    worker_running_ = false;
+    if (predecode) {
+      packet_decoder_ = std::make_unique<PacketDecoder>(memory_);
+      REQUIRE(packet_decoder_->Initialize());
+    }
+    InitializeRingBuffer(kRingBufferPtr, kRingBufferLog2Size);
+  }
+
+  // Makes the packets up to write_index visible to the decoder and executes
+  // them like the worker thread, returns the new read index.
+  uint32_t Submit(uint32_t write_index) {
+    UpdateWritePointer(write_index);
+    read_ptr_index_ = ExecutePrimaryBuffer(read_ptr_index_, write_index);
+    return read_ptr_index_;
+  }
+
+  void TracePlaybackWroteMemory(uint32_t base_ptr, uint32_t length) override {}
+  void RestoreEdramSnapshot(const void* snapshot) override {}
+
+ private:
+  bool SetupContext() override { return true; }
+  void ShutdownContext() override {}
+  void PerformSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
+                   uint32_t frontbuffer_height) override {}
+  Shader* LoadShader(xenos::ShaderType shader_type, uint32_t guest_address,
+                     const uint32_t* host_address,
+                     uint32_t dword_count) override {
+    return nullptr;
+  }
+  bool IssueDraw(xenos::PrimitiveType prim_type, uint32_t index_count,
+                 IndexBufferInfo* index_buffer_info,
+                 bool major_mode_explicit) override {
+    return true;
+  }
+  bool IssueCopy() override { return true; }
+  void InitializeTrace() override {}
+};
+
+static uint32_t MakePacketType0(uint32_t index, uint32_t count,
+                                bool one_register = false) {
+  return ((count - 1) << 16) | (one_register ? 0x8000 : 0) | index;
+}
+
+static uint32_t MakePacketType1(uint32_t index_1, uint32_t index_2) {
+  return (0x1 << 30) | (index_2 << 11) | index_1;
+}
+
+static uint32_t MakePacketType3(uint32_t opcode, uint32_t count) {
+  return (0x3u << 30) | ((count - 1) << 16) | (opcode << 8);
+}
+
+// Writes big-endian dwords to the ring buffer, wrapping around, returns the
+// index after them.
+static uint32_t WriteRing(Memory* memory, uint32_t index,
+                          std::initializer_list<uint32_t> values) {
+  auto ring = memory->TranslatePhysical<uint32_t*>(kRingBufferPtr);
+  for (uint32_t value : values) {
+    xe::store_and_swap<uint32_t>(ring + index, value);
+    index = (index + 1) % kRingBufferDwordCount;
+  }
+  return index;
+}
+
+static uint32_t WriteBuffer(Memory* memory, uint32_t ptr,
+                            std::initializer_list<uint32_t> values) {
+  auto buffer = memory->TranslatePhysical<uint32_t*>(ptr);
+  for (uint32_t value : values) {
+    xe::store_and_swap<uint32_t>(buffer++, value);
+  }
+  return uint32_t(values.size());
+}
+
+// Writes the two parts of the test primary buffer and executes them, returns
+// whether all of the primary buffer was executed.
+static bool ExecuteTestRing(Memory* memory,
+                            TestCommandProcessor* command_processor) {
+  // Indirect buffer calling another, which sets the register polled by the
+  // barrier in the primary buffer.
+  uint32_t nested_length = WriteBuffer(
+      memory, kNestedIndirectBufferPtr,
+      {MakePacketType0(XE_GPU_REG_VGT_MAX_VTX_INDX, 1), 0x1234,
+       MakePacketType0(XE_GPU_REG_SHADER_CONSTANT_000_X + 4, 4), 0x3F800000,
+       0x40000000, 0x40400000, 0x40800000});
+  uint32_t indirect_length = WriteBuffer(
+      memory, kIndirectBufferPtr,
+      {MakePacketType0(XE_GPU_REG_PA_CL_VTE_CNTL, 1), 0x0000043F,
+       MakePacketType3(PM4_INDIRECT_BUFFER, 2), kNestedIndirectBufferPtr,
+       nested_length, MakePacketType0(XE_GPU_REG_RB_DEPTHCONTROL, 1),
+       0x00700702});
+
+  // The packets after the barrier are executed from the guest memory.
+  uint32_t index = WriteRing(
+      memory, 0,
+      {MakePacketType0(XE_GPU_REG_RB_SURFACE_INFO, 2), 0x00000500, 0x00000020,
+       MakePacketType3(PM4_INDIRECT_BUFFER, 2), kIndirectBufferPtr,
+       indirect_length, MakePacketType3(PM4_WAIT_REG_MEM, 5), 0x3,
+       XE_GPU_REG_VGT_MAX_VTX_INDX, 0x1234, 0xFFFFFFFF, 0x100,
+       MakePacketType0(XE_GPU_REG_VGT_MIN_VTX_INDX, 1), 0x00000010,
+       MakePacketType3(PM4_INDIRECT_BUFFER, 2), kIndirectBufferPtr,
+       indirect_length});
+  // Padding so the second part wraps around.
+  while (index < kRingBufferDwordCount - 6) {
+    index = WriteRing(memory, index, {0x80000000});
+  }
+  uint32_t first_write_index = index;
+  if (command_processor->Submit(first_write_index) != first_write_index) {
+    return false;
+  }
+
+  // Shader constants wrapping around, decoded without a barrier.
+  index = WriteRing(
+      memory, first_write_index,
+      {MakePacketType0(XE_GPU_REG_SHADER_CONSTANT_000_X, 8), 0x3F800000,
+       0x3F000000, 0x3E800000, 0x3E000000, 0xBF800000, 0xBF000000, 0xBE800000,
+       0xBE000000, MakePacketType3(PM4_SET_CONSTANT, 5), 0x00000010,
+       0x41000000, 0x41100000, 0x41200000, 0x41300000,
+       MakePacketType1(XE_GPU_REG_CP_PERFCOUNTER0_SELECT,
+                       XE_GPU_REG_RBBM_PERFCOUNTER0_SELECT),
+       0x00000003, 0x00000005, MakePacketType3(PM4_INDIRECT_BUFFER, 2),
+       kIndirectBufferPtr, indirect_length,
+       MakePacketType0(XE_GPU_REG_PA_SC_WINDOW_OFFSET, 3, true), 0x00010001,
+       0x00020002, 0x00030003});
+  REQUIRE(index < first_write_index);
+  return command_processor->Submit(index) == index;
+}
+
+TEST_CASE("PACKET_DECODER_MATCHES_DIRECT", "[gpu]") {
+  auto memory = std::make_unique<Memory>();
+  REQUIRE(memory->Initialize());
+  auto heap = memory->LookupHeapByType(true, 64 * 1024);
+  REQUIRE(heap->AllocFixed(heap->heap_base() + kTestPhysicalBase, 64 * 1024,
+                           64 * 1024,
+                           kMemoryAllocationReserve | kMemoryAllocationCommit,
+                           kMemoryProtectRead | kMemoryProtectWrite));
+
+  auto reference_graphics_system =
+      std::make_unique<TestGraphicsSystem>(memory.get());
+  auto reference_command_processor = std::make_unique<TestCommandProcessor>(
+      reference_graphics_system.get(), false);
+  REQUIRE(ExecuteTestRing(memory.get(), reference_command_processor.get()));
+
+  auto graphics_system = std::make_unique<TestGraphicsSystem>(memory.get());
+  auto command_processor =
+      std::make_unique<TestCommandProcessor>(graphics_system.get(), true);
+  REQUIRE(ExecuteTestRing(memory.get(), command_processor.get()));
+
+  const RegisterFile* reference_regs =
+      reference_graphics_system->register_file();
+  const RegisterFile* regs = graphics_system->register_file();
+  REQUIRE(reference_regs->values[XE_GPU_REG_VGT_MIN_VTX_INDX].u32 == 0x10);
+  REQUIRE(reference_regs->values[XE_GPU_REG_PA_SC_WINDOW_OFFSET].u32 ==
+          0x00030003);
+  for (uint32_t i = 0; i < RegisterFile::kRegisterCount; ++i) {
+    INFO("Register " << i);
+    REQUIRE(regs->values[i].u32 == reference_regs->values[i].u32);
+  }
+
+  command_processor.reset();
+  reference_command_processor.reset();
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
@@ -14,9 +14,11 @@
 #include <cstring>
 #include <functional>
 
+#include "xenia/base/byte_order.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/xxhash.h"
 
@@ -26,23 +28,68 @@ namespace texture_conversion {
 
 using namespace xe::gpu::xenos;
 
-void CopySwapBlock(xenos::Endian endian, void* output, const void* input,
-                   size_t length) {
+#if XE_ARCH_AMD64
+static __m128i GetEndianSwapShuffle(xenos::Endian endian) {
   switch (endian) {
     case xenos::Endian::k8in16:
-      xe::copy_and_swap_16_unaligned(output, input, length / 2);
-      break;
+      return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15,
+                           14);
     case xenos::Endian::k8in32:
-      xe::copy_and_swap_32_unaligned(output, input, length / 4);
-      break;
-    case xenos::Endian::k16in32:  // Swap high and low 16 bits within a 32 bit
-                                  // word
-      xe::copy_and_swap_16_in_32_unaligned(output, input, length);
-      break;
+      return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13,
+                           12);
+    case xenos::Endian::k16in32:
+      return _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12,
+                           13);
     default:
-    case xenos::Endian::kNone:
-      std::memcpy(output, input, length);
-      break;
+      return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                           15);
+  }
+}
+#endif  // XE_ARCH_AMD64
+
+void CopySwapBlock(xenos::Endian endian, void* output, const void* input,
+                   size_t length) {
+  auto output_bytes = static_cast<uint8_t*>(output);
+  auto input_bytes = static_cast<const uint8_t*>(input);
+  if (endian != xenos::Endian::k8in16 && endian != xenos::Endian::k8in32 &&
+      endian != xenos::Endian::k16in32) {
+    std::memcpy(output, input, length);
+    return;
+  }
+#if XE_ARCH_AMD64
+  __m128i shuffle = GetEndianSwapShuffle(endian);
+  for (; length >= 16; length -= 16) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(output_bytes),
+        _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_bytes)),
+            shuffle));
+    output_bytes += 16;
+    input_bytes += 16;
+  }
+#endif  // XE_ARCH_AMD64
+  if (endian == xenos::Endian::k8in16) {
+    for (; length >= 2; length -= 2) {
+      uint16_t value;
+      std::memcpy(&value, input_bytes, sizeof(value));
+      value = xe::byte_swap(value);
+      std::memcpy(output_bytes, &value, sizeof(value));
+      output_bytes += 2;
+      input_bytes += 2;
+    }
+  } else {
+    for (; length >= 4; length -= 4) {
+      uint32_t value;
+      std::memcpy(&value, input_bytes, sizeof(value));
+      if (endian == xenos::Endian::k8in32) {
+        value = xe::byte_swap(value);
+      } else {
+        value = (value >> 16) | (value << 16);
+      }
+      std::memcpy(output_bytes, &value, sizeof(value));
+      output_bytes += 4;
+      input_bytes += 4;
+    }
   }
 }
 
@@ -108,6 +155,67 @@ static uint32_t TiledOffset2DColumn(uint32_t x, uint32_t y, uint32_t log2_bpp,
          ((y & 16) << 7) + (((((y & 8) >> 2) + (x >> 3)) & 3) << 6);
 }
 
+// Blocks in a tiled texture are stored in runs of 16 bytes (8 with 1 byte per
+// block) that are contiguous in both the tiled and the linear layout. Without
+// a conversion, each of these runs is copied and swapped at once, with the
+// address calculated once per run.
+static void UntileCopySwapRuns(uint8_t* output_buffer,
+                               const uint8_t* input_buffer,
+                               const UntileInfo* untile_info,
+                               uint32_t log2_bpp) {
+  uint32_t bytes_per_block = uint32_t(1) << log2_bpp;
+  uint32_t run_blocks = log2_bpp <= 1 ? 8 : (16 >> log2_bpp);
+  uint32_t run_bytes = run_blocks << log2_bpp;
+  uint32_t output_pitch = untile_info->output_pitch << log2_bpp;
+  xenos::Endian endian = untile_info->endian;
+#if XE_ARCH_AMD64
+  __m128i shuffle = GetEndianSwapShuffle(endian);
+#endif  // XE_ARCH_AMD64
+
+  uint32_t output_row_offset = 0;
+  for (uint32_t y = 0; y < untile_info->height; y++) {
+    uint32_t tiled_y = untile_info->offset_y + y;
+    auto input_row_offset =
+        TiledOffset2DRow(tiled_y, untile_info->input_pitch, log2_bpp);
+    uint8_t* output = &output_buffer[output_row_offset];
+    uint32_t x = 0;
+    while (x < untile_info->width) {
+      uint32_t tiled_x = untile_info->offset_x + x;
+      auto input_offset =
+          TiledOffset2DColumn(tiled_x, tiled_y, log2_bpp, input_row_offset);
+      const uint8_t* input =
+          &input_buffer[(input_offset >> log2_bpp) << log2_bpp];
+      if ((tiled_x & (run_blocks - 1)) || x + run_blocks > untile_info->width) {
+        // Partial run at the edges.
+        CopySwapBlock(endian, output, input, bytes_per_block);
+        output += bytes_per_block;
+        ++x;
+        continue;
+      }
+#if XE_ARCH_AMD64
+      if (run_bytes == 16) {
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(output),
+            _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(input)),
+                shuffle));
+      } else {
+        _mm_storel_epi64(
+            reinterpret_cast<__m128i*>(output),
+            _mm_shuffle_epi8(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input)),
+                shuffle));
+      }
+#else
+      CopySwapBlock(endian, output, input, run_bytes);
+#endif  // XE_ARCH_AMD64
+      output += run_bytes;
+      x += run_blocks;
+    }
+    output_row_offset += output_pitch;
+  }
+}
+
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
             const UntileInfo* untile_info) {
   SCOPE_profile_cpu_f("gpu");
@@ -125,6 +233,28 @@ void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
   auto log2_bpp = (input_bytes_per_block / 4) +
                   ((input_bytes_per_block / 2) >> (input_bytes_per_block / 4));
 
+  UntileCopyBlockCallback copy_callback = untile_info->copy_callback;
+  if (!copy_callback) {
+    assert_true(input_bytes_per_block == output_bytes_per_block);
+    // Swapping must not cross blocks for blocks smaller than the swapped
+    // units, to stay the same as swapping each block.
+    uint32_t swap_bytes = 1;
+    if (untile_info->endian == xenos::Endian::k8in16) {
+      swap_bytes = 2;
+    } else if (untile_info->endian == xenos::Endian::k8in32 ||
+               untile_info->endian == xenos::Endian::k16in32) {
+      swap_bytes = 4;
+    }
+    if (input_bytes_per_block >= swap_bytes) {
+      UntileCopySwapRuns(output_buffer, input_buffer, untile_info, log2_bpp);
+      return;
+    }
+    xenos::Endian endian = untile_info->endian;
+    copy_callback = [endian](void* output, const void* input, size_t length) {
+      CopySwapBlock(endian, output, input, length);
+    };
+  }
+
   // Offset to the current row, in bytes.
   uint32_t output_row_offset = 0;
   for (uint32_t y = 0; y < untile_info->height; y++) {
@@ -140,10 +270,9 @@ void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
                                               log2_bpp, input_row_offset);
       input_offset >>= log2_bpp;
 
-      untile_info->copy_callback(
-          &output_buffer[output_offset],
-          &input_buffer[input_offset * input_bytes_per_block],
-          output_bytes_per_block);
+      copy_callback(&output_buffer[output_offset],
+                    &input_buffer[input_offset * input_bytes_per_block],
+                    output_bytes_per_block);
 
       output_offset += output_bytes_per_block;
     }
@@ -43,7 +43,9 @@ typedef struct UntileInfo {
   uint32_t output_pitch;
   const FormatInfo* input_format_info;
   const FormatInfo* output_format_info;
+  // If empty, the blocks are copied with endian swapping, several at once.
   UntileCopyBlockCallback copy_callback;
+  xenos::Endian endian;
 } UntileInfo;
 
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
@@ -0,0 +1,223 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/gpu/texture_conversion.h"
+
+DEFINE_int32(texture_conversion_bench_size, 1024,
+             "Width and height of the untiled textures, in blocks.", "GPU");
+DEFINE_int32(texture_conversion_bench_iterations, 8,
+             "Number of times to untile each texture.", "GPU");
+
+namespace xe {
+namespace gpu {
+
+using namespace xe::gpu::texture_conversion;
+
+// Swaps each block separately the simplest way, for checking CopySwapBlock.
+static void CopySwapBlockReference(xenos::Endian endian, void* output,
+                                   const void* input, size_t length) {
+  auto output_bytes = static_cast<uint8_t*>(output);
+  auto input_bytes = static_cast<const uint8_t*>(input);
+  for (size_t i = 0; i < length; ++i) {
+    size_t swapped_i = i;
+    switch (endian) {
+      case xenos::Endian::k8in16:
+        swapped_i = i ^ 1;
+        break;
+      case xenos::Endian::k8in32:
+        swapped_i = i ^ 3;
+        break;
+      case xenos::Endian::k16in32:
+        swapped_i = i ^ 2;
+        break;
+      default:
+        break;
+    }
+    output_bytes[i] = input_bytes[swapped_i];
+  }
+}
+
+static uint32_t GetEndianSwapSize(xenos::Endian endian) {
+  switch (endian) {
+    case xenos::Endian::k8in16:
+      return 2;
+    case xenos::Endian::k8in32:
+    case xenos::Endian::k16in32:
+      return 4;
+    default:
+      return 1;
+  }
+}
+
+static const char* GetEndianName(xenos::Endian endian) {
+  switch (endian) {
+    case xenos::Endian::k8in16:
+      return "8in16";
+    case xenos::Endian::k8in32:
+      return "8in32";
+    case xenos::Endian::k16in32:
+      return "16in32";
+    default:
+      return "none";
+  }
+}
+
+// Untiles the texture the old way, with CopySwapBlockReference called for each
+// block, and with the runs of blocks, returning whether the results are the
+// same.
+static bool BenchmarkUntile(xenos::TextureFormat format,
+                            xenos::Endian endian, uint32_t size,
+                            uint32_t offset, uint32_t iteration_count) {
+  const FormatInfo* format_info = FormatInfo::Get(format);
+  uint32_t bytes_per_block = format_info->bytes_per_block();
+  // The tiled pitch must be a multiple of 32 blocks.
+  uint32_t input_pitch = (size + offset + 31) & ~uint32_t(31);
+  std::vector<uint8_t> input(input_pitch * input_pitch * bytes_per_block);
+  uint32_t random = 1;
+  for (uint8_t& byte : input) {
+    random = random * 1103515245 + 12345;
+    byte = uint8_t(random >> 16);
+  }
+  std::vector<uint8_t> reference_output(size * size * bytes_per_block);
+  std::vector<uint8_t> output(reference_output.size());
+
+  UntileInfo untile_info = {};
+  untile_info.offset_x = offset;
+  untile_info.offset_y = offset;
+  untile_info.width = size;
+  untile_info.height = size;
+  untile_info.input_pitch = input_pitch;
+  untile_info.output_pitch = size;
+  untile_info.input_format_info = format_info;
+  untile_info.output_format_info = format_info;
+  untile_info.endian = endian;
+
+  double ms_per_tick = 1000.0 / Clock::QueryHostTickFrequency();
+  UntileInfo reference_untile_info = untile_info;
+  reference_untile_info.copy_callback = [endian](void* o, const void* i,
+                                                 size_t l) {
+    CopySwapBlockReference(endian, o, i, l);
+  };
+  uint64_t start_tick = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    Untile(reference_output.data(), input.data(), &reference_untile_info);
+  }
+  double reference_ms =
+      (Clock::QueryHostTickCount() - start_tick) * ms_per_tick;
+
+  start_tick = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    Untile(output.data(), input.data(), &untile_info);
+  }
+  double ms = (Clock::QueryHostTickCount() - start_tick) * ms_per_tick;
+
+  bool matches = !std::memcmp(output.data(), reference_output.data(),
+                              output.size());
+  double megabytes = double(output.size()) * iteration_count / (1024 * 1024);
+  XELOGI("{:2} bytes per block, {:6} swap, offset {:2}: {:8.1f} MB/s, "
+         "reference {:8.1f} MB/s{}",
+         bytes_per_block, GetEndianName(endian), offset,
+         megabytes * 1000.0 / ms, megabytes * 1000.0 / reference_ms,
+         matches ? "" : " - MISMATCH");
+  return matches;
+}
+
+static bool BenchmarkCopySwapBlock(xenos::Endian endian, uint32_t size,
+                                   uint32_t iteration_count) {
+  std::vector<uint8_t> input(size);
+  uint32_t random = 2;
+  for (uint8_t& byte : input) {
+    random = random * 1103515245 + 12345;
+    byte = uint8_t(random >> 16);
+  }
+  std::vector<uint8_t> reference_output(size);
+  std::vector<uint8_t> output(size);
+  double ms_per_tick = 1000.0 / Clock::QueryHostTickFrequency();
+
+  uint64_t start_tick = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    CopySwapBlockReference(endian, reference_output.data(), input.data(),
+                           size);
+  }
+  double reference_ms =
+      (Clock::QueryHostTickCount() - start_tick) * ms_per_tick;
+
+  start_tick = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    CopySwapBlock(endian, output.data(), input.data(), size);
+  }
+  double ms = (Clock::QueryHostTickCount() - start_tick) * ms_per_tick;
+
+  bool matches = !std::memcmp(output.data(), reference_output.data(), size);
+  double megabytes = double(size) * iteration_count / (1024 * 1024);
+  XELOGI("CopySwapBlock {:6} swap: {:8.1f} MB/s, reference {:8.1f} MB/s{}",
+         GetEndianName(endian), megabytes * 1000.0 / ms,
+         megabytes * 1000.0 / reference_ms, matches ? "" : " - MISMATCH");
+  return matches;
+}
+
+// Compares the untiling and endian swapping fast paths with the scalar
+// reference, returning an error if the results are different.
+int texture_conversion_bench_main(const std::vector<std::string>& args) {
+  uint32_t size = uint32_t(std::max(cvars::texture_conversion_bench_size, 8));
+  uint32_t iteration_count =
+      uint32_t(std::max(cvars::texture_conversion_bench_iterations, 1));
+  const xenos::Endian endians[] = {
+      xenos::Endian::kNone,
+      xenos::Endian::k8in16,
+      xenos::Endian::k8in32,
+      xenos::Endian::k16in32,
+  };
+  // One format for each number of bytes per block.
+  const xenos::TextureFormat formats[] = {
+      xenos::TextureFormat::k_8,
+      xenos::TextureFormat::k_8_8,
+      xenos::TextureFormat::k_8_8_8_8,
+      xenos::TextureFormat::k_16_16_16_16,
+      xenos::TextureFormat::k_32_32_32_32_FLOAT,
+  };
+
+  bool all_match = true;
+  for (xenos::Endian endian : endians) {
+    all_match &= BenchmarkCopySwapBlock(endian, size * size * 4,
+                                        iteration_count);
+  }
+  for (xenos::TextureFormat format : formats) {
+    for (xenos::Endian endian : endians) {
+      // Blocks smaller than the swapped units are not swapped.
+      if (FormatInfo::Get(format)->bytes_per_block() <
+          GetEndianSwapSize(endian)) {
+        continue;
+      }
+      all_match &= BenchmarkUntile(format, endian, size, 0, iteration_count);
+      // Offsets not aligned to the runs of blocks go through the edge cases.
+      all_match &= BenchmarkUntile(format, endian, size - 5, 3, 1);
+    }
+  }
+  if (!all_match) {
+    XELOGE("Results are different from the reference");
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace gpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT("xenia-gpu-texture-conversion-bench",
+                   xe::gpu::texture_conversion_bench_main, "");
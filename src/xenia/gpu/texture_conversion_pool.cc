@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/texture_conversion_pool.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace gpu {
+
+TextureConversionPool::TextureConversionPool() = default;
+
+TextureConversionPool::~TextureConversionPool() { Shutdown(); }
+
+bool TextureConversionPool::Initialize(uint32_t worker_count) {
+  Shutdown();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = false;
+  }
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    xe::threading::Thread::CreationParameters params;
+    auto thread = xe::threading::Thread::Create(
+        params, [this]() { WorkerThreadMain(); });
+    if (!thread) {
+      XELOGE("Failed to create texture conversion thread {}", i);
+      Shutdown();
+      return false;
+    }
+    thread->set_name(fmt::format("Texture Conversion {}", i));
+    worker_threads_.push_back(std::move(thread));
+  }
+  return true;
+}
+
+void TextureConversionPool::Shutdown() {
+  {
+    // Finish what has been submitted, the results may already be referenced
+    // by command buffers.
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!queue_.empty()) {
+      RunTask(lock);
+    }
+    shutting_down_ = true;
+  }
+  queue_cond_.notify_all();
+  for (auto& thread : worker_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  worker_threads_.clear();
+}
+
+void TextureConversionPool::Submit(Batch* batch, std::function<void()> task) {
+  if (worker_threads_.empty()) {
+    task();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++batch->pending_count_;
+    queue_.push_back({batch, std::move(task)});
+  }
+  queue_cond_.notify_one();
+}
+
+void TextureConversionPool::Wait(Batch* batch) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (batch->pending_count_) {
+    if (!queue_.empty()) {
+      RunTask(lock);
+    } else {
+      done_cond_.wait(lock);
+    }
+  }
+}
+
+void TextureConversionPool::WorkerThreadMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queue_cond_.wait(lock,
+                     [this]() { return shutting_down_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+    RunTask(lock);
+  }
+}
+
+void TextureConversionPool::RunTask(std::unique_lock<std::mutex>& lock) {
+  Task task = std::move(queue_.front());
+  queue_.pop_front();
+  lock.unlock();
+  {
+    SCOPE_profile_cpu_i("gpu", "xe::gpu::TextureConversionPool::RunTask");
+    task.function();
+  }
+  lock.lock();
+  if (!--task.batch->pending_count_) {
+    done_cond_.notify_all();
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
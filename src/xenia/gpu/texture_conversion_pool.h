@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2020 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TEXTURE_CONVERSION_POOL_H_
+#define XENIA_GPU_TEXTURE_CONVERSION_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace gpu {
+
+// Host threads converting textures on the CPU for upload, so the command
+// processor only has to wait for the conversion right before the converted
+// data is used by the GPU.
+class TextureConversionPool {
+ public:
+  // Tasks that are waited for together.
+  class Batch {
+   private:
+    friend class TextureConversionPool;
+    uint32_t pending_count_ = 0;
+  };
+
+  TextureConversionPool();
+  ~TextureConversionPool();
+
+  // Without workers, tasks are run right when they're submitted.
+  bool Initialize(uint32_t worker_count);
+  void Shutdown();
+
+  uint32_t worker_count() const {
+    return uint32_t(worker_threads_.size());
+  }
+
+  void Submit(Batch* batch, std::function<void()> task);
+  // Also runs the queued tasks on the calling thread while waiting.
+  void Wait(Batch* batch);
+
+ private:
+  struct Task {
+    Batch* batch;
+    std::function<void()> function;
+  };
+
+  void WorkerThreadMain();
+  // Called with the lock held, releases it while running the task.
+  void RunTask(std::unique_lock<std::mutex>& lock);
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> worker_threads_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_cond_;
+  std::condition_variable done_cond_;
+  bool shutting_down_ = false;
+  std::deque<Task> queue_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TEXTURE_CONVERSION_POOL_H_
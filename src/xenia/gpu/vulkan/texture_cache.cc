@@ -37,6 +37,8 @@ using xe::ui::vulkan::CheckResult;
 
 constexpr uint32_t kMaxTextureSamplers = 32;
 constexpr VkDeviceSize kStagingBufferSize = 64 * 1024 * 1024;
+// Rows of blocks converted by one task of the conversion pool.
+constexpr uint32_t kConversionTaskBlockRows = 64;
 
 const char* get_dimension_name(xenos::DataDimension dimension) {
   static const char* names[] = {
@@ -155,10 +157,23 @@ VkResult TextureCache::Initialize() {
       memory_->RegisterPhysicalMemoryInvalidationCallback(
           MemoryInvalidationCallbackThunk, this);
 
+  int32_t conversion_thread_count = cvars::vulkan_texture_conversion_threads;
+  if (conversion_thread_count < 0) {
+    // Leave some of the processors to the guest threads.
+    conversion_thread_count = int32_t(
+        std::min(xe::threading::logical_processor_count() / 2, 8u));
+  }
+  if (!conversion_pool_.Initialize(uint32_t(conversion_thread_count))) {
+    XELOGW("Failed to create the texture conversion threads");
+    conversion_pool_.Initialize(0);
+  }
+
   return VK_SUCCESS;
 }
 
 void TextureCache::Shutdown() {
+  conversion_pool_.Shutdown();
+
   if (memory_invalidation_callback_handle_ != nullptr) {
     memory_->UnregisterPhysicalMemoryInvalidationCallback(
         memory_invalidation_callback_handle_);
@@ -947,6 +962,8 @@ TextureCache::Texture* TextureCache::LookupAddress(uint32_t guest_address,
 
 void TextureCache::FlushPendingCommands(VkCommandBuffer command_buffer,
                                         VkFence completion_fence) {
+  WaitForConversions();
+
   auto status = vkEndCommandBuffer(command_buffer);
   CheckResult(status, "vkEndCommandBuffer");
 
@@ -1005,15 +1022,27 @@ bool TextureCache::ConvertTexture(uint8_t* dest, VkBufferImageCopy* copy_region,
       dst_extent.block_pitch_h * GetFormatInfo(src.format)->bytes_per_block();
 
   auto copy_block = GetFormatCopyBlock(src.format);
+  xenos::Endian endian = src.endianness;
 
+  // The faces are converted in bands of rows on the conversion pool, and are
+  // waited for before the upload commands are submitted.
   const uint8_t* src_mem = reinterpret_cast<const uint8_t*>(host_address);
   if (!src.is_tiled) {
     for (uint32_t face = 0; face < dst_extent.depth; face++) {
       src_mem += offset_y * src_pitch;
       src_mem += offset_x * src.format_info()->bytes_per_block();
-      for (uint32_t y = 0; y < dst_extent.block_height; y++) {
-        copy_block(src.endianness, dest + y * dst_pitch,
-                   src_mem + y * src_pitch, dst_pitch);
+      for (uint32_t band_y = 0; band_y < dst_extent.block_height;
+           band_y += kConversionTaskBlockRows) {
+        uint32_t band_height = std::min(kConversionTaskBlockRows,
+                                        dst_extent.block_height - band_y);
+        uint8_t* band_dest = dest + band_y * dst_pitch;
+        const uint8_t* band_src = src_mem + band_y * src_pitch;
+        conversion_pool_.Submit(&pending_conversions_, [=]() {
+          for (uint32_t y = 0; y < band_height; y++) {
+            copy_block(endian, band_dest + y * dst_pitch,
+                       band_src + y * src_pitch, dst_pitch);
+          }
+        });
       }
       src_mem += src_pitch * src_extent.block_pitch_v;
       dest += dst_pitch * dst_extent.block_pitch_v;
@@ -1021,21 +1050,37 @@ bool TextureCache::ConvertTexture(uint8_t* dest, VkBufferImageCopy* copy_region,
   } else {
     // Untile image.
     // We could do this in a shader to speed things up, as this is pretty slow.
-    for (uint32_t face = 0; face < dst_extent.depth; face++) {
-      texture_conversion::UntileInfo untile_info;
-      std::memset(&untile_info, 0, sizeof(untile_info));
-      untile_info.offset_x = offset_x;
-      untile_info.offset_y = offset_y;
-      untile_info.width = src_extent.block_width;
-      untile_info.height = src_extent.block_height;
-      untile_info.input_pitch = src_extent.block_pitch_h;
-      untile_info.output_pitch = dst_extent.block_pitch_h;
-      untile_info.input_format_info = src.format_info();
-      untile_info.output_format_info = GetFormatInfo(src.format);
+    texture_conversion::UntileInfo untile_info;
+    std::memset(&untile_info, 0, sizeof(untile_info));
+    untile_info.offset_x = offset_x;
+    untile_info.width = src_extent.block_width;
+    untile_info.input_pitch = src_extent.block_pitch_h;
+    untile_info.output_pitch = dst_extent.block_pitch_h;
+    untile_info.input_format_info = src.format_info();
+    untile_info.output_format_info = GetFormatInfo(src.format);
+    untile_info.endian = endian;
+    // Without a conversion, untiling copies and swaps multiple blocks at
+    // once.
+    auto copy_block_function =
+        copy_block.target<decltype(&texture_conversion::CopySwapBlock)>();
+    if (!copy_block_function ||
+        *copy_block_function != &texture_conversion::CopySwapBlock) {
       untile_info.copy_callback = [=](auto o, auto i, auto l) {
-        copy_block(src.endianness, o, i, l);
+        copy_block(endian, o, i, l);
       };
-      texture_conversion::Untile(dest, src_mem, &untile_info);
+    }
+    for (uint32_t face = 0; face < dst_extent.depth; face++) {
+      for (uint32_t band_y = 0; band_y < src_extent.block_height;
+           band_y += kConversionTaskBlockRows) {
+        texture_conversion::UntileInfo band_untile_info = untile_info;
+        band_untile_info.offset_y = offset_y + band_y;
+        band_untile_info.height = std::min(kConversionTaskBlockRows,
+                                           src_extent.block_height - band_y);
+        uint8_t* band_dest = dest + band_y * dst_pitch;
+        conversion_pool_.Submit(&pending_conversions_, [=]() {
+          texture_conversion::Untile(band_dest, src_mem, &band_untile_info);
+        });
+      }
       src_mem += src_pitch * src_extent.block_pitch_v;
       dest += dst_pitch * dst_extent.block_pitch_v;
     }
@@ -1152,6 +1197,7 @@ bool TextureCache::UploadTexture(VkCommandBuffer command_buffer,
   }
 
   if (cvars::texture_dump) {
+    WaitForConversions();
     TextureDump(src, unpack_buffer, unpack_length);
   }
 
@@ -1602,7 +1648,13 @@ void TextureCache::RemoveInvalidatedTextures() {
   }
 }
 
+void TextureCache::WaitForConversions() {
+  SCOPE_profile_cpu_f("gpu");
+  conversion_pool_.Wait(&pending_conversions_);
+}
+
 void TextureCache::ClearCache() {
+  WaitForConversions();
   RemoveInvalidatedTextures();
   for (auto it = textures_.begin(); it != textures_.end(); ++it) {
     while (!FreeTexture(it->second)) {
@@ -20,6 +20,7 @@
 #include "xenia/gpu/sampler_info.h"
 #include "xenia/gpu/shader.h"
 #include "xenia/gpu/texture_conversion.h"
+#include "xenia/gpu/texture_conversion_pool.h"
 #include "xenia/gpu/texture_info.h"
 #include "xenia/gpu/trace_writer.h"
 #include "xenia/gpu/vulkan/vulkan_command_processor.h"
@@ -119,6 +120,10 @@ class TextureCache {
   // creates a new texture or returns a previously created texture.
   Texture* DemandResolveTexture(const TextureInfo& texture_info);
 
+  // Waits for the conversion of the textures uploaded since the last wait, must
+  // be called before submitting the setup command buffer.
+  void WaitForConversions();
+
   // Clears all cached content.
   void ClearCache();
 
@@ -216,6 +221,10 @@ class TextureCache {
 
   ui::vulkan::CircularBuffer staging_buffer_;
   ui::vulkan::CircularBuffer wb_staging_buffer_;
+  // Converts the textures into the staging buffer while the following draws
+  // are being set up.
+  TextureConversionPool conversion_pool_;
+  TextureConversionPool::Batch pending_conversions_;
   std::unordered_map<uint64_t, Texture*> textures_;
   std::unordered_map<uint64_t, Sampler*> samplers_;
   std::list<Texture*> pending_delete_textures_;
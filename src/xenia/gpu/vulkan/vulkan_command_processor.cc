@@ -190,6 +190,12 @@ void VulkanCommandProcessor::PrepareForWait() {
   context_->ClearCurrent();
 }
 
+void VulkanCommandProcessor::PrepareForGuestSignal() {
+  // The texture cache threads may still be reading the guest memory the guest
+  // will be allowed to reuse.
+  texture_cache_->WaitForConversions();
+}
+
 void VulkanCommandProcessor::ReturnFromWait() {
   context_->MakeCurrent();
 
@@ -199,26 +205,7 @@ void VulkanCommandProcessor::ReturnFromWait() {
 void VulkanCommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
   CommandProcessor::WriteRegister(index, value);
 
-  if (index >= XE_GPU_REG_SHADER_CONSTANT_000_X &&
-      index <= XE_GPU_REG_SHADER_CONSTANT_511_W) {
-    uint32_t offset = index - XE_GPU_REG_SHADER_CONSTANT_000_X;
-    offset /= 4 * 4;
-    offset ^= 0x3F;
-
-    dirty_float_constants_ |= (1ull << offset);
-  } else if (index >= XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 &&
-             index <= XE_GPU_REG_SHADER_CONSTANT_BOOL_224_255) {
-    uint32_t offset = index - XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031;
-    offset ^= 0x7;
-
-    dirty_bool_constants_ |= (1 << offset);
-  } else if (index >= XE_GPU_REG_SHADER_CONSTANT_LOOP_00 &&
-             index <= XE_GPU_REG_SHADER_CONSTANT_LOOP_31) {
-    uint32_t offset = index - XE_GPU_REG_SHADER_CONSTANT_LOOP_00;
-    offset ^= 0x1F;
-
-    dirty_loop_constants_ |= (1 << offset);
-  } else if (index == XE_GPU_REG_DC_LUT_PWL_DATA) {
+  if (index == XE_GPU_REG_DC_LUT_PWL_DATA) {
     UpdateGammaRampValue(GammaRampType::kPWL, value);
   } else if (index == XE_GPU_REG_DC_LUT_30_COLOR) {
     UpdateGammaRampValue(GammaRampType::kNormal, value);
@@ -344,6 +331,8 @@ void VulkanCommandProcessor::BeginFrame() {
   current_batch_fence_ = command_buffer_pool_->BeginBatch();
   current_command_buffer_ = command_buffer_pool_->AcquireEntry();
   current_setup_buffer_ = command_buffer_pool_->AcquireEntry();
+  // The transient data of the previous batches may be freed when it completes.
+  constants_uploaded_ = false;
 
   VkCommandBufferBeginInfo command_buffer_begin_info;
   command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -530,6 +519,10 @@ void VulkanCommandProcessor::PerformSwap(uint32_t frontbuffer_ptr,
 
   submit_buffers.push_back(copy_commands);
   if (!submit_buffers.empty()) {
+    // The setup buffer copies the textures converted by the texture cache
+    // threads.
+    texture_cache_->WaitForConversions();
+
     // TODO(benvanik): move to CP or to host (trace dump, etc).
     // This only needs to surround a vkQueueSubmit.
     if (queue_mutex_) {
@@ -736,24 +729,44 @@ bool VulkanCommandProcessor::PopulateConstants(VkCommandBuffer command_buffer,
   xe::gpu::Shader::ConstantRegisterMap dummy_map;
   std::memset(&dummy_map, 0, sizeof(dummy_map));
 
-  // Upload the constants the shaders require.
-  // These are optional, and if none are defined 0 will be returned.
-  auto constant_offsets = buffer_cache_->UploadConstantRegisters(
-      current_setup_buffer_, vertex_shader->constant_register_map(),
-      pixel_shader ? pixel_shader->constant_register_map() : dummy_map,
-      current_batch_fence_);
-  if (constant_offsets.first == VK_WHOLE_SIZE ||
-      constant_offsets.second == VK_WHOLE_SIZE) {
-    // Shader wants constants but we couldn't upload them.
-    return false;
+  // All constants are uploaded, so the ones from an earlier draw in this batch
+  // can be used if none of the shader constant registers have been written
+  // since then.
+  auto& regs = *register_file_;
+  const uint32_t kFloatConstantCount = XE_GPU_REG_SHADER_CONSTANT_511_W -
+                                       XE_GPU_REG_SHADER_CONSTANT_000_X + 1;
+  const uint32_t kBoolLoopConstantCount =
+      XE_GPU_REG_SHADER_CONSTANT_LOOP_31 -
+      XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031 + 1;
+  if (!constants_uploaded_ ||
+      regs.IsRangeDirty(XE_GPU_REG_SHADER_CONSTANT_000_X,
+                        kFloatConstantCount) ||
+      regs.IsRangeDirty(XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031,
+                        kBoolLoopConstantCount)) {
+    // Upload the constants the shaders require.
+    // These are optional, and if none are defined 0 will be returned.
+    auto constant_offsets = buffer_cache_->UploadConstantRegisters(
+        current_setup_buffer_, vertex_shader->constant_register_map(),
+        pixel_shader ? pixel_shader->constant_register_map() : dummy_map,
+        current_batch_fence_);
+    if (constant_offsets.first == VK_WHOLE_SIZE ||
+        constant_offsets.second == VK_WHOLE_SIZE) {
+      // Shader wants constants but we couldn't upload them.
+      return false;
+    }
+    constant_offsets_ = constant_offsets;
+    constants_uploaded_ = true;
+    regs.ClearRangeDirty(XE_GPU_REG_SHADER_CONSTANT_000_X, kFloatConstantCount);
+    regs.ClearRangeDirty(XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031,
+                         kBoolLoopConstantCount);
   }
 
   // Configure constant uniform access to point at our offsets.
   auto constant_descriptor_set = buffer_cache_->constant_descriptor_set();
   auto pipeline_layout = pipeline_cache_->pipeline_layout();
   uint32_t set_constant_offsets[2] = {
-      static_cast<uint32_t>(constant_offsets.first),
-      static_cast<uint32_t>(constant_offsets.second)};
+      static_cast<uint32_t>(constant_offsets_.first),
+      static_cast<uint32_t>(constant_offsets_.second)};
   vkCmdBindDescriptorSets(
       command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1,
       &constant_descriptor_set,
@@ -18,6 +18,7 @@
 #include <queue>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/threading.h"
@@ -64,6 +65,7 @@ class VulkanCommandProcessor : public CommandProcessor {
   void MakeCoherent() override;
   void PrepareForWait() override;
   void ReturnFromWait() override;
+  void PrepareForGuestSignal() override;
 
   void WriteRegister(uint32_t index, uint32_t value) override;
 
@@ -106,11 +108,13 @@ class VulkanCommandProcessor : public CommandProcessor {
   VkImageView fb_image_view_ = nullptr;
   VkFramebuffer fb_framebuffer_ = nullptr;
 
-  uint64_t dirty_float_constants_ = 0;  // Dirty float constants in blocks of 4
-  uint8_t dirty_bool_constants_ = 0;
-  uint32_t dirty_loop_constants_ = 0;
   uint8_t dirty_gamma_constants_ = 0;
 
+  // Constants uploaded in the current batch, reused by the following draws
+  // until the shader constant registers are written.
+  bool constants_uploaded_ = false;
+  std::pair<VkDeviceSize, VkDeviceSize> constant_offsets_;
+
   uint32_t coher_base_vc_ = 0;
   uint32_t coher_size_vc_ = 0;
 
@@ -14,13 +14,16 @@
 #include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/mmio_handler.h"
 
 // TODO(benvanik): move xbox.h out
@@ -32,6 +35,14 @@ DEFINE_bool(protect_on_release, false,
             "Protect released memory to prevent accesses.", "Memory");
 DEFINE_bool(scribble_heap, false,
             "Scribble 0xCD into all allocated heap memory.", "Memory");
+DEFINE_string(
+    physical_write_watch, "protect",
+    "How CPU writes to physical memory used by the GPU are detected. Use: "
+    "[protect, userfaultfd, any]. protect makes the pages read-only and "
+    "handles access violations, userfaultfd uses write protection on a "
+    "separate thread without signals (Linux 6.4+), any uses userfaultfd if "
+    "available.",
+    "Memory");
 
 namespace xe {
 uint32_t get_page_count(uint32_t value, uint32_t page_size) {
@@ -98,6 +109,7 @@ Memory::~Memory() {
   // Uninstall the MMIO handler, as we won't be able to service more
   // requests.
   mmio_handler_.reset();
+  write_watch_.reset();
 
   for (auto invalidation_callback : physical_memory_invalidation_callbacks_) {
     delete invalidation_callback;
@@ -195,6 +207,17 @@ bool Memory::Initialize() {
       kMemoryAllocationReserve | kMemoryAllocationCommit,
       kMemoryProtectRead | kMemoryProtectWrite);
 
+  if (cvars::physical_write_watch == "any" ||
+      cvars::physical_write_watch == "userfaultfd") {
+    write_watch_ = xe::memory::WriteWatch::Create(
+        WriteWatchCallbackThunk, WriteWatchFlushCallbackThunk, this);
+    if (!write_watch_ && cvars::physical_write_watch != "any") {
+      XELOGW(
+          "The write watch is not supported by the host, falling back to "
+          "access violations for physical memory watches");
+    }
+  }
+
   // Add handlers for MMIO.
   mmio_handler_ = cpu::MMIOHandler::Install(
       virtual_membase_, physical_membase_, physical_membase_ + 0x1FFFFFFF,
@@ -472,6 +495,73 @@ bool Memory::AccessViolationCallbackThunk(
       std::move(global_lock_locked_once), host_address, is_write);
 }
 
+void Memory::WriteWatchCallbackThunk(void* context, void* host_address) {
+  auto memory = reinterpret_cast<Memory*>(context);
+  BaseHeap* heap =
+      memory->LookupHeap(memory->HostToGuestVirtual(host_address));
+  if (heap && heap->heap_type() == HeapType::kGuestPhysical) {
+    static_cast<PhysicalHeap*>(heap)->MarkSystemPageWritten(host_address);
+  }
+}
+
+bool Memory::WriteWatchFlushCallbackThunk(void* context) {
+  // The writing thread may be holding the global critical region, so don't
+  // wait for it on the only thread resuming writers.
+  auto memory = reinterpret_cast<Memory*>(context);
+  bool dispatched = memory->heaps_.vA0000000.DispatchWrites(false);
+  dispatched &= memory->heaps_.vC0000000.DispatchWrites(false);
+  dispatched &= memory->heaps_.vE0000000.DispatchWrites(false);
+  return dispatched;
+}
+
+void Memory::DispatchPhysicalMemoryWrites() {
+  if (!write_watch_) {
+    return;
+  }
+  heaps_.vA0000000.DispatchWrites(true);
+  heaps_.vC0000000.DispatchWrites(true);
+  heaps_.vE0000000.DispatchWrites(true);
+}
+
+void Memory::UpdateProfileCounters() {
+  uint64_t ticks_per_us = std::max(Clock::QueryHostTickFrequency() / 1000000,
+                                   uint64_t(1));
+  const BaseHeap* virtual_heaps[] = {&heaps_.v00000000, &heaps_.v40000000};
+  const BaseHeap* xex_heaps[] = {&heaps_.v80000000, &heaps_.v90000000};
+  const BaseHeap* physical_heaps[] = {&heaps_.physical, &heaps_.vA0000000,
+                                      &heaps_.vC0000000, &heaps_.vE0000000};
+  uint64_t contended = 0, hold_ticks = 0;
+  for (const BaseHeap* heap : virtual_heaps) {
+    contended += heap->heap_mutex().contended_count();
+    hold_ticks += heap->heap_mutex().hold_ticks();
+  }
+  COUNT_profile_set("memory/virtual_heap_lock_contended", contended);
+  COUNT_profile_set("memory/virtual_heap_lock_held_us",
+                    hold_ticks / ticks_per_us);
+  contended = 0;
+  hold_ticks = 0;
+  for (const BaseHeap* heap : xex_heaps) {
+    contended += heap->heap_mutex().contended_count();
+    hold_ticks += heap->heap_mutex().hold_ticks();
+  }
+  COUNT_profile_set("memory/xex_heap_lock_contended", contended);
+  COUNT_profile_set("memory/xex_heap_lock_held_us", hold_ticks / ticks_per_us);
+  contended = 0;
+  hold_ticks = 0;
+  for (const BaseHeap* heap : physical_heaps) {
+    contended += heap->heap_mutex().contended_count();
+    hold_ticks += heap->heap_mutex().hold_ticks();
+  }
+  COUNT_profile_set("memory/physical_heap_lock_contended", contended);
+  COUNT_profile_set("memory/physical_heap_lock_held_us",
+                    hold_ticks / ticks_per_us);
+
+  COUNT_profile_set("cpu/mmio/faulting_accesses",
+                    mmio_handler_->faulting_access_count());
+  COUNT_profile_set("cpu/mmio/checked_accesses",
+                    mmio_handler_->checked_access_count());
+}
+
 bool Memory::TriggerPhysicalMemoryCallbacks(
     std::unique_lock<std::recursive_mutex> global_lock_locked_once,
     uint32_t virtual_address, uint32_t length, bool is_write,
@@ -580,26 +670,41 @@ void Memory::DumpMap() {
   XELOGE("");
 }
 
-bool Memory::Save(ByteStream* stream) {
+bool Memory::Save(ByteStream* stream, bool incremental) {
+  if (incremental && !has_saved_state_) {
+    return false;
+  }
+
   XELOGD("Serializing memory...");
-  heaps_.v00000000.Save(stream);
-  heaps_.v40000000.Save(stream);
-  heaps_.v80000000.Save(stream);
-  heaps_.v90000000.Save(stream);
-  heaps_.physical.Save(stream);
+  heaps_.v00000000.Save(stream, incremental);
+  heaps_.v40000000.Save(stream, incremental);
+  heaps_.v80000000.Save(stream, incremental);
+  heaps_.v90000000.Save(stream, incremental);
+  heaps_.physical.Save(stream, incremental);
+  has_saved_state_ = true;
 
   return true;
 }
 
+bool Memory::SaveRaw(ByteStream* stream, bool incremental) {
+  if (incremental && !has_saved_state_) {
+    return false;
+  }
+
+  return heaps_.v00000000.SaveRaw(stream, incremental) &&
+         heaps_.v40000000.SaveRaw(stream, incremental) &&
+         heaps_.v80000000.SaveRaw(stream, incremental) &&
+         heaps_.v90000000.SaveRaw(stream, incremental) &&
+         heaps_.physical.SaveRaw(stream, incremental);
+}
+
 bool Memory::Restore(ByteStream* stream) {
   XELOGD("Restoring memory...");
-  heaps_.v00000000.Restore(stream);
-  heaps_.v40000000.Restore(stream);
-  heaps_.v80000000.Restore(stream);
-  heaps_.v90000000.Restore(stream);
-  heaps_.physical.Restore(stream);
-
-  return true;
+  has_saved_state_ = false;
+  return heaps_.v00000000.Restore(stream) &&
+         heaps_.v40000000.Restore(stream) &&
+         heaps_.v80000000.Restore(stream) &&
+         heaps_.v90000000.Restore(stream) && heaps_.physical.Restore(stream);
 }
 
 xe::memory::PageAccess ToPageAccess(uint32_t protect) {
@@ -666,7 +771,7 @@ void BaseHeap::Dispose() {
 }
 
 void BaseHeap::DumpMap() {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
   XELOGE("------------------------------------------------------------------");
   XELOGE("Heap: {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
   XELOGE("------------------------------------------------------------------");
@@ -719,7 +824,7 @@ void BaseHeap::DumpMap() {
 uint32_t BaseHeap::GetTotalPageCount() { return uint32_t(page_table_.size()); }
 
 uint32_t BaseHeap::GetUnreservedPageCount() {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
   uint32_t count = 0;
   bool is_empty_span = false;
   uint32_t empty_span_start = 0;
@@ -745,29 +850,108 @@ uint32_t BaseHeap::GetUnreservedPageCount() {
   return count;
 }
 
-bool BaseHeap::Save(ByteStream* stream) {
+// How the contents of a committed page are stored in a saved state.
+enum class SavedPageType : uint8_t {
+  kZero,
+  // Same as in the previous state in the incremental chain.
+  kUnchanged,
+  kRaw,
+  // Followed by the uint32_t compressed length.
+  kSnappy,
+};
+
+bool BaseHeap::Save(ByteStream* stream, bool incremental) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
+  saved_page_hashes_.resize(page_table_.size());
+  std::vector<uint8_t> zero_page(page_size_);
+  uint64_t zero_page_hash = XXH3_64bits(zero_page.data(), page_size_);
+  std::vector<char> compressed(snappy::MaxCompressedLength(page_size_));
+
   for (size_t i = 0; i < page_table_.size(); i++) {
     auto& page = page_table_[i];
     stream->Write(page.qword);
-    if (!page.state) {
-      // Unallocated.
+    if (!(page.state & kMemoryAllocationCommit)) {
+      // Unallocated or reserved.
+      saved_page_hashes_[i] = 0;
       continue;
     }
 
-    // TODO(DrChat): write compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
+    void* addr = TranslateRelative(i * page_size_);
+
+    memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
+                    nullptr);
+
+    uint64_t hash = XXH3_64bits(addr, page_size_);
+    if (incremental && hash == saved_page_hashes_[i]) {
+      stream->Write(SavedPageType::kUnchanged);
+    } else if (hash == zero_page_hash &&
+               !std::memcmp(addr, zero_page.data(), page_size_)) {
+      stream->Write(SavedPageType::kZero);
+    } else {
+      size_t compressed_length;
+      snappy::RawCompress(static_cast<const char*>(addr), page_size_,
+                          compressed.data(), &compressed_length);
+      if (compressed_length < page_size_) {
+        stream->Write(SavedPageType::kSnappy);
+        stream->Write(uint32_t(compressed_length));
+        stream->Write(compressed.data(), compressed_length);
+      } else {
+        stream->Write(SavedPageType::kRaw);
+        stream->Write(addr, page_size_);
+      }
+    }
+    saved_page_hashes_[i] = hash;
+
+    memory::Protect(addr, page_size_, ToPageAccess(page.current_protect),
+                    nullptr);
+  }
+
+  return true;
+}
+
+bool BaseHeap::SaveRaw(ByteStream* stream, bool incremental) {
+  if (incremental && saved_page_hashes_.size() != page_table_.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < page_table_.size(); i++) {
+    // Not relying on the assertions in the stream, which would log.
+    if (stream->data_length() - stream->offset() <
+        sizeof(uint64_t) + sizeof(SavedPageType) + page_size_) {
+      return false;
+    }
+    auto& page = page_table_[i];
+    stream->Write(page.qword);
+    if (!(page.state & kMemoryAllocationCommit)) {
+      continue;
+    }
 
-      memory::PageAccess old_access;
-      memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                      &old_access);
+    void* addr = TranslateRelative(i * page_size_);
 
-      stream->Write(addr, page_size_);
+    memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
+                    nullptr);
 
-      memory::Protect(addr, page_size_, old_access, nullptr);
+    if (incremental &&
+        XXH3_64bits(addr, page_size_) == saved_page_hashes_[i]) {
+      stream->Write(SavedPageType::kUnchanged);
+    } else {
+      auto page_qwords = static_cast<const uint64_t*>(addr);
+      size_t page_qword_count = page_size_ / sizeof(uint64_t);
+      size_t j = 0;
+      while (j < page_qword_count && !page_qwords[j]) {
+        ++j;
+      }
+      if (j == page_qword_count) {
+        stream->Write(SavedPageType::kZero);
+      } else {
+        stream->Write(SavedPageType::kRaw);
+        stream->Write(addr, page_size_);
+      }
     }
+
+    memory::Protect(addr, page_size_, ToPageAccess(page.current_protect),
+                    nullptr);
   }
 
   return true;
@@ -776,6 +960,9 @@ bool BaseHeap::Save(ByteStream* stream) {
 bool BaseHeap::Restore(ByteStream* stream) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
+  // The contents will have to be saved fully again.
+  saved_page_hashes_.clear();
+
   for (size_t i = 0; i < page_table_.size(); i++) {
     auto& page = page_table_[i];
     page.qword = stream->Read<uint64_t>();
@@ -792,26 +979,59 @@ bool BaseHeap::Restore(ByteStream* stream) {
       page_access = memory::PageAccess::kReadOnly;
     }
 
+    if (!(page.state & kMemoryAllocationCommit)) {
+      continue;
+    }
+
     // Commit the memory if it isn't already. We do not need to reserve any
     // memory, as the mapping has already taken care of that.
-    if (page.state & kMemoryAllocationCommit) {
-      xe::memory::AllocFixed(TranslateRelative(i * page_size_), page_size_,
-                             memory::AllocationType::kCommit,
-                             memory::PageAccess::kReadWrite);
-    }
+    void* addr = TranslateRelative(i * page_size_);
+    xe::memory::AllocFixed(addr, page_size_, memory::AllocationType::kCommit,
+                           memory::PageAccess::kReadWrite);
 
     // Now read into memory. We'll set R/W protection first, then set the
     // protection back to its previous state.
-    // TODO(DrChat): read compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
-      xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                          nullptr);
-
-      stream->Read(addr, page_size_);
+    xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
+                        nullptr);
 
-      xe::memory::Protect(addr, page_size_, page_access, nullptr);
+    switch (stream->Read<SavedPageType>()) {
+      case SavedPageType::kZero:
+        std::memset(addr, 0, page_size_);
+        break;
+      case SavedPageType::kUnchanged:
+        // Restored from the previous state in the chain.
+        break;
+      case SavedPageType::kRaw:
+        stream->Read(addr, page_size_);
+        break;
+      case SavedPageType::kSnappy: {
+        auto compressed_length = stream->Read<uint32_t>();
+        if (stream->data_length() - stream->offset() < compressed_length) {
+          XELOGE("Saved page {:08X} is truncated",
+                 heap_base_ + uint32_t(i) * page_size_);
+          return false;
+        }
+        auto compressed =
+            reinterpret_cast<const char*>(stream->data() + stream->offset());
+        size_t uncompressed_length;
+        if (!snappy::GetUncompressedLength(compressed, compressed_length,
+                                           &uncompressed_length) ||
+            uncompressed_length != page_size_ ||
+            !snappy::RawUncompress(compressed, compressed_length,
+                                   static_cast<char*>(addr))) {
+          XELOGE("Failed to decompress saved page {:08X}",
+                 heap_base_ + uint32_t(i) * page_size_);
+          return false;
+        }
+        stream->Advance(compressed_length);
+      } break;
+      default:
+        XELOGE("Invalid saved page {:08X} type",
+               heap_base_ + uint32_t(i) * page_size_);
+        return false;
     }
+
+    xe::memory::Protect(addr, page_size_, page_access, nullptr);
   }
 
   return true;
@@ -851,7 +1071,7 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
     return false;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
 
   // - If we are reserving the entire range requested must not be already
   //   reserved.
@@ -936,7 +1156,7 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     return false;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
 
   // Find a free page range.
   // The base page must match the requested alignment, so we first scan for
@@ -1068,7 +1288,7 @@ bool BaseHeap::Decommit(uint32_t address, uint32_t size) {
       std::min(uint32_t(page_table_.size()) - 1, start_page_number);
   end_page_number = std::min(uint32_t(page_table_.size()) - 1, end_page_number);
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
 
   // Release from host.
   // TODO(benvanik): find a way to actually decommit memory;
@@ -1092,7 +1312,7 @@ bool BaseHeap::Decommit(uint32_t address, uint32_t size) {
 }
 
 bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
 
   // Given address must be a region base address.
   uint32_t base_page_number = (base_address - heap_base_) / page_size_;
@@ -1184,7 +1404,7 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
     return false;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
 
   // Ensure all pages are in the same reserved region and all are committed.
   uint32_t first_base_address = UINT_MAX;
@@ -1243,7 +1463,7 @@ bool BaseHeap::QueryRegionInfo(uint32_t base_address,
     return false;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
 
   auto start_page_entry = page_table_[start_page_number];
   out_info->base_address = base_address;
@@ -1297,7 +1517,7 @@ bool BaseHeap::QuerySize(uint32_t address, uint32_t* out_size) {
     *out_size = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
   auto page_entry = page_table_[page_number];
   *out_size = (page_entry.region_page_count * page_size_);
   return true;
@@ -1310,7 +1530,7 @@ bool BaseHeap::QueryBaseAndSize(uint32_t* in_out_address, uint32_t* out_size) {
     *out_size = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
   auto page_entry = page_table_[page_number];
   *in_out_address = (page_entry.base_address * page_size_);
   *out_size = (page_entry.region_page_count * page_size_);
@@ -1324,7 +1544,7 @@ bool BaseHeap::QueryProtect(uint32_t address, uint32_t* out_protect) {
     *out_protect = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
   auto page_entry = page_table_[page_number];
   *out_protect = page_entry.current_protect;
   return true;
@@ -1340,7 +1560,7 @@ xe::memory::PageAccess BaseHeap::QueryRangeAccess(uint32_t low_address,
   uint32_t high_page_number = (high_address - heap_base_) / page_size_;
   uint32_t protect = kMemoryProtectRead | kMemoryProtectWrite;
   {
-    auto global_lock = global_critical_region_.Acquire();
+    std::lock_guard<HeapMutex> heap_lock(heap_mutex_);
     for (uint32_t i = low_page_number; protect && i <= high_page_number; ++i) {
       protect &= page_table_[i].current_protect;
     }
@@ -1384,6 +1604,8 @@ void PhysicalHeap::Initialize(Memory* memory, uint8_t* membase,
       (size_t(heap_size_) + host_address_offset + (system_page_size_ - 1)) /
       system_page_size_;
   system_page_flags_.resize((system_page_count_ + 63) / 64);
+  system_pages_written_ =
+      std::make_unique<std::atomic<uint64_t>[]>(system_page_flags_.size());
 }
 
 bool PhysicalHeap::Alloc(uint32_t size, uint32_t alignment,
@@ -1604,7 +1826,6 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
   xe::memory::PageAccess protect_access =
       enable_data_providers ? xe::memory::PageAccess::kNoAccess
                             : xe::memory::PageAccess::kReadOnly;
-  uint8_t* protect_base = membase_ + heap_base_;
   uint32_t protect_system_page_first = UINT32_MAX;
   auto global_lock = global_critical_region_.Acquire();
   for (uint32_t i = system_page_first; i <= system_page_last; ++i) {
@@ -1659,19 +1880,16 @@ void PhysicalHeap::EnableAccessCallbacks(uint32_t physical_address,
       }
     } else {
       if (protect_system_page_first != UINT32_MAX) {
-        xe::memory::Protect(
-            protect_base + protect_system_page_first * system_page_size_,
-            (i - protect_system_page_first) * system_page_size_,
-            protect_access);
+        ProtectSystemPages(protect_system_page_first,
+                           i - protect_system_page_first, protect_access);
         protect_system_page_first = UINT32_MAX;
       }
     }
   }
   if (protect_system_page_first != UINT32_MAX) {
-    xe::memory::Protect(
-        protect_base + protect_system_page_first * system_page_size_,
-        (system_page_last + 1 - protect_system_page_first) * system_page_size_,
-        protect_access);
+    ProtectSystemPages(protect_system_page_first,
+                       system_page_last + 1 - protect_system_page_first,
+                       protect_access);
   }
 }
 
@@ -1794,7 +2012,6 @@ bool PhysicalHeap::TriggerCallbacks(
 
   // Unprotect ranges that need unprotection.
   if (unprotect) {
-    uint8_t* protect_base = membase_ + heap_base_;
     uint32_t unprotect_system_page_first = UINT32_MAX;
     for (uint32_t i = system_page_first; i <= system_page_last; ++i) {
       // Check if need to allow writing to this page.
@@ -1815,20 +2032,17 @@ bool PhysicalHeap::TriggerCallbacks(
         }
       } else {
         if (unprotect_system_page_first != UINT32_MAX) {
-          xe::memory::Protect(
-              protect_base + unprotect_system_page_first * system_page_size_,
-              (i - unprotect_system_page_first) * system_page_size_,
-              xe::memory::PageAccess::kReadWrite);
+          ProtectSystemPages(unprotect_system_page_first,
+                             i - unprotect_system_page_first,
+                             xe::memory::PageAccess::kReadWrite);
           unprotect_system_page_first = UINT32_MAX;
         }
       }
     }
     if (unprotect_system_page_first != UINT32_MAX) {
-      xe::memory::Protect(
-          protect_base + unprotect_system_page_first * system_page_size_,
-          (system_page_last + 1 - unprotect_system_page_first) *
-              system_page_size_,
-          xe::memory::PageAccess::kReadWrite);
+      ProtectSystemPages(unprotect_system_page_first,
+                         system_page_last + 1 - unprotect_system_page_first,
+                         xe::memory::PageAccess::kReadWrite);
     }
   }
 
@@ -1847,6 +2061,84 @@ bool PhysicalHeap::TriggerCallbacks(
   return true;
 }
 
+void PhysicalHeap::MarkSystemPageWritten(const void* host_address) {
+  size_t offset = static_cast<const uint8_t*>(host_address) -
+                  (membase_ + heap_base_);
+  uint32_t system_page = uint32_t(offset / system_page_size_);
+  if (system_page < system_page_count_) {
+    system_pages_written_[system_page >> 6].fetch_or(
+        uint64_t(1) << (system_page & 63));
+    any_system_page_written_.store(true);
+  }
+}
+
+bool PhysicalHeap::DispatchWrites(bool wait) {
+  // Called for every command processor packet - don't write to the shared
+  // cache line if nothing has been written.
+  if (!any_system_page_written_.load(std::memory_order_relaxed) ||
+      !any_system_page_written_.exchange(false)) {
+    return true;
+  }
+  for (uint32_t i = 0; i < uint32_t(system_page_flags_.size()); ++i) {
+    if (!system_pages_written_[i].load(std::memory_order_relaxed)) {
+      continue;
+    }
+    auto global_lock = wait ? global_critical_region_.Acquire()
+                            : global_critical_region_.TryAcquire();
+    if (!global_lock.owns_lock()) {
+      any_system_page_written_.store(true);
+      return false;
+    }
+    uint64_t written = system_pages_written_[i].exchange(0);
+    uint32_t run_first;
+    while (xe::bit_scan_forward(written, &run_first)) {
+      if (!global_lock.owns_lock()) {
+        if (wait) {
+          global_lock.lock();
+        } else if (!global_lock.try_lock()) {
+          system_pages_written_[i].fetch_or(written);
+          any_system_page_written_.store(true);
+          return false;
+        }
+      }
+      uint32_t run_length;
+      if (!xe::bit_scan_forward(~(written >> run_first), &run_length)) {
+        run_length = 64 - run_first;
+      }
+      written &= ~((UINT64_MAX >> (64 - run_length)) << run_first);
+      uint32_t system_page_first = (i << 6) + run_first;
+      uint32_t virtual_address =
+          heap_base_ + xe::sat_sub(system_page_first * system_page_size_,
+                                   host_address_offset());
+      // Releases the lock.
+      TriggerCallbacks(std::move(global_lock), virtual_address,
+                       run_length * system_page_size_, true, false);
+      global_lock = global_critical_region_.AcquireDeferred();
+    }
+  }
+  return true;
+}
+
+void PhysicalHeap::ProtectSystemPages(uint32_t system_page_first,
+                                      uint32_t system_page_count,
+                                      xe::memory::PageAccess access) {
+  uint8_t* address =
+      membase_ + heap_base_ + size_t(system_page_first) * system_page_size_;
+  size_t length = size_t(system_page_count) * system_page_size_;
+  xe::memory::WriteWatch* write_watch = memory_->write_watch_.get();
+  if (write_watch && access != xe::memory::PageAccess::kNoAccess) {
+    // The write protection is separate from the page protection requested by
+    // the guest.
+    if (access == xe::memory::PageAccess::kReadOnly) {
+      write_watch->Protect(address, length);
+    } else {
+      write_watch->Unprotect(address, length);
+    }
+    return;
+  }
+  xe::memory::Protect(address, length, access);
+}
+
 uint32_t PhysicalHeap::GetPhysicalAddress(uint32_t address) const {
   assert_true(address >= heap_base_);
   address -= heap_base_;
@@ -10,6 +10,7 @@
 #ifndef XENIA_MEMORY_H_
 #define XENIA_MEMORY_H_
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
@@ -19,6 +20,7 @@
 
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/write_watch.h"
 #include "xenia/cpu/mmio_handler.h"
 
 namespace xe {
@@ -101,6 +103,8 @@ union PageEntry {
 // Heap abstraction for page-based allocation.
 class BaseHeap {
  public:
+  typedef xe::profiled_mutex<std::recursive_mutex> HeapMutex;
+
   virtual ~BaseHeap();
 
   // Offset of the heap in relative to membase, without host_address_offset
@@ -120,6 +124,9 @@ class BaseHeap {
   // (not including membase).
   uint32_t host_address_offset() const { return host_address_offset_; }
 
+  // Lock statistics for the profiler.
+  const HeapMutex& heap_mutex() const { return heap_mutex_; }
+
   template <typename T = uint8_t*>
   inline T TranslateRelative(size_t relative_address) const {
     return reinterpret_cast<T>(membase_ + heap_base_ + host_address_offset_ +
@@ -187,7 +194,13 @@ class BaseHeap {
   xe::memory::PageAccess QueryRangeAccess(uint32_t low_address,
                                           uint32_t high_address);
 
-  bool Save(ByteStream* stream);
+  // Writes the page table and the contents of the committed pages, compressed.
+  // If incremental, pages not modified since the previous Save are skipped,
+  // and must be restored from that state first.
+  bool Save(ByteStream* stream, bool incremental);
+  // Same format as Save, but with the pages uncompressed, and without logging,
+  // allocating or updating the hashes, so it can be used in a forked process.
+  bool SaveRaw(ByteStream* stream, bool incremental);
   bool Restore(ByteStream* stream);
 
   void Reset();
@@ -206,8 +219,14 @@ class BaseHeap {
   uint32_t heap_size_;
   uint32_t page_size_;
   uint32_t host_address_offset_;
-  xe::global_critical_region global_critical_region_;
+  // Protects the page table, so allocations in different heaps don't contend.
+  // Physical heaps modify their page tables and the ones of their parent heap
+  // only with the global critical region held too, which is acquired first.
+  HeapMutex heap_mutex_;
   std::vector<PageEntry> page_table_;
+  // Hashes of the page contents as of the last Save for incremental saving, or
+  // 0 if unknown.
+  std::vector<uint64_t> saved_page_hashes_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -263,9 +282,25 @@ class PhysicalHeap : public BaseHeap {
 
   uint32_t GetPhysicalAddress(uint32_t address) const;
 
+  // Records a write caught by the write watch, to be passed to the callbacks
+  // by DispatchWrites. Safe to call without the global critical region.
+  void MarkSystemPageWritten(const void* host_address);
+  // Triggers callbacks for the recorded writes. Returns false if some couldn't
+  // be dispatched because the global critical region is owned by another
+  // thread and wait is false.
+  bool DispatchWrites(bool wait);
+
  protected:
+  // Write-protects the system pages or makes them writable again, with the
+  // write watch if used instead of access violations.
+  void ProtectSystemPages(uint32_t system_page_first,
+                          uint32_t system_page_count,
+                          xe::memory::PageAccess access);
+
   VirtualHeap* parent_heap_;
 
+  xe::global_critical_region global_critical_region_;
+
   uint32_t system_page_size_;
   uint32_t system_page_count_;
 
@@ -277,6 +312,11 @@ class PhysicalHeap : public BaseHeap {
   // Protected by global_critical_region. Flags for each 64 system pages,
   // interleaved as blocks, so bit scan can be used to quickly extract ranges.
   std::vector<SystemPageFlagsBlock> system_page_flags_;
+  // Bits for each 64 system pages written while watched by the write watch,
+  // but not dispatched to the callbacks yet.
+  std::unique_ptr<std::atomic<uint64_t>[]> system_pages_written_;
+  // Whether any bit may be set in system_pages_written_, to skip the scan.
+  std::atomic<bool> any_system_page_written_{false};
 };
 
 // Models the entire guest memory system on the console.
@@ -371,6 +411,8 @@ class Memory {
   // Gets the defined MMIO range for the given virtual address, if any.
   cpu::MMIORange* LookupVirtualMappedRange(uint32_t virtual_address);
 
+  cpu::MMIOHandler* mmio_handler() const { return mmio_handler_.get(); }
+
   // Physical memory access callbacks, two types of them.
   //
   // This is simple per-system-page protection without reference counting or
@@ -448,6 +490,16 @@ class Memory {
       uint32_t virtual_address, uint32_t length, bool is_write,
       bool unwatch_exact_range, bool unprotect = true);
 
+  // With the write watch, callbacks are triggered on the watch thread shortly
+  // after the write. Triggers them for all the writes caught so far, so they
+  // can't be missed by the caller. Must be called without the global critical
+  // region locked.
+  void DispatchPhysicalMemoryWrites();
+
+  // Publishes the heap lock contention and hold time counters and the MMIO
+  // access counters to the profiler.
+  void UpdateProfileCounters();
+
   // Allocates virtual memory from the 'system' heap.
   // System memory is kept separate from game memory but is still accessible
   // using normal guest virtual addresses. Kernel structures and other internal
@@ -475,8 +527,22 @@ class Memory {
   // Dumps a map of all allocated memory to the log.
   void DumpMap();
 
-  bool Save(ByteStream* stream);
+  // With incremental, only the pages modified since the previous Save are
+  // written - the state from it must be restored before this one. Returns
+  // false if incremental saving is not possible because nothing has been saved
+  // since the last restore.
+  bool Save(ByteStream* stream, bool incremental = false);
+  // Save for a forked copy of the emulator process, where only the calling
+  // thread exists, so nothing that may take a lock (logging, allocation) can
+  // be done. The saved state is not tracked - the pages are stored in full
+  // unless unchanged since the last Save in the parent.
+  bool SaveRaw(ByteStream* stream, bool incremental = false);
   bool Restore(ByteStream* stream);
+  // Whether Save can be incremental.
+  bool has_saved_state() const { return has_saved_state_; }
+  // Makes the next Save full, for when the last state has been saved by a
+  // copy of the memory (such as in a forked process).
+  void DiscardSavedState() { has_saved_state_ = false; }
 
  private:
   int MapViews(uint8_t* mapping_base);
@@ -491,6 +557,8 @@ class Memory {
   static bool AccessViolationCallbackThunk(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       void* context, void* host_address, bool is_write);
+  static void WriteWatchCallbackThunk(void* context, void* host_address);
+  static bool WriteWatchFlushCallbackThunk(void* context);
 
   std::filesystem::path file_name_;
   uint32_t system_page_size_ = 0;
@@ -517,6 +585,12 @@ class Memory {
   } views_ = {{0}};
 
   std::unique_ptr<cpu::MMIOHandler> mmio_handler_;
+  // Used instead of access violations for physical memory watches if
+  // available.
+  std::unique_ptr<xe::memory::WriteWatch> write_watch_;
+
+  // Whether the page hashes for incremental saving are up to date.
+  bool has_saved_state_ = false;
 
   struct {
     VirtualHeap v00000000;